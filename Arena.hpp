@@ -0,0 +1,145 @@
+/**
+ * @file arena.hpp
+ * @brief Bump allocator that owns every node of a parsed program.
+ *
+ * The parser allocates all AST nodes, and the child lists of blocks, calls and print statements, out of one
+ * Arena instead of creating each node with its own heap allocation. Nodes that are parsed one after another
+ * end up next to each other in memory, which keeps the tree walk cache friendly, and the whole program is
+ * released at once when the Arena is destroyed instead of node by node through unique_ptr destructors.
+ *
+ * Memory layout:
+ * - Memory is handed out from large blocks (64 KiB by default); an allocation that does not fit in the rest of
+ *   the current block starts a new one. Requests larger than a block get a block of their own.
+ * - The blocks come from malloc rather than operator new, so they report themselves to MemStats.
+ * - Objects with a non-trivial destructor (for example nodes holding a std::string name) are recorded in a
+ *   list and destroyed in reverse order of construction before the blocks are freed. Trivially destructible
+ *   objects such as literals and pointer arrays cost nothing to release.
+ *
+ * Node pointers handed out by the Arena are plain, non-owning pointers: they stay valid exactly as long as
+ * the Arena, so the Arena must outlive the Interpreter or VM that executes the program.
+ *
+ * Usage:
+ *   Arena arena;
+ *   auto* literal = arena.make<LiteralExpr>(42);
+ *   NodeList<Expr*> arguments = arena.copyList(argumentVector);
+ */
+
+#pragma once
+#include "MemStats.hpp"
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * Fixed-size array of node pointers stored in an Arena. Supports range-for loops and indexing like the
+ * std::vector it replaces, but does not own its elements.
+ */
+template<typename T>
+class NodeList {
+    T* items = nullptr;
+    size_t count = 0;
+
+public:
+    NodeList() = default;
+    NodeList(T* items, size_t count) : items(items), count(count) {}
+
+    T* begin() const { return items; }
+    T* end() const { return items + count; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    T& operator[](size_t i) const { return items[i]; }
+};
+
+class Arena {
+public:
+    explicit Arena(size_t blockSize = 64 * 1024) : blockSize(blockSize) {}
+    ~Arena() {
+        // Destroy in reverse order of construction, then free the raw memory.
+        for (size_t i = destructors.size(); i-- > 0;) {
+            destructors[i].destroy(destructors[i].object);
+        }
+        for (char* block : blocks) {
+            std::free(block);
+            MemStats::countBlockRelease();
+        }
+    }
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    /**
+     * Constructs a T in arena memory.
+     * @return A non-owning pointer that stays valid until the Arena is destroyed.
+     */
+    template<typename T, typename... Args>
+    T* make(Args&&... args) {
+        void* memory = allocate(sizeof(T), alignof(T));
+        T* object = new (memory) T(std::forward<Args>(args)...);
+        if (!std::is_trivially_destructible<T>::value) {
+            destructors.push_back(Destructor{object, &destroy<T>});
+        }
+        return object;
+    }
+
+    /**
+     * Copies the elements of a vector (node pointers while parsing) into arena memory.
+     */
+    template<typename T>
+    NodeList<T> copyList(const std::vector<T>& source) {
+        static_assert(std::is_trivially_copyable<T>::value, "NodeList elements are copied bytewise");
+        if (source.empty()) return NodeList<T>();
+        T* items = static_cast<T*>(allocate(sizeof(T) * source.size(), alignof(T)));
+        std::memcpy(items, source.data(), sizeof(T) * source.size());
+        return NodeList<T>(items, source.size());
+    }
+
+    /**
+     * Returns uninitialised, suitably aligned memory.
+     * @throws std::bad_alloc If the system allocator fails.
+     */
+    void* allocate(size_t size, size_t alignment) {
+        size_t offset = (used + alignment - 1) & ~(alignment - 1);
+        if (blocks.empty() || offset + size > capacity) {
+            newBlock(size + alignment);
+            offset = (used + alignment - 1) & ~(alignment - 1);
+        }
+        used = offset + size;
+        return blocks.back() + offset;
+    }
+
+    // Total bytes reserved from the system allocator so far.
+    size_t bytesReserved() const { return reserved; }
+
+private:
+    struct Destructor {
+        void* object;
+        void (*destroy)(void*);
+    };
+
+    size_t blockSize;
+    std::vector<char*> blocks;
+    size_t used = 0;      // Bytes used in the last block
+    size_t capacity = 0;  // Size of the last block
+    size_t reserved = 0;
+    std::vector<Destructor> destructors;
+
+    template<typename T>
+    static void destroy(void* object) {
+        static_cast<T*>(object)->~T();
+    }
+
+    void newBlock(size_t minimum) {
+        size_t size = minimum > blockSize ? minimum : blockSize;
+        char* block = static_cast<char*>(std::malloc(size));
+        if (!block) throw std::bad_alloc();
+        MemStats::countBlock(size);
+        blocks.push_back(block);
+        used = 0;
+        capacity = size;
+        reserved += size;
+    }
+};
@@ -0,0 +1,488 @@
+/**
+ * @file astcache.cpp
+ * @brief Serialization of resolved ASTs for the `--cache` option.
+ *
+ * An Encoder (an ASTVisitor) appends each node to a byte string in pre-order; the Decoder reads the same layout
+ * back and allocates the nodes in an Arena. Integers are stored in native byte order: the build stamp in the
+ * header already ties an entry to the binary that wrote it. Any inconsistency found while decoding throws a
+ * CorruptCache error, which `load` turns into a cache miss.
+ */
+
+#include "AstCache.hpp"
+#include "SourceFile.hpp"
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+// Bump whenever the node layout below changes.
+const uint32_t formatVersion = 5;
+// Changes with every rebuild of the interpreter, so entries written by another build are never used.
+const char* const buildStamp = __DATE__ " " __TIME__;
+
+enum class NodeTag : uint8_t {
+    Null, Binary, Literal, Var, AssignExpr, StringLiteral, Call,
+    Assign, If, Print, Expression, Return, Function, Block, While, ForRange, BigLiteral
+};
+
+uint64_t fnv1a(const char* data, size_t size) {
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+template<typename T>
+void put(std::string& out, T value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+void putString(std::string& out, const std::string& text) {
+    put<uint32_t>(out, static_cast<uint32_t>(text.size()));
+    out.append(text);
+}
+
+class Encoder : public ASTVisitor {
+public:
+    explicit Encoder(std::string& out) : out(out) {}
+
+    void node(ASTNode* node) {
+        if (node) {
+            node->accept(*this);
+        } else {
+            tag(NodeTag::Null);
+        }
+    }
+
+    void visit(BinaryExpr& expr) override {
+        tag(NodeTag::Binary, expr);
+        put<uint8_t>(out, static_cast<uint8_t>(expr.getOp()));
+        node(expr.getLeft());
+        node(expr.getRight());
+    }
+    void visit(LiteralExpr& expr) override {
+        if (expr.isInline()) {
+            tag(NodeTag::Literal, expr);
+            put<int64_t>(out, expr.getValue());
+            return;
+        }
+        // Sign, limb count, then the limbs, least significant first
+        const BigInt& number = expr.getConstant().asBig();
+        tag(NodeTag::BigLiteral, expr);
+        put<uint8_t>(out, number.isNegative() ? 1 : 0);
+        put<uint32_t>(out, static_cast<uint32_t>(number.size()));
+        out.append(reinterpret_cast<const char*>(number.limbs()), number.size() * sizeof(uint32_t));
+    }
+    void visit(VarExpr& expr) override {
+        tag(NodeTag::Var, expr);
+        variable(expr.getName(), expr.getDepth(), expr.getSlot());
+    }
+    void visit(AssignExpr& expr) override {
+        tag(NodeTag::AssignExpr, expr);
+        variable(expr.getName(), expr.getDepth(), expr.getSlot());
+        node(expr.getValue());
+    }
+    void visit(StringLiteralExpr& expr) override {
+        tag(NodeTag::StringLiteral, expr);
+        putString(out, expr.getValue());
+    }
+    void visit(CallExpr& expr) override {
+        tag(NodeTag::Call, expr);
+        putString(out, expr.getFunctionName());
+        list(expr.getArguments());
+    }
+    void visit(AssignStmt& stmt) override {
+        tag(NodeTag::Assign, stmt);
+        variable(stmt.getName(), stmt.getDepth(), stmt.getSlot());
+        node(stmt.getValue());
+    }
+    void visit(IfStmt& stmt) override {
+        tag(NodeTag::If, stmt);
+        node(stmt.condition);
+        node(stmt.ifBranch);
+        node(stmt.elseBranch);
+    }
+    void visit(PrintStmt& stmt) override {
+        tag(NodeTag::Print, stmt);
+        list(stmt.getExpressions());
+    }
+    void visit(ExpressionStmt& stmt) override {
+        tag(NodeTag::Expression, stmt);
+        node(stmt.getExpression());
+    }
+    void visit(ReturnStmt& stmt) override {
+        tag(NodeTag::Return, stmt);
+        node(stmt.getReturnValue());
+    }
+    void visit(FunctionStmt& stmt) override {
+        tag(NodeTag::Function, stmt);
+        putString(out, stmt.getName());
+        symbols(stmt.getParameters());
+        symbols(stmt.getLocals());
+        node(stmt.getBody());
+    }
+    void visit(BlockStmt& stmt) override {
+        tag(NodeTag::Block, stmt);
+        list(stmt.getStatements());
+    }
+    void visit(WhileStmt& stmt) override {
+        tag(NodeTag::While, stmt);
+        node(stmt.condition);
+        node(stmt.body);
+    }
+    void visit(ForRangeStmt& stmt) override {
+        tag(NodeTag::ForRange, stmt);
+        variable(stmt.getName(), stmt.getDepth(), stmt.getSlot());
+        node(stmt.start);
+        node(stmt.stop);
+        node(stmt.step);
+        node(stmt.body);
+    }
+
+    void strings(const std::vector<std::string>& names) {
+        put<uint32_t>(out, static_cast<uint32_t>(names.size()));
+        for (const auto& name : names) putString(out, name);
+    }
+
+    void symbols(const std::vector<Symbol>& names) {
+        put<uint32_t>(out, static_cast<uint32_t>(names.size()));
+        for (Symbol name : names) putString(out, name.name());
+    }
+
+private:
+    std::string& out;
+
+    void tag(NodeTag value) { put<uint8_t>(out, static_cast<uint8_t>(value)); }
+
+    // Every node other than Null is followed by its source line
+    void tag(NodeTag value, const ASTNode& node) {
+        tag(value);
+        put<int32_t>(out, node.getLine());
+    }
+
+    void variable(const std::string& name, size_t depth, size_t slot) {
+        putString(out, name);
+        put<uint32_t>(out, static_cast<uint32_t>(depth));
+        put<uint32_t>(out, static_cast<uint32_t>(slot));
+    }
+
+    template<typename T>
+    void list(const NodeList<T>& items) {
+        put<uint32_t>(out, static_cast<uint32_t>(items.size()));
+        for (T item : items) node(item);
+    }
+};
+
+class CorruptCache : public std::runtime_error {
+public:
+    CorruptCache() : std::runtime_error("Corrupt AST cache entry.") {}
+};
+
+class Decoder {
+public:
+    Decoder(const char* data, size_t size, Arena& arena)
+        : cursor(data), end(data + size), arena(arena), strings(*arena.make<StringTable>()),
+          symbols(*arena.make<SymbolTable>()) {}
+
+    bool atEnd() const { return cursor == end; }
+
+    template<typename T>
+    T get() {
+        if (static_cast<size_t>(end - cursor) < sizeof(T)) throw CorruptCache();
+        T value;
+        std::memcpy(&value, cursor, sizeof(T));
+        cursor += sizeof(T);
+        return value;
+    }
+
+    std::string getString() {
+        uint32_t length = get<uint32_t>();
+        if (static_cast<size_t>(end - cursor) < length) throw CorruptCache();
+        std::string text(cursor, length);
+        cursor += length;
+        return text;
+    }
+
+    // Interns the name in place, so a name seen before costs no allocation
+    Symbol getSymbol() {
+        uint32_t length = get<uint32_t>();
+        if (static_cast<size_t>(end - cursor) < length) throw CorruptCache();
+        Symbol symbol = symbols.intern(cursor, length);
+        cursor += length;
+        return symbol;
+    }
+
+    std::vector<Symbol> getSymbols() {
+        uint32_t count = getCount();
+        std::vector<Symbol> names;
+        names.reserve(count);
+        for (uint32_t i = 0; i < count; i++) names.push_back(getSymbol());
+        return names;
+    }
+
+    std::vector<std::string> getStrings() {
+        uint32_t count = getCount();
+        std::vector<std::string> names;
+        names.reserve(count);
+        for (uint32_t i = 0; i < count; i++) names.push_back(getString());
+        return names;
+    }
+
+    void setGlobalCount(size_t count) { globalCount = count; }
+
+    Expr* expr(bool optional = false) {
+        NodeTag tag = static_cast<NodeTag>(get<uint8_t>());
+        if (tag == NodeTag::Null) {
+            if (!optional) throw CorruptCache();
+            return nullptr;
+        }
+        int32_t line = get<int32_t>();
+        Expr* node = makeExpr(tag);
+        node->setLine(line);
+        return node;
+    }
+
+    Stmt* stmt(bool optional = false) {
+        NodeTag tag = static_cast<NodeTag>(get<uint8_t>());
+        if (tag == NodeTag::Null) {
+            if (!optional) throw CorruptCache();
+            return nullptr;
+        }
+        int32_t line = get<int32_t>();
+        Stmt* node = makeStmt(tag);
+        node->setLine(line);
+        return node;
+    }
+
+private:
+    const char* cursor;
+    const char* end;
+    Arena& arena;
+    StringTable& strings; // String literals are interned as the Parser does
+    SymbolTable& symbols; // And so are names
+    size_t globalCount = 0;
+    // Slot counts of the functions around the node being read, innermost last, and the innermost function
+    std::vector<size_t> frameSizes;
+    FunctionStmt* function = nullptr;
+
+    Expr* makeExpr(NodeTag tag) {
+        switch (tag) {
+            case NodeTag::Binary: {
+                uint8_t op = get<uint8_t>();
+                if (op > static_cast<uint8_t>(TokenType::IN)) throw CorruptCache();
+                Expr* left = expr();
+                Expr* right = expr();
+                return arena.make<BinaryExpr>(left, static_cast<TokenType>(op), right);
+            }
+            case NodeTag::Literal:
+                return arena.make<LiteralExpr>(get<int64_t>());
+            case NodeTag::BigLiteral: {
+                bool negative = get<uint8_t>() != 0;
+                uint32_t length = get<uint32_t>();
+                if (static_cast<size_t>(end - cursor) / sizeof(uint32_t) < length) throw CorruptCache();
+                std::vector<uint32_t> limbs(length);
+                if (length > 0) std::memcpy(limbs.data(), cursor, length * sizeof(uint32_t));
+                cursor += length * sizeof(uint32_t);
+                return arena.make<LiteralExpr>(BigInt::fromLimbs(limbs.data(), length, negative, arena));
+            }
+            case NodeTag::Var: {
+                size_t depth, slot;
+                Symbol name = variable(depth, slot);
+                VarExpr* var = arena.make<VarExpr>(name);
+                var->resolve(depth, slot);
+                return var;
+            }
+            case NodeTag::AssignExpr: {
+                size_t depth, slot;
+                Symbol name = variable(depth, slot);
+                AssignExpr* assign = arena.make<AssignExpr>(name, expr());
+                assign->resolve(depth, slot);
+                return assign;
+            }
+            case NodeTag::StringLiteral:
+                return arena.make<StringLiteralExpr>(strings.intern(getString()));
+            case NodeTag::Call: {
+                Symbol name = getSymbol();
+                return arena.make<CallExpr>(name, exprList());
+            }
+            default:
+                throw CorruptCache();
+        }
+    }
+
+    Stmt* makeStmt(NodeTag tag) {
+        switch (tag) {
+            case NodeTag::Assign: {
+                size_t depth, slot;
+                Symbol name = variable(depth, slot);
+                AssignStmt* assign = arena.make<AssignStmt>(name, expr());
+                assign->resolve(depth, slot);
+                return assign;
+            }
+            case NodeTag::If: {
+                Expr* condition = expr();
+                Stmt* ifBranch = stmt();
+                Stmt* elseBranch = stmt(true);
+                return arena.make<IfStmt>(condition, ifBranch, elseBranch);
+            }
+            case NodeTag::Print:
+                return arena.make<PrintStmt>(exprList());
+            case NodeTag::Expression:
+                return arena.make<ExpressionStmt>(expr());
+            case NodeTag::Return:
+                if (frameSizes.empty()) throw CorruptCache();
+                return arena.make<ReturnStmt>(expr(true));
+            case NodeTag::Function: {
+                Symbol name = getSymbol();
+                std::vector<Symbol> parameters = getSymbols();
+                std::vector<Symbol> locals = getSymbols();
+                if (locals.size() < parameters.size()) throw CorruptCache();
+                // Made before the body, so that the functions defined in it can refer to it
+                FunctionStmt* defined = arena.make<FunctionStmt>(name, std::move(parameters), nullptr);
+                defined->setEnclosing(function);
+                // Resolve the body against this function's frame, then restore the enclosing one
+                FunctionStmt* enclosing = function;
+                function = defined;
+                frameSizes.push_back(locals.size());
+                Stmt* body = stmt();
+                frameSizes.pop_back();
+                function = enclosing;
+                defined->setBody(body);
+                defined->setLocals(std::move(locals));
+                return defined;
+            }
+            case NodeTag::Block: {
+                uint32_t count = getCount();
+                std::vector<Stmt*> statements;
+                statements.reserve(count);
+                for (uint32_t i = 0; i < count; i++) statements.push_back(stmt());
+                return arena.make<BlockStmt>(arena.copyList(statements));
+            }
+            case NodeTag::While: {
+                Expr* condition = expr();
+                Stmt* body = stmt();
+                return arena.make<WhileStmt>(condition, body);
+            }
+            case NodeTag::ForRange: {
+                size_t depth, slot;
+                Symbol name = variable(depth, slot);
+                Expr* start = expr();
+                Expr* stop = expr();
+                Expr* step = expr(true);
+                Stmt* body = stmt();
+                ForRangeStmt* loop = arena.make<ForRangeStmt>(name, start, stop, step, body);
+                loop->resolve(depth, slot);
+                return loop;
+            }
+            default:
+                throw CorruptCache();
+        }
+    }
+
+    // A count of items that each take at least one byte, checked against what is left of the entry.
+    uint32_t getCount() {
+        uint32_t count = get<uint32_t>();
+        if (static_cast<size_t>(end - cursor) < count) throw CorruptCache();
+        return count;
+    }
+
+    // Reads a resolved variable and checks that its slot exists in the frame it refers to.
+    Symbol variable(size_t& depth, size_t& slot) {
+        Symbol name = getSymbol();
+        depth = get<uint32_t>();
+        slot = get<uint32_t>();
+        // Depth 0 is the innermost frame, one more per enclosing function, and one past the outermost the globals
+        size_t nesting = frameSizes.size();
+        bool valid = depth == nesting ? slot < globalCount
+                                      : depth < nesting && slot < frameSizes[nesting - 1 - depth];
+        if (!valid) throw CorruptCache();
+        return name;
+    }
+
+    NodeList<Expr*> exprList() {
+        uint32_t count = getCount();
+        std::vector<Expr*> items;
+        items.reserve(count);
+        for (uint32_t i = 0; i < count; i++) items.push_back(expr());
+        return arena.copyList(items);
+    }
+};
+
+} // namespace
+
+AstCache::AstCache(const std::string& sourcePath, const char* source, size_t sourceSize, int optimizationLevel)
+    : sourceHash(fnv1a(source, sourceSize)), sourceSize(sourceSize), optimizationLevel(optimizationLevel) {
+    size_t separator = sourcePath.find_last_of('/');
+    std::string parent = separator == std::string::npos ? "" : sourcePath.substr(0, separator + 1);
+    std::string base = separator == std::string::npos ? sourcePath : sourcePath.substr(separator + 1);
+    directory = parent + "__pycache__";
+    path = directory + "/" + base + ".mypython-O" + std::to_string(optimizationLevel) + ".ast";
+}
+
+std::string AstCache::header() const {
+    std::string out("MPYC", 4);
+    put<uint32_t>(out, formatVersion);
+    putString(out, buildStamp);
+    put<uint8_t>(out, static_cast<uint8_t>(optimizationLevel));
+    put<uint64_t>(out, sourceSize);
+    put<uint64_t>(out, sourceHash);
+    return out;
+}
+
+Stmt* AstCache::load(Arena& arena, std::vector<std::string>& globals) const {
+    SourceFile file;
+    if (!file.open(path)) return nullptr;
+
+    std::string expected = header();
+    if (file.size() < expected.size() || std::memcmp(file.data(), expected.data(), expected.size()) != 0) {
+        return nullptr; // Stale: written for another source, build or optimization level
+    }
+
+    Decoder decoder(file.data() + expected.size(), file.size() - expected.size(), arena);
+    try {
+        std::vector<std::string> names = decoder.getStrings();
+        decoder.setGlobalCount(names.size());
+        Stmt* root = decoder.stmt();
+        if (!decoder.atEnd()) return nullptr;
+        globals = std::move(names);
+        return root;
+    } catch (const CorruptCache&) {
+        // Nodes decoded so far stay in the arena until it is destroyed; the caller parses instead
+        return nullptr;
+    }
+}
+
+bool AstCache::store(Stmt& root, const std::vector<std::string>& globals) const {
+    std::string out = header();
+    Encoder encoder(out);
+    encoder.strings(globals);
+    encoder.node(&root);
+
+    if (mkdir(directory.c_str(), 0777) != 0 && errno != EEXIST) return false;
+
+    // Write next to the final name and rename, so readers see either the old entry or the complete new one
+    // The name is unique per process and per call, since server workers may store the same entry concurrently
+    static std::atomic<unsigned> sequence(0);
+    std::string temporary = path + ".tmp" + std::to_string(static_cast<long>(getpid())) + "." +
+                            std::to_string(sequence++);
+    std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+    file.write(out.data(), static_cast<std::streamsize>(out.size()));
+    file.close();
+    if (!file) {
+        std::remove(temporary.c_str());
+        return false;
+    }
+    if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+        std::remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
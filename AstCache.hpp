@@ -0,0 +1,68 @@
+/**
+ * @file astcache.hpp
+ * @brief On-disk cache of parsed programs (`mypython --cache`), in the spirit of Python's `__pycache__`.
+ *
+ * Lexing, parsing, resolving and optimizing a script gives the same tree every time the script and the
+ * interpreter are unchanged. With `--cache`, main stores that tree in `__pycache__/<script>.mypython-O<level>.ast`
+ * next to the script after a successful parse, and later runs rebuild the tree from it instead of running the
+ * Lexer and Parser at all.
+ *
+ * Cache entries:
+ * - The header records a format version, the build stamp of the interpreter, the optimization level and the
+ *   size and 64-bit FNV-1a hash of the source. An entry whose header does not match exactly is ignored and
+ *   overwritten, so editing the script or rebuilding mypython invalidates it.
+ * - The body is the resolved (and at -O1, optimized) tree in pre-order, one tag byte per node followed by its
+ *   source line and its fields, plus the global slot names from the Resolver. Function frames keep the slot
+ *   layout they had.
+ * - The file is memory-mapped with a SourceFile and decoded in one pass into the caller's Arena. Every slot,
+ *   operator and length is bounds checked, so a truncated or corrupted file is treated as a miss, never trusted.
+ * - Entries are written to a temporary file and renamed into place, so a concurrent reader never sees half an
+ *   entry. Failing to write the cache (read-only directory, full disk) is not an error.
+ *
+ * Programs whose parse reported errors are not cached, since a cached run would skip those messages.
+ *
+ * Usage:
+ *   AstCache cache(filename, source.data(), source.size(), optimizationLevel);
+ *   Stmt* ast = cache.load(arena, globals);
+ *   if (!ast) { ...parse, resolve, optimize...; cache.store(*ast, resolver.getGlobals()); }
+ */
+
+#pragma once
+#include "Parser.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class AstCache {
+public:
+    /**
+     * @param sourcePath Path of the script; the cache file goes into a `__pycache__` directory beside it.
+     * @param source The script's text, hashed once to key the entry.
+     */
+    AstCache(const std::string& sourcePath, const char* source, size_t sourceSize, int optimizationLevel);
+
+    const std::string& getPath() const { return path; }
+
+    /**
+     * Rebuilds the cached program in `arena`.
+     * @param globals Receives the global slot names the program was resolved with.
+     * @return The root BlockStmt, or null if there is no valid entry for this source and interpreter.
+     */
+    Stmt* load(Arena& arena, std::vector<std::string>& globals) const;
+
+    /**
+     * Writes the entry for a resolved (and optimized, if enabled) program.
+     * @return false if the entry could not be written.
+     */
+    bool store(Stmt& root, const std::vector<std::string>& globals) const;
+
+private:
+    std::string path;
+    std::string directory;
+    uint64_t sourceHash;
+    uint64_t sourceSize;
+    int optimizationLevel;
+
+    // The header every valid entry starts with.
+    std::string header() const;
+};
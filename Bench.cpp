@@ -0,0 +1,203 @@
+/**
+ * @file bench.cpp
+ * @brief Implementation of the benchmark mode.
+ *
+ * Phases are timed with std::chrono::steady_clock. While the program executes, std::cout is pointed at a
+ * streambuf that drops everything, so the cost of the console (and of the trace file) is not part of the
+ * exec numbers; the original buffer is restored before the report is written, even if the program throws.
+ */
+
+#include "Bench.hpp"
+#include "Lexer.hpp"
+#include "Parser.hpp"
+#include "Interpreter.hpp"
+#include "Resolver.hpp"
+#include "Optimizer.hpp"
+#include "Purity.hpp"
+#include "Compiler.hpp"
+#include "VM.hpp"
+#include "Closure.hpp"
+#include "Lazy.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+
+namespace {
+
+// Streambuf that accepts and discards all output
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override { return c == EOF ? !EOF : c; }
+    std::streamsize xsputn(const char*, std::streamsize n) override { return n; }
+};
+
+// Points std::cout at a NullBuffer for as long as it is alive
+class DiscardOutput {
+public:
+    DiscardOutput() { std::cout.flush(); original = std::cout.rdbuf(&sink); }
+    ~DiscardOutput() { std::cout.rdbuf(original); }
+private:
+    NullBuffer sink;
+    std::streambuf* original;
+};
+
+typedef std::chrono::steady_clock Clock;
+
+double millisecondsSince(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// Escapes a string for use inside a JSON string literal
+std::string jsonEscape(const std::string& text) {
+    std::string escaped;
+    for (char c : text) {
+        if (c == '"' || c == '\\') escaped += '\\';
+        escaped += c;
+    }
+    return escaped;
+}
+
+} // namespace
+
+PhaseStats summarize(const std::string& name, std::vector<double>& samples) {
+    PhaseStats stats;
+    stats.name = name;
+    if (samples.empty()) return stats;
+    std::sort(samples.begin(), samples.end());
+    size_t n = samples.size();
+    stats.min = samples.front();
+    stats.median = n % 2 ? samples[n / 2] : (samples[n / 2 - 1] + samples[n / 2]) / 2;
+    size_t rank = static_cast<size_t>(std::ceil(0.99 * n)); // Nearest-rank percentile
+    stats.p99 = samples[rank - 1];
+    return stats;
+}
+
+int runBenchmark(const SourceFile& source, const std::string& filename, const BenchOptions& options, std::ostream& out) {
+    std::vector<double> lexSamples, parseSamples, compileSamples, execSamples;
+    bool lazy = options.lazyFunctions && !options.useVM && !options.useClosures && !options.memoize;
+
+    try {
+        for (int run = 0; run < options.runs; run++) {
+            Clock::time_point start = Clock::now();
+            {
+                Lexer lexer(source.data(), source.size());
+                lexer.setVectorScan(!options.scalarLex);
+                while (lexer.nextToken().type != TokenType::END_OF_FILE) {}
+            }
+            lexSamples.push_back(millisecondsSince(start));
+            if (options.lexOnly) continue;
+            if (options.parseOnly) {
+                Arena arena;
+                start = Clock::now();
+                Lexer lexer(source.data(), source.size());
+                Parser parser(lexer, arena);
+                parser.parse();
+                parseSamples.push_back(millisecondsSince(start));
+                continue;
+            }
+
+            Arena arena;
+            Interpreter interpreter;
+            interpreter.setRecursionLimit(options.recursionLimit);
+            start = Clock::now();
+            Lexer lexer(source.data(), source.size());
+            Parser parser(lexer, arena);
+            parser.setLazyFunctions(lazy);
+            Stmt* ast = parser.parse();
+            Resolver resolver;
+            resolver.resolve(*ast);
+            BodyLoader loader(source.data(), arena, parser.getStrings(), parser.getSymbols(), resolver,
+                              options.optimizationLevel);
+            if (lazy) interpreter.setBodyLoader(&loader);
+            if (options.optimizationLevel >= 1) {
+                Optimizer optimizer(arena);
+                optimizer.optimize(*ast);
+            }
+            if (options.memoize && !options.useVM && !options.useClosures) {
+                PurityAnalysis purity;
+                purity.analyze(*ast);
+                interpreter.enableMemoization();
+            }
+            parseSamples.push_back(millisecondsSince(start));
+
+            if (options.useVM) {
+                start = Clock::now();
+                Compiler compiler;
+                compiler.setSuperinstructions(options.optimizationLevel >= 1);
+                Chunk chunk = compiler.compile(*ast, resolver.getGlobals());
+                compileSamples.push_back(millisecondsSince(start));
+
+                VM vm;
+                vm.setRecursionLimit(options.recursionLimit);
+                vm.setDispatch(options.switchDispatch ? VM::Dispatch::Switch : VM::Dispatch::Threaded);
+                DiscardOutput discard;
+                start = Clock::now();
+                vm.run(chunk);
+                execSamples.push_back(millisecondsSince(start));
+            } else if (options.useClosures) {
+                start = Clock::now();
+                ClosureProgram program(*ast, resolver.getGlobals(), arena);
+                program.setRecursionLimit(options.recursionLimit);
+                compileSamples.push_back(millisecondsSince(start));
+
+                DiscardOutput discard;
+                start = Clock::now();
+                program.run();
+                execSamples.push_back(millisecondsSince(start));
+            } else {
+                DiscardOutput discard;
+                start = Clock::now();
+                interpreter.interpret(ast, resolver.getGlobals().size());
+                execSamples.push_back(millisecondsSince(start));
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+
+    std::vector<PhaseStats> phases;
+    phases.push_back(summarize("lex", lexSamples));
+    if (!options.lexOnly) {
+        phases.push_back(summarize("parse", parseSamples));
+    }
+    if (!options.lexOnly && !options.parseOnly) {
+        if (options.useVM || options.useClosures) phases.push_back(summarize("compile", compileSamples));
+        phases.push_back(summarize("exec", execSamples));
+    }
+    // Bytes per microsecond of the fastest run are MB/s
+    double lexThroughput = phases[0].min > 0 ? source.size() / (phases[0].min * 1000) : 0;
+    double parseThroughput = options.parseOnly && phases[1].min > 0 ? source.size() / (phases[1].min * 1000) : 0;
+    const char* scan = options.scalarLex || !Lexer::hasVectorScan() ? "scalar" : "sse2";
+
+    const char* mode = options.lexOnly ? "lex" : options.parseOnly ? "parse"
+                     : options.useVM ? (options.switchDispatch || !VM::hasThreadedDispatch() ? "vm-switch" : "vm")
+                     : options.useClosures ? "closures" : lazy ? "tree-lazy" : "tree";
+    if (options.json) {
+        out << std::setprecision(6) << "{\"file\": \"" << jsonEscape(filename) << "\", \"mode\": \"" << mode
+            << "\", \"opt\": " << options.optimizationLevel << ", \"runs\": " << options.runs
+            << ", \"bytes\": " << source.size() << ", \"lex_scan\": \"" << scan << "\", \"lex_mb_per_s\": "
+            << lexThroughput;
+        if (options.parseOnly) out << ", \"parse_mb_per_s\": " << parseThroughput;
+        out << ", \"phases\": {";
+        for (size_t i = 0; i < phases.size(); i++) {
+            out << (i ? ", " : "") << "\"" << phases[i].name << "\": {\"min_ms\": " << phases[i].min
+                << ", \"median_ms\": " << phases[i].median << ", \"p99_ms\": " << phases[i].p99 << "}";
+        }
+        out << "}}\n";
+    } else {
+        out << filename << " (" << mode << ", -O" << options.optimizationLevel << ", " << options.runs << " runs)\n";
+        out << std::left << std::setw(10) << "phase" << std::right << std::setw(12) << "min ms"
+            << std::setw(12) << "median ms" << std::setw(12) << "p99 ms" << '\n';
+        out << std::fixed << std::setprecision(3);
+        for (const PhaseStats& phase : phases) {
+            out << std::left << std::setw(10) << phase.name << std::right << std::setw(12) << phase.min
+                << std::setw(12) << phase.median << std::setw(12) << phase.p99 << '\n';
+        }
+        out << "lex throughput " << std::setprecision(1) << lexThroughput << " MB/s (" << scan << ")\n";
+        if (options.parseOnly) out << "parse throughput " << parseThroughput << " MB/s\n";
+        out << std::defaultfloat;
+    }
+    return 0;
+}
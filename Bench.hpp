@@ -0,0 +1,71 @@
+/**
+ * @file bench.hpp
+ * @brief Built-in benchmark mode (`mypython --bench N file.py`).
+ *
+ * The benchmark runs the pipeline N times on an already loaded SourceFile and times each phase separately:
+ * - lex: pulling every token from a Lexer with `nextToken()`, as the parser does, without keeping them (collecting
+ *   them with `tokenize()` would mostly time the growth of the vector).
+ * - parse: `Parser::parse()` followed by the Resolver and (at -O1) the Optimizer. The parser pulls its tokens
+ *   from the lexer, so this phase includes lexing as it happens in a normal run.
+ * - compile: lowering to bytecode (only with --vm).
+ * - exec: running the program, on the tree-walker or the VM. Program output is discarded while timing.
+ *   With lazyFunctions (tree-walker only, mode "tree-lazy") the parse phase skips function bodies and exec
+ *   includes parsing the bodies that are called.
+ *
+ * With lexOnly (`--bench-lex`) only the lex phase is run, for inputs too large to parse and run repeatedly. The
+ * report always includes the lexer's throughput in MB/s (10^6 bytes per second, from the fastest lex run), and
+ * `scalarLex` (`--scalar-lex`) measures it with the Lexer's scalar loops instead of the SSE2 ones. With parseOnly
+ * (`--bench-parse`) the parse phase is `Parser::parse()` alone, without the Resolver and Optimizer or any later
+ * phase, and the report adds the parser's throughput (lexing included) from the fastest parse run.
+ *
+ * Every run uses a fresh Arena and Interpreter, so no state leaks from one run into the next. The report gives
+ * the min, median and 99th percentile (nearest rank) of each phase in milliseconds, either as a table or as a
+ * single JSON object that `bench/run.sh` collects into a report.
+ *
+ * Usage:
+ *   BenchOptions options;
+ *   options.runs = 20;
+ *   return runBenchmark(source, filename, options, std::cout);
+ */
+
+#pragma once
+#include "SourceFile.hpp"
+#include <iostream>
+#include <string>
+#include <vector>
+
+struct BenchOptions {
+    int runs = 10;
+    bool useVM = false;
+    bool useClosures = false;    // Like --closures; --vm takes precedence
+    bool switchDispatch = false; // VM only, like --vm-dispatch switch
+    int optimizationLevel = 1;
+    size_t recursionLimit = 10000;
+    bool memoize = false; // Tree-walker only, like --memo
+    bool lazyFunctions = false; // Tree-walker without --memo only, like --lazy
+    bool lexOnly = false;       // Time the lex phase only
+    bool parseOnly = false;     // Time the lex phase and Parser::parse() only
+    bool scalarLex = false;     // Lex with Lexer::setVectorScan(false)
+    bool json = false;
+};
+
+/**
+ * Summary statistics of one phase, in milliseconds.
+ */
+struct PhaseStats {
+    std::string name;
+    double min = 0;
+    double median = 0;
+    double p99 = 0;
+};
+
+/**
+ * Computes min, median and p99 of a set of samples (the vector is sorted in place).
+ */
+PhaseStats summarize(const std::string& name, std::vector<double>& samples);
+
+/**
+ * Runs the benchmark and writes the report to `out`.
+ * @return The process exit code: 0, or 1 if the program failed (the error is printed to std::cerr).
+ */
+int runBenchmark(const SourceFile& source, const std::string& filename, const BenchOptions& options, std::ostream& out);
@@ -0,0 +1,470 @@
+/**
+ * @file bigint.cpp
+ * @brief Implementation of the BigInt arithmetic and of its heap.
+ *
+ * Operands are read through a Digits view, which for an inline integer keeps its (at most two) limbs in the
+ * view itself, so mixing inline and big operands costs no allocation. Magnitude arithmetic works on limb
+ * pointers and lengths and leaves its result in a Magnitude vector passed in, the heap's scratch buffer for the
+ * result of an operation, which `pack` trims and turns back into a Value: inline if it fits, otherwise a copy
+ * in the heap. Only the partial products of Karatsuba have vectors of their own.
+ *
+ * The heap hands out cells of 2^k limbs, k being the cell's size class, so the cell of a dead number fits any
+ * later number of the same class. Every cell is listed in `cells`; a sweep moves the unmarked ones to the free
+ * list of their class.
+ */
+
+#include "BigInt.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+typedef std::vector<uint32_t> Magnitude;
+
+const uint64_t limbBase = static_cast<uint64_t>(1) << 32;
+
+// Sign and magnitude of an integer Value
+class Digits {
+public:
+    explicit Digits(Value value) {
+        if (value.isBig()) {
+            const BigInt& number = value.asBig();
+            negative = number.isNegative();
+            limbs = number.limbs();
+            length = number.size();
+            return;
+        }
+        int64_t integer = value.asInt();
+        negative = integer < 0;
+        uint64_t magnitude = negative ? 0 - static_cast<uint64_t>(integer) : static_cast<uint64_t>(integer);
+        storage[0] = static_cast<uint32_t>(magnitude);
+        storage[1] = static_cast<uint32_t>(magnitude >> 32);
+        limbs = storage;
+        length = storage[1] ? 2 : storage[0] ? 1 : 0;
+    }
+    Digits(const Digits&) = delete; // `limbs` may point into the object itself
+
+    bool negative;
+    const uint32_t* limbs;
+    size_t length; // 0 for zero
+
+private:
+    uint32_t storage[2];
+};
+
+size_t trimmedLength(const uint32_t* limbs, size_t length) {
+    while (length > 0 && limbs[length - 1] == 0) length--;
+    return length;
+}
+
+int compareMagnitudes(const uint32_t* a, size_t aLength, const uint32_t* b, size_t bLength) {
+    if (aLength != bLength) return aLength < bLength ? -1 : 1;
+    for (size_t i = aLength; i-- > 0;) {
+        if (a[i] != b[i]) return a[i] < b[i] ? -1 : 1;
+    }
+    return 0;
+}
+
+void addMagnitudes(const uint32_t* a, size_t aLength, const uint32_t* b, size_t bLength, Magnitude& sum) {
+    if (aLength < bLength) {
+        std::swap(a, b);
+        std::swap(aLength, bLength);
+    }
+    sum.resize(aLength + 1);
+    uint64_t carry = 0;
+    for (size_t i = 0; i < aLength; i++) {
+        carry += static_cast<uint64_t>(a[i]) + (i < bLength ? b[i] : 0);
+        sum[i] = static_cast<uint32_t>(carry);
+        carry >>= 32;
+    }
+    sum[aLength] = static_cast<uint32_t>(carry);
+}
+
+// a - b, where a >= b
+void subtractMagnitudes(const uint32_t* a, size_t aLength, const uint32_t* b, size_t bLength,
+                        Magnitude& difference) {
+    difference.resize(aLength);
+    int64_t borrow = 0;
+    for (size_t i = 0; i < aLength; i++) {
+        int64_t limb = static_cast<int64_t>(a[i]) - (i < bLength ? b[i] : 0) - borrow;
+        borrow = limb < 0;
+        difference[i] = static_cast<uint32_t>(limb + (borrow ? static_cast<int64_t>(limbBase) : 0));
+    }
+}
+
+// target[offset...] += addend; target is long enough to absorb the carry
+void addAt(Magnitude& target, const Magnitude& addend, size_t offset) {
+    uint64_t carry = 0;
+    size_t i = 0;
+    for (; i < addend.size(); i++) {
+        carry += static_cast<uint64_t>(target[offset + i]) + addend[i];
+        target[offset + i] = static_cast<uint32_t>(carry);
+        carry >>= 32;
+    }
+    for (size_t j = offset + i; carry && j < target.size(); j++) {
+        carry += target[j];
+        target[j] = static_cast<uint32_t>(carry);
+        carry >>= 32;
+    }
+}
+
+// target -= subtrahend; target >= subtrahend
+void subtractFrom(Magnitude& target, const Magnitude& subtrahend) {
+    int64_t borrow = 0;
+    for (size_t i = 0; i < target.size() && (i < subtrahend.size() || borrow); i++) {
+        int64_t limb = static_cast<int64_t>(target[i]) - (i < subtrahend.size() ? subtrahend[i] : 0) - borrow;
+        borrow = limb < 0;
+        target[i] = static_cast<uint32_t>(limb + (borrow ? static_cast<int64_t>(limbBase) : 0));
+    }
+}
+
+void multiplySchoolbook(const uint32_t* a, size_t aLength, const uint32_t* b, size_t bLength, Magnitude& product) {
+    product.assign(aLength + bLength, 0);
+    for (size_t i = 0; i < aLength; i++) {
+        uint64_t carry = 0;
+        uint64_t digit = a[i];
+        if (digit == 0) continue;
+        for (size_t j = 0; j < bLength; j++) {
+            carry += digit * b[j] + product[i + j];
+            product[i + j] = static_cast<uint32_t>(carry);
+            carry >>= 32;
+        }
+        product[i + bLength] = static_cast<uint32_t>(carry);
+    }
+}
+
+// `product` must not overlap the operands
+void multiplyMagnitudes(const uint32_t* a, size_t aLength, const uint32_t* b, size_t bLength, Magnitude& product) {
+    aLength = trimmedLength(a, aLength);
+    bLength = trimmedLength(b, bLength);
+    if (aLength < bLength) {
+        std::swap(a, b);
+        std::swap(aLength, bLength);
+    }
+    if (bLength < BigInt::karatsubaThreshold) {
+        multiplySchoolbook(a, aLength, b, bLength, product);
+        return;
+    }
+
+    product.assign(aLength + bLength, 0);
+    if (bLength * 2 <= aLength) {
+        // Unbalanced: multiply b by slices of a as long as b, so every product is balanced
+        Magnitude partial;
+        for (size_t offset = 0; offset < aLength; offset += bLength) {
+            size_t slice = std::min(bLength, aLength - offset);
+            multiplyMagnitudes(a + offset, slice, b, bLength, partial);
+            addAt(product, partial, offset);
+        }
+        return;
+    }
+
+    // Karatsuba: with a = a1*B^h + a0 and b = b1*B^h + b0,
+    // a*b = z2*B^2h + (z1 - z2 - z0)*B^h + z0, where z2 = a1*b1, z0 = a0*b0 and z1 = (a1 + a0)*(b1 + b0)
+    size_t half = aLength / 2; // < bLength, so both high halves are non-empty
+    Magnitude low, high, aSum, bSum, middle;
+    multiplyMagnitudes(a, half, b, half, low);
+    multiplyMagnitudes(a + half, aLength - half, b + half, bLength - half, high);
+    addMagnitudes(a, half, a + half, aLength - half, aSum);
+    addMagnitudes(b, half, b + half, bLength - half, bSum);
+    multiplyMagnitudes(aSum.data(), aSum.size(), bSum.data(), bSum.size(), middle);
+    subtractFrom(middle, low);
+    subtractFrom(middle, high);
+
+    addAt(product, low, 0);
+    middle.resize(trimmedLength(middle.data(), middle.size()));
+    addAt(product, middle, half);
+    addAt(product, high, 2 * half);
+}
+
+int leadingZeros(uint32_t limb) {
+    int count = 0;
+    for (uint32_t bit = 0x80000000u; !(limb & bit); bit >>= 1) count++;
+    return count;
+}
+
+/**
+ * quotient = u / v and remainder = u % v, truncated, for u >= v > 0 (both trimmed). Knuth's algorithm D as
+ * given in Hacker's Delight (divmnu): the divisor is shifted so its top limb has its high bit set, then each
+ * quotient limb is estimated from the top two limbs of the running remainder and corrected at most twice.
+ * `vn` and `un` receive the shifted divisor and dividend.
+ */
+void divideMagnitudes(const uint32_t* u, size_t uLength, const uint32_t* v, size_t vLength, Magnitude& quotient,
+                      Magnitude& remainder, Magnitude& vn, Magnitude& un) {
+    quotient.assign(uLength - vLength + 1, 0);
+    if (vLength == 1) {
+        uint64_t divisor = v[0];
+        uint64_t rest = 0;
+        for (size_t i = uLength; i-- > 0;) {
+            uint64_t current = rest << 32 | u[i];
+            quotient[i] = static_cast<uint32_t>(current / divisor);
+            rest = current % divisor;
+        }
+        remainder.assign(1, static_cast<uint32_t>(rest));
+        return;
+    }
+
+    int shift = leadingZeros(v[vLength - 1]);
+    vn.resize(vLength);
+    un.resize(uLength + 1);
+    for (size_t i = vLength; i-- > 0;) {
+        vn[i] = v[i] << shift | (shift && i > 0 ? v[i - 1] >> (32 - shift) : 0);
+    }
+    un[uLength] = shift ? u[uLength - 1] >> (32 - shift) : 0;
+    for (size_t i = uLength; i-- > 0;) {
+        un[i] = u[i] << shift | (shift && i > 0 ? u[i - 1] >> (32 - shift) : 0);
+    }
+
+    for (size_t j = uLength - vLength + 1; j-- > 0;) {
+        uint64_t top = static_cast<uint64_t>(un[j + vLength]) << 32 | un[j + vLength - 1];
+        uint64_t estimate = top / vn[vLength - 1];
+        uint64_t rest = top % vn[vLength - 1];
+        while (estimate >= limbBase || estimate * vn[vLength - 2] > (rest << 32 | un[j + vLength - 2])) {
+            estimate--;
+            rest += vn[vLength - 1];
+            if (rest >= limbBase) break;
+        }
+
+        // un[j..j+vLength] -= estimate * vn
+        int64_t borrow = 0;
+        int64_t difference;
+        for (size_t i = 0; i < vLength; i++) {
+            uint64_t product = estimate * vn[i];
+            difference = static_cast<int64_t>(un[i + j]) - borrow - static_cast<int64_t>(product & 0xFFFFFFFFu);
+            un[i + j] = static_cast<uint32_t>(difference);
+            borrow = static_cast<int64_t>(product >> 32) - (difference >> 32);
+        }
+        difference = static_cast<int64_t>(un[j + vLength]) - borrow;
+        un[j + vLength] = static_cast<uint32_t>(difference);
+
+        quotient[j] = static_cast<uint32_t>(estimate);
+        if (difference < 0) {
+            // The estimate was one too large: add the divisor back
+            quotient[j]--;
+            uint64_t carry = 0;
+            for (size_t i = 0; i < vLength; i++) {
+                carry += static_cast<uint64_t>(un[i + j]) + vn[i];
+                un[i + j] = static_cast<uint32_t>(carry);
+                carry >>= 32;
+            }
+            un[j + vLength] += static_cast<uint32_t>(carry);
+        }
+    }
+
+    remainder.resize(vLength);
+    for (size_t i = 0; i < vLength; i++) {
+        remainder[i] = un[i] >> shift | (shift ? un[i + 1] << (32 - shift) : 0);
+    }
+}
+
+// Sets `result` to the integer with this sign and trimmed magnitude if it fits inline
+bool packInline(bool negative, const uint32_t* limbs, size_t length, Value& result) {
+    if (length > 2) return false;
+    uint64_t value = length == 0 ? 0 : limbs[0] | (length == 2 ? static_cast<uint64_t>(limbs[1]) << 32 : 0);
+    if (value <= static_cast<uint64_t>(Value::inlineMax)) {
+        int64_t integer = static_cast<int64_t>(value);
+        result = Value::small(negative ? -integer : integer);
+        return true;
+    }
+    if (negative && value == static_cast<uint64_t>(Value::inlineMax) + 1) {
+        result = Value::small(Value::inlineMin);
+        return true;
+    }
+    return false;
+}
+
+// The integer with this sign and magnitude: inline if it fits, otherwise a new BigInt
+Value pack(bool negative, const Magnitude& magnitude, BigIntHeap& heap) {
+    size_t length = trimmedLength(magnitude.data(), magnitude.size());
+    Value result;
+    if (packInline(negative, magnitude.data(), length, result)) return result;
+    return Value::big(heap.make(magnitude.data(), length, negative));
+}
+
+// left + right, with the sign of right given separately so subtraction is addition of the negation
+Value addSigned(const Digits& left, const Digits& right, bool rightNegative, Magnitude& result, BigIntHeap& heap) {
+    if (left.negative == rightNegative) {
+        addMagnitudes(left.limbs, left.length, right.limbs, right.length, result);
+        return pack(left.negative, result, heap);
+    }
+    // Opposite signs: the larger magnitude minus the smaller, with the sign of the larger
+    if (compareMagnitudes(left.limbs, left.length, right.limbs, right.length) >= 0) {
+        subtractMagnitudes(left.limbs, left.length, right.limbs, right.length, result);
+        return pack(left.negative, result, heap);
+    }
+    subtractMagnitudes(right.limbs, right.length, left.limbs, left.length, result);
+    return pack(rightNegative, result, heap);
+}
+
+size_t cellBytes(size_t sizeClass) {
+    return sizeof(BigInt) + (static_cast<size_t>(1) << sizeClass) * sizeof(uint32_t);
+}
+
+} // namespace
+
+Value BigInt::add(Value left, Value right, BigIntHeap& heap) {
+    Digits a(left), b(right);
+    return addSigned(a, b, b.negative, heap.scratch.result, heap);
+}
+
+Value BigInt::subtract(Value left, Value right, BigIntHeap& heap) {
+    Digits a(left), b(right);
+    return addSigned(a, b, !b.negative, heap.scratch.result, heap);
+}
+
+Value BigInt::multiply(Value left, Value right, BigIntHeap& heap) {
+    Digits a(left), b(right);
+    Magnitude& product = heap.scratch.result;
+    multiplyMagnitudes(a.limbs, a.length, b.limbs, b.length, product);
+    return pack(a.negative != b.negative, product, heap);
+}
+
+Value BigInt::floorDivide(Value left, Value right, BigIntHeap& heap) {
+    Digits a(left), b(right);
+    if (b.length == 0) {
+        throw std::runtime_error("Division by zero.");
+    }
+    if (compareMagnitudes(a.limbs, a.length, b.limbs, b.length) < 0) {
+        // |a| < |b|: 0, or -1 when the signs differ and a is not 0
+        return a.length && a.negative != b.negative ? Value(-1) : Value(0);
+    }
+    Magnitude& quotient = heap.scratch.result;
+    Magnitude& remainder = heap.scratch.remainder;
+    divideMagnitudes(a.limbs, a.length, b.limbs, b.length, quotient, remainder, heap.scratch.divisor,
+                     heap.scratch.dividend);
+    bool negative = a.negative != b.negative;
+    if (negative && trimmedLength(remainder.data(), remainder.size())) {
+        // Truncation rounded towards zero; floor rounds away from it
+        quotient.push_back(0);
+        for (size_t i = 0; ++quotient[i] == 0; i++) {}
+    }
+    return pack(negative, quotient, heap);
+}
+
+int BigInt::compare(Value left, Value right) {
+    if (Value::bothInts(left, right)) {
+        return left.asInt() < right.asInt() ? -1 : left.asInt() > right.asInt();
+    }
+    Digits a(left), b(right);
+    if (a.negative != b.negative) return a.negative ? -1 : 1;
+    int magnitude = compareMagnitudes(a.limbs, a.length, b.limbs, b.length);
+    return a.negative ? -magnitude : magnitude;
+}
+
+std::string BigInt::toString() const {
+    // Peel off nine decimal digits at a time, least significant first
+    Magnitude rest(limbs(), limbs() + length);
+    std::vector<uint32_t> groups;
+    size_t restLength = length;
+    while (restLength > 0) {
+        uint64_t remainder = 0;
+        for (size_t i = restLength; i-- > 0;) {
+            uint64_t current = remainder << 32 | rest[i];
+            rest[i] = static_cast<uint32_t>(current / 1000000000u);
+            remainder = current % 1000000000u;
+        }
+        groups.push_back(static_cast<uint32_t>(remainder));
+        restLength = trimmedLength(rest.data(), restLength);
+    }
+
+    std::string text = negative ? "-" : "";
+    text += std::to_string(groups.back());
+    for (size_t i = groups.size() - 1; i-- > 0;) {
+        std::string group = std::to_string(groups[i]);
+        text.append(9 - group.size(), '0');
+        text += group;
+    }
+    return text;
+}
+
+Value BigInt::parse(const char* digits, size_t length, bool negative, Arena& arena) {
+    // Nine decimal digits at a time: magnitude = magnitude * 10^n + the next n digits
+    Magnitude magnitude;
+    for (size_t i = 0; i < length;) {
+        size_t count = std::min<size_t>(9, length - i);
+        uint64_t carry = 0;
+        uint64_t scale = 1;
+        for (size_t j = 0; j < count; j++) {
+            carry = carry * 10 + static_cast<uint64_t>(digits[i + j] - '0');
+            scale *= 10;
+        }
+        i += count;
+        for (uint32_t& limb : magnitude) {
+            carry += limb * scale;
+            limb = static_cast<uint32_t>(carry);
+            carry >>= 32;
+        }
+        if (carry) magnitude.push_back(static_cast<uint32_t>(carry));
+    }
+    return fromLimbs(magnitude.data(), magnitude.size(), negative, arena);
+}
+
+Value BigInt::fromLimbs(const uint32_t* limbs, size_t length, bool negative, Arena& arena) {
+    length = trimmedLength(limbs, length);
+    Value result;
+    if (packInline(negative, limbs, length, result)) return result;
+    return Value::big(create(limbs, length, negative, arena));
+}
+
+const BigInt& BigInt::create(const uint32_t* limbs, size_t length, bool negative, Arena& arena) {
+    void* memory = arena.allocate(sizeof(BigInt) + length * sizeof(uint32_t), alignof(BigInt));
+    BigInt* number = new (memory) BigInt(static_cast<uint32_t>(length), negative);
+    std::copy(limbs, limbs + length, number->storage());
+    return *number;
+}
+
+const BigInt& BigIntHeap::make(const uint32_t* limbs, size_t length, bool negative) {
+    count++;
+    size_t sizeClass = 1; // A BigInt has at least 2 limbs
+    while ((static_cast<size_t>(1) << sizeClass) < length) sizeClass++;
+    if (sizeClass >= freeCells.size()) freeCells.resize(sizeClass + 1);
+    size_t bytes = cellBytes(sizeClass);
+    if (roots && allocatedBytes >= nextCollection) collect();
+    allocatedBytes += bytes;
+
+    void* memory;
+    std::vector<BigInt*>& reusable = freeCells[sizeClass];
+    if (reusable.empty()) {
+        memory = arena.allocate(bytes, alignof(BigInt));
+    } else {
+        memory = reusable.back();
+        reusable.pop_back();
+    }
+    BigInt* number = new (memory) BigInt(static_cast<uint32_t>(length), negative);
+    number->sizeClass = static_cast<uint8_t>(sizeClass);
+    number->state = BigInt::State::Unmarked;
+    std::copy(limbs, limbs + length, number->storage());
+    cells.push_back(number);
+    return *number;
+}
+
+void BigIntHeap::collect() {
+    roots->markRoots(*this);
+    for (Value value : pinned) mark(value);
+    size_t live = 0;
+    size_t liveBytes = 0;
+    for (BigInt* number : cells) {
+        if (number->state == BigInt::State::Marked) {
+            number->state = BigInt::State::Unmarked;
+            cells[live++] = number;
+            liveBytes += cellBytes(number->sizeClass);
+        } else {
+            freeCells[number->sizeClass].push_back(number);
+        }
+    }
+    cells.resize(live);
+    // Collect again once as much has been allocated as survived, so the heap stays within twice the live size
+    allocatedBytes = 0;
+    nextCollection = liveBytes > collectionBytes ? liveBytes : collectionBytes;
+}
+
+bool Value::equalBigs(Value left, Value right) {
+    const BigInt& a = left.asBig();
+    const BigInt& b = right.asBig();
+    return a.isNegative() == b.isNegative() &&
+           compareMagnitudes(a.limbs(), a.size(), b.limbs(), b.size()) == 0;
+}
+
+std::ostream& printBig(std::ostream& out, const BigInt& number) {
+    return out << number.toString();
+}
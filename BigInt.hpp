@@ -0,0 +1,168 @@
+/**
+ * @file bigint.hpp
+ * @brief Arbitrary-precision integers, for the results that do not fit in a Value's inline integer.
+ *
+ * Integers are Python's: they never overflow. A Value holds any integer of 63 bits inline and does its
+ * arithmetic with overflow-checked machine instructions (see Value::add); only a result that overflows, or an
+ * operation on an operand that already did, comes here and is computed on sign-magnitude numbers of 32-bit
+ * limbs. A result that fits inline again is returned inline, so every integer has exactly one representation
+ * and a BigInt is never equal to an inline integer.
+ *
+ * Algorithms:
+ * - Addition, subtraction and comparison limb by limb.
+ * - Multiplication by the schoolbook method below `karatsubaThreshold` limbs and by Karatsuba above it, which
+ *   splits each operand in halves and needs three half-size products instead of four (O(n^1.585)). Operands
+ *   of very different sizes are multiplied slice by slice.
+ * - Floor division by Knuth's algorithm D (a one-limb divisor takes a single pass).
+ * - Decimal conversion nine digits at a time.
+ *
+ * Memory: a BigInt is immutable, its limbs follow it in the same allocation, and it is allocated from the
+ * BigIntHeap of the run that computed it (the Interpreter's, the VM's or the closure runtime's); the big
+ * integer literals of a program are allocated once, with its tree, in the parser's Arena. Values are copied
+ * as plain words, so the heap finds the dead numbers by tracing rather than counting references: once the
+ * numbers allocated since the last collection reach the size of those that survived it (and at least
+ * `collectionBytes`), the next allocation first has the back end mark every Value it holds (see
+ * BigIntHeap::Roots), then sweeps the rest onto free lists of cells of the same size class. By then the
+ * operands of the operation are no longer needed, and every other live number is in a frame, an argument
+ * stack or the VM's value stack, except the left operand of a binary expression whose right operand is still
+ * being evaluated, which the tree-walker and the closures pin while it is. The arithmetic computes in scratch
+ * buffers the heap keeps from one operation to the next, so an operation allocates nothing but its result.
+ * Scripts whose values stay within 63 bits never touch the heap.
+ *
+ * Usage:
+ *   BigIntHeap heap;
+ *   Value product = BigInt::multiply(left, right, heap); // left, right: inline or big integers
+ *   std::cout << product;
+ */
+
+#pragma once
+#include "Arena.hpp"
+#include "Value.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class BigIntHeap;
+
+class BigInt {
+public:
+    // Operands below this many limbs (in the shorter one) are multiplied by the schoolbook method
+    static const size_t karatsubaThreshold = 64;
+
+    bool isNegative() const { return negative; }
+    // Number of limbs, at least 2 since smaller numbers are inline
+    size_t size() const { return length; }
+    // Magnitude, least significant limb first; the most significant limb is never 0
+    const uint32_t* limbs() const { return reinterpret_cast<const uint32_t*>(this + 1); }
+
+    // Decimal representation, with a leading '-' when negative
+    std::string toString() const;
+
+    /**
+     * The integer operators, on any two integer Values (inline or big). The result is inline whenever it fits.
+     * @throws std::runtime_error floorDivide on division by zero.
+     */
+    static Value add(Value left, Value right, BigIntHeap& heap);
+    static Value subtract(Value left, Value right, BigIntHeap& heap);
+    static Value multiply(Value left, Value right, BigIntHeap& heap);
+    static Value floorDivide(Value left, Value right, BigIntHeap& heap);
+
+    // Negative, zero or positive as `left` is less than, equal to or greater than `right` (integer Values)
+    static int compare(Value left, Value right);
+
+    /**
+     * The integer written in decimal by `digits`, negated when `negative`, for an integer literal. Constants
+     * are allocated in the program's Arena rather than a run's heap, so they live as long as the tree.
+     * @return An inline integer if the number fits, otherwise a BigInt in `arena`.
+     */
+    static Value parse(const char* digits, size_t length, bool negative, Arena& arena);
+    // The same for a sign and magnitude (least significant limb first), as stored by the AstCache
+    static Value fromLimbs(const uint32_t* limbs, size_t length, bool negative, Arena& arena);
+
+private:
+    friend class BigIntHeap;
+
+    // Never collected: a constant in an Arena; otherwise a cell of a heap, marked or not by the collection
+    enum class State : uint8_t { Constant, Unmarked, Marked };
+
+    uint32_t length;
+    bool negative;
+    uint8_t sizeClass = 0; // A heap cell has room for 2^sizeClass limbs
+    State state = State::Constant;
+
+    BigInt(uint32_t length, bool negative) : length(length), negative(negative) {}
+    uint32_t* storage() { return reinterpret_cast<uint32_t*>(this + 1); }
+
+    // A copy of `limbs` (whose most significant limb is not 0) in `arena`
+    static const BigInt& create(const uint32_t* limbs, size_t length, bool negative, Arena& arena);
+};
+
+/**
+ * Owns the BigInts of one run. Blocks are only reserved once the first number is allocated; the cells of dead
+ * numbers are reused by later ones of the same size class, but never returned before the heap is destroyed.
+ */
+class BigIntHeap {
+public:
+    // Fewest bytes of numbers allocated between two collections
+    static const size_t collectionBytes = 1 << 20;
+
+    // The back end whose numbers the heap holds, which knows where its Values are
+    class Roots {
+    public:
+        // Calls heap.mark with every Value the back end holds in its frames and stacks
+        virtual void markRoots(BigIntHeap& heap) = 0;
+    protected:
+        ~Roots() = default;
+    };
+
+    // @param roots Marks the live numbers for a collection; without it, the heap keeps every number it made.
+    explicit BigIntHeap(Roots* roots = nullptr) : roots(roots) {}
+    BigIntHeap(const BigIntHeap&) = delete;
+    BigIntHeap& operator=(const BigIntHeap&) = delete;
+
+    /**
+     * A BigInt of `length` limbs, copied from `limbs` (whose most significant limb is not 0). May collect
+     * first, so `limbs` must not point into a number nothing else keeps alive.
+     */
+    const BigInt& make(const uint32_t* limbs, size_t length, bool negative);
+
+    // Keeps a number held only in a native variable alive while other numbers are made; unpin in reverse order
+    void pin(Value value) { pinned.push_back(value); }
+    void unpin() { pinned.pop_back(); }
+
+    // For Roots::markRoots
+    void mark(Value value) {
+        if (value.isBig() && value.asBig().state == BigInt::State::Unmarked) {
+            const_cast<BigInt&>(value.asBig()).state = BigInt::State::Marked;
+        }
+    }
+
+    // Numbers allocated so far
+    size_t size() const { return count; }
+    size_t bytesReserved() const { return arena.bytesReserved(); }
+
+private:
+    friend class BigInt;
+
+    // Limb buffers the arithmetic computes in, grown to the largest operation so far (see BigInt.cpp)
+    struct Scratch {
+        std::vector<uint32_t> result;
+        std::vector<uint32_t> remainder;
+        std::vector<uint32_t> dividend;
+        std::vector<uint32_t> divisor;
+    };
+
+    Roots* roots;
+    Arena arena;
+    std::vector<BigInt*> cells;                   // Every cell holding a number, dead or alive
+    std::vector<std::vector<BigInt*>> freeCells;  // Cells of dead numbers, by size class
+    std::vector<Value> pinned;
+    Scratch scratch;
+    size_t count = 0;
+    size_t allocatedBytes = 0; // Since the last collection
+    size_t nextCollection = collectionBytes;
+
+    // Marks the roots and the pinned numbers, moves every other number to the free lists and clears the marks
+    void collect();
+};
@@ -0,0 +1,130 @@
+/**
+ * @file bytecode.cpp
+ * @brief Bytecode listing used by `mypython --dump-bytecode`.
+ */
+
+#include "Bytecode.hpp"
+
+static const char* opcodeName(OpCode op) {
+    switch (op) {
+        case OpCode::CONSTANT: return "CONSTANT";
+        case OpCode::CONSTANT_WIDE: return "CONSTANT_WIDE";
+        case OpCode::CONSTANT_STRING: return "CONSTANT_STRING";
+        case OpCode::LOAD_LOCAL: return "LOAD_LOCAL";
+        case OpCode::STORE_LOCAL: return "STORE_LOCAL";
+        case OpCode::LOAD_GLOBAL: return "LOAD_GLOBAL";
+        case OpCode::STORE_GLOBAL: return "STORE_GLOBAL";
+        case OpCode::LOAD_ENCLOSING: return "LOAD_ENCLOSING";
+        case OpCode::POP: return "POP";
+        case OpCode::ADD: return "ADD";
+        case OpCode::SUBTRACT: return "SUBTRACT";
+        case OpCode::MULTIPLY: return "MULTIPLY";
+        case OpCode::FLOOR_DIVIDE: return "FLOOR_DIVIDE";
+        case OpCode::EQUAL: return "EQUAL";
+        case OpCode::LESS: return "LESS";
+        case OpCode::LESS_EQUAL: return "LESS_EQUAL";
+        case OpCode::GREATER: return "GREATER";
+        case OpCode::GREATER_EQUAL: return "GREATER_EQUAL";
+        case OpCode::BINARY_OP: return "BINARY_OP";
+        case OpCode::JUMP: return "JUMP";
+        case OpCode::JUMP_IF_FALSE: return "JUMP_IF_FALSE";
+        case OpCode::FOR_RANGE_START: return "FOR_RANGE_START";
+        case OpCode::FOR_RANGE: return "FOR_RANGE";
+        case OpCode::PRINT_STRING: return "PRINT_STRING";
+        case OpCode::PRINT_VALUE: return "PRINT_VALUE";
+        case OpCode::PRINT_END: return "PRINT_END";
+        case OpCode::DEFINE_FUNCTION: return "DEFINE_FUNCTION";
+        case OpCode::CALL: return "CALL";
+        case OpCode::TAIL_CALL: return "TAIL_CALL";
+        case OpCode::RETURN: return "RETURN";
+        case OpCode::ADD_LOCAL_CONST: return "ADD_LOCAL_CONST";
+        case OpCode::ADD_GLOBAL_CONST: return "ADD_GLOBAL_CONST";
+        case OpCode::JUMP_UNLESS_EQUAL: return "JUMP_UNLESS_EQUAL";
+        case OpCode::JUMP_UNLESS_LESS: return "JUMP_UNLESS_LESS";
+        case OpCode::JUMP_UNLESS_LESS_EQUAL: return "JUMP_UNLESS_LESS_EQUAL";
+        case OpCode::JUMP_UNLESS_GREATER: return "JUMP_UNLESS_GREATER";
+        case OpCode::JUMP_UNLESS_GREATER_EQUAL: return "JUMP_UNLESS_GREATER_EQUAL";
+        case OpCode::CALL_1: return "CALL_1";
+        case OpCode::CALL_2: return "CALL_2";
+        case OpCode::CALL_3: return "CALL_3";
+        case OpCode::HALT: return "HALT";
+    }
+    return "UNKNOWN";
+}
+
+void disassemble(const Chunk& chunk, std::ostream& out) {
+    const FunctionProto* current = nullptr;
+    for (size_t pc = 0; pc < chunk.code.size(); pc++) {
+        for (const auto& function : chunk.functions) {
+            if (function.entry == pc && pc != 0) {
+                out << function.name << ":" << '\n';
+                current = &function;
+            }
+        }
+        const Instruction& instruction = chunk.code[pc];
+        out << "  " << pc << '\t' << opcodeName(instruction.op);
+        switch (instruction.op) {
+            case OpCode::CONSTANT:
+            case OpCode::JUMP:
+            case OpCode::JUMP_IF_FALSE:
+            case OpCode::FOR_RANGE:
+            case OpCode::JUMP_UNLESS_EQUAL:
+            case OpCode::JUMP_UNLESS_LESS:
+            case OpCode::JUMP_UNLESS_LESS_EQUAL:
+            case OpCode::JUMP_UNLESS_GREATER:
+            case OpCode::JUMP_UNLESS_GREATER_EQUAL:
+                out << ' ' << instruction.a;
+                break;
+            case OpCode::ADD_LOCAL_CONST:
+                out << ' ' << instruction.b;
+                if (current) out << " (" << current->locals[instruction.b] << ")";
+                out << ' ' << instruction.a;
+                break;
+            case OpCode::ADD_GLOBAL_CONST:
+                out << ' ' << instruction.b << " (" << chunk.globals[instruction.b] << ") " << instruction.a;
+                break;
+            case OpCode::LOAD_LOCAL:
+            case OpCode::STORE_LOCAL:
+                out << ' ' << instruction.a;
+                if (current) out << " (" << current->locals[instruction.a] << ")";
+                break;
+            case OpCode::LOAD_GLOBAL:
+            case OpCode::STORE_GLOBAL:
+                out << ' ' << instruction.a << " (" << chunk.globals[instruction.a] << ")";
+                break;
+            case OpCode::LOAD_ENCLOSING: {
+                const FunctionProto* scope = current;
+                for (uint16_t level = 0; scope && level < instruction.b; level++) {
+                    scope = scope->enclosing >= 0 ? &chunk.functions[scope->enclosing] : nullptr;
+                }
+                out << ' ' << instruction.a;
+                if (scope) out << " (" << scope->locals[instruction.a] << ")";
+                out << " levels=" << instruction.b;
+                break;
+            }
+            case OpCode::CONSTANT_WIDE:
+                out << ' ' << instruction.a << " (" << chunk.integers[instruction.a] << ")";
+                break;
+            case OpCode::CONSTANT_STRING:
+            case OpCode::PRINT_STRING:
+                out << " \"" << chunk.strings[instruction.a] << '"';
+                break;
+            case OpCode::BINARY_OP:
+                out << " op=" << instruction.b;
+                break;
+            case OpCode::DEFINE_FUNCTION:
+                out << ' ' << chunk.functions[instruction.a].name;
+                break;
+            case OpCode::CALL:
+            case OpCode::CALL_1:
+            case OpCode::CALL_2:
+            case OpCode::CALL_3:
+            case OpCode::TAIL_CALL:
+                out << ' ' << chunk.names[instruction.a] << " argc=" << instruction.b;
+                break;
+            default:
+                break;
+        }
+        out << '\n';
+    }
+}
@@ -0,0 +1,90 @@
+/**
+ * @file bytecode.hpp
+ * @brief Instruction set and program container for the bytecode VM.
+ *
+ * The Compiler lowers the AST produced by the Parser into a Chunk: a flat array of fixed-size instructions
+ * plus the tables those instructions refer to. The VM then executes the Chunk in a single dispatch loop
+ * instead of making a virtual call per AST node.
+ *
+ * Data Structures:
+ * - OpCode: The operations understood by the VM. Operands live in the instruction itself.
+ * - Instruction: An opcode with two immediate operands, 8 bytes in total so the code array stays compact.
+ * - FunctionProto: Compile-time description of a `def` (name, parameter names and entry point in the code array).
+ * - Chunk: The whole compiled program. Top-level code starts at index 0 and ends with HALT; function bodies
+ *   follow it and always end with RETURN.
+ *
+ * Operand conventions (a = 32-bit operand, b = 16-bit operand):
+ * - CONSTANT a            push the integer a
+ * - CONSTANT_WIDE a       push the integer Chunk::integers[a], for literals beyond 32 bits (big ones included)
+ * - CONSTANT_STRING a     push the string Chunk::strings[a]
+ * - LOAD_LOCAL/STORE_LOCAL    a is a slot of the current function frame (see FunctionProto::locals)
+ * - LOAD_GLOBAL/STORE_GLOBAL  a is a slot of the global frame (see Chunk::globals)
+ * - LOAD_ENCLOSING a b    a is a slot of the frame of the function b levels out from the current one (b >= 1),
+ *                         for a name a nested function reads from the function that defines it
+ * - JUMP/JUMP_IF_FALSE    a is the absolute target instruction index
+ * - PRINT_STRING a        print Chunk::strings[a]; a string literal printed directly skips the stack
+ * - BINARY_OP b           generic binary operator, b holds the TokenType (used for operators without a dedicated opcode)
+ * - DEFINE_FUNCTION a     a indexes Chunk::functions
+ * - CALL a b              a indexes Chunk::names (the function name), b is the argument count
+ * - TAIL_CALL a b         like CALL, but replaces the current frame; emitted for `return f(...)` in a function,
+ *                         followed by a RETURN for the callee nested in the current function, which needs the
+ *                         frame and is called like CALL instead
+ * - FOR_RANGE_START       checks the [counter, stop, step] triple a `for` loop keeps on the stack (step != 0)
+ * - FOR_RANGE a           pushes the counter and advances it while it is short of stop, otherwise pops the triple
+ *                         and jumps to a; the loop body stores the pushed value into the loop variable
+ *
+ * Superinstructions replace the most frequent sequences with one dispatch (emitted at -O1, see Compiler.hpp):
+ * - ADD_LOCAL_CONST b a   push local slot b + a (`n + 1`, `n - 2`); ADD_GLOBAL_CONST reads global slot b
+ * - JUMP_UNLESS_<cmp> a   pop right and left, jump to a unless `left <cmp> right` (an if or while condition)
+ * - CALL_1..CALL_3 a b    CALL with 1 to 3 arguments, so the arguments are copied without a loop
+ */
+
+#pragma once
+#include "Value.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <iostream>
+
+enum class OpCode : uint8_t {
+    CONSTANT, CONSTANT_WIDE, CONSTANT_STRING, LOAD_LOCAL, STORE_LOCAL, LOAD_GLOBAL, STORE_GLOBAL, LOAD_ENCLOSING,
+    POP,
+    ADD, SUBTRACT, MULTIPLY, FLOOR_DIVIDE,
+    EQUAL, LESS, LESS_EQUAL, GREATER, GREATER_EQUAL, BINARY_OP,
+    JUMP, JUMP_IF_FALSE, FOR_RANGE_START, FOR_RANGE,
+    PRINT_STRING, PRINT_VALUE, PRINT_END,
+    DEFINE_FUNCTION, CALL, TAIL_CALL, RETURN,
+    ADD_LOCAL_CONST, ADD_GLOBAL_CONST,
+    JUMP_UNLESS_EQUAL, JUMP_UNLESS_LESS, JUMP_UNLESS_LESS_EQUAL, JUMP_UNLESS_GREATER, JUMP_UNLESS_GREATER_EQUAL,
+    CALL_1, CALL_2, CALL_3,
+    HALT // Last, the VM sizes its dispatch table by it
+};
+
+struct Instruction {
+    OpCode op;
+    uint16_t b;
+    int32_t a;
+    Instruction(OpCode op, int32_t a = 0, uint16_t b = 0) : op(op), b(b), a(a) {}
+};
+
+struct FunctionProto {
+    std::string name;
+    int nameIndex;                 // Index of the name in Chunk::names, used to bind the function at runtime
+    size_t arity = 0;              // Parameters occupy the first `arity` local slots
+    std::vector<std::string> locals; // Slot names of the frame, as assigned by the Resolver
+    size_t entry = 0;              // Index of the first instruction of the body
+    int enclosing = -1;            // Index in Chunk::functions of the function the def is in, -1 at top level
+};
+
+struct Chunk {
+    std::vector<Instruction> code;
+    std::vector<std::string> names;     // Function names referred to by CALL and DEFINE_FUNCTION
+    std::vector<std::string> globals;   // Slot names of the global frame
+    std::vector<std::string> strings;   // String literals, each text once so string values compare by address
+    // Integer literals too wide for an instruction operand; big ones point into the Arena of the compiled tree
+    std::vector<Value> integers;
+    std::vector<FunctionProto> functions;
+};
+
+// Writes a human readable listing of the chunk, one instruction per line.
+void disassemble(const Chunk& chunk, std::ostream& out);
@@ -0,0 +1,747 @@
+/**
+ * @file closure.cpp
+ * @brief Closure types, the compiler that picks them and the runtime state of `--closures`.
+ *
+ * Every closure is a small arena-allocated object with one virtual `run`. The specializations are templates:
+ * operators are policy structs (Add, Less, ...) and the place a variable lives in is Local or Global, so each
+ * combination is its own class and the compiler's choice costs nothing at runtime. The compiler is an
+ * ASTVisitor that leaves the closure for the visited node in `compiledExpr`/`compiledStmt`, like the Optimizer.
+ */
+
+#include "Closure.hpp"
+#include "Interpreter.hpp"
+#include "Utilities.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <unordered_map>
+
+struct FunctionCode {
+    const StmtClosure* body;
+    size_t arity;
+    size_t slotCount;
+    const FunctionCode* enclosing; // The function the def is in, null at top level
+};
+
+// The function currently bound to a name; a `def` updates it when it runs.
+struct ClosureBinding {
+    const std::string* name;
+    const FunctionCode* function = nullptr;
+    explicit ClosureBinding(const std::string& name) : name(&name) {}
+};
+
+namespace {
+
+// State of one run: the frames, the pending tail call and the output.
+class Runtime : private BigIntHeap::Roots {
+public:
+    std::vector<Value> globals;
+    OutputWriter& output;
+    Value returnValue;                    // Value of the last executed return statement
+    std::vector<Value> arguments;         // Arguments of generic and tail calls while they are evaluated
+    const ClosureBinding* tailCallee = nullptr;
+    size_t tailCallBase = 0;              // Where the pending tail call's arguments start in `arguments`
+    BigIntHeap bigInts;                   // Integers computed beyond 63 bits
+
+    Runtime(size_t globalCount, size_t recursionLimit, OutputWriter& output)
+        : globals(globalCount, Value::unbound()), output(output), bigInts(this), recursionLimit(recursionLimit),
+          stackFloor(nativeStackFloor(nativeStackReserve)) {}
+
+    /**
+     * Calls `callee` with `count` arguments starting at `args`, then drops `arguments` back to `argumentBase`.
+     * Same checks, in the same order, as Interpreter::callFunction.
+     */
+    Value call(const ClosureBinding* callee, const Value* args, size_t count, size_t argumentBase);
+
+    // Frame of the call `levels` parents up from the running one (see Activation::parent)
+    Value* enclosingFrame(size_t levels) const {
+        size_t call = depth - 1;
+        for (; levels > 0; --levels) call = frames[call]->parent;
+        return frames[call]->slots.data();
+    }
+
+private:
+    static const size_t topLevel = SIZE_MAX; // Parent of a top-level function's call
+
+    // One active call: its frame, its function and its parent, the call of the function its `def` is in
+    struct Activation {
+        std::vector<Value> slots;
+        const FunctionCode* function = nullptr;
+        size_t parent = topLevel;
+    };
+
+    std::vector<std::unique_ptr<Activation>> frames; // Function frames by call depth, reused across calls
+    size_t depth = 0;
+    size_t recursionLimit;
+    const char* stackFloor; // Calls that start below it raise RecursionError (see nativeStackFloor)
+
+    // Parent of a call of `function` made from the call at depth index `caller` (topLevel outside any call)
+    size_t enclosingCall(const ClosureBinding* callee, const FunctionCode* function, size_t caller) const;
+    // The numbers of the globals, the active frames and the arguments, for a collection of `bigInts`
+    void markRoots(BigIntHeap& heap) override;
+};
+
+class ExprClosure {
+public:
+    virtual Value run(Runtime& runtime, Value* frame) const = 0;
+    // Truth value, for conditions
+    virtual bool test(Runtime& runtime, Value* frame) const { return run(runtime, frame).isTruthy(); }
+protected:
+    ~ExprClosure() = default; // Arena-allocated and trivially destructible, like the AST nodes
+};
+
+} // namespace
+
+class StmtClosure {
+public:
+    virtual ExecStatus run(Runtime& runtime, Value* frame) const = 0;
+protected:
+    ~StmtClosure() = default;
+};
+
+namespace {
+
+// Tracks the call depth for the duration of one call, including when the body throws
+class DepthGuard {
+public:
+    explicit DepthGuard(size_t& depth) : depth(depth) { ++depth; }
+    ~DepthGuard() { --depth; }
+private:
+    size_t& depth;
+};
+
+size_t Runtime::enclosingCall(const ClosureBinding* callee, const FunctionCode* function, size_t caller) const {
+    if (!function->enclosing) return topLevel;
+    for (size_t call = caller; call != topLevel; call = frames[call]->parent) {
+        if (frames[call]->function == function->enclosing) return call;
+    }
+    throw std::runtime_error("Function '" + *callee->name + "' is called outside the function that defines it.");
+}
+
+void Runtime::markRoots(BigIntHeap& heap) {
+    for (Value value : globals) heap.mark(value);
+    for (size_t i = 0; i < depth; i++) {
+        for (Value value : frames[i]->slots) heap.mark(value);
+    }
+    for (Value value : arguments) heap.mark(value);
+    heap.mark(returnValue);
+}
+
+Value Runtime::call(const ClosureBinding* callee, const Value* args, size_t count, size_t argumentBase) {
+    if (depth >= recursionLimit || nativeStackLow(stackFloor)) {
+        throw RecursionError();
+    }
+    if (depth == frames.size()) {
+        frames.push_back(std::make_unique<Activation>());
+    }
+    size_t index = depth;
+    Activation& activation = *frames[index];
+    std::vector<Value>& frame = activation.slots;
+    size_t caller = index == 0 ? topLevel : index - 1;
+    DepthGuard guard(depth);
+    for (;;) {
+        const FunctionCode* function = callee->function;
+        if (!function) {
+            throw std::runtime_error("Function '" + *callee->name + "' is not defined.");
+        }
+        if (count != function->arity) {
+            throw std::runtime_error("Incorrect number of arguments provided to function '" + *callee->name + "'.");
+        }
+        size_t parent = enclosingCall(callee, function, caller);
+        if (parent == index) {
+            // A tail call of a function nested in the returning one reads its frame, which must stay as it is
+            return call(callee, args, count, argumentBase);
+        }
+        activation.function = function;
+        activation.parent = parent;
+        // Parameters take the first slots; the arguments are copied out before the stack is popped
+        frame.assign(function->slotCount, Value::unbound());
+        std::copy(args, args + count, frame.begin());
+        arguments.resize(argumentBase);
+
+        ExecStatus status = function->body->run(*this, frame.data());
+        if (status == ExecStatus::TailCall) {
+            // Run the callee in this frame, like the tree-walker
+            callee = tailCallee;
+            argumentBase = tailCallBase;
+            args = arguments.data() + tailCallBase;
+            count = arguments.size() - tailCallBase;
+            caller = index;
+            continue;
+        }
+        // A body that runs to completion without a return statement returns 0
+        return status == ExecStatus::Return ? returnValue : Value();
+    }
+}
+
+[[noreturn]] void undefinedVariable(const std::string& name) {
+    throw std::runtime_error("Variable '" + name + "' is not defined.");
+}
+
+// Where a variable lives: the frame of the running function, or the global frame (variables of enclosing
+// functions are only read, by LoadEnclosing).
+struct Local {
+    static Value& at(Runtime&, Value* frame, size_t slot) { return frame[slot]; }
+};
+struct Global {
+    static Value& at(Runtime& runtime, Value*, size_t slot) { return runtime.globals[slot]; }
+};
+
+// Binary operators on two inline integers, false when the result needs a BigInt; everything else goes to
+// BinaryExpr::applyToObjects, as in the VM.
+struct Add {
+    static const TokenType token = TokenType::PLUS;
+    static bool apply(Value left, Value right, Value& result) { return Value::add(left, right, result); }
+};
+struct Subtract {
+    static const TokenType token = TokenType::MINUS;
+    static bool apply(Value left, Value right, Value& result) { return Value::subtract(left, right, result); }
+};
+struct Multiply {
+    static const TokenType token = TokenType::MUL;
+    static bool apply(Value left, Value right, Value& result) { return Value::multiply(left, right, result); }
+};
+struct FloorDivide {
+    static const TokenType token = TokenType::DIV;
+    static bool apply(Value left, Value right, Value& result) {
+        return BinaryExpr::floorDivide(left, right, result);
+    }
+};
+struct Equal {
+    static const TokenType token = TokenType::EQUAL;
+    static bool apply(Value left, Value right, Value& result) { result = left.asInt() == right.asInt(); return true; }
+};
+struct Less {
+    static const TokenType token = TokenType::LESS;
+    static bool apply(Value left, Value right, Value& result) { result = left.asInt() < right.asInt(); return true; }
+};
+struct LessEqual {
+    static const TokenType token = TokenType::LESS_EQUAL;
+    static bool apply(Value left, Value right, Value& result) { result = left.asInt() <= right.asInt(); return true; }
+};
+struct Greater {
+    static const TokenType token = TokenType::GREATER;
+    static bool apply(Value left, Value right, Value& result) { result = left.asInt() > right.asInt(); return true; }
+};
+struct GreaterEqual {
+    static const TokenType token = TokenType::GREATER_EQUAL;
+    static bool apply(Value left, Value right, Value& result) { result = left.asInt() >= right.asInt(); return true; }
+};
+
+template<typename Op>
+Value combine(Runtime& runtime, Value left, Value right) {
+    Value result;
+    if (Value::bothInts(left, right) && Op::apply(left, right, result)) return result;
+    return BinaryExpr::applyToObjects(Op::token, left, right, runtime.bigInts);
+}
+
+// The right operand of a binary closure with a big `left` already evaluated, which a collection while the
+// operand allocates has to see
+Value pinnedOperand(Runtime& runtime, Value* frame, Value left, const ExprClosure* right) {
+    runtime.bigInts.pin(left);
+    Value value = right->run(runtime, frame);
+    runtime.bigInts.unpin();
+    return value;
+}
+
+inline Value rightOperand(Runtime& runtime, Value* frame, Value left, const ExprClosure* right) {
+    return left.isBig() ? pinnedOperand(runtime, frame, left, right) : right->run(runtime, frame);
+}
+
+template<typename Op>
+bool holds(Runtime& runtime, Value left, Value right) {
+    Value result;
+    // A result of the integer path is an inline integer, so its truth is a test of the integer
+    if (Value::bothInts(left, right) && Op::apply(left, right, result)) return result.asInt() != 0;
+    return BinaryExpr::applyToObjects(Op::token, left, right, runtime.bigInts).isTruthy();
+}
+
+class Constant : public ExprClosure {
+    Value value;
+public:
+    explicit Constant(Value value) : value(value) {}
+    Value run(Runtime&, Value*) const override { return value; }
+    bool test(Runtime&, Value*) const override { return value.isTruthy(); }
+};
+
+template<typename Place>
+class Load : public ExprClosure {
+    size_t slot;
+    const std::string& name;
+public:
+    Load(size_t slot, const std::string& name) : slot(slot), name(name) {}
+    Value run(Runtime& runtime, Value* frame) const override {
+        Value value = Place::at(runtime, frame, slot);
+        if (value == Value::unbound()) undefinedVariable(name);
+        return value;
+    }
+};
+
+// A variable of the function `levels` levels out from the running one
+class LoadEnclosing : public ExprClosure {
+    size_t levels;
+    size_t slot;
+    const std::string& name;
+public:
+    LoadEnclosing(size_t levels, size_t slot, const std::string& name) : levels(levels), slot(slot), name(name) {}
+    Value run(Runtime& runtime, Value*) const override {
+        Value value = runtime.enclosingFrame(levels)[slot];
+        if (value == Value::unbound()) undefinedVariable(name);
+        return value;
+    }
+};
+
+// An assignment used as an expression; yields the assigned value
+template<typename Place>
+class StoreExpr : public ExprClosure {
+    size_t slot;
+    const ExprClosure* value;
+public:
+    StoreExpr(size_t slot, const ExprClosure* value) : slot(slot), value(value) {}
+    Value run(Runtime& runtime, Value* frame) const override {
+        Value result = value->run(runtime, frame);
+        Place::at(runtime, frame, slot) = result;
+        return result;
+    }
+};
+
+template<typename Op>
+class Binary : public ExprClosure {
+    const ExprClosure* left;
+    const ExprClosure* right;
+public:
+    Binary(const ExprClosure* left, const ExprClosure* right) : left(left), right(right) {}
+    Value run(Runtime& runtime, Value* frame) const override {
+        Value leftValue = left->run(runtime, frame);
+        return combine<Op>(runtime, leftValue, rightOperand(runtime, frame, leftValue, right));
+    }
+    bool test(Runtime& runtime, Value* frame) const override {
+        Value leftValue = left->run(runtime, frame);
+        return holds<Op>(runtime, leftValue, rightOperand(runtime, frame, leftValue, right));
+    }
+};
+
+// `expression op literal`
+template<typename Op>
+class BinaryConstant : public ExprClosure {
+    const ExprClosure* left;
+    Value right;
+public:
+    BinaryConstant(const ExprClosure* left, Value right) : left(left), right(right) {}
+    Value run(Runtime& runtime, Value* frame) const override {
+        return combine<Op>(runtime, left->run(runtime, frame), right);
+    }
+    bool test(Runtime& runtime, Value* frame) const override {
+        return holds<Op>(runtime, left->run(runtime, frame), right);
+    }
+};
+
+// `variable op literal`, reading the slot directly
+template<typename Op, typename Place>
+class VariableConstant : public ExprClosure {
+    size_t slot;
+    Value right;
+    const std::string& name;
+public:
+    VariableConstant(size_t slot, Value right, const std::string& name) : slot(slot), right(right), name(name) {}
+    Value run(Runtime& runtime, Value* frame) const override {
+        return combine<Op>(runtime, load(runtime, frame), right);
+    }
+    bool test(Runtime& runtime, Value* frame) const override {
+        return holds<Op>(runtime, load(runtime, frame), right);
+    }
+private:
+    Value load(Runtime& runtime, Value* frame) const {
+        Value value = Place::at(runtime, frame, slot);
+        if (value == Value::unbound()) undefinedVariable(name);
+        return value;
+    }
+};
+
+// Operators without a closure of their own, decided by BinaryExpr::apply at runtime like the tree-walker does
+class DynamicBinary : public ExprClosure {
+    TokenType op;
+    const ExprClosure* left;
+    const ExprClosure* right;
+public:
+    DynamicBinary(TokenType op, const ExprClosure* left, const ExprClosure* right) : op(op), left(left), right(right) {}
+    Value run(Runtime& runtime, Value* frame) const override {
+        Value leftValue = left->run(runtime, frame);
+        return BinaryExpr::apply(op, leftValue, rightOperand(runtime, frame, leftValue, right), runtime.bigInts);
+    }
+};
+
+// Calls with any number of arguments, passed on the runtime's argument stack
+class Call : public ExprClosure {
+    const ClosureBinding* callee;
+    NodeList<const ExprClosure*> arguments;
+public:
+    Call(const ClosureBinding* callee, NodeList<const ExprClosure*> arguments) : callee(callee), arguments(arguments) {}
+    Value run(Runtime& runtime, Value* frame) const override {
+        // Nested calls made while evaluating the arguments push above `base` and pop back before the call
+        size_t base = runtime.arguments.size();
+        for (const ExprClosure* argument : arguments) {
+            Value value = argument->run(runtime, frame);
+            runtime.arguments.push_back(value);
+        }
+        return runtime.call(callee, runtime.arguments.data() + base, arguments.size(), base);
+    }
+};
+
+// Calls with 1 to 3 arguments, evaluated into a native array
+template<size_t Count>
+class FixedCall : public ExprClosure {
+    const ClosureBinding* callee;
+    const ExprClosure* arguments[Count];
+public:
+    FixedCall(const ClosureBinding* callee, const NodeList<const ExprClosure*>& list) : callee(callee) {
+        for (size_t i = 0; i < Count; i++) arguments[i] = list[i];
+    }
+    Value run(Runtime& runtime, Value* frame) const override {
+        Value values[Count];
+        // Like the left operand of a binary closure, a big argument is pinned while the next ones are evaluated
+        size_t pinned = 0;
+        for (size_t i = 0; i < Count; i++) {
+            values[i] = arguments[i]->run(runtime, frame);
+            if (i + 1 < Count && values[i].isBig()) {
+                runtime.bigInts.pin(values[i]);
+                pinned++;
+            }
+        }
+        for (; pinned > 0; pinned--) runtime.bigInts.unpin();
+        return runtime.call(callee, values, Count, runtime.arguments.size());
+    }
+};
+
+class Block : public StmtClosure {
+    NodeList<const StmtClosure*> statements;
+public:
+    explicit Block(NodeList<const StmtClosure*> statements) : statements(statements) {}
+    ExecStatus run(Runtime& runtime, Value* frame) const override {
+        for (const StmtClosure* statement : statements) {
+            ExecStatus status = statement->run(runtime, frame);
+            if (status != ExecStatus::Normal) return status;
+        }
+        return ExecStatus::Normal;
+    }
+};
+
+template<typename Place>
+class Assign : public StmtClosure {
+    size_t slot;
+    const ExprClosure* value;
+public:
+    Assign(size_t slot, const ExprClosure* value) : slot(slot), value(value) {}
+    ExecStatus run(Runtime& runtime, Value* frame) const override {
+        Place::at(runtime, frame, slot) = value->run(runtime, frame);
+        return ExecStatus::Normal;
+    }
+};
+
+class If : public StmtClosure {
+    const ExprClosure* condition;
+    const StmtClosure* ifBranch;
+    const StmtClosure* elseBranch; // May be null
+public:
+    If(const ExprClosure* condition, const StmtClosure* ifBranch, const StmtClosure* elseBranch)
+        : condition(condition), ifBranch(ifBranch), elseBranch(elseBranch) {}
+    ExecStatus run(Runtime& runtime, Value* frame) const override {
+        if (condition->test(runtime, frame)) return ifBranch->run(runtime, frame);
+        return elseBranch ? elseBranch->run(runtime, frame) : ExecStatus::Normal;
+    }
+};
+
+class While : public StmtClosure {
+    const ExprClosure* condition;
+    const StmtClosure* body;
+public:
+    While(const ExprClosure* condition, const StmtClosure* body) : condition(condition), body(body) {}
+    ExecStatus run(Runtime& runtime, Value* frame) const override {
+        while (condition->test(runtime, frame)) {
+            ExecStatus status = body->run(runtime, frame);
+            if (status != ExecStatus::Normal) return status;
+        }
+        return ExecStatus::Normal;
+    }
+};
+
+template<typename Place>
+class ForRange : public StmtClosure {
+    size_t slot;
+    const ExprClosure* start;
+    const ExprClosure* stop;
+    const ExprClosure* step; // Null for a step of 1
+    const StmtClosure* body;
+public:
+    ForRange(size_t slot, const ExprClosure* start, const ExprClosure* stop, const ExprClosure* step,
+             const StmtClosure* body)
+        : slot(slot), start(start), stop(stop), step(step), body(body) {}
+    ExecStatus run(Runtime& runtime, Value* frame) const override {
+        // Same as ForRangeStmt::execute: inline bounds and a 64-bit counter, which cannot overflow
+        int64_t first = start->run(runtime, frame).toInt("range() argument");
+        int64_t last = stop->run(runtime, frame).toInt("range() argument");
+        int64_t increment = step ? step->run(runtime, frame).toInt("range() argument") : 1;
+        if (increment == 0) {
+            throw std::runtime_error("range() arg 3 must not be zero.");
+        }
+        for (int64_t i = first; increment > 0 ? i < last : i > last; i += increment) {
+            Place::at(runtime, frame, slot) = Value::small(i);
+            ExecStatus status = body->run(runtime, frame);
+            if (status != ExecStatus::Normal) return status;
+        }
+        return ExecStatus::Normal;
+    }
+};
+
+class Print : public StmtClosure {
+    NodeList<const ExprClosure*> expressions;
+public:
+    explicit Print(NodeList<const ExprClosure*> expressions) : expressions(expressions) {}
+    ExecStatus run(Runtime& runtime, Value* frame) const override {
+        for (const ExprClosure* expression : expressions) {
+            runtime.output.write(expression->run(runtime, frame));
+            runtime.output.write(' ');
+        }
+        runtime.output.endLine();
+        return ExecStatus::Normal;
+    }
+};
+
+class Evaluate : public StmtClosure {
+    const ExprClosure* expression;
+public:
+    explicit Evaluate(const ExprClosure* expression) : expression(expression) {}
+    ExecStatus run(Runtime& runtime, Value* frame) const override {
+        expression->run(runtime, frame);
+        return ExecStatus::Normal;
+    }
+};
+
+class Return : public StmtClosure {
+    const ExprClosure* value; // May be null, which returns 0
+public:
+    explicit Return(const ExprClosure* value) : value(value) {}
+    ExecStatus run(Runtime& runtime, Value* frame) const override {
+        runtime.returnValue = value ? value->run(runtime, frame) : Value();
+        return ExecStatus::Return;
+    }
+};
+
+// `return f(...)`: evaluates the arguments and lets Runtime::call run the callee in the current frame
+class TailCall : public StmtClosure {
+    const ClosureBinding* callee;
+    NodeList<const ExprClosure*> arguments;
+public:
+    TailCall(const ClosureBinding* callee, NodeList<const ExprClosure*> arguments) : callee(callee), arguments(arguments) {}
+    ExecStatus run(Runtime& runtime, Value* frame) const override {
+        size_t base = runtime.arguments.size();
+        for (const ExprClosure* argument : arguments) {
+            Value value = argument->run(runtime, frame);
+            runtime.arguments.push_back(value);
+        }
+        runtime.tailCallee = callee;
+        runtime.tailCallBase = base;
+        return ExecStatus::TailCall;
+    }
+};
+
+class Define : public StmtClosure {
+    ClosureBinding* binding;
+    const FunctionCode* function;
+public:
+    Define(ClosureBinding* binding, const FunctionCode* function) : binding(binding), function(function) {}
+    ExecStatus run(Runtime&, Value*) const override {
+        binding->function = function;
+        return ExecStatus::Normal;
+    }
+};
+
+class ClosureCompiler : public ASTVisitor {
+public:
+    ClosureCompiler(Arena& arena, std::vector<ClosureBinding*>& bindings) : arena(arena), bindings(bindings) {}
+
+    const ExprClosure* compile(Expr* expr) {
+        expr->accept(*this);
+        return compiledExpr;
+    }
+
+    const StmtClosure* compile(Stmt* stmt) {
+        stmt->accept(*this);
+        return compiledStmt;
+    }
+
+    void visit(BinaryExpr& expr) override {
+        switch (expr.getOp()) {
+            case TokenType::PLUS: compiledExpr = binary<Add>(expr); break;
+            case TokenType::MINUS: compiledExpr = binary<Subtract>(expr); break;
+            case TokenType::MUL: compiledExpr = binary<Multiply>(expr); break;
+            case TokenType::DIV: compiledExpr = binary<FloorDivide>(expr); break;
+            case TokenType::EQUAL: compiledExpr = binary<Equal>(expr); break;
+            case TokenType::LESS: compiledExpr = binary<Less>(expr); break;
+            case TokenType::LESS_EQUAL: compiledExpr = binary<LessEqual>(expr); break;
+            case TokenType::GREATER: compiledExpr = binary<Greater>(expr); break;
+            case TokenType::GREATER_EQUAL: compiledExpr = binary<GreaterEqual>(expr); break;
+            default: {
+                const ExprClosure* left = compile(expr.getLeft());
+                compiledExpr = arena.make<DynamicBinary>(expr.getOp(), left, compile(expr.getRight()));
+                break;
+            }
+        }
+    }
+    void visit(LiteralExpr& expr) override {
+        compiledExpr = arena.make<Constant>(expr.getConstant());
+    }
+    void visit(VarExpr& expr) override {
+        if (isLocal(expr.getDepth())) {
+            compiledExpr = arena.make<Load<Local>>(expr.getSlot(), expr.getName());
+        } else if (isEnclosing(expr.getDepth())) {
+            compiledExpr = arena.make<LoadEnclosing>(expr.getDepth(), expr.getSlot(), expr.getName());
+        } else {
+            compiledExpr = arena.make<Load<Global>>(expr.getSlot(), expr.getName());
+        }
+    }
+    void visit(AssignExpr& expr) override {
+        const ExprClosure* value = compile(expr.getValue());
+        if (isLocal(expr.getDepth())) {
+            compiledExpr = arena.make<StoreExpr<Local>>(expr.getSlot(), value);
+        } else {
+            compiledExpr = arena.make<StoreExpr<Global>>(expr.getSlot(), value);
+        }
+    }
+    void visit(StringLiteralExpr& expr) override {
+        compiledExpr = arena.make<Constant>(Value::string(expr.getValue()));
+    }
+    void visit(CallExpr& expr) override {
+        ClosureBinding* callee = binding(expr.getFunctionSymbol());
+        NodeList<const ExprClosure*> arguments = compileList(expr.getArguments());
+        switch (arguments.size()) {
+            case 1: compiledExpr = arena.make<FixedCall<1>>(callee, arguments); break;
+            case 2: compiledExpr = arena.make<FixedCall<2>>(callee, arguments); break;
+            case 3: compiledExpr = arena.make<FixedCall<3>>(callee, arguments); break;
+            default: compiledExpr = arena.make<Call>(callee, arguments); break;
+        }
+    }
+    void visit(AssignStmt& stmt) override {
+        const ExprClosure* value = compile(stmt.getValue());
+        if (isLocal(stmt.getDepth())) {
+            compiledStmt = arena.make<Assign<Local>>(stmt.getSlot(), value);
+        } else {
+            compiledStmt = arena.make<Assign<Global>>(stmt.getSlot(), value);
+        }
+    }
+    void visit(IfStmt& stmt) override {
+        const ExprClosure* condition = compile(stmt.condition);
+        const StmtClosure* ifBranch = compile(stmt.ifBranch);
+        const StmtClosure* elseBranch = stmt.elseBranch ? compile(stmt.elseBranch) : nullptr;
+        compiledStmt = arena.make<If>(condition, ifBranch, elseBranch);
+    }
+    void visit(PrintStmt& stmt) override {
+        compiledStmt = arena.make<Print>(compileList(stmt.getExpressions()));
+    }
+    void visit(ExpressionStmt& stmt) override {
+        compiledStmt = arena.make<Evaluate>(compile(stmt.getExpression()));
+    }
+    void visit(ReturnStmt& stmt) override {
+        if (CallExpr* call = stmt.getTailCall()) {
+            compiledStmt = arena.make<TailCall>(binding(call->getFunctionSymbol()), compileList(call->getArguments()));
+            return;
+        }
+        compiledStmt = arena.make<Return>(stmt.getReturnValue() ? compile(stmt.getReturnValue()) : nullptr);
+    }
+    void visit(FunctionStmt& stmt) override {
+        // Made before the body, which refers to it when it defines nested functions
+        FunctionCode* function = arena.make<FunctionCode>(
+            FunctionCode{nullptr, stmt.getParameters().size(), stmt.getSlotCount(), currentFunction});
+        const FunctionCode* enclosing = currentFunction;
+        currentFunction = function;
+        ++nesting;
+        function->body = compile(stmt.getBody());
+        --nesting;
+        currentFunction = enclosing;
+        compiledStmt = arena.make<Define>(binding(stmt.getSymbol()), function);
+    }
+    void visit(BlockStmt& stmt) override {
+        std::vector<const StmtClosure*> statements;
+        for (Stmt* statement : stmt.getStatements()) statements.push_back(compile(statement));
+        compiledStmt = arena.make<Block>(arena.copyList(statements));
+    }
+    void visit(WhileStmt& stmt) override {
+        const ExprClosure* condition = compile(stmt.condition);
+        compiledStmt = arena.make<While>(condition, compile(stmt.body));
+    }
+    void visit(ForRangeStmt& stmt) override {
+        const ExprClosure* start = compile(stmt.start);
+        const ExprClosure* stop = compile(stmt.stop);
+        const ExprClosure* step = stmt.step ? compile(stmt.step) : nullptr;
+        const StmtClosure* body = compile(stmt.body);
+        if (isLocal(stmt.getDepth())) {
+            compiledStmt = arena.make<ForRange<Local>>(stmt.getSlot(), start, stop, step, body);
+        } else {
+            compiledStmt = arena.make<ForRange<Global>>(stmt.getSlot(), start, stop, step, body);
+        }
+    }
+
+private:
+    Arena& arena;
+    std::vector<ClosureBinding*>& bindings;
+    std::unordered_map<uint32_t, ClosureBinding*> bindingsById;
+    // Functions around the code being compiled: depth 0 is the global frame at top level and the function frame
+    // inside a body, the depth equal to the nesting is the global frame, and the depths between them are the
+    // frames of enclosing functions, which are only read
+    size_t nesting = 0;
+    const FunctionCode* currentFunction = nullptr;
+    const ExprClosure* compiledExpr = nullptr;
+    const StmtClosure* compiledStmt = nullptr;
+
+    bool isLocal(size_t depth) const { return nesting > 0 && depth == 0; }
+    bool isEnclosing(size_t depth) const { return depth > 0 && depth < nesting; }
+
+    ClosureBinding* binding(Symbol name) {
+        ClosureBinding*& binding = bindingsById[name.id()];
+        if (!binding) {
+            binding = arena.make<ClosureBinding>(name.name());
+            bindings.push_back(binding);
+        }
+        return binding;
+    }
+
+    NodeList<const ExprClosure*> compileList(const NodeList<Expr*>& expressions) {
+        std::vector<const ExprClosure*> compiled;
+        for (Expr* expr : expressions) compiled.push_back(compile(expr));
+        return arena.copyList(compiled);
+    }
+
+    template<typename Op>
+    const ExprClosure* binary(BinaryExpr& expr) {
+        if (auto literal = dynamic_cast<LiteralExpr*>(expr.getRight())) {
+            Value constant = literal->getConstant();
+            auto var = dynamic_cast<VarExpr*>(expr.getLeft());
+            if (var && !isEnclosing(var->getDepth())) {
+                if (isLocal(var->getDepth())) {
+                    return arena.make<VariableConstant<Op, Local>>(var->getSlot(), constant, var->getName());
+                }
+                return arena.make<VariableConstant<Op, Global>>(var->getSlot(), constant, var->getName());
+            }
+            return arena.make<BinaryConstant<Op>>(compile(expr.getLeft()), constant);
+        }
+        const ExprClosure* left = compile(expr.getLeft());
+        return arena.make<Binary<Op>>(left, compile(expr.getRight()));
+    }
+};
+
+} // namespace
+
+ClosureProgram::ClosureProgram(Stmt& root, const std::vector<std::string>& globals, Arena& arena)
+    : globalCount(globals.size()) {
+    ClosureCompiler compiler(arena, bindings);
+    main = compiler.compile(&root);
+}
+
+void ClosureProgram::run() {
+    for (ClosureBinding* binding : bindings) binding->function = nullptr;
+    FlushOnExit flushOutput(output);
+    Runtime runtime(globalCount, recursionLimit, output);
+    // At the top level depth 0 is the global frame, which Global closures read from the runtime
+    main->run(runtime, runtime.globals.data());
+}
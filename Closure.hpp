@@ -0,0 +1,66 @@
+/**
+ * @file closure.hpp
+ * @brief Closure-compiled back end (`mypython --closures`): the AST turned into a tree of specialized callables.
+ *
+ * A ClosureProgram compiles every node of a resolved program once into a small function object whose code was
+ * chosen for that node at compile time, then runs the program by calling the root. It sits between the two
+ * other back ends: it keeps the tree shape (and the native recursion) of the tree-walking Interpreter, so it
+ * needs no instruction set of its own and the Parser.hpp nodes remain the source of truth, but the decisions
+ * the tree-walker makes again on every evaluation are made once:
+ * - A BinaryExpr becomes one closure type per operator (add, subtract, multiply, floor-divide, each comparison),
+ *   so there is no `switch (op)` at runtime. An integer literal on the right (`n - 1`, `i < 10`) is stored in
+ *   the closure instead of being evaluated, and `variable op literal` reads the variable's slot itself.
+ * - Variable reads and writes are direct loads and stores: the frame is passed to every closure as a Value
+ *   array, and whether a slot is local or global is fixed by the closure type.
+ * - Conditions are evaluated through `test`, which comparisons implement without making a Value.
+ * - Calls bind to their callee's binding at compile time; calls with one to three arguments evaluate them into
+ *   a native array instead of the argument stack.
+ *
+ * Everything else follows the Interpreter exactly, including the error messages, the evaluation order, calls in
+ * tail position reusing their caller's frame, and the RecursionError at the recursion limit. Like the
+ * tree-walker, closures recurse on the native stack, so runProgram gives them the same stack size. --memo and
+ * --profile have no effect on this back end.
+ *
+ * The closures are allocated in the Arena of the tree they were compiled from and refer to its names, so the
+ * Arena must outlive the program. A program is run by one thread at a time.
+ *
+ * Usage:
+ *   ClosureProgram program(*ast, resolver.getGlobals(), arena);
+ *   program.setOutput(out);
+ *   program.run();
+ */
+
+#pragma once
+#include "Output.hpp"
+#include "Parser.hpp"
+#include <iostream>
+#include <string>
+#include <vector>
+
+class StmtClosure;
+struct ClosureBinding;
+
+class ClosureProgram {
+public:
+    /**
+     * Compiles a resolved (and, at -O1, optimized) program.
+     * @param globals The global slot names reported by the Resolver.
+     * @param arena Receives the closures; usually the Arena that owns the tree.
+     */
+    ClosureProgram(Stmt& root, const std::vector<std::string>& globals, Arena& arena);
+
+    // Runs the program from the top, with no function defined yet.
+    void run();
+
+    // Maximum number of nested (non-tail) calls before a RecursionError is raised.
+    void setRecursionLimit(size_t limit) { recursionLimit = limit; }
+    // Stream print statements write to, std::cout by default. Must outlive the run.
+    void setOutput(std::ostream& stream) { output.setTarget(stream); }
+
+private:
+    const StmtClosure* main;
+    size_t globalCount;
+    std::vector<ClosureBinding*> bindings; // One per called or defined name, unbound at the start of a run
+    size_t recursionLimit = 10000;
+    OutputWriter output;
+};
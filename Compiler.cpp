@@ -0,0 +1,285 @@
+/**
+ * @file compiler.cpp
+ * @brief Implementation of the AST to bytecode Compiler.
+ *
+ * Each visit method emits the instructions for one node type. Variables use the (depth, slot) pairs assigned
+ * by the Resolver: depth 0 inside a function body is a local slot, the depth one past the outermost function
+ * is a global slot, and any depth between them a slot of an enclosing function.
+ * Function names are interned into Chunk::names and string literals into Chunk::strings.
+ * Forward jumps are emitted with a placeholder target and patched once the jumped-over code is known.
+ */
+
+#include "Compiler.hpp"
+#include <climits>
+#include <stdexcept>
+
+Chunk Compiler::compile(Stmt& root, const std::vector<std::string>& globals) {
+    chunk = Chunk();
+    chunk.globals = globals;
+    nameIndices.clear();
+    stringIndices.clear();
+    integerIndices.clear();
+    pendingBodies.clear();
+
+    nesting = 0;
+    currentFunction = -1;
+    root.accept(*this);
+    emit(OpCode::HALT);
+
+    // Bodies may define further functions, so keep going until nothing is pending.
+    for (size_t i = 0; i < pendingBodies.size(); i++) {
+        PendingBody pending = pendingBodies[i];
+        nesting = pending.nesting;
+        currentFunction = pending.index;
+        chunk.functions[pending.index].entry = chunk.code.size();
+        pending.function->getBody()->accept(*this);
+        emit(OpCode::CONSTANT, 0); // Falling off the end of a function returns 0
+        emit(OpCode::RETURN);
+    }
+    return std::move(chunk);
+}
+
+size_t Compiler::emit(OpCode op, int32_t a, uint16_t b) {
+    chunk.code.push_back(Instruction(op, a, b));
+    return chunk.code.size() - 1;
+}
+
+void Compiler::patchJump(size_t jump) {
+    chunk.code[jump].a = static_cast<int32_t>(chunk.code.size());
+}
+
+void Compiler::emitLoad(size_t depth, size_t slot) {
+    if (isLocal(depth)) {
+        emit(OpCode::LOAD_LOCAL, static_cast<int32_t>(slot));
+    } else if (isGlobal(depth)) {
+        emit(OpCode::LOAD_GLOBAL, static_cast<int32_t>(slot));
+    } else {
+        emit(OpCode::LOAD_ENCLOSING, static_cast<int32_t>(slot), static_cast<uint16_t>(depth));
+    }
+}
+
+void Compiler::emitStore(size_t depth, size_t slot) {
+    if (!isLocal(depth) && !isGlobal(depth)) {
+        // The Resolver makes every name a function assigns local to it
+        throw std::logic_error("Store into the frame of an enclosing function.");
+    }
+    emit(isLocal(depth) ? OpCode::STORE_LOCAL : OpCode::STORE_GLOBAL, static_cast<int32_t>(slot));
+}
+
+int Compiler::nameIndex(Symbol name) {
+    auto inserted = nameIndices.insert(std::make_pair(name.id(), static_cast<int>(chunk.names.size())));
+    if (inserted.second) chunk.names.push_back(name.name());
+    return inserted.first->second;
+}
+
+int Compiler::stringIndex(const std::string& text) {
+    auto it = stringIndices.find(text);
+    if (it != stringIndices.end()) return it->second;
+    int index = static_cast<int>(chunk.strings.size());
+    chunk.strings.push_back(text);
+    stringIndices[text] = index;
+    return index;
+}
+
+int Compiler::integerIndex(Value value) {
+    auto inserted = integerIndices.insert(std::make_pair(value.raw(), static_cast<int>(chunk.integers.size())));
+    if (inserted.second) chunk.integers.push_back(value);
+    return inserted.first->second;
+}
+
+// Emits ADD_LOCAL_CONST/ADD_GLOBAL_CONST for a variable plus or minus a literal; false if `expr` is not one.
+bool Compiler::emitAddConstant(BinaryExpr& expr) {
+    TokenType op = expr.getOp();
+    if (!superinstructions || (op != TokenType::PLUS && op != TokenType::MINUS)) return false;
+    auto var = dynamic_cast<VarExpr*>(expr.getLeft());
+    auto literal = dynamic_cast<LiteralExpr*>(expr.getRight());
+    if (!var && op == TokenType::PLUS) {
+        // Loading a variable and a constant have no effects on each other, so `1 + n` may load n first
+        var = dynamic_cast<VarExpr*>(expr.getRight());
+        literal = dynamic_cast<LiteralExpr*>(expr.getLeft());
+    }
+    if (!var || !literal || !literal->isInline() || var->getSlot() > UINT16_MAX) return false;
+    // The constant is the instruction's 32-bit operand
+    int64_t constant = literal->getValue();
+    if (op == TokenType::MINUS) constant = -constant;
+    if (constant < INT32_MIN || constant > INT32_MAX) return false;
+    if (!isLocal(var->getDepth()) && !isGlobal(var->getDepth())) return false;
+    bool local = isLocal(var->getDepth());
+    emit(local ? OpCode::ADD_LOCAL_CONST : OpCode::ADD_GLOBAL_CONST, constant, static_cast<uint16_t>(var->getSlot()));
+    return true;
+}
+
+// Emits the test of an if or while condition; returns the jump taken when it is false, for patchJump.
+size_t Compiler::emitConditionJump(Expr* condition) {
+    auto comparison = dynamic_cast<BinaryExpr*>(condition);
+    if (superinstructions && comparison) {
+        OpCode jump = OpCode::HALT;
+        switch (comparison->getOp()) {
+            case TokenType::EQUAL: jump = OpCode::JUMP_UNLESS_EQUAL; break;
+            case TokenType::LESS: jump = OpCode::JUMP_UNLESS_LESS; break;
+            case TokenType::LESS_EQUAL: jump = OpCode::JUMP_UNLESS_LESS_EQUAL; break;
+            case TokenType::GREATER: jump = OpCode::JUMP_UNLESS_GREATER; break;
+            case TokenType::GREATER_EQUAL: jump = OpCode::JUMP_UNLESS_GREATER_EQUAL; break;
+            default: break;
+        }
+        if (jump != OpCode::HALT) {
+            comparison->getLeft()->accept(*this);
+            comparison->getRight()->accept(*this);
+            return emit(jump);
+        }
+    }
+    condition->accept(*this);
+    return emit(OpCode::JUMP_IF_FALSE);
+}
+
+void Compiler::visit(BinaryExpr& expr) {
+    if (emitAddConstant(expr)) return;
+    expr.getLeft()->accept(*this);
+    expr.getRight()->accept(*this);
+    switch (expr.getOp()) {
+        case TokenType::PLUS: emit(OpCode::ADD); break;
+        case TokenType::MINUS: emit(OpCode::SUBTRACT); break;
+        case TokenType::MUL: emit(OpCode::MULTIPLY); break;
+        case TokenType::DIV: emit(OpCode::FLOOR_DIVIDE); break;
+        case TokenType::EQUAL: emit(OpCode::EQUAL); break;
+        case TokenType::LESS: emit(OpCode::LESS); break;
+        case TokenType::LESS_EQUAL: emit(OpCode::LESS_EQUAL); break;
+        case TokenType::GREATER: emit(OpCode::GREATER); break;
+        case TokenType::GREATER_EQUAL: emit(OpCode::GREATER_EQUAL); break;
+        default:
+            // Let BinaryExpr::apply decide at runtime, exactly like the tree-walker does.
+            emit(OpCode::BINARY_OP, 0, static_cast<uint16_t>(expr.getOp()));
+            break;
+    }
+}
+
+void Compiler::visit(LiteralExpr& expr) {
+    if (expr.isInline() && expr.getValue() >= INT32_MIN && expr.getValue() <= INT32_MAX) {
+        emit(OpCode::CONSTANT, static_cast<int32_t>(expr.getValue()));
+    } else {
+        emit(OpCode::CONSTANT_WIDE, integerIndex(expr.getConstant()));
+    }
+}
+
+void Compiler::visit(VarExpr& expr) {
+    emitLoad(expr.getDepth(), expr.getSlot());
+}
+
+void Compiler::visit(AssignExpr& expr) {
+    expr.getValue()->accept(*this);
+    emitStore(expr.getDepth(), expr.getSlot());
+    emitLoad(expr.getDepth(), expr.getSlot()); // An assignment expression yields the assigned value
+}
+
+void Compiler::visit(StringLiteralExpr& expr) {
+    emit(OpCode::CONSTANT_STRING, stringIndex(expr.getValue()));
+}
+
+void Compiler::visit(CallExpr& expr) {
+    const auto& arguments = expr.getArguments();
+    for (const auto& arg : arguments) {
+        arg->accept(*this);
+    }
+    OpCode call = OpCode::CALL;
+    if (superinstructions && arguments.size() >= 1 && arguments.size() <= 3) {
+        const OpCode fixed[] = {OpCode::CALL_1, OpCode::CALL_2, OpCode::CALL_3};
+        call = fixed[arguments.size() - 1];
+    }
+    emit(call, nameIndex(expr.getFunctionSymbol()), static_cast<uint16_t>(arguments.size()));
+}
+
+void Compiler::visit(AssignStmt& stmt) {
+    stmt.getValue()->accept(*this);
+    emitStore(stmt.getDepth(), stmt.getSlot());
+}
+
+void Compiler::visit(IfStmt& stmt) {
+    size_t elseJump = emitConditionJump(stmt.condition);
+    stmt.ifBranch->accept(*this);
+    if (stmt.elseBranch) {
+        size_t endJump = emit(OpCode::JUMP);
+        patchJump(elseJump);
+        stmt.elseBranch->accept(*this);
+        patchJump(endJump);
+    } else {
+        patchJump(elseJump);
+    }
+}
+
+void Compiler::visit(PrintStmt& stmt) {
+    for (const auto& expr : stmt.getExpressions()) {
+        if (auto stringExpr = dynamic_cast<StringLiteralExpr*>(expr)) {
+            emit(OpCode::PRINT_STRING, stringIndex(stringExpr->getValue()));
+        } else {
+            expr->accept(*this);
+            emit(OpCode::PRINT_VALUE);
+        }
+    }
+    emit(OpCode::PRINT_END);
+}
+
+void Compiler::visit(ExpressionStmt& stmt) {
+    stmt.getExpression()->accept(*this);
+    emit(OpCode::POP);
+}
+
+void Compiler::visit(ReturnStmt& stmt) {
+    if (CallExpr* call = stmt.getTailCall()) {
+        // The callee takes over the current frame and returns straight to our caller
+        for (const auto& arg : call->getArguments()) {
+            arg->accept(*this);
+        }
+        emit(OpCode::TAIL_CALL, nameIndex(call->getFunctionSymbol()), static_cast<uint16_t>(call->getArguments().size()));
+        emit(OpCode::RETURN); // Only reached when the callee could not take over the frame
+        return;
+    }
+    if (stmt.getReturnValue()) {
+        stmt.getReturnValue()->accept(*this);
+    } else {
+        emit(OpCode::CONSTANT, 0);
+    }
+    emit(OpCode::RETURN);
+}
+
+void Compiler::visit(FunctionStmt& stmt) {
+    FunctionProto proto;
+    proto.name = stmt.getName();
+    proto.nameIndex = nameIndex(stmt.getSymbol());
+    proto.arity = stmt.getParameters().size();
+    for (Symbol local : stmt.getLocals()) proto.locals.push_back(local.name());
+    proto.enclosing = currentFunction;
+    int index = static_cast<int>(chunk.functions.size());
+    chunk.functions.push_back(std::move(proto));
+    pendingBodies.push_back(PendingBody{index, &stmt, nesting + 1});
+    emit(OpCode::DEFINE_FUNCTION, index);
+}
+
+void Compiler::visit(BlockStmt& stmt) {
+    for (const auto& statement : stmt.getStatements()) {
+        statement->accept(*this);
+    }
+}
+
+void Compiler::visit(WhileStmt& stmt) {
+    size_t loopStart = chunk.code.size();
+    size_t exitJump = emitConditionJump(stmt.condition);
+    stmt.body->accept(*this);
+    emit(OpCode::JUMP, static_cast<int32_t>(loopStart));
+    patchJump(exitJump);
+}
+
+void Compiler::visit(ForRangeStmt& stmt) {
+    stmt.start->accept(*this);
+    stmt.stop->accept(*this);
+    if (stmt.step) {
+        stmt.step->accept(*this);
+    } else {
+        emit(OpCode::CONSTANT, 1);
+    }
+    emit(OpCode::FOR_RANGE_START);
+    size_t loop = emit(OpCode::FOR_RANGE);
+    emitStore(stmt.getDepth(), stmt.getSlot());
+    stmt.body->accept(*this);
+    emit(OpCode::JUMP, static_cast<int32_t>(loop));
+    patchJump(loop);
+}
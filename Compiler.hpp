@@ -0,0 +1,96 @@
+/**
+ * @file compiler.hpp
+ * @brief Declaration of the Compiler that lowers the AST into bytecode.
+ *
+ * The Compiler walks the BlockStmt returned by `Parser::parse()` once and emits a Chunk for the VM. It is
+ * an ASTVisitor: every node type appends the instructions that reproduce what its `execute`/`evaluate`
+ * method does in the tree-walking Interpreter, which remains the reference implementation.
+ *
+ * Lowering rules:
+ * - Expressions push exactly one value on the VM stack. Binary operators evaluate left then right.
+ * - If statements become a JUMP_IF_FALSE over the if branch and a JUMP over the else branch.
+ * - While loops test the condition at the top and JUMP back to it after the body. `for` loops keep their
+ *   counter, stop and step on the stack and advance with FOR_RANGE, which stores nothing but the loop variable.
+ * - Function definitions emit DEFINE_FUNCTION where the `def` appears; the bodies are compiled after the
+ *   top-level code so the main program is a straight line ending in HALT.
+ * - A function body that falls off its end returns 0, matching `Interpreter::callFunction`.
+ * - String literals push CONSTANT_STRING, except directly inside print, which uses PRINT_STRING.
+ * - `return f(...)` becomes TAIL_CALL, which reuses the current frame like the tree-walker does.
+ * - A name a nested function reads from an enclosing function becomes LOAD_ENCLOSING with the number of levels
+ *   between them, which is the depth the Resolver gave it; the depth one past the outermost function is global.
+ *
+ * Superinstructions (on by default, off at -O0):
+ * - `name + constant` and `name - constant` (either operand order for +) become ADD_LOCAL_CONST/ADD_GLOBAL_CONST.
+ * - An if or while condition that is a comparison becomes its two operands and one JUMP_UNLESS_<cmp>.
+ * - Calls with 1 to 3 arguments use CALL_1..CALL_3.
+ * They are chosen from the shape of the AST, never by rewriting emitted code, so jump targets are unaffected;
+ * each one does exactly what the instructions it replaces do, including the errors they raise.
+ *
+ * Usage:
+ *   Compiler compiler;
+ *   Chunk chunk = compiler.compile(*ast);
+ */
+
+#pragma once
+#include "Bytecode.hpp"
+#include "Parser.hpp"
+#include <unordered_map>
+
+class Compiler : public ASTVisitor {
+public:
+    /**
+     * Compiles a resolved program.
+     * @param root The BlockStmt returned by the parser, already processed by the Resolver.
+     * @param globals The global slot names reported by the Resolver.
+     */
+    Chunk compile(Stmt& root, const std::vector<std::string>& globals);
+
+    // Emit superinstructions for the common sequences (the default) or only the basic instructions.
+    void setSuperinstructions(bool enabled) { superinstructions = enabled; }
+
+    void visit(BinaryExpr& expr) override;
+    void visit(LiteralExpr& expr) override;
+    void visit(VarExpr& expr) override;
+    void visit(AssignExpr& expr) override;
+    void visit(StringLiteralExpr& expr) override;
+    void visit(CallExpr& expr) override;
+    void visit(AssignStmt& stmt) override;
+    void visit(IfStmt& stmt) override;
+    void visit(PrintStmt& stmt) override;
+    void visit(ExpressionStmt& stmt) override;
+    void visit(ReturnStmt& stmt) override;
+    void visit(FunctionStmt& stmt) override;
+    void visit(BlockStmt& stmt) override;
+    void visit(WhileStmt& stmt) override;
+    void visit(ForRangeStmt& stmt) override;
+
+private:
+    Chunk chunk;
+    std::unordered_map<uint32_t, int> nameIndices; // By symbol ID
+    std::unordered_map<std::string, int> stringIndices;
+    std::unordered_map<uint64_t, int> integerIndices; // By the constant's raw Value
+    // A function body waiting to be compiled, with the number of functions it is nested in, itself included
+    struct PendingBody {
+        int index; // In Chunk::functions
+        FunctionStmt* function;
+        size_t nesting;
+    };
+    std::vector<PendingBody> pendingBodies;
+    // Functions around the code being compiled: 0 at top level, where depth 0 is the globals, 1 in a top-level
+    // function, where depth 0 is its frame and depth 1 the globals, and so on
+    size_t nesting = 0;
+    int currentFunction = -1; // Index in Chunk::functions of the body being compiled, -1 at top level
+    bool superinstructions = true;
+
+    size_t emit(OpCode op, int32_t a = 0, uint16_t b = 0);
+    void patchJump(size_t jump);
+    int nameIndex(Symbol name);
+    int stringIndex(const std::string& text);
+    int integerIndex(Value value);
+    void emitLoad(size_t depth, size_t slot);
+    void emitStore(size_t depth, size_t slot);
+    bool isLocal(size_t depth) const { return nesting > 0 && depth == 0; }
+    bool isGlobal(size_t depth) const { return depth == nesting; }
+    bool emitAddConstant(BinaryExpr& expr);
+    size_t emitConditionJump(Expr* condition);
+};
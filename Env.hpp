@@ -1,66 +1,106 @@
 #pragma once
-#include <unordered_map>
 #include <string>
-#include <memory>
-#include <iostream>
+#include <vector>
+#include <stdexcept>
+#include "Value.hpp"
+
 class FunctionStmt;
 
 /**
- * A simple environment for variable storage. Supports nested scopes through parent pointers.
+ * Variable storage for one frame: the global frame or the frame of one function call. Variables are resolved
+ * ahead of time by the Resolver into (depth, slot) pairs following Python's function-level scoping, so a frame
+ * is a flat vector indexed by slot. Depth 0 is the frame itself and each further level one step up the chain of
+ * parents: the frame of a call has the frame of the call of the enclosing function as its parent (the global
+ * frame for a top-level function), so depth 1 is the global frame unless the function is nested in another.
+ * Blocks never create frames, so entering an if branch costs nothing.
  */
 class Environment {
-    std::unordered_map<std::string, int> values; // Stores variable names and their values.
-    std::unordered_map<std::string, std::shared_ptr<FunctionStmt>> functions;  // Function storage
-    Environment* parent; // Pointer to parent environment, nullptr for global scope
+public:
+    // One word per variable: Value::unbound() until the variable is first assigned
+    struct Slot {
+        Value value = Value::unbound();
+        bool isBound() const { return value != Value::unbound(); }
+    };
 
+private:
+    std::vector<Slot> slots; // Variable values, indexed by the slot assigned by the Resolver.
+    Environment* parent; // Frame of the enclosing function or the global frame, nullptr for the global frame
+    const FunctionStmt* function = nullptr; // Function of the call using the frame, nullptr for the global frame
 
 public:
 
     /**
-     * Constructor that optionally takes a parent environment to support nested scopes.
-     * @param parent The parent environment, nullptr if this is the global environment.
+     * Constructor that optionally takes a parent environment.
+     * @param parent The frame variables of enclosing scopes are read from, nullptr for the global environment.
+     * @param slotCount The number of variable slots of this frame.
+     */
+    Environment(Environment* parent = nullptr, size_t slotCount = 0) : slots(slotCount), parent(parent) {}
+
+    /**
+     * Grows or shrinks the frame to the given number of slots.
      */
-    Environment(Environment* parent = nullptr) : parent(parent) {}
+    void resize(size_t slotCount) {
+        slots.resize(slotCount);
+    }
+
+    /**
+     * Unbinds every variable and sizes the frame for a new call, reusing the existing storage.
+     * @param parent Frame of the call of the enclosing function, or the global frame for a top-level function.
+     * @param function The called function.
+     */
+    void reset(Environment* parent, const FunctionStmt* function, size_t slotCount) {
+        this->parent = parent;
+        this->function = function;
+        slots.assign(slotCount, Slot());
+    }
+
+    Environment* getParent() const { return parent; }
+    const FunctionStmt* getFunction() const { return function; }
+    // Every slot of the frame, for the BigIntHeap's collection
+    const std::vector<Slot>& getSlots() const { return slots; }
    
     /**
      * Defines or updates a variable in the environment.
-     * @param name The name of the variable.
+     * @param depth 0 for this frame, 1 for its parent, and so on.
+     * @param slot The slot of the variable within that frame.
      * @param value The value to be assigned to the variable.
      */
-    void define(const std::string& name, int value) {
-        values[name] = value;
+    void assign(size_t depth, size_t slot, Value value) {
+        frame(depth).slots[slot].value = value;
     }
 
     /**
-     * Retrieves the value of a variable from the environment. Searches in the current
-     * environment and up through parent environments if necessary.
-     * @param name The name of the variable to retrieve.
+     * Retrieves the value of a variable from the environment.
+     * @param depth 0 for this frame, 1 for its parent, and so on.
+     * @param slot The slot of the variable within that frame.
+     * @param name The name of the variable, used for the error message only.
      * @return The value of the variable.
-     * @throws std::runtime_error If the variable is not defined in the environment or any parent environment.
+     * @throws std::runtime_error If the variable has not been assigned yet.
      */
-    int get(const std::string& name) {
-        if (values.count(name)) {
-            return values[name];
-        } else if (parent != nullptr) {
-            return parent->get(name);
-        } else {
+    Value get(size_t depth, size_t slot, const std::string& name) {
+        const Slot& source = frame(depth).slots[slot];
+        if (!source.isBound()) {
             throw std::runtime_error("Variable '" + name + "' is not defined.");
         }
-        
+        return source.value;
     }
 
+    /**
+     * Direct access to a slot, for loops that write their induction variable on every iteration.
+     * The reference stays valid until this frame is reset or resized.
+     */
+    Slot& slotAt(size_t depth, size_t slot) {
+        return frame(depth).slots[slot];
+    }
 
-    void mergeChanges(const Environment& childEnv) {
-    // merge variables from childEnv back into this environment.
-        for (const auto& var : childEnv.values) {  
-            this->values[var.first] = var.second;
-        }
-}
-
-
-
-    void defineFunction(const std::string& name, std::shared_ptr<FunctionStmt> function);
-    std::shared_ptr<FunctionStmt> getFunction(const std::string& name);
-
+private:
+    Environment& frame(size_t depth) {
+        return depth == 0 ? *this : depth == 1 ? *parent : enclosingFrame(depth);
+    }
 
-};
\ No newline at end of file
+    Environment& enclosingFrame(size_t depth) {
+        Environment* found = this;
+        for (; depth > 0; --depth) found = found->parent;
+        return *found;
+    }
+};
@@ -4,12 +4,14 @@
  * 
  * This file contains the definitions of the Interpreter class methods. The Interpreter is responsible for
  * executing the abstract syntax tree (AST) by traversing it and performing the operations defined in each node.
- * It supports evaluating expressions, executing statements, and managing scoped execution blocks.
+ * It supports evaluating expressions, executing statements, and calling functions in their own frames.
  * 
  * Implementation Details:
  * - evaluateExpr(): Calls the `evaluate` method of expression nodes, passing the environment to resolve variables.
  * - executeStatement(): Delegates the execution to the `execute` method of statement nodes.
- * - executeBlock(): Iterates over a list of statements, executing each within a newly created scoped environment.
+ * - executeBlock(): Iterates over a list of statements, executing each within the given environment.
+ * - callFunction(): Binds the arguments to the first slots of a fresh function frame and runs the body. The
+ *   function comes from a FunctionBinding cached at the call site, so a call does not look its name up.
  * 
  * The Interpreter works closely with the Environment class to track variable states and supports basic arithmetic,
  * conditional logic, and variable assignment. This implementation ensures that expressions and statements are executed
@@ -21,72 +23,174 @@
 
 #include "Parser.hpp" 
 #include "Interpreter.hpp" 
+#include "Profiler.hpp"
+#include "Lazy.hpp"
 
 
-int Interpreter::evaluateExpr(const std::unique_ptr<Expr>& expr, Environment& env) {
+Value Interpreter::evaluateExpr(Expr* expr, Environment& env) {
     // Directly call the evaluate method on the expression, passing the current environment.
-    return expr->evaluate(env);
+    return expr->evaluate(*this, env);
 }
 
 
 
 
-void Interpreter::executeStatement(const std::unique_ptr<Stmt>& stmt, Environment& env) {
-    stmt->execute(*this, env); // Pass the current environment
+ExecStatus Interpreter::executeStatement(Stmt* stmt, Environment& env) {
+    return stmt->execute(*this, env); // Pass the current environment
 }
 
 
 
 
-void Interpreter::executeBlock(const std::vector<std::unique_ptr<Stmt>>& statements, Environment& environment) {
-    try {
-        for (const auto& stmt : statements) {
-            stmt->execute(*this, environment);
+ExecStatus Interpreter::executeBlock(const NodeList<Stmt*>& statements, Environment& environment) {
+    for (const auto& stmt : statements) {
+        ExecStatus status = stmt->execute(*this, environment);
+        if (status != ExecStatus::Normal) {
+            // Pass a return up to the caller, which is responsible for picking up the value
+            return status;
         }
-    } catch (const ReturnValue& returnValue) {
-        // If a ReturnValue is caught here, rethrow it to continue passing it up the call stack
-        throw;
     }
+    return ExecStatus::Normal;
 }
 
 
 
-int Interpreter::callFunction(const std::string& name, const std::vector<int>& arguments, Environment& currentEnv) {
-    auto functionStmt = currentEnv.getFunction(name);
-    if (!functionStmt) {
-        throw std::runtime_error("Function '" + name + "' is not defined.");
-    }
+namespace {
+
+// Tracks the call depth for the duration of one callFunction, including when the body throws
+class CallDepthGuard {
+public:
+    explicit CallDepthGuard(size_t& depth) : depth(depth) { ++depth; }
+    ~CallDepthGuard() { --depth; }
+private:
+    size_t& depth;
+};
 
-    // initialize the local environment with currentEnv as the parent
-    Environment localEnvironment(&currentEnv);
+} // namespace
 
-    const auto& parameters = functionStmt->getParameters();
-    if (arguments.size() != parameters.size()) {
-        throw std::runtime_error("Incorrect number of arguments provided to function '" + name + "'.");
+Environment* Interpreter::enclosingFrame(const std::string& name, const FunctionStmt& function, Environment& caller) {
+    const FunctionStmt* enclosing = function.getEnclosing();
+    // A nested function is only bound once its enclosing function runs, and can only be called from code
+    // that sees that call's frame: the enclosing function itself, or a function nested in it
+    for (Environment* frame = &caller; frame; frame = frame->getParent()) {
+        if (frame->getFunction() == enclosing) return frame;
     }
+    throw std::runtime_error("Function '" + name + "' is called outside the function that defines it.");
+}
 
-    for (size_t i = 0; i < arguments.size(); i++) {
-        localEnvironment.define(parameters[i], arguments[i]);
+Value Interpreter::callFunction(const std::string& name, const FunctionBinding& binding, size_t argumentBase,
+                                Environment& caller) {
+    if (callDepth >= recursionLimit || nativeStackLow(stackFloor)) {
+        throw RecursionError();
     }
+    if (callDepth == frames.size()) {
+        frames.push_back(std::make_unique<Environment>(&globalEnvironment));
+    }
+    // The function frame holds the parameters in its first slots followed by the locals; names that are
+    // not local resolve to the frame's parent: the enclosing function's frame, or the global environment.
+    Environment& localEnvironment = *frames[callDepth];
+    CallDepthGuard guard(callDepth);
+
+    const std::string* calleeName = &name;
+    const FunctionBinding* callee = &binding;
+    Environment* callerFrame = &caller;
+    size_t memoBase = memoPending.size();
+    Value result;
+    for (;;) {
+        FunctionStmt* functionStmt = callee->function;
+        if (!functionStmt) {
+            throw std::runtime_error("Function '" + *calleeName + "' is not defined.");
+        }
+
+        size_t argumentCount = argumentStack.size() - argumentBase;
+        if (argumentCount != callee->arity) {
+            throw std::runtime_error("Incorrect number of arguments provided to function '" + *calleeName + "'.");
+        }
+        if (functionStmt->isDeferred()) loadBody(*functionStmt);
+        Environment* parent = functionStmt->getEnclosing() ? enclosingFrame(*calleeName, *functionStmt, *callerFrame)
+                                                           : &globalEnvironment;
+        if (parent == &localEnvironment) {
+            // A tail call of a function nested in the returning one reads its frame, which must stay as it is
+            result = callFunction(*calleeName, *callee, argumentBase, localEnvironment);
+            break;
+        }
+
+        if (profiler) profiler->enter(*functionStmt);
+        if (memo && functionStmt->isPure() && MemoTable::canMemoize(argumentCount)) {
+            MemoTable::Key key = MemoTable::makeKey(functionStmt, &argumentStack[argumentBase], argumentCount);
+            if (memo->lookup(key, result)) {
+                argumentStack.resize(argumentBase);
+                if (profiler) profiler->exit();
+                break;
+            }
+            // Every call of a tail-call chain returns the final result, so the key is stored when the chain ends
+            memoPending.push_back(key);
+        }
 
-    try {
-        functionStmt->getBody()->execute(*this, localEnvironment);
-    } catch (const ReturnValue& returnValue) {
-        return returnValue.value;
+        localEnvironment.reset(parent, functionStmt, callee->slotCount);
+        for (size_t i = 0; i < argumentCount; i++) {
+            localEnvironment.assign(0, i, argumentStack[argumentBase + i]);
+        }
+        argumentStack.resize(argumentBase);
+
+        ExecStatus status = functionStmt->getBody()->execute(*this, localEnvironment);
+        if (profiler) profiler->exit(); // A tail call replaces this call rather than nesting in it
+        if (status == ExecStatus::TailCall) {
+            // Run the callee in this frame; its arguments were evaluated before the frame is reset
+            calleeName = tailCallName;
+            callee = tailCallBinding;
+            argumentBase = tailCallBase;
+            callerFrame = &localEnvironment;
+            continue;
+        }
+        // A body that runs to completion without a return statement returns 0
+        result = status == ExecStatus::Return ? returnValue : Value();
+        break;
     }
 
-    return 0;
+    for (size_t i = memoBase; i < memoPending.size(); i++) {
+        memo->store(memoPending[i], result);
+    }
+    memoPending.resize(memoBase);
+    return result;
 }
 
-void Interpreter::executeFunction(const std::unique_ptr<Stmt>& functionStmt, Environment& env) {
-    try {
-        functionStmt->execute(*this, env);
-    } catch (const ReturnValue& ret) {
+void Interpreter::executeFunction(Stmt* functionStmt, Environment& env) {
+    if (functionStmt->execute(*this, env) == ExecStatus::Return) {
         // Handle the returned value
-        std::cout << "Function returned: " << ret.value << std::endl;
+        output.stream() << "Function returned: " << returnValue << std::endl;
+    }
+}
+
+void Interpreter::markRoots(BigIntHeap& heap) {
+    auto markSlots = [&heap](const Environment& frame) {
+        for (const Environment::Slot& slot : frame.getSlots()) heap.mark(slot.value);
+    };
+    markSlots(globalEnvironment);
+    // Frames above the call depth are kept for reuse but hold values of calls that have returned
+    for (size_t i = 0; i < callDepth; i++) markSlots(*frames[i]);
+    for (Value value : argumentStack) heap.mark(value);
+    heap.mark(returnValue);
+    // A memo key holds its arguments by address, which must not be reused for another number
+    for (const MemoTable::Key& key : memoPending) {
+        for (size_t i = 0; i < key.argumentCount; i++) heap.mark(key.arguments[i]);
+    }
+    if (memo) memo->forEachValue([&heap](Value value) { heap.mark(value); });
+}
+
+void Interpreter::loadBody(FunctionStmt& function) {
+    if (!loader) {
+        throw std::logic_error("Function '" + function.getName() + "' was parsed lazily but no body loader is set.");
     }
+    loader->load(function);
+    // The binding is the one being called, so the frame below is sized with the resolved slot count
+    bindingFor(function.getSymbol()).slotCount = function.getSlotCount();
 }
 
-void Interpreter::defineFunction(const std::string& name, std::shared_ptr<FunctionStmt> functionStmt) {
-    globalEnvironment.defineFunction(name, functionStmt);
+void Interpreter::defineFunction(Symbol name, FunctionStmt* functionStmt) {
+    // Update the binding in place so call sites that cached it see the new function
+    FunctionBinding& binding = bindingFor(name);
+    binding.function = functionStmt;
+    binding.arity = functionStmt->getParameters().size();
+    binding.slotCount = functionStmt->getSlotCount();
 }
@@ -8,22 +8,66 @@
  * 
  * Key Features:
  * - interpret(): Begins the execution process by traversing the AST starting from the root node.
- * - evaluateExpr(): Evaluates expressions and returns their integer values.
+ * - evaluateExpr(): Evaluates expressions and returns their values (integers or strings, see Value.hpp).
  * - executeStatement(): Executes individual statements, including variable assignments and print operations.
- * - executeBlock(): Executes a series of statements in a new scope, allowing for local variable definitions.
+ * - executeBlock(): Executes a series of statements in the given environment.
  * 
  * The Interpreter class handles the execution of basic arithmetic operations, if-else conditional statements, and variable assignments.
- * It operates within a global environment but can create scoped environments for block execution, supporting local variables.
+ * It operates within a global environment and uses one frame per active function call for parameters and local variables,
+ * whose slots were assigned by the Resolver. Frames are kept in a pool indexed by call depth and reused, calls in tail
+ * position (`return f(...)`) reuse the caller's frame instead of nesting, and nesting deeper than the recursion limit,
+ * or a call that finds the native stack nearly used up, raises a RecursionError. When enabled, calls to pure functions are memoized in a bounded MemoTable, and a Profiler
+ * is told about every function call.
  * 
  * Usage:
  * The interpreter is designed to be used after parsing. Once an AST is obtained from the parser, the interpret() method
  * can be called to execute the program represented by the AST.
  */
 
+#pragma once
 #include <string>
+#include <deque>
+#include <stdexcept>
 #include "Env.hpp"
+#include "Arena.hpp"
+#include "Memo.hpp"
+#include "Output.hpp"
 #include "Utilities.hpp"
 
+class FunctionStmt;
+class Profiler;
+class BodyLoader;
+
+/**
+ * Raised when nested calls exceed the recursion limit, by both the Interpreter and the VM, or when the back ends that
+ * recurse natively run low on native stack.
+ */
+class RecursionError : public std::runtime_error {
+public:
+    RecursionError() : std::runtime_error("RecursionError: maximum recursion depth exceeded") {}
+};
+
+// Native stack kept free below the last call, for the nested blocks and expressions of its body and for the
+// error path
+static const size_t nativeStackReserve = 256 << 10;
+
+// Whether a call made from here would start within the reserve above `floor` (null: bounds unknown)
+inline bool nativeStackLow(const char* floor) {
+    char here;
+    return floor && &here < floor;
+}
+
+/**
+ * The function currently bound to a name. Bindings are created on first use and never move (they live in a
+ * deque indexed by the name's symbol ID), so a CallExpr can keep a pointer to one; `def` rebinds a name by
+ * updating its binding.
+ */
+struct FunctionBinding {
+    FunctionStmt* function = nullptr; // Null until a `def` for the name has executed
+    size_t arity = 0;
+    size_t slotCount = 0;
+};
+
 
 
 
@@ -32,16 +76,48 @@
  * and expressions of the AST (Abstract Syntax Tree).
  */
 
-class Interpreter {
+class Interpreter : private BigIntHeap::Roots {
     Environment globalEnvironment; // The global environment, serving as the outermost scope
+    Value returnValue; // Value of the last executed return statement
+    std::deque<FunctionBinding> functions; // Functions bound by `def` (owned by the Arena), by symbol ID
+    std::vector<Value> argumentStack; // Evaluated arguments of the calls in progress
+    std::vector<std::unique_ptr<Environment>> frames; // Function frames by call depth, reused across calls
+    size_t callDepth = 0;
+    size_t recursionLimit = 10000;
+    const char* stackFloor = nullptr; // Calls that start below it raise RecursionError (see nativeStackFloor)
+    // Callee of the pending tail call, set by requestTailCall and consumed by callFunction
+    const std::string* tailCallName = nullptr;
+    const FunctionBinding* tailCallBinding = nullptr;
+    size_t tailCallBase = 0;
+    std::unique_ptr<MemoTable> memo; // Results of calls to pure functions, null unless memoization is enabled
+    std::vector<MemoTable::Key> memoPending; // Keys of the pure calls in progress, filled in when they return
+    OutputWriter output; // Where print statements write
+    BigIntHeap bigInts; // Integers computed beyond 63 bits
+    Profiler* profiler = nullptr; // Receives every function call when profiling, null otherwise
+    BodyLoader* loader = nullptr; // Parses deferred function bodies on their first call, if there are any
+
+    // Parses a deferred body through the loader and updates the slot count of the function's binding
+    void loadBody(FunctionStmt& function);
+    // The numbers of every frame in use, the arguments and the memo table, for a collection of `bigInts`
+    void markRoots(BigIntHeap& heap) override;
+    // Parent of the frame of a call of the nested function `function` made from `caller` (see Env.hpp)
+    Environment* enclosingFrame(const std::string& name, const FunctionStmt& function, Environment& caller);
 
 public:
 
-    Interpreter() : globalEnvironment() {}
+    Interpreter() : globalEnvironment(), bigInts(this) {}
 
    
-    void interpret(std::unique_ptr<ASTNode> root) {
+    /**
+     * Executes a resolved program.
+     * @param root The root of the AST, already processed by the Resolver.
+     * @param globalSlotCount The number of global variable slots reported by the Resolver.
+     */
+    void interpret(ASTNode* root, size_t globalSlotCount) {
         if (!root) return; // Early return if the AST is empty
+        globalEnvironment.resize(globalSlotCount);
+        stackFloor = nativeStackFloor(nativeStackReserve);
+        FlushOnExit flushOutput(output);
 
         // virtual method like execute or evaluate overridden by derived classes. 
         //The interpret method does not need to know the specific type of the AST node.
@@ -52,26 +128,84 @@ public:
      * Evaluates an expression within a given environment.
      * @param expr The expression to evaluate.
      * @param env The environment within which the expression is evaluated.
-     * @return The result of the expression evaluation as an integer.
+     * @return The result of the expression evaluation.
      */
-    int evaluateExpr(const std::unique_ptr<Expr>& expr, Environment& env);
+    Value evaluateExpr(Expr* expr, Environment& env);
 
     /**
      * Executes a statement within a given environment.
      * @param stmt The statement to execute.
      * @param env The environment within which the statement is executed.
      */
-    void executeStatement(const std::unique_ptr<Stmt>& stmt, Environment& env);
+    ExecStatus executeStatement(Stmt* stmt, Environment& env);
 
      /**
-     * Executes a block of statements, creating a new scope for the block.
+     * Executes a block of statements. Blocks share the frame of the enclosing function.
      * @param statements The statements within the block to execute.
-     * @param environment Scoped environment for the block.
+     * @param environment Environment of the enclosing function or the global environment.
+     * @return ExecStatus::Return if a return statement ended the block early.
      */   
-    void executeBlock(const std::vector<std::unique_ptr<Stmt>>& statements, Environment& environment);
+    ExecStatus executeBlock(const NodeList<Stmt*>& statements, Environment& environment);
     
 
-    int callFunction(const std::string& name, const std::vector<int>& arguments,Environment& currentEnv);
-    void executeFunction(const std::unique_ptr<Stmt>& functionStmt, Environment& env);
-    void defineFunction(const std::string& name, std::shared_ptr<FunctionStmt> functionStmt);
+    /**
+     * Calls the function bound to a name with the arguments on top of the argument stack.
+     * @param name The called name, for error messages.
+     * @param binding The binding of `name`, as returned by bindingFor().
+     * @param argumentBase Index of the first argument on the argument stack; the arguments are popped.
+     * @param caller Frame of the call, through which a nested function finds the frame of its enclosing one.
+     * @throws std::runtime_error If the name is not bound, the number of arguments does not match or a nested
+     *                            function is called where no call of its enclosing function is visible.
+     */
+    Value callFunction(const std::string& name, const FunctionBinding& binding, size_t argumentBase,
+                       Environment& caller);
+
+    // Returns the binding for a name, creating an unbound one if no `def` has run for it yet.
+    FunctionBinding& bindingFor(Symbol name) {
+        // Growing a deque at the end keeps every existing binding where it is
+        if (name.id() >= functions.size()) functions.resize(name.id() + 1);
+        return functions[name.id()];
+    }
+    std::vector<Value>& getArgumentStack() { return argumentStack; }
+
+    /**
+     * Records a call in tail position; the statement then reports ExecStatus::TailCall and callFunction runs
+     * the callee in the frame of the returning function instead of nesting a new call.
+     */
+    ExecStatus requestTailCall(const std::string& name, const FunctionBinding& binding, size_t argumentBase) {
+        tailCallName = &name;
+        tailCallBinding = &binding;
+        tailCallBase = argumentBase;
+        return ExecStatus::TailCall;
+    }
+
+    /**
+     * Memoizes calls to functions marked pure by the PurityAnalysis from now on.
+     * @param capacity Number of entries of the bounded memo table.
+     */
+    void enableMemoization(size_t capacity = 1 << 16) { memo = std::make_unique<MemoTable>(capacity); }
+    const MemoTable* getMemoTable() const { return memo.get(); }
+
+    // Maximum number of nested (non-tail) calls before a RecursionError is raised.
+    void setRecursionLimit(size_t limit) { recursionLimit = limit; }
+    size_t getRecursionLimit() const { return recursionLimit; }
+
+    // Reports every run of a function body to `profiler` (see Profiler.hpp), or stops reporting when null.
+    void setProfiler(Profiler* value) { profiler = value; }
+
+    // Loads the bodies the parser deferred (see Lazy.hpp). Needed to call them; must outlive the run.
+    void setBodyLoader(BodyLoader* value) { loader = value; }
+
+    // Stream the program's print statements write to, std::cout by default. Must outlive the run.
+    void setOutput(std::ostream& stream) { output.setTarget(stream); }
+    OutputWriter& getOutput() { return output; }
+    // Heap of the big integers the run computes (see BigInt.hpp)
+    BigIntHeap& getBigInts() { return bigInts; }
+    void executeFunction(Stmt* functionStmt, Environment& env);
+    void defineFunction(Symbol name, FunctionStmt* functionStmt);
+
+    /**
+     * Records the value of a return statement; the statement then reports ExecStatus::Return.
+     */
+    void setReturnValue(Value value) { returnValue = value; }
 };
@@ -0,0 +1,24 @@
+/**
+ * @file lazy.cpp
+ * @brief Implementation of the BodyLoader.
+ */
+
+#include "Lazy.hpp"
+#include "Optimizer.hpp"
+
+void BodyLoader::load(FunctionStmt& function) {
+    const DeferredBody& range = function.getDeferredBody();
+    Lexer lexer(source, range.end, range.begin, range.line);
+    Parser parser(lexer, arena, strings, symbols);
+    parser.setDiagnostics(*diagnostics);
+    parser.setLazyFunctions(true);
+    Stmt* body = parser.parseDeferredBody();
+
+    function.setBody(body);
+    resolver.resolveDeferred(function);
+    if (optimizationLevel >= 1) {
+        Optimizer optimizer(arena);
+        optimizer.optimize(*body);
+    }
+    loaded++;
+}
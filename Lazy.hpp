@@ -0,0 +1,65 @@
+/**
+ * @file lazy.hpp
+ * @brief Parses the function bodies the Parser deferred (`mypython --lazy`) when the functions are first called.
+ *
+ * A module that defines hundreds of functions and calls a handful of them spends most of its startup building,
+ * resolving and optimizing trees that never run. With `Parser::setLazyFunctions(true)` the parser only records
+ * where each `def` body is in the source (a DeferredBody), and the Interpreter hands a deferred function to this
+ * loader on its first call, before binding the arguments. The loader then does for that one body what runProgram
+ * did for the rest of the program:
+ * - A Lexer over the body's range re-tokenizes it (tokens keep their offsets and lines in the whole source).
+ * - A Parser sharing the program's Arena, StringTable and SymbolTable builds the body, deferring nested defs in
+ *   turn, so a string literal is the same Value and a name the same Symbol wherever they are parsed.
+ * - The program's Resolver binds its variables without adding global slots (see Resolver::resolveDeferred).
+ * - At -O1 the Optimizer folds it.
+ * Startup time and memory then grow with the code that actually runs. A body is loaded once; later calls, and
+ * later executions of the same `def`, use the parsed tree.
+ *
+ * Only the tree-walker loads bodies on demand. The VM, the closure back end, the AST cache, --memo and --profile
+ * need every body up front, so runProgram does not defer bodies when any of them is used.
+ *
+ * The source buffer, the Arena, the two tables and the Resolver must outlive the run.
+ *
+ * Usage:
+ *   parser.setLazyFunctions(true);
+ *   Stmt* ast = parser.parse();
+ *   resolver.resolve(*ast);
+ *   BodyLoader loader(source, arena, parser.getStrings(), parser.getSymbols(), resolver, optimizationLevel);
+ *   interpreter.setBodyLoader(&loader);
+ *   interpreter.interpret(ast, resolver.getGlobals().size());
+ */
+
+#pragma once
+#include "Parser.hpp"
+#include "Resolver.hpp"
+#include <iostream>
+
+class BodyLoader {
+public:
+    BodyLoader(const char* source, Arena& arena, StringTable& strings, SymbolTable& symbols, Resolver& resolver,
+               int optimizationLevel)
+        : source(source), arena(arena), strings(strings), symbols(symbols), resolver(resolver),
+          optimizationLevel(optimizationLevel) {}
+
+    /**
+     * Parses, resolves and optimizes the body of a deferred function and stores it in the function.
+     * @throws std::runtime_error On a syntax error in the body, which ends the run like any runtime error.
+     */
+    void load(FunctionStmt& function);
+
+    // Stream for the errors the body's parser recovers from, std::cerr by default
+    void setDiagnostics(std::ostream& stream) { diagnostics = &stream; }
+
+    // Number of bodies loaded so far
+    size_t getLoadedCount() const { return loaded; }
+
+private:
+    const char* source;
+    Arena& arena;
+    StringTable& strings;
+    SymbolTable& symbols;
+    Resolver& resolver;
+    int optimizationLevel;
+    std::ostream* diagnostics = &std::cerr;
+    size_t loaded = 0;
+};
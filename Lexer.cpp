@@ -7,7 +7,9 @@
  * basic arithmetic operators, parentheses, identifiers, literals, and keywords.
  * 
  * Key Methods:
- * - tokenize(): Processes the entire source string and converts it into tokens.
+ * - nextToken(): Scans just far enough to return the next token. The Parser pulls tokens one at a time, so the
+ *   token stream is never materialized.
+ * - tokenize(): Convenience wrapper that collects every token into a vector.
  * - scanToken(): Determines the type of the next token and calls the appropriate handler.
  * 
  * Special Handling:
@@ -17,80 +19,219 @@
  * - Equal/Not Equal: Recognizes '==' and '!=' as comparison operators.
  * - Numbers and Identifiers: Distinguishes between numeric literals and identifiers (which may include numbers as part of their name).
  * 
+ * - Tokens: Each token stores the offset and length of its lexeme instead of a copy of it, and integer literals are
+ *   decoded here, so the only allocations while tokenizing are the growth of the token vector itself.
+ * - Positions: The line number and the offset of the current line are updated on every newline (including those
+ *   inside string literals), so the line and column of a token cost nothing extra to compute.
+ * 
  * Error Handling:
  * - Unterminated strings: Throws a runtime_error exception if a string literal is not properly closed before the end of the source.
+ *   It is thrown as a LexError so that the parser's statement-level recovery does not swallow it.
+ * - Integer literals beyond an inline integer are not an error: the token's value is Token::bigInteger, and the parser
+ *   turns its digits into a BigInt constant.
  */
 
 #include "Lexer.hpp"
+#include "Value.hpp"
 #include <iostream>
-#include <unordered_map>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__SSE2__) && defined(__GNUC__) && !defined(MYPYTHON_SCALAR_LEXER)
+#define MYPYTHON_VECTOR_SCAN 1
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// Byte classes the Lexer skips runs of. Alnum is isalnum() in the "C" locale, which the interpreter never
+// changes; bytes of 0x80 and above are in no class.
+enum class ByteClass { Space, Digit, Alnum };
+
+template<ByteClass type>
+inline bool inClass(char c) {
+    switch (type) {
+        case ByteClass::Space: return c == ' ';
+        case ByteClass::Digit: return c >= '0' && c <= '9';
+        case ByteClass::Alnum: return (c >= '0' && c <= '9') || ((c | 0x20) >= 'a' && (c | 0x20) <= 'z');
+    }
+    return false;
+}
+
+#ifdef MYPYTHON_VECTOR_SCAN
+// Signed byte compares: bytes of 0x80 and above are negative and fall outside every range
+inline __m128i inRange(__m128i bytes, char low, char high) {
+    return _mm_and_si128(_mm_cmpgt_epi8(bytes, _mm_set1_epi8(static_cast<char>(low - 1))),
+                         _mm_cmplt_epi8(bytes, _mm_set1_epi8(static_cast<char>(high + 1))));
+}
+
+// Bit i is set if byte i of the chunk is in the class
+template<ByteClass type>
+inline unsigned classMask(__m128i bytes) {
+    switch (type) {
+        case ByteClass::Space:
+            return _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(' ')));
+        case ByteClass::Digit:
+            return _mm_movemask_epi8(inRange(bytes, '0', '9'));
+        case ByteClass::Alnum: {
+            __m128i letters = inRange(_mm_or_si128(bytes, _mm_set1_epi8(0x20)), 'a', 'z');
+            return _mm_movemask_epi8(_mm_or_si128(letters, inRange(bytes, '0', '9')));
+        }
+    }
+    return 0;
+}
+#endif
+
+// Index of the first byte at or after `index` that is not in the class, or `length` if there is none
+template<ByteClass type>
+inline size_t skipRun(const char* text, size_t index, size_t length, bool vectorScan) {
+#ifdef MYPYTHON_VECTOR_SCAN
+    if (vectorScan) {
+        // Whole chunks only, so no load reaches past the end of the buffer
+        while (index + 16 <= length) {
+            __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + index));
+            unsigned outside = ~classMask<type>(bytes) & 0xFFFF;
+            if (outside) return index + __builtin_ctz(outside);
+            index += 16;
+        }
+    }
+#else
+    (void)vectorScan;
+#endif
+    while (index < length && inClass<type>(text[index])) index++;
+    return index;
+}
+
+} // namespace
+
+bool Token::is(const char* source, const char* text) const {
+    return std::strlen(text) == length && std::memcmp(source + offset, text, length) == 0;
+}
+
+std::string Token::text(const char* source) const {
+    switch (type) {
+        // Synthesized tokens have no text in the source
+        case TokenType::INDENT: return "    ";
+        case TokenType::DEDENT: return "";
+        case TokenType::END_OF_FILE: return "eof";
+        // Two-character operators are recognized by position only (see tokenizeEqual), so spell them out
+        case TokenType::EQUAL: return "==";
+        case TokenType::NOT_EQUAL: return "!=";
+        case TokenType::GREATER_EQUAL: return ">=";
+        case TokenType::LESS_EQUAL: return "<=";
+        default: return std::string(source + offset, length);
+    }
+}
 
-Lexer::Lexer(const std::string& source) : source(source) {
+Lexer::Lexer(const char* source, size_t length) : source(source), length(length) {
     indentStack.push(0); // Initial indentation level is zero
 }
 
-    std::vector<Token> Lexer::tokenize() {
-        while (!isAtEnd()) {
-            start = current; // We are at the beginning of the next lexeme
-            scanToken();
+Lexer::Lexer(const std::string& source) : Lexer(source.data(), source.size()) {}
 
-        }
+bool Lexer::hasVectorScan() {
+#ifdef MYPYTHON_VECTOR_SCAN
+    return true;
+#else
+    return false;
+#endif
+}
 
-        //new while statement for indentation levels
-        while (!indentStack.empty() && indentStack.top() != 0) {
-        indentStack.pop();
-        tokens.push_back(Token(TokenType::DEDENT, ""));
-        
+Lexer::Lexer(const char* source, size_t length, size_t offset, int line)
+    : source(source), length(length), start(offset), current(offset), lineStart(offset), line(line) {
+    indentStack.push(0);
+}
+
+    Token Lexer::nextToken() {
+        // scanToken() may produce no token (whitespace, comments) or several (one DEDENT per closed
+        // block), so keep scanning until something is pending.
+        while (pendingHead == pending.size()) {
+            pending.clear();
+            pendingHead = 0;
+            if (isAtEnd()) {
+                //new while statement for indentation levels
+                while (!indentStack.empty() && indentStack.top() != 0) {
+                    indentStack.pop();
+                    addToken(TokenType::DEDENT, current, 0);
+                }
+                addToken(TokenType::END_OF_FILE, current, 0); // Returned again on every further call
+                break;
+            }
+            start = current; // We are at the beginning of the next lexeme
+            scanToken();
         }
+        return pending[pendingHead++];
+    }
 
-        tokens.push_back(Token(TokenType::END_OF_FILE, "eof"));
+    std::vector<Token> Lexer::tokenize() {
+        std::vector<Token> tokens;
+        do {
+            tokens.push_back(nextToken());
+        } while (tokens.back().type != TokenType::END_OF_FILE);
         return tokens;
     }
 
-    void Lexer::addToken(TokenType type, const std::string& text) {
-        tokens.push_back(Token(type, text));
+    void Lexer::addToken(TokenType type) {
+        addToken(type, start, current - start);
+    }
+
+    void Lexer::addToken(TokenType type, size_t offset, size_t length, int64_t value) {
+        int column = static_cast<int>(offset - lineStart) + 1;
+        pending.push_back(Token(type, offset, length, value, line, column));
     }
 
     bool Lexer::isAtEnd() const {
-        return current >= source.length();
+        return current >= length;
     }
 
     char Lexer::advance() {
-        return source[current++];
+        return charAt(current++);
         
     }
 
+    // Bounds-checked access: the buffer may be a memory-mapped file without a terminating NUL
+    char Lexer::charAt(size_t index) const {
+        return index < length ? source[index] : '\0';
+    }
+
     void Lexer::scanToken() {
     char c = advance();
     switch (c) {
         case '\n':
+            line++;
+            lineStart = current;
             checkIndentation();
             
             break;
-        case '+': addToken(TokenType::PLUS, "+"); break;
-        case '-': addToken(TokenType::MINUS, "-"); break;
-        case '*': addToken(TokenType::MUL, "*"); break;
-        case '/': addToken(TokenType::DIV, "/"); break;
-        case '(': addToken(TokenType::LPAREN, "("); break;
-        case ')': addToken(TokenType::RPAREN, ")"); break;
-        case ',': addToken(TokenType::COMMA, ","); break;
-        case ':': addToken(TokenType::COLON, ":"); break;
+        case '+': addToken(TokenType::PLUS); break;
+        case '-': addToken(TokenType::MINUS); break;
+        case '*': addToken(TokenType::MUL); break;
+        case '/': addToken(TokenType::DIV); break;
+        case '(': addToken(TokenType::LPAREN); break;
+        case ')': addToken(TokenType::RPAREN); break;
+        case ',': addToken(TokenType::COMMA); break;
+        case ':': addToken(TokenType::COLON); break;
         case '>': tokenizeGreater(); break;
         case '<': tokenizeLess(); break;
         case '!': tokenizeNotEqual(); break;
         case '=': tokenizeEqual(); break;
         case '"': tokenizeString(); break; // double quotes for strings
-        case '#':
-            // Handle comment 
-            while(peek() != '\n' && !isAtEnd()) advance(); // Skip to end of line
+        case ' ':
+            current = skipRun<ByteClass::Space>(source, current, length, vectorScan); // The rest of the run
             break;
+        case '#': {
+            // Handle comment: skip to the end of the line, leaving the newline to be scanned
+            const void* newline = std::memchr(source + current, '\n', length - current);
+            current = newline ? static_cast<const char*>(newline) - source : length;
+            break;
+        }
         default:
             if (isdigit(c)) {
                 tokenizeNumber();
             } else if (isalpha(c)) {
                 tokenizeIdentifier();
             } else if (!isspace(c)) {
-                addToken(TokenType::UNKNOWN, std::string(1, c));
+                addToken(TokenType::UNKNOWN);
                 //maybe this should be reported as an error instead?
             }
             break;
@@ -104,12 +245,14 @@ void Lexer::checkIndentation() {
     }
 
     int currentIndentation = 0;
-    while (isspace(peek()) && peek() != '\n') {
-        if (peek() == '\t') {
-            currentIndentation += 4;
-        } else if (peek() == ' ') {
-            currentIndentation += 1;
-        }
+    for (;;) {
+        // Spaces count one each and come in runs; tabs count four and other whitespace nothing
+        size_t end = skipRun<ByteClass::Space>(source, current, length, vectorScan);
+        currentIndentation += static_cast<int>(end - current);
+        current = end;
+        char c = peek();
+        if (!isspace(c) || c == '\n') break;
+        if (c == '\t') currentIndentation += 4;
         advance();
     }
 
@@ -119,11 +262,11 @@ void Lexer::checkIndentation() {
 
         if (currentIndentation > currentIndent) {
             indentStack.push(currentIndentation);
-            addToken(TokenType::INDENT, "    ");
+            addToken(TokenType::INDENT, current, 0);
         } else if (currentIndentation < currentIndent) {
             while (!indentStack.empty() && indentStack.top() > currentIndentation) {
                 indentStack.pop();
-                addToken(TokenType::DEDENT, "");
+                addToken(TokenType::DEDENT, current, 0);
             }
         }
     }
@@ -132,24 +275,24 @@ void Lexer::checkIndentation() {
 
 void Lexer::tokenizeGreater(){
     size_t lookahead = current +1 ;
-    if(source[lookahead]==' '){
-        addToken(TokenType::GREATER_EQUAL, ">=");
+    if(charAt(lookahead)==' '){
+        addToken(TokenType::GREATER_EQUAL, start, 2);
         advance();
     }
-    else{addToken(TokenType::GREATER, ">");}
+    else{addToken(TokenType::GREATER);}
 }
 void Lexer::tokenizeLess(){
     size_t lookahead = current +1 ;
-    if(source[lookahead]==' '){
-        addToken(TokenType::LESS_EQUAL, "<=");
+    if(charAt(lookahead)==' '){
+        addToken(TokenType::LESS_EQUAL, start, 2);
         advance();
     }
-    else{addToken(TokenType::LESS, "<");}
+    else{addToken(TokenType::LESS);}
 }
 void Lexer::tokenizeNotEqual(){
     size_t lookahead = current +1 ;
-    if(source[lookahead]==' '){
-        addToken(TokenType::NOT_EQUAL, "!=");
+    if(charAt(lookahead)==' '){
+        addToken(TokenType::NOT_EQUAL, start, 2);
         advance();
     }
 }
@@ -157,53 +300,70 @@ void Lexer::tokenizeNotEqual(){
 
 void Lexer::tokenizeEqual() {
     size_t lookahead = current + 1;
-    if (source[lookahead] == ' ') {
-        addToken(TokenType::EQUAL, "==");
+    if (charAt(lookahead) == ' ') {
+        addToken(TokenType::EQUAL, start, 2);
         advance(); // Consume the second '='
     } else {
-        addToken(TokenType::ASSIGN, "=");
+        addToken(TokenType::ASSIGN);
     }
 }
 
 void Lexer::tokenizeNumber() {
-    while (isdigit(peek())) advance(); // Consume digits
+    current = skipRun<ByteClass::Digit>(source, current, length, vectorScan); // Consume digits
     
     // Lookahead to see if next non-space character is alphabetic (invalid number token)
     size_t lookahead = current;
-    while (!isspace(source[lookahead])) lookahead++;
-    if (isalpha(source[lookahead])) {
+    while (lookahead < length && !isspace(source[lookahead])) lookahead++;
+    if (isalpha(charAt(lookahead))) {
         // It's not a valid number; treat as an identifier
         current = lookahead; // Move current to where lookahead stopped
         tokenizeIdentifier(); // handle as identifier
         return;
     }
 
-    // It's a valid number; capture it
-    std::string number = source.substr(start, current - start);
-    addToken(TokenType::INTEGER, number);
+    // It's a valid number; decode it now so the parser never has to look at the digits again, unless it is
+    // beyond an inline integer (63 bits), which the parser turns into a BigInt constant
+    int64_t number = 0;
+    for (size_t i = start; i < current; i++) {
+        int digit = source[i] - '0';
+        if (number > (Value::inlineMax - digit) / 10) {
+            number = Token::bigInteger;
+            break;
+        }
+        number = number * 10 + digit;
+    }
+    addToken(TokenType::INTEGER, start, current - start, number);
 }
 
-void Lexer::tokenizeIdentifier() {
-    while (isalnum(peek())) advance(); // Consume alphanumeric characters
-
-    std::string text = source.substr(start, current - start);
+// Keywords are matched on the slice directly instead of building a std::string for every identifier
+static TokenType keywordType(const char* text, size_t length) {
+    switch (length) {
+        case 2:
+            if (std::memcmp(text, "if", 2) == 0) return TokenType::IF;
+            if (std::memcmp(text, "in", 2) == 0) return TokenType::IN;
+            break;
+        case 3:
+            if (std::memcmp(text, "def", 3) == 0) return TokenType::DEF;
+            if (std::memcmp(text, "for", 3) == 0) return TokenType::FOR;
+            break;
+        case 4:
+            if (std::memcmp(text, "else", 4) == 0) return TokenType::ELSE;
+            break;
+        case 5:
+            if (std::memcmp(text, "print", 5) == 0) return TokenType::PRINT;
+            if (std::memcmp(text, "while", 5) == 0) return TokenType::WHILE;
+            break;
+        case 6:
+            if (std::memcmp(text, "return", 6) == 0) return TokenType::RETURN;
+            break;
+    }
+    return TokenType::IDENTIFIER;
+}
 
-    // Keywords map
-    static const std::unordered_map<std::string, TokenType> keywords = {
-        {"print", TokenType::PRINT},
-        {"if", TokenType::IF},
-        {"else", TokenType::ELSE},
-        {"def", TokenType::DEF},
-        {"return", TokenType::RETURN},
-    
-    };
+void Lexer::tokenizeIdentifier() {
+    current = skipRun<ByteClass::Alnum>(source, current, length, vectorScan); // Consume alphanumeric characters
 
-    auto keyword = keywords.find(text);
-    if (keyword != keywords.end()) {
-        addToken(keyword->second, text);
-    } else {
-        addToken(TokenType::IDENTIFIER, text);
-    }
+    addToken(keywordType(source + start, current - start));
 }
 
 void Lexer::tokenizeString() {
@@ -211,19 +371,21 @@ void Lexer::tokenizeString() {
         if (peek() == '\\') { // Check for escape character
             advance(); // Skip the escape character
         }
-        advance(); // Move to next character
+        if (advance() == '\n') { // Strings may span lines
+            line++;
+            lineStart = current;
+        }
     }
 
     if (isAtEnd()) {
-        throw std::runtime_error("Unterminated string.");
+        throw LexError("Unterminated string.");
     }
 
     // Consume the closing "
     advance();
 
     // Trim the surrounding quotes
-    std::string value = source.substr(start + 1, current - start - 2);
-    addToken(TokenType::STRING, value);
+    addToken(TokenType::STRING, start + 1, current - start - 2);
 }
 
 
@@ -234,7 +396,7 @@ char Lexer::peek() const {
 
 
 char Lexer::peekNext() const {
-    if (current + 1 >= source.size()) return '\0';
+    if (current + 1 >= length) return '\0';
     return source[current + 1];
 }
 
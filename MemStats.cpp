@@ -0,0 +1,177 @@
+/**
+ * @file memstats.cpp
+ * @brief The replaced global operator new and delete, and the per-phase counters they feed.
+ */
+
+#include "MemStats.hpp"
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <sys/resource.h>
+#include <unistd.h>
+
+namespace {
+
+const size_t phaseCount = static_cast<size_t>(MemStats::Phase::Count);
+
+// Zero-initialised before any constructor runs, as the operators are called before main and after it returns
+struct AtomicCounters {
+    std::atomic<uint64_t> allocations;
+    std::atomic<uint64_t> bytes;
+    std::atomic<uint64_t> deallocations;
+};
+
+AtomicCounters phaseCounters[phaseCount];
+uint64_t phaseResident[phaseCount];
+std::atomic<bool> counting(false);
+std::atomic<size_t> currentPhase(0);
+
+void countAllocation(size_t size) {
+    if (!counting.load(std::memory_order_relaxed)) return;
+    AtomicCounters& counters = phaseCounters[currentPhase.load(std::memory_order_relaxed)];
+    counters.allocations.fetch_add(1, std::memory_order_relaxed);
+    counters.bytes.fetch_add(size, std::memory_order_relaxed);
+}
+
+void countDeallocation() {
+    if (!counting.load(std::memory_order_relaxed)) return;
+    phaseCounters[currentPhase.load(std::memory_order_relaxed)].deallocations.fetch_add(1,
+                                                                                      std::memory_order_relaxed);
+}
+
+void* allocate(size_t size) {
+    if (size == 0) size = 1;
+    for (;;) {
+        void* pointer = std::malloc(size);
+        if (pointer != nullptr) {
+            countAllocation(size);
+            return pointer;
+        }
+        std::new_handler handler = std::get_new_handler();
+        if (handler == nullptr) throw std::bad_alloc();
+        handler();
+    }
+}
+
+void* allocateNothrow(size_t size) noexcept {
+    try {
+        return allocate(size);
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void deallocate(void* pointer) noexcept {
+    if (pointer != nullptr) countDeallocation();
+    std::free(pointer);
+}
+
+// Ends the current phase: samples the RSS it ended with
+void endPhase() {
+    phaseResident[currentPhase.load(std::memory_order_relaxed)] = MemStats::residentBytes();
+}
+
+} // namespace
+
+void* operator new(size_t size) { return allocate(size); }
+void* operator new[](size_t size) { return allocate(size); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return allocateNothrow(size); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return allocateNothrow(size); }
+void operator delete(void* pointer) noexcept { deallocate(pointer); }
+void operator delete[](void* pointer) noexcept { deallocate(pointer); }
+void operator delete(void* pointer, const std::nothrow_t&) noexcept { deallocate(pointer); }
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept { deallocate(pointer); }
+void operator delete(void* pointer, size_t) noexcept { deallocate(pointer); }
+void operator delete[](void* pointer, size_t) noexcept { deallocate(pointer); }
+
+namespace MemStats {
+
+void start(Phase phase) {
+    counting.store(false);
+    for (size_t i = 0; i < phaseCount; ++i) {
+        phaseCounters[i].allocations.store(0);
+        phaseCounters[i].bytes.store(0);
+        phaseCounters[i].deallocations.store(0);
+        phaseResident[i] = 0;
+    }
+    currentPhase.store(static_cast<size_t>(phase));
+    counting.store(true);
+}
+
+void enter(Phase phase) {
+    if (!counting.load()) return;
+    endPhase();
+    currentPhase.store(static_cast<size_t>(phase));
+}
+
+void stop() {
+    if (!counting.load()) return;
+    endPhase();
+    counting.store(false);
+}
+
+bool isCounting() { return counting.load(std::memory_order_relaxed); }
+
+void countBlock(size_t bytes) { countAllocation(bytes); }
+
+void countBlockRelease() { countDeallocation(); }
+
+PhaseCounters counters(Phase phase) {
+    size_t i = static_cast<size_t>(phase);
+    PhaseCounters result;
+    result.allocations = phaseCounters[i].allocations.load();
+    result.bytes = phaseCounters[i].bytes.load();
+    result.deallocations = phaseCounters[i].deallocations.load();
+    result.residentBytes = phaseResident[i];
+    return result;
+}
+
+const char* name(Phase phase) {
+    switch (phase) {
+    case Phase::Parse:
+        return "parse";
+    case Phase::Resolve:
+        return "resolve";
+    case Phase::Compile:
+        return "compile";
+    case Phase::Execute:
+        return "execute";
+    default:
+        return "?";
+    }
+}
+
+uint64_t residentBytes() {
+    // statm's second field is the resident set in pages; read without iostreams so it allocates nothing
+    std::FILE* file = std::fopen("/proc/self/statm", "r");
+    if (file == nullptr) return 0;
+    unsigned long long size = 0, resident = 0;
+    int fields = std::fscanf(file, "%llu %llu", &size, &resident);
+    std::fclose(file);
+    if (fields != 2) return 0;
+    long pageSize = ::sysconf(_SC_PAGESIZE);
+    return resident * static_cast<uint64_t>(pageSize > 0 ? pageSize : 4096);
+}
+
+uint64_t peakResidentBytes() {
+    struct rusage usage;
+    if (::getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+    return static_cast<uint64_t>(usage.ru_maxrss) * 1024; // Kilobytes on Linux
+}
+
+void report(std::ostream& out) {
+    // The kernel updates ru_maxrss lazily; a sample taken at the end of a phase can be above it
+    uint64_t peak = peakResidentBytes();
+    for (size_t i = 0; i < phaseCount; ++i) {
+        Phase phase = static_cast<Phase>(i);
+        PhaseCounters phaseCounters = counters(phase);
+        if (phaseCounters.allocations == 0 && phaseCounters.deallocations == 0) continue;
+        out << "mem: " << name(phase) << " allocs=" << phaseCounters.allocations << " bytes=" << phaseCounters.bytes
+            << " frees=" << phaseCounters.deallocations << " rss_kb=" << phaseCounters.residentBytes / 1024 << "\n";
+        if (phaseCounters.residentBytes > peak) peak = phaseCounters.residentBytes;
+    }
+    out << "mem: peak_rss_kb=" << peak / 1024 << "\n";
+}
+
+} // namespace MemStats
@@ -0,0 +1,72 @@
+/**
+ * @file memstats.hpp
+ * @brief Allocation counters and resident set sizes per phase of a run (`mypython --mem-stats`).
+ *
+ * The global operator new and delete are replaced (in MemStats.cpp) by versions that call malloc and free and,
+ * while counting is on, add every allocation and its size, and every deallocation, to the counters of the current
+ * phase. The one allocator that goes to malloc directly, the Arena (which holds the tree and, in an Arena of its
+ * own, the cells of the big integer heap), reports its blocks through countBlock and countBlockRelease, so they
+ * are counted in the phase that allocated them too. runProgram moves through the phases as it goes:
+ * - parse: the Lexer and the Parser building the tree, or loading it from the AstCache. Tokens are pulled one at a
+ *   time and never stored, so what is counted here is the tree's Arena blocks, the interned names and strings.
+ * - resolve: the Resolver's scopes, the Optimizer and storing the cache entry.
+ * - compile: the bytecode or closure compiler, or the purity analysis and profiler of the tree-walker.
+ * - execute: running the program: the Interpreter's pooled frames and argument stack, the VM's stacks, the big
+ *   integer heap, and the teardown of what the earlier phases built (the Arena is reported separately).
+ * At the end of each phase the resident set size is sampled; the report adds the peak RSS of the process.
+ *
+ * Counting is off unless start() was called; the replaced operators then cost one relaxed atomic load and a
+ * predictable branch more than malloc and free. They are linked into every build, as a replacement of operator
+ * new cannot be chosen at run time; on the parse-heavy workloads of bench/workload.sh (64000 defs or
+ * assignments) and on bench/dispatch.py the difference against a build without them was below the run-to-run
+ * noise of about 1%. The counters are process-wide, so only one run may be measured at a time (--mem-stats is not
+ * available with --serve or --jobs), and allocations of other threads during the run count too.
+ *
+ * Usage:
+ *   MemStats::start(MemStats::Phase::Parse);
+ *   ...
+ *   MemStats::enter(MemStats::Phase::Resolve);
+ *   ...
+ *   MemStats::stop();
+ *   MemStats::report(std::cerr);
+ */
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+
+namespace MemStats {
+
+enum class Phase { Parse, Resolve, Compile, Execute, Count };
+
+struct PhaseCounters {
+    uint64_t allocations = 0;
+    uint64_t bytes = 0;        // Bytes requested from operator new, and in Arena blocks
+    uint64_t deallocations = 0;
+    uint64_t residentBytes = 0; // Resident set size when the phase ended, 0 if it did not run or is unknown
+};
+
+// Starts counting, from zero, in `phase`
+void start(Phase phase);
+// Ends the current phase (sampling the RSS) and counts what follows in `phase`
+void enter(Phase phase);
+// Ends the current phase and stops counting
+void stop();
+bool isCounting();
+
+// Counts a block of `bytes` taken from malloc, or one given back, by an allocator that bypasses operator new
+void countBlock(size_t bytes);
+void countBlockRelease();
+
+PhaseCounters counters(Phase phase);
+const char* name(Phase phase);
+
+// Current and peak resident set size of the process in bytes, 0 where the platform does not report it
+uint64_t residentBytes();
+uint64_t peakResidentBytes();
+
+// One line per phase that allocated anything and the peak RSS, each prefixed with "mem: "
+void report(std::ostream& out);
+
+} // namespace MemStats
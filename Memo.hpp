@@ -0,0 +1,121 @@
+/**
+ * @file memo.hpp
+ * @brief Bounded memo table for calls to pure functions (`--memo`).
+ *
+ * The table caches the result of a call keyed by the called FunctionStmt and its argument values. Strings are
+ * interned, so a string argument is keyed by its address like an integer by its value. A big integer is hashed
+ * by its address too, so an equal one computed separately misses instead of finding the entry. It is
+ * direct mapped: each key hashes to exactly one entry, and storing a new result evicts whatever was there, so
+ * memory use is fixed at construction no matter how many distinct calls a script makes.
+ *
+ * Only functions the PurityAnalysis marked pure are memoized, and only calls with at most `maxArguments`
+ * arguments. Calls that throw are never stored, so errors are reported exactly as without memoization.
+ *
+ * Usage:
+ *   MemoTable memo;
+ *   MemoTable::Key key = MemoTable::makeKey(function, arguments, count);
+ *   if (!memo.lookup(key, value)) { value = ...; memo.store(key, value); }
+ */
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "Value.hpp"
+
+class FunctionStmt;
+
+class MemoTable {
+public:
+    static const size_t maxArguments = 4;
+
+    struct Key {
+        const FunctionStmt* function = nullptr;
+        size_t argumentCount = 0;
+        Value arguments[maxArguments];
+
+        bool operator==(const Key& other) const {
+            if (function != other.function || argumentCount != other.argumentCount) return false;
+            for (size_t i = 0; i < argumentCount; i++) {
+                if (arguments[i] != other.arguments[i]) return false;
+            }
+            return true;
+        }
+    };
+
+    // @param capacity Number of entries, rounded up to a power of two.
+    explicit MemoTable(size_t capacity = 1 << 16) {
+        size_t size = 1;
+        while (size < capacity) size <<= 1;
+        entries.resize(size);
+        mask = size - 1;
+    }
+
+    static bool canMemoize(size_t argumentCount) { return argumentCount <= maxArguments; }
+
+    static Key makeKey(const FunctionStmt* function, const Value* arguments, size_t argumentCount) {
+        Key key;
+        key.function = function;
+        key.argumentCount = argumentCount;
+        for (size_t i = 0; i < argumentCount; i++) key.arguments[i] = arguments[i];
+        return key;
+    }
+
+    bool lookup(const Key& key, Value& value) {
+        const Entry& entry = entries[hash(key) & mask];
+        if (entry.used && entry.key == key) {
+            hits++;
+            value = entry.value;
+            return true;
+        }
+        misses++;
+        return false;
+    }
+
+    void store(const Key& key, Value value) {
+        Entry& entry = entries[hash(key) & mask];
+        if (entry.used && !(entry.key == key)) evictions++;
+        entry.key = key;
+        entry.value = value;
+        entry.used = true;
+    }
+
+    // Calls `visit` with every argument and result the table holds, for the BigIntHeap's collection
+    template<typename Visit>
+    void forEachValue(Visit visit) const {
+        for (const Entry& entry : entries) {
+            if (!entry.used) continue;
+            for (size_t i = 0; i < entry.key.argumentCount; i++) visit(entry.key.arguments[i]);
+            visit(entry.value);
+        }
+    }
+
+    size_t getHits() const { return hits; }
+    size_t getMisses() const { return misses; }
+    size_t getEvictions() const { return evictions; }
+
+private:
+    struct Entry {
+        Key key;
+        Value value;
+        bool used = false;
+    };
+
+    std::vector<Entry> entries;
+    size_t mask;
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t evictions = 0;
+
+    static uint64_t hash(const Key& key) {
+        uint64_t h = reinterpret_cast<uintptr_t>(key.function);
+        for (size_t i = 0; i < key.argumentCount; i++) {
+            h = (h ^ key.arguments[i].raw()) * 0x9E3779B97F4A7C15ULL;
+        }
+        // Final mix (from splitmix64) so the low bits used for indexing depend on every input bit
+        h ^= h >> 31;
+        h *= 0xBF58476D1CE4E5B9ULL;
+        h ^= h >> 29;
+        return h;
+    }
+};
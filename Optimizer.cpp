@@ -0,0 +1,147 @@
+/**
+ * @file optimizer.cpp
+ * @brief Implementation of constant folding and dead-branch elimination.
+ *
+ * Expression visits leave their replacement in `foldedExpr` and statement visits leave theirs in
+ * `rewrittenStmt`; `fold` and `rewrite` reset the slot to the node itself before visiting, so a visit only has
+ * to assign it when the node changes (or after visiting children, which overwrite it).
+ */
+
+#include "Optimizer.hpp"
+#include <stdexcept>
+#include <vector>
+
+void Optimizer::optimize(Stmt& root) {
+    rewrite(&root);
+}
+
+Expr* Optimizer::fold(Expr* expr) {
+    foldedExpr = expr;
+    expr->accept(*this);
+    return foldedExpr;
+}
+
+Stmt* Optimizer::rewrite(Stmt* stmt) {
+    rewrittenStmt = stmt;
+    stmt->accept(*this);
+    return rewrittenStmt;
+}
+
+void Optimizer::visit(BinaryExpr& expr) {
+    expr.setLeft(fold(expr.getLeft()));
+    expr.setRight(fold(expr.getRight()));
+    foldedExpr = &expr;
+
+    auto left = dynamic_cast<LiteralExpr*>(expr.getLeft());
+    auto right = dynamic_cast<LiteralExpr*>(expr.getRight());
+    if (!left || !right || !left->isInline() || !right->isInline()) return;
+    try {
+        // A result too large for a literal (an inline integer) is computed at runtime instead
+        Value value;
+        if (!BinaryExpr::applyToInts(expr.getOp(), Value::small(left->getValue()), Value::small(right->getValue()),
+                                     value)) {
+            return;
+        }
+        foldedExpr = arena.make<LiteralExpr>(value.asInt());
+        foldedExpressions++;
+    } catch (const std::runtime_error&) {
+        // Keep the expression so the error surfaces at runtime, exactly as without the optimizer
+    }
+}
+
+void Optimizer::visit(LiteralExpr&) {}
+
+void Optimizer::visit(VarExpr&) {}
+
+void Optimizer::visit(AssignExpr& expr) {
+    expr.setValue(fold(expr.getValue()));
+    foldedExpr = &expr;
+}
+
+void Optimizer::visit(StringLiteralExpr&) {}
+
+void Optimizer::visit(CallExpr& expr) {
+    for (auto& arg : expr.getArguments()) {
+        arg = fold(arg);
+    }
+    foldedExpr = &expr;
+}
+
+void Optimizer::visit(AssignStmt& stmt) {
+    stmt.setValue(fold(stmt.getValue()));
+}
+
+void Optimizer::visit(IfStmt& stmt) {
+    stmt.condition = fold(stmt.condition);
+    rewrite(stmt.ifBranch);
+    if (stmt.elseBranch) rewrite(stmt.elseBranch);
+    rewrittenStmt = &stmt;
+
+    if (auto literal = dynamic_cast<LiteralExpr*>(stmt.condition)) {
+        // Only the branch that can run survives; without an else branch a false condition removes the statement
+        rewrittenStmt = literal->getConstant().isTruthy() ? stmt.ifBranch : stmt.elseBranch;
+        removedBranches++;
+    }
+}
+
+void Optimizer::visit(PrintStmt& stmt) {
+    for (auto& expr : stmt.getExpressions()) {
+        expr = fold(expr);
+    }
+}
+
+void Optimizer::visit(ExpressionStmt& stmt) {
+    stmt.setExpression(fold(stmt.getExpression()));
+}
+
+void Optimizer::visit(ReturnStmt& stmt) {
+    if (stmt.getReturnValue()) stmt.setReturnValue(fold(stmt.getReturnValue()));
+}
+
+void Optimizer::visit(FunctionStmt& stmt) {
+    // The body is a BlockStmt, which is always rewritten in place; a deferred one is optimized once it is parsed
+    if (!stmt.isDeferred()) rewrite(stmt.getBody());
+    rewrittenStmt = &stmt;
+}
+
+void Optimizer::visit(BlockStmt& stmt) {
+    std::vector<Stmt*> statements;
+    bool changed = false;
+    for (Stmt* statement : stmt.getStatements()) {
+        Stmt* replacement = rewrite(statement);
+        if (replacement == statement) {
+            statements.push_back(statement);
+            continue;
+        }
+        changed = true;
+        if (!replacement) continue; // Dead if statement without an else branch
+        if (auto block = dynamic_cast<BlockStmt*>(replacement)) {
+            // Splice the surviving branch into this block
+            for (Stmt* inner : block->getStatements()) statements.push_back(inner);
+        } else {
+            statements.push_back(replacement);
+        }
+    }
+    if (changed) stmt.setStatements(arena.copyList(statements));
+    rewrittenStmt = &stmt;
+}
+
+void Optimizer::visit(WhileStmt& stmt) {
+    stmt.condition = fold(stmt.condition);
+    rewrite(stmt.body);
+    rewrittenStmt = &stmt;
+
+    auto literal = dynamic_cast<LiteralExpr*>(stmt.condition);
+    if (literal && !literal->getConstant().isTruthy()) {
+        rewrittenStmt = nullptr; // The body can never run
+        removedBranches++;
+    }
+}
+
+void Optimizer::visit(ForRangeStmt& stmt) {
+    stmt.start = fold(stmt.start);
+    stmt.stop = fold(stmt.stop);
+    if (stmt.step) stmt.step = fold(stmt.step);
+    rewrite(stmt.body);
+    rewrittenStmt = &stmt;
+}
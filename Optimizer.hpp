@@ -0,0 +1,69 @@
+/**
+ * @file optimizer.hpp
+ * @brief Declaration of the AST Optimizer that folds constants and removes dead if branches.
+ *
+ * The Optimizer runs after the Resolver and before execution (`-O1`, the default; `-O0` skips it). It rewrites
+ * the tree in place, so the tree-walking Interpreter, the Compiler and `--dump-bytecode` all see the result.
+ *
+ * Transformations:
+ * - A BinaryExpr whose operands are (after folding) both integer literals is replaced by a LiteralExpr holding
+ *   `BinaryExpr::applyToInts(op, left, right)`, so folded arithmetic and comparisons, including floor division,
+ *   behave exactly as they would at runtime. Operations that would throw at runtime (division by zero, an
+ *   operator without runtime support) are left in place so the error is still reported when, and only if,
+ *   the code runs, and so are results beyond 63 bits, which need a BigInt at runtime.
+ * - An IfStmt whose condition folds to a literal is replaced by the statements of the branch that runs (or
+ *   removed when there is no such branch). Blocks do not introduce scopes, so splicing a branch into the
+ *   enclosing block does not change which slots its statements use.
+ * - A WhileStmt whose condition folds to false is removed. Loop bounds and bodies are folded like any other
+ *   expression and block.
+ *
+ * Replacement literals are allocated in the same Arena as the rest of the tree.
+ *
+ * Usage:
+ *   Optimizer optimizer(arena);
+ *   optimizer.optimize(*ast);
+ */
+
+#pragma once
+#include "Parser.hpp"
+
+class Optimizer : public ASTVisitor {
+public:
+    explicit Optimizer(Arena& arena) : arena(arena) {}
+
+    /**
+     * Optimizes a resolved program in place.
+     * @param root The BlockStmt returned by the parser, already processed by the Resolver.
+     */
+    void optimize(Stmt& root);
+
+    size_t getFoldedExpressions() const { return foldedExpressions; }
+    size_t getRemovedBranches() const { return removedBranches; }
+
+    void visit(BinaryExpr& expr) override;
+    void visit(LiteralExpr& expr) override;
+    void visit(VarExpr& expr) override;
+    void visit(AssignExpr& expr) override;
+    void visit(StringLiteralExpr& expr) override;
+    void visit(CallExpr& expr) override;
+    void visit(AssignStmt& stmt) override;
+    void visit(IfStmt& stmt) override;
+    void visit(PrintStmt& stmt) override;
+    void visit(ExpressionStmt& stmt) override;
+    void visit(ReturnStmt& stmt) override;
+    void visit(FunctionStmt& stmt) override;
+    void visit(BlockStmt& stmt) override;
+    void visit(WhileStmt& stmt) override;
+    void visit(ForRangeStmt& stmt) override;
+
+private:
+    Arena& arena;
+    Expr* foldedExpr = nullptr;   // Replacement for the expression being visited
+    Stmt* rewrittenStmt = nullptr; // Replacement for the statement being visited, null to remove it
+    size_t foldedExpressions = 0;
+    size_t removedBranches = 0;
+
+    // Visits a node and returns what should take its place
+    Expr* fold(Expr* expr);
+    Stmt* rewrite(Stmt* stmt);
+};
@@ -0,0 +1,99 @@
+/**
+ * @file output.cpp
+ * @brief Implementation of the OutputWriter.
+ */
+
+#include "Output.hpp"
+#include "BigInt.hpp"
+#include <cstring>
+#include <unistd.h>
+
+namespace {
+
+// "00" to "99", so each division by 100 produces two digits
+const char digitPairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+// Enough for the 20 digits of 2^64 and a sign
+const size_t maxIntegerLength = 21;
+
+bool isTerminal(const std::ostream& stream) {
+    return &stream == &std::cout && ::isatty(STDOUT_FILENO);
+}
+
+} // namespace
+
+OutputWriter::OutputWriter(std::ostream& target)
+    : target(&target), buffer(chunkSize + maxIntegerLength), lineBuffered(isTerminal(target)) {}
+
+void OutputWriter::setTarget(std::ostream& stream) {
+    flush();
+    target = &stream;
+    lineBuffered = isTerminal(stream);
+}
+
+void OutputWriter::write(const char* data, size_t length) {
+    if (buffer.size() - used < length) grow(length);
+    std::memcpy(buffer.data() + used, data, length);
+    used += length;
+}
+
+void OutputWriter::writeInteger(int64_t number) {
+    if (buffer.size() - used < maxIntegerLength) grow(maxIntegerLength);
+    // Digits are produced from the right, into a scratch area, then copied into place
+    char digits[maxIntegerLength];
+    char* end = digits + maxIntegerLength;
+    char* start = end;
+    uint64_t magnitude = number < 0 ? 0 - static_cast<uint64_t>(number) : static_cast<uint64_t>(number);
+    while (magnitude >= 100) {
+        const char* pair = digitPairs + 2 * (magnitude % 100);
+        magnitude /= 100;
+        *--start = pair[1];
+        *--start = pair[0];
+    }
+    if (magnitude >= 10) {
+        const char* pair = digitPairs + 2 * magnitude;
+        *--start = pair[1];
+        *--start = pair[0];
+    } else {
+        *--start = static_cast<char>('0' + magnitude);
+    }
+    if (number < 0) *--start = '-';
+    size_t length = static_cast<size_t>(end - start);
+    std::memcpy(buffer.data() + used, start, length);
+    used += length;
+}
+
+void OutputWriter::writeObject(Value value) {
+    if (value.isBig()) {
+        write(value.asBig().toString());
+    } else {
+        write(value.asString());
+    }
+}
+
+void OutputWriter::flush() {
+    if (used == 0) return;
+    target->write(buffer.data(), static_cast<std::streamsize>(used));
+    used = 0;
+}
+
+void OutputWriter::flushLine() {
+    flush();
+    if (lineBuffered) target->flush();
+}
+
+void OutputWriter::grow(size_t extra) {
+    // A full chunk goes out first; only a single write larger than the buffer makes it grow
+    flush();
+    if (buffer.size() < extra) buffer.resize(extra);
+}
@@ -0,0 +1,108 @@
+/**
+ * @file output.hpp
+ * @brief The buffer print statements write to, formatting integers without iostream.
+ *
+ * `print` used to write every argument with `operator<<`, which for an integer builds an ostream sentry and goes
+ * through the locale's num_put facet, and then copied the digits one at a time into the stream buffer (the
+ * TeeBuffer when tracing). Scripts that print many numbers spent most of their time there. An OutputWriter
+ * instead appends the bytes of a line to its own growable buffer, formats integers two digits per step from a
+ * table, and hands the buffer to the target stream with a single write:
+ * - once it holds `chunkSize` bytes, so the console and the trace file each see one large write per chunk
+ *   (a TeeBuffer passes writes that large straight through to both);
+ * - after every line when the target is std::cout and stdout is a terminal, so interactive output appears as it
+ *   is printed, as stdio's line buffering would;
+ * - when flush() is called, which every back end does at the end of a run, also when the run fails, so the
+ *   output precedes the error message.
+ * Strings are copied as they are and big integers in decimal (see BigInt.hpp).
+ *
+ * Anything else writing to the target stream must flush() first to keep the order; stream() does that.
+ *
+ * Usage:
+ *   OutputWriter output(std::cout);
+ *   output.write(value);
+ *   output.write(' ');
+ *   output.endLine();
+ *   output.flush();
+ */
+
+#pragma once
+#include "Value.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+class OutputWriter {
+public:
+    // Bytes collected before they are handed to the target stream
+    static const size_t chunkSize = 64 * 1024;
+
+    explicit OutputWriter(std::ostream& target = std::cout);
+    ~OutputWriter() { flush(); }
+    OutputWriter(const OutputWriter&) = delete;
+    OutputWriter& operator=(const OutputWriter&) = delete;
+
+    // Flushes what was written so far to the current target and writes to `stream` from now on
+    void setTarget(std::ostream& stream);
+
+    // An integer in decimal, a big integer in decimal or a string as its text
+    void write(Value value) {
+        if (value.isInt()) {
+            writeInteger(value.asInt());
+        } else {
+            writeObject(value);
+        }
+    }
+    void write(char c) {
+        if (used == buffer.size()) grow(1);
+        buffer[used++] = c;
+    }
+    void write(const char* data, size_t length);
+    void write(const std::string& text) { write(text.data(), text.size()); }
+    void writeInteger(int64_t number);
+
+    // Ends the line, handing the buffer to the target if it is full or the target is line buffered
+    void endLine() {
+        write('\n');
+        if (lineBuffered || used >= chunkSize) flushLine();
+    }
+
+    // Hands everything buffered to the target stream; the stream's own buffers are left as they are
+    void flush();
+
+    // The target stream, after flushing, for output that does not go through the writer
+    std::ostream& stream() {
+        flush();
+        return *target;
+    }
+
+    // True if every line is flushed to the target (and the target flushed) as soon as it ends
+    bool isLineBuffered() const { return lineBuffered; }
+
+private:
+    std::ostream* target;
+    std::vector<char> buffer;
+    size_t used = 0;
+    bool lineBuffered;
+
+    void writeObject(Value value);
+    void flushLine();
+    // Makes room for `extra` more bytes
+    void grow(size_t extra);
+};
+
+/**
+ * Flushes an OutputWriter when it goes out of scope, so the output of a run reaches its stream before the run's
+ * error does.
+ */
+class FlushOnExit {
+public:
+    explicit FlushOnExit(OutputWriter& output) : output(output) {}
+    ~FlushOnExit() { output.flush(); }
+    FlushOnExit(const FlushOnExit&) = delete;
+    FlushOnExit& operator=(const FlushOnExit&) = delete;
+
+private:
+    OutputWriter& output;
+};
@@ -10,9 +10,9 @@
  * - ASTNode: Base class for all nodes in the AST, used to represent both expressions and statements.
  * - Expr and Stmt: Derived from ASTNode, these abstract classes represent expressions and statements in the AST.
  *   Specific types of expressions and statements are further derived from these.
- * - std::unique_ptr<Expr> and std::unique_ptr<Stmt>: Smart pointers used for memory management of AST nodes,
- *   ensuring automatic deallocation of dynamically allocated nodes.
- * - std::vector<std::unique_ptr<Stmt>>: A vector of unique pointers to statement nodes, used for blocks of
+ * - Expr* and Stmt*: Non-owning pointers to nodes allocated in the Arena passed to the Parser. The Arena owns
+ *   the whole tree and releases it in one go, so nodes never delete their children.
+ * - NodeList<Stmt*>: An arena-allocated array of statement pointers, used for blocks of
  *   statements, allowing the parser to represent compound statements and control structures.
  *
  * Key Classes:
@@ -20,45 +20,122 @@
  *   integer literals, variable references, and assignments, respectively.
  * - AssignStmt, PrintStmt, IfStmt, BlockStmt: Derived from Stmt, these classes represent assignment statements,
  *   print statements, conditional statements, and blocks of statements, respectively.
+ * - WhileStmt, ForRangeStmt: Derived from Stmt, these classes represent `while` loops and `for name in range(...)`
+ *   loops. Loop bodies are plain BlockStmts and run in the enclosing frame like if branches do.
+ *
+ * Source positions:
+ * Every statement, BinaryExpr and CallExpr records the line of its first token (the operator for a BinaryExpr),
+ * which the profiler reports hot sites by.
+ *
+ * Values:
+ * Expressions evaluate to a Value (see Value.hpp), an integer or a string. A StringLiteralExpr holds its text
+ * interned in the Parser's StringTable, so evaluating it, printing it or storing it in a variable never copies
+ * the string.
+ *
+ * Lazy function bodies:
+ * With `setLazyFunctions(true)` the parser does not build the body of a `def`: it only follows the INDENT and
+ * DEDENT tokens to the end of the body and records its source range in the FunctionStmt (a DeferredBody). The
+ * body is parsed when the function is first called (see Lazy.hpp), so the tokens are still lexed (lexical errors
+ * are found up front) but no nodes are made for functions that never run. Syntax errors in such a body are
+ * reported by the first call instead of before the program starts.
+ *
+ * Names:
+ * Variable, parameter and function names are interned in the Parser's SymbolTable (see Symbol.hpp) as they are
+ * parsed, and nodes hold the resulting Symbol. `getName()` returns the text, for error messages and listings;
+ * `getSymbol()` gives the Symbol, whose ID the passes key their tables by. Apart from FunctionStmt, no node
+ * owns a string, so the Arena never has to run their destructors.
  *
  * Variables:
  * The parser does not directly store variables; it constructs nodes representing variable assignments and
- * references. The actual storage and retrieval of variable values are handled by the environment in the
- * interpreter module.
+ * references. The Resolver later fills in the (depth, slot) of each reference, and the actual storage and
+ * retrieval of variable values are handled by the environment in the interpreter module.
  */
 
 
 #pragma once
 #include "Lexer.hpp"
 #include <memory>
+#include "Arena.hpp"
 #include <vector>
 #include <string>
 #include <iostream>
 #include "Env.hpp"
+#include "BigInt.hpp"
+#include "Value.hpp"
+#include "Symbol.hpp"
 
 // Forward declaration
 class Interpreter;
+struct FunctionBinding;
 class Expr;
 class Stmt;
+class BinaryExpr;
+class LiteralExpr;
+class VarExpr;
+class AssignExpr;
+class StringLiteralExpr;
+class CallExpr;
+class AssignStmt;
+class IfStmt;
+class PrintStmt;
+class ExpressionStmt;
+class ReturnStmt;
+class FunctionStmt;
+class BlockStmt;
+class WhileStmt;
+class ForRangeStmt;
+
+/**
+ * Completion status of executing a statement. A `return` reports Return (with the value stored in the
+ * Interpreter) and every enclosing block passes it up unchanged until Interpreter::callFunction sees it,
+ * so leaving a function never unwinds the C++ stack with an exception. `return f(...)` reports TailCall
+ * instead: the arguments are already evaluated and callFunction runs the callee in the caller's frame.
+ */
+enum class ExecStatus {
+    Normal,
+    Return,
+    TailCall
+};
+
+/**
+ * Visitor over the concrete AST node types. Passes that walk the tree without executing it
+ * (for example the bytecode Compiler) implement this interface and call `accept` on a node.
+ */
+class ASTVisitor {
+public:
+    virtual ~ASTVisitor() = default;
+    virtual void visit(BinaryExpr& expr) = 0;
+    virtual void visit(LiteralExpr& expr) = 0;
+    virtual void visit(VarExpr& expr) = 0;
+    virtual void visit(AssignExpr& expr) = 0;
+    virtual void visit(StringLiteralExpr& expr) = 0;
+    virtual void visit(CallExpr& expr) = 0;
+    virtual void visit(AssignStmt& stmt) = 0;
+    virtual void visit(IfStmt& stmt) = 0;
+    virtual void visit(PrintStmt& stmt) = 0;
+    virtual void visit(ExpressionStmt& stmt) = 0;
+    virtual void visit(ReturnStmt& stmt) = 0;
+    virtual void visit(FunctionStmt& stmt) = 0;
+    virtual void visit(BlockStmt& stmt) = 0;
+    virtual void visit(WhileStmt& stmt) = 0;
+    virtual void visit(ForRangeStmt& stmt) = 0;
+};
 
 class ASTNode {
 public:
-    enum NodeType {
-        ExprNode,
-        StmtNode
-    };
     ASTNode() = default;
-    virtual ~ASTNode() = default;
-    virtual void execute(Interpreter& interpreter, Environment& env) = 0;    
-    NodeType type;
-    std::unique_ptr<Expr> expr;
-    std::unique_ptr<Stmt> stmt;
-
-    // Constructor for expression nodes
-    ASTNode(std::unique_ptr<Expr> e) : type(ExprNode), expr(std::move(e)) {}
-
-    // Constructor for statement nodes
-    ASTNode(std::unique_ptr<Stmt> s) : type(StmtNode), stmt(std::move(s)) {}
+    virtual ExecStatus execute(Interpreter& interpreter, Environment& env) = 0;    
+    virtual void accept(ASTVisitor& visitor) = 0;
+
+    // Source line the node starts on, set by the Parser for statements, operators and calls; 0 if unknown
+    int getLine() const { return line; }
+    void setLine(int value) { line = value; }
+protected:
+    // Nodes are destroyed by their Arena through their concrete type, never through an ASTNode pointer.
+    // Keeping the destructor non-virtual lets nodes without string members skip destruction entirely.
+    ~ASTNode() = default;
+private:
+    int line = 0;
 };
 
 
@@ -68,130 +145,176 @@ public:
  */
 class Expr : public ASTNode {
 public:
-    virtual ~Expr() = default;
-    virtual int evaluate(Environment& env) = 0; // Accept an Environment reference
+    // Calls are made through `interpreter`; nodes keep no reference to the Interpreter that runs them
+    virtual Value evaluate(Interpreter& interpreter, Environment& env) = 0;
 };
 
 class BinaryExpr : public Expr {
-    std::unique_ptr<Expr> left;
-    std::unique_ptr<Expr> right;
+    Expr* left;
+    Expr* right;
     TokenType op;
 
 public:
-    BinaryExpr(std::unique_ptr<Expr> left, TokenType op, std::unique_ptr<Expr> right)
-        : left(std::move(left)), op(op), right(std::move(right)) {}
+    BinaryExpr(Expr* left, TokenType op, Expr* right)
+        : left(left), op(op), right(right) {}
 
     // Getter for left
-    const std::unique_ptr<Expr>& getLeft() const { return left; }
+    Expr* getLeft() const { return left; }
     
     // Getter for right
-    const std::unique_ptr<Expr>& getRight() const { return right; }
+    Expr* getRight() const { return right; }
+
+    // Setters used by the Optimizer to replace folded operands
+    void setLeft(Expr* expr) { left = expr; }
+    void setRight(Expr* expr) { right = expr; }
 
     // Getter for op 
     const TokenType getOp() const { return op; }
 
-    int evaluate(Environment& env) override { // accepts an Environment reference
-        int leftVal = left->evaluate(env); // Pass the environment to left expression
-        int rightVal = right->evaluate(env); // Pass the environment to right expression
-        int result;
+    // Integers come from the Interpreter's BigIntHeap when they outgrow 63 bits
+    Value evaluate(Interpreter& interpreter, Environment& env) override;
+
+    /**
+     * Applies a binary operator to two values. Two inline integers take the fast path of applyToInts; big
+     * integers, results that overflow it and strings go to applyToObjects. Shared by the tree-walker, the VM
+     * and the closures so every execution mode agrees on the semantics (in particular floor division).
+     * @param heap Receives the result if it is a BigInt.
+     * @throws std::runtime_error On division by zero, an operator without runtime support, or any operator but
+     *                            `==` on a string.
+     */
+    static Value apply(TokenType op, Value leftVal, Value rightVal, BigIntHeap& heap) {
+        Value result;
+        if (Value::bothInts(leftVal, rightVal) && applyToInts(op, leftVal, rightVal, result)) {
+            return result;
+        }
+        return applyToObjects(op, leftVal, rightVal, heap);
+    }
+
+    /**
+     * The integer path of apply, for two inline integers.
+     * @return false, leaving `result` unchanged, if the result does not fit inline or the operator is not an
+     *         integer operator; applyToObjects then computes it or raises the error.
+     * @throws std::runtime_error On division by zero.
+     */
+    static bool applyToInts(TokenType op, Value leftVal, Value rightVal, Value& result) {
         switch (op) {
-            case TokenType::PLUS: return leftVal + rightVal;
-            case TokenType::MINUS: return leftVal - rightVal;
-            case TokenType::MUL: return leftVal * rightVal;
-            case TokenType::DIV:
-                if (rightVal == 0) {
-                    throw std::runtime_error("Division by zero.");
-                }
-                // Adjust for floor division in cases with different signs
-                result = leftVal / rightVal;
-                // Check if correction is needed for floor division (operands have different signs and division is not exact)
-                if ((leftVal < 0) ^ (rightVal < 0) && (leftVal % rightVal != 0)) {
-                    result--;
-                }
-                return result;
-            case TokenType::EQUAL:
-            // std::cout << "binary operation == result " << (leftVal == rightVal) << std::endl;
-            return leftVal == rightVal;
-            case TokenType::LESS_EQUAL:    
-            return leftVal <= rightVal;
-            case TokenType::LESS:
-            return leftVal < rightVal;
-            case TokenType::GREATER:
-            return leftVal > rightVal;
-            case TokenType::GREATER_EQUAL:
-            return leftVal >= rightVal;
-            default:
-                throw std::runtime_error("Unsupported binary operator.");
+            case TokenType::PLUS: return Value::add(leftVal, rightVal, result);
+            case TokenType::MINUS: return Value::subtract(leftVal, rightVal, result);
+            case TokenType::MUL: return Value::multiply(leftVal, rightVal, result);
+            case TokenType::DIV: return floorDivide(leftVal, rightVal, result);
+            case TokenType::EQUAL: result = leftVal.asInt() == rightVal.asInt(); return true;
+            case TokenType::LESS_EQUAL: result = leftVal.asInt() <= rightVal.asInt(); return true;
+            case TokenType::LESS: result = leftVal.asInt() < rightVal.asInt(); return true;
+            case TokenType::GREATER: result = leftVal.asInt() > rightVal.asInt(); return true;
+            case TokenType::GREATER_EQUAL: result = leftVal.asInt() >= rightVal.asInt(); return true;
+            default: return false;
         }
     }
-    void execute(Interpreter& interpreter, Environment& env) override {
-        
-        std::cout << "BinaryExpr value: " << evaluate(env) << std::endl;
+
+    // The rest of apply, out of line so the integer path stays small where it is inlined
+    static Value applyToObjects(TokenType op, Value leftVal, Value rightVal, BigIntHeap& heap);
+
+    // Floor division of two inline integers; false only for inlineMin / -1, whose result needs a BigInt
+    static bool floorDivide(Value left, Value right, Value& result) {
+        int64_t leftVal = left.asInt();
+        int64_t rightVal = right.asInt();
+        if (rightVal == 0) {
+            throw std::runtime_error("Division by zero.");
+        }
+        // Adjust for floor division in cases with different signs
+        int64_t quotient = leftVal / rightVal;
+        // Check if correction is needed for floor division (operands have different signs and division is not exact)
+        if ((leftVal < 0) ^ (rightVal < 0) && (leftVal % rightVal != 0)) {
+            quotient--;
+        }
+        if (!Value::fitsInline(quotient)) return false;
+        result = Value::small(quotient);
+        return true;
     }
+
+    ExecStatus execute(Interpreter& interpreter, Environment& env) override;
+    void accept(ASTVisitor& visitor) override { visitor.visit(*this); }
+
+private:
+    // The right operand, with a big left operand pinned while it is evaluated
+    Value evaluateRightPinned(Value leftVal, Interpreter& interpreter, Environment& env);
 };
 
 
 class LiteralExpr : public Expr {
-    int value;
+    Value value; // An inline integer, or a BigInt in the program's Arena for a literal beyond 63 bits
 
 public:
-    // Constructor initializes 'value' with the integer value passed to it.
-    LiteralExpr(int value) : value(value) {}
+    // Constructor initializes 'value' with the integer value passed to it, which must fit inline (see Value).
+    LiteralExpr(int64_t value) : value(Value::small(value)) {}
+    // An integer constant of any size (see BigInt::parse)
+    explicit LiteralExpr(Value value) : value(value) {}
 
     //  accepts an Environment reference.
     // The environment is not used for literal expressions, but it's included to match the Expr interface.
-    int evaluate(Environment& env) override {
+    Value evaluate(Interpreter& interpreter, Environment& env) override {
         return value;
     }
 
-    // Getter method for 'value', indicating the method doesn't modify any class members.
-    const int& getValue() const { return value; }
+    // False for a literal beyond 63 bits, whose value only getConstant returns
+    bool isInline() const { return value.isInt(); }
+    // Getter method for the value of an inline literal
+    int64_t getValue() const { return value.asInt(); }
+    Value getConstant() const { return value; }
 
-    void execute(Interpreter& interpreter, Environment& env) override {
-        
-        std::cout << "LiteralExpr value: " << value << std::endl;
-    }
+    ExecStatus execute(Interpreter& interpreter, Environment& env) override;
+    void accept(ASTVisitor& visitor) override { visitor.visit(*this); }
 };
 
 class VarExpr : public Expr {
-    std::string name;
+    Symbol name;
+    size_t depth = 0; // Resolved by the Resolver: environments to walk up
+    size_t slot = 0;  // Resolved by the Resolver: index within that environment
 
 public:
-    VarExpr(const std::string& name) : name(name) {}
+    explicit VarExpr(Symbol name) : name(name) {}
 
-    int evaluate(Environment& env) override {
-        return env.get(name); // Use the environment to look up the variable's value
+    Value evaluate(Interpreter& interpreter, Environment& env) override {
+        return env.get(depth, slot, name.name()); // Use the environment to look up the variable's value
     }
     // Getter for name
-    const std::string& getName() const { return name; }
+    const std::string& getName() const { return name.name(); }
+    Symbol getSymbol() const { return name; }
 
-    void execute(Interpreter& interpreter, Environment& env) override {
-        
-        std::cout << "VarExpr value: " << evaluate(env) << std::endl;
-    }
+    size_t getDepth() const { return depth; }
+    size_t getSlot() const { return slot; }
+    void resolve(size_t depth, size_t slot) { this->depth = depth; this->slot = slot; }
+
+    ExecStatus execute(Interpreter& interpreter, Environment& env) override;
+    void accept(ASTVisitor& visitor) override { visitor.visit(*this); }
 };
 
 
 class AssignExpr : public Expr {
-    std::string name;
-    std::unique_ptr<Expr> value;
+    Symbol name;
+    Expr* value;
+    size_t depth = 0;
+    size_t slot = 0;
 
 public:
-    AssignExpr(const std::string& name, std::unique_ptr<Expr> value)
-        : name(name), value(std::move(value)) {}
+    AssignExpr(Symbol name, Expr* value)
+        : name(name), value(value) {}
     
-    int evaluate(Environment& env) override {
-        int val = value->evaluate(env); // Evaluate the right-hand side expression with the current environment
-        env.define(name, val); // Update the environment with the new value for this variable
+    Value evaluate(Interpreter& interpreter, Environment& env) override {
+        Value val = value->evaluate(interpreter, env); // Evaluate the right-hand side expression with the current environment
+        env.assign(depth, slot, val); // Update the environment with the new value for this variable
         return val; // Return the assigned value, allowing for expressions like a = b = 5
     }
 
-    const std::unique_ptr<Expr>& getValue() const {return value;}
-    const std::string& getName() const {return name;}
-    void execute(Interpreter& interpreter, Environment& env) override {
-        
-        std::cout << "AssignExpr value: " << evaluate(env) << std::endl;
-    }
+    Expr* getValue() const {return value;}
+    void setValue(Expr* expr) { value = expr; }
+    const std::string& getName() const {return name.name();}
+    Symbol getSymbol() const { return name; }
+    size_t getDepth() const { return depth; }
+    size_t getSlot() const { return slot; }
+    void resolve(size_t depth, size_t slot) { this->depth = depth; this->slot = slot; }
+    ExecStatus execute(Interpreter& interpreter, Environment& env) override;
+    void accept(ASTVisitor& visitor) override { visitor.visit(*this); }
 };
 
 
@@ -200,64 +323,78 @@ public:
  */
 class Stmt : public ASTNode {
 public:
-    virtual ~Stmt() = default;
-    virtual void execute(Interpreter& interpreter, Environment& env) = 0; // include Environment reference
+    virtual ExecStatus execute(Interpreter& interpreter, Environment& env) = 0; // include Environment reference
 };
 
 class AssignStmt : public Stmt {
-    std::string name;
-    std::unique_ptr<Expr> value;
+    Symbol name;
+    Expr* value;
+    size_t depth = 0; // Resolved by the Resolver: environments to walk up
+    size_t slot = 0;  // Resolved by the Resolver: index within that environment
 public:
-    //AssignStmt(const std::string& name, std::unique_ptr<Expr> value) : name(name), value(std::move(value));
-    AssignStmt(const std::string& name, std::unique_ptr<Expr> value);
+    //AssignStmt(const std::string& name, Expr* value) : name(name), value(value);
+    AssignStmt(Symbol name, Expr* value);
     // Getter for value
-    const std::unique_ptr<Expr>& getValue() const { return value; }
+    Expr* getValue() const { return value; }
+    void setValue(Expr* expr) { value = expr; }
     // Getter for name
-    const std::string& getName() const { return name; }
+    const std::string& getName() const { return name.name(); }
+    Symbol getSymbol() const { return name; }
 
-    void execute(Interpreter& interpreter, Environment& env) override;
+    size_t getDepth() const { return depth; }
+    size_t getSlot() const { return slot; }
+    void resolve(size_t depth, size_t slot) { this->depth = depth; this->slot = slot; }
+
+    ExecStatus execute(Interpreter& interpreter, Environment& env) override;
+    void accept(ASTVisitor& visitor) override { visitor.visit(*this); }
 
 };
 
 
 class StringLiteralExpr : public Expr {
-    std::string value;
+    Value value; // Points at the interned text, so the node stays trivially destructible
 public:
-    StringLiteralExpr(const std::string& value) : value(value) {}
+    // @param interned The literal's text as returned by StringTable::intern.
+    explicit StringLiteralExpr(const std::string& interned) : value(Value::string(interned)) {}
 
-    const std::string& getValue() const { return value; }
+    const std::string& getValue() const { return value.asString(); }
 
-    std::string evaluatee(Environment& env) {
-        
-        return value;
-    }
-    int evaluate(Environment& env) override {return 0;}
+    Value evaluate(Interpreter& interpreter, Environment& env) override { return value; }
 
-    void execute(Interpreter& interpreter, Environment& env) override {
-        std::cout << evaluatee(env) << std::endl; // Print the evaluated expression result
-    }
+    ExecStatus execute(Interpreter& interpreter, Environment& env) override;
+    void accept(ASTVisitor& visitor) override { visitor.visit(*this); }
 };
 
 class CallExpr : public Expr {
-    std::string functionName;
-    std::vector<std::unique_ptr<Expr>> arguments;
-    Interpreter& interpreter;
+    Symbol functionName;
+    NodeList<Expr*> arguments;
+    // Per-site cache of the binding for functionName in the interpreter `owner`, looked up on the first call. A
+    // `def` updates the binding in place, so the cache never goes stale and no name lookup happens after the first
+    // call. A different interpreter running the same tree looks its own binding up again; a tree is executed by
+    // one interpreter at a time.
+    Interpreter* owner = nullptr;
+    FunctionBinding* binding = nullptr;
+
+    // Resolves the binding if needed and evaluates the arguments onto the argument stack; returns their base.
+    size_t pushArguments(Interpreter& interpreter, Environment& env);
 
 public:
-    CallExpr(const std::string& functionName, std::vector<std::unique_ptr<Expr>> arguments, Interpreter& interpreter)
-        : functionName(functionName), arguments(std::move(arguments)), interpreter(interpreter) {}
+    CallExpr(Symbol functionName, NodeList<Expr*> arguments)
+        : functionName(functionName), arguments(arguments) {}
    
-    virtual int evaluate(Environment& env) override;
-    virtual void execute(Interpreter& interpreter, Environment& env) override;
-
-    // Utility to convert argument expressions to their evaluated results
-    std::vector<int> convertArgumentsToValues(const std::vector<std::unique_ptr<Expr>>& args, Environment& env) {
-        std::vector<int> result;
-        for (const auto& arg : args) {
-            result.push_back(arg->evaluate(env));
-        }
-        return result;
-    }
+    virtual Value evaluate(Interpreter& interpreter, Environment& env) override;
+    virtual ExecStatus execute(Interpreter& interpreter, Environment& env) override;
+    void accept(ASTVisitor& visitor) override { visitor.visit(*this); }
+
+    /**
+     * Evaluates the arguments and hands the call to the interpreter as a tail call instead of making it.
+     * Used by `return f(...)`; the result is ExecStatus::TailCall.
+     */
+    ExecStatus evaluateTailCall(Interpreter& interpreter, Environment& env);
+
+    const std::string& getFunctionName() const { return functionName.name(); }
+    Symbol getFunctionSymbol() const { return functionName; }
+    const NodeList<Expr*>& getArguments() const { return arguments; }
 };
 
 
@@ -265,14 +402,15 @@ public:
 
 class IfStmt : public Stmt {
 public:
-    std::unique_ptr<Expr> condition;
-    std::unique_ptr<Stmt> ifBranch;  // Actions to execute if the condition is true
-    std::unique_ptr<Stmt> elseBranch; // Actions to execute if the condition is false
+    Expr* condition;
+    Stmt* ifBranch;  // Actions to execute if the condition is true
+    Stmt* elseBranch; // Actions to execute if the condition is false
 
-    IfStmt(std::unique_ptr<Expr> condition, std::unique_ptr<Stmt> ifBranch, std::unique_ptr<Stmt> elseBranch=nullptr)
-        : condition(std::move(condition)), ifBranch(std::move(ifBranch)), elseBranch(std::move(elseBranch)) {}
+    IfStmt(Expr* condition, Stmt* ifBranch, Stmt* elseBranch=nullptr)
+        : condition(condition), ifBranch(ifBranch), elseBranch(elseBranch) {}
 
-    void execute(Interpreter& interpreter, Environment& env) override ;
+    ExecStatus execute(Interpreter& interpreter, Environment& env) override ;
+    void accept(ASTVisitor& visitor) override { visitor.visit(*this); }
 
     
 };
@@ -280,101 +418,194 @@ public:
 
 
 class PrintStmt : public Stmt {
-    std::vector<std::unique_ptr<Expr>> expressions;
+    NodeList<Expr*> expressions;
     
 
 public:
-    PrintStmt(std::vector<std::unique_ptr<Expr>> expressions) : expressions(std::move(expressions)) {}
+    PrintStmt(NodeList<Expr*> expressions) : expressions(expressions) {}
 
 
-    void execute(Interpreter& interpreter, Environment& env) override {
-        for (const auto& expr : expressions) {
-            if (auto stringExpr = dynamic_cast<StringLiteralExpr*>(expr.get())) {
-                std::cout << stringExpr->getValue(); // Assuming StringLiteralExpr has a `getValue` method.
-            } else {
-                // Fallback for other expression types, converting numeric results to strings for display.
-                std::cout << expr->evaluate(env);
-            }
-            std::cout << " "; // Separate arguments with spaces.
-        }
-        std::cout << std::endl; // End the print statement with a newline.
-    }
+    // Writes to the interpreter's output stream
+    ExecStatus execute(Interpreter& interpreter, Environment& env) override;
+    void accept(ASTVisitor& visitor) override { visitor.visit(*this); }
+
+    // Getter for the printed expressions
+    const NodeList<Expr*>& getExpressions() const { return expressions; }
 
 };
 class ExpressionStmt : public Stmt {
-    std::unique_ptr<Expr> expression;
+    Expr* expression;
 
 public:
-    ExpressionStmt(std::unique_ptr<Expr> expr) : expression(std::move(expr)) {}
+    ExpressionStmt(Expr* expr) : expression(expr) {}
 
-    virtual void execute(Interpreter& interpreter, Environment& env) override {
-        expression->evaluate(env);  // The return value can be ignored if not needed
+    virtual ExecStatus execute(Interpreter& interpreter, Environment& env) override {
+        expression->evaluate(interpreter, env);  // The return value can be ignored if not needed
+        return ExecStatus::Normal;
     }
+    void accept(ASTVisitor& visitor) override { visitor.visit(*this); }
+
+    Expr* getExpression() const { return expression; }
+    void setExpression(Expr* expr) { expression = expr; }
 };
 
 class ReturnStmt : public Stmt {
-    std::unique_ptr<Expr> returnValue;
+    Expr* returnValue;
+    CallExpr* tailCall; // returnValue when it is a call, which then runs in the caller's frame
 public:
-    ReturnStmt(std::unique_ptr<Expr> returnValue) : returnValue(std::move(returnValue)) {}
-    void execute(Interpreter& interpreter, Environment& env) override;
+    ReturnStmt(Expr* returnValue) : returnValue(returnValue), tailCall(dynamic_cast<CallExpr*>(returnValue)) {}
+    ExecStatus execute(Interpreter& interpreter, Environment& env) override;
+    void accept(ASTVisitor& visitor) override { visitor.visit(*this); }
+
+    // Getter for the returned expression, may be null
+    Expr* getReturnValue() const { return returnValue; }
+    void setReturnValue(Expr* expr) { returnValue = expr; tailCall = dynamic_cast<CallExpr*>(expr); }
+    // The call in tail position, or null when the returned expression is not a call
+    CallExpr* getTailCall() const { return tailCall; }
+};
+
+/**
+ * Source range of a function body the parser skipped: from the line break before its first line up to the first
+ * token after it, as offsets into the parsed buffer, and the line number of that line break.
+ */
+struct DeferredBody {
+    size_t begin = 0;
+    size_t end = 0;
+    int line = 0;
 };
 
 class FunctionStmt : public Stmt {
 private:
-    std::string name;  // Function name
-    std::vector<std::string> parameters;  // List of parameter names
-    std::unique_ptr<Stmt> body;  // The body of the function
+    Symbol name;  // Function name
+    std::vector<Symbol> parameters;  // List of parameter names
+    Stmt* body;  // The body of the function, null until a deferred body is parsed
+    DeferredBody deferred;  // Where to find the body while it is not parsed
+    std::vector<Symbol> locals;  // Slot names of the function frame, parameters first (set by the Resolver)
+    FunctionStmt* enclosing = nullptr;  // Function whose body holds this def, null at top level (set by the Resolver)
+    bool pure = false;  // Result depends only on the arguments (set by the PurityAnalysis)
 
 public:
     // Constructor
-    FunctionStmt(const std::string& name, std::vector<std::string> parameters, std::unique_ptr<Stmt> body)
-        : name(name), parameters(std::move(parameters)), body(std::move(body)) {}
+    FunctionStmt(Symbol name, std::vector<Symbol> parameters, Stmt* body)
+        : name(name), parameters(std::move(parameters)), body(body) {}
+    // A function whose body the parser skipped (see Parser::setLazyFunctions)
+    FunctionStmt(Symbol name, std::vector<Symbol> parameters, const DeferredBody& deferred)
+        : name(name), parameters(std::move(parameters)), body(nullptr), deferred(deferred) {}
 
     // Execute function in interpreter context
-    virtual void execute(Interpreter& interpreter, Environment& env) override;
+    virtual ExecStatus execute(Interpreter& interpreter, Environment& env) override;
+    void accept(ASTVisitor& visitor) override { visitor.visit(*this); }
 
     // Getters for the function's components
-    const std::string& getName() const { return name; }
-    const std::vector<std::string>& getParameters() const { return parameters; }
-    const std::unique_ptr<Stmt>& getBody() const { return body; }
+    const std::string& getName() const { return name.name(); }
+    Symbol getSymbol() const { return name; }
+    const std::vector<Symbol>& getParameters() const { return parameters; }
+    Stmt* getBody() const { return body; }
+    // True while the body is only known by its source range; the Resolver and any later pass skip it
+    bool isDeferred() const { return body == nullptr; }
+    const DeferredBody& getDeferredBody() const { return deferred; }
+    void setBody(Stmt* parsed) { body = parsed; }
+    const std::vector<Symbol>& getLocals() const { return locals; }
+    size_t getSlotCount() const { return locals.size(); }
+    void setLocals(std::vector<Symbol> names) { locals = std::move(names); }
+    FunctionStmt* getEnclosing() const { return enclosing; }
+    void setEnclosing(FunctionStmt* function) { enclosing = function; }
+    // Number of functions this one is nested in: 0 at top level
+    size_t getNesting() const { return enclosing ? enclosing->getNesting() + 1 : 0; }
+    bool isPure() const { return pure; }
+    void setPure(bool value) { pure = value; }
 };
 
 
 class BlockStmt : public Stmt {
-    std::vector<std::unique_ptr<Stmt>> statements;
+    NodeList<Stmt*> statements;
 public:
-    BlockStmt(std::vector<std::unique_ptr<Stmt>> statements);
+    BlockStmt(NodeList<Stmt*> statements);
     
-    void execute(Interpreter& interpreter, Environment& env) override;
+    ExecStatus execute(Interpreter& interpreter, Environment& env) override;
+    void accept(ASTVisitor& visitor) override { visitor.visit(*this); }
     
     // Getter for statement
-    const std::vector<std::unique_ptr<Stmt>>& getStatements() {return statements;}
+    const NodeList<Stmt*>& getStatements() {return statements;}
+    void setStatements(NodeList<Stmt*> list) { statements = list; }
+};
+
+
+class WhileStmt : public Stmt {
+public:
+    Expr* condition;
+    Stmt* body;
+
+    WhileStmt(Expr* condition, Stmt* body) : condition(condition), body(body) {}
+
+    ExecStatus execute(Interpreter& interpreter, Environment& env) override;
+    void accept(ASTVisitor& visitor) override { visitor.visit(*this); }
+};
+
+/**
+ * `for name in range(start, stop, step)`. The bounds are evaluated once before the first iteration, and the
+ * counter is kept in a native variable and written straight into the loop variable's resolved slot on every
+ * iteration, so the loop costs no name lookups and no Environment calls. As in Python, assigning to the loop
+ * variable in the body does not change the iteration, and the variable keeps its last value after the loop.
+ */
+class ForRangeStmt : public Stmt {
+    Symbol name;  // Loop variable
+    size_t depth = 0;  // Resolved by the Resolver: environments to walk up
+    size_t slot = 0;   // Resolved by the Resolver: index within that environment
+public:
+    Expr* start;  // A literal 0 when range() was given only the stop value
+    Expr* stop;
+    Expr* step;   // Null when range() was given no step, which means 1
+    Stmt* body;
+
+    ForRangeStmt(Symbol name, Expr* start, Expr* stop, Expr* step, Stmt* body)
+        : name(name), start(start), stop(stop), step(step), body(body) {}
+
+    ExecStatus execute(Interpreter& interpreter, Environment& env) override;
+    void accept(ASTVisitor& visitor) override { visitor.visit(*this); }
+
+    const std::string& getName() const { return name.name(); }
+    Symbol getSymbol() const { return name; }
+    size_t getDepth() const { return depth; }
+    size_t getSlot() const { return slot; }
+    void resolve(size_t depth, size_t slot) { this->depth = depth; this->slot = slot; }
 };
 
 
 
 class Parser {
 private:
-    std::vector<Token> tokens;
-    size_t current = 0;
-    Interpreter& interpreter;
+    Lexer& lexer;
+    const char* source; // Buffer the tokens point into
+    Token currentToken;  // One token of lookahead, pulled from the lexer on demand
+    Token previousToken;
+    bool atEnd = false;  // Set once the END_OF_FILE token has been consumed
+    Arena& arena; // Owns every node the parser creates
+    StringTable& strings; // Interns the string literals, allocated in the arena so it lives as long as the tree
+    SymbolTable& symbols; // Interns the names, allocated in the arena like `strings`
+    size_t errorCount = 0; // Statements skipped by the error recovery in parseBlock
+    bool lazyFunctions = false; // Record the source range of def bodies instead of parsing them
+    std::ostream* diagnostics = &std::cerr; // Where recovered parse errors are reported
 
     // Utility methods...
 
     bool isAtEnd() const {
-        return current >= tokens.size();
+        return atEnd;
     }
 
-    Token advance() {
-        if (!isAtEnd()) return tokens[current++];
-        //this line is for debugging
-        if (current < tokens.size()) std::cout << "Consuming Token: " << tokens[current].lexeme << std::endl;  
-        return tokens.back(); // Return the last token if at end (should be EOF token)
+    const Token& advance() {
+        if (isAtEnd()) return currentToken; // Keep returning the EOF token once at the end
+        previousToken = currentToken;
+        if (currentToken.type == TokenType::END_OF_FILE) {
+            atEnd = true;
+        } else {
+            currentToken = lexer.nextToken();
+        }
+        return previousToken;
     }
 
-    Token peek() const {
-        if (!isAtEnd()) return tokens[current];
-        return tokens.back(); // Safeguard against going past the end
+    const Token& peek() const {
+        return currentToken;
     }
 
     bool match(std::initializer_list<TokenType> types) {
@@ -387,14 +618,16 @@ private:
         return false;
     }
 
-    void consume(TokenType type, const std::string& message) {
+    // `message` is only turned into a string on an error, so consuming the expected token allocates nothing
+    void consume(TokenType type, const char* message) {
     if (check(type)) {
         advance();
     } else {
         // throw std::runtime_error(message);
         // this one is for degugging replace with ^ when done debugging
-        error(peek(), message + " instead found token type: " + std::to_string(static_cast<int>(peek().type)));
-        throw std::runtime_error(message + " instead found " + peek().lexeme);
+        error(peek(), message + std::string(" instead found token type: ") +
+                          std::to_string(static_cast<int>(peek().type)));
+        throw std::runtime_error(message + std::string(" instead found ") + peek().text(source));
     }
     }
 
@@ -403,38 +636,82 @@ private:
         return peek().type == type;
     }
 
-    Token previous() const {
-        return tokens.at(current - 1);
+    const Token& previous() const {
+        return previousToken;
     }
  
+    // The interned name of an IDENTIFIER token
+    Symbol symbol(const Token& token) {
+        return symbols.intern(source + token.offset, token.length);
+    }
+
+    // The literal of an INTEGER token, negated for a unary minus
+    LiteralExpr* integerLiteral(const Token& token, bool negative) {
+        if (token.value != Token::bigInteger) return arena.make<LiteralExpr>(negative ? -token.value : token.value);
+        return arena.make<LiteralExpr>(BigInt::parse(source + token.offset, token.length, negative, arena));
+    }
+
+    // Records the source line of a node the parser just created
+    template<typename T>
+    T* at(int line, T* node) {
+        node->setLine(line);
+        return node;
+    }
+
     void error(const Token& token, const std::string& message) {
-    std::cerr << "Error at " << token.lexeme << ": " << message << std::endl;
+    *diagnostics << "Error at " << token.text(source) << ": " << message << std::endl;
     // You might want to throw an exception or handle the error based on your application's needs.
     }
 
 
 public:
     // Parser(const std::vector<Token>& tokens) : tokens(tokens), current(0) {}
-    Parser(const std::vector<Token>& tokens, Interpreter& interpreter)
-        : tokens(tokens), current(0), interpreter(interpreter) {}
-
-
-    std::unique_ptr<Stmt> parse();
-    std::unique_ptr<Expr> parseExpression();
-    std::unique_ptr<Stmt> parseStatement();
+    // Tokens are pulled from `lexer` while parsing; identifiers are copied into the nodes, so the source
+    // buffer only has to outlive the parse.
+    Parser(Lexer& lexer, Arena& arena)
+        : lexer(lexer), source(lexer.getSource()), currentToken(lexer.nextToken()),
+          previousToken(TokenType::UNKNOWN, 0, 0), arena(arena),
+          strings(*arena.make<StringTable>()), symbols(*arena.make<SymbolTable>()) {}
+    // For parsing part of a program whose literals and names are already interned in `strings` and `symbols`
+    Parser(Lexer& lexer, Arena& arena, StringTable& strings, SymbolTable& symbols)
+        : lexer(lexer), source(lexer.getSource()), currentToken(lexer.nextToken()),
+          previousToken(TokenType::UNKNOWN, 0, 0), arena(arena), strings(strings), symbols(symbols) {}
+
+
+    Stmt* parse();
+    // True if some statements were reported and skipped, so the tree is not the whole program
+    bool hadErrors() const { return errorCount > 0; }
+    // Stream for the errors the parser recovers from, std::cerr by default
+    void setDiagnostics(std::ostream& stream) { diagnostics = &stream; }
+    // Defers the body of every def from now on (see "Lazy function bodies" above). The source buffer must then
+    // outlive the run, not only the parse.
+    void setLazyFunctions(bool value) { lazyFunctions = value; }
+    // The tables the string literals and the names are interned in, to share with the parser of a deferred body
+    StringTable& getStrings() { return strings; }
+    SymbolTable& getSymbols() { return symbols; }
+    /**
+     * Parses a deferred body, for a Parser whose Lexer covers exactly its DeferredBody range.
+     * @throws std::runtime_error On a syntax error in the body.
+     */
+    Stmt* parseDeferredBody();
+    Expr* parseExpression();
+    Stmt* parseStatement();
     // Helper methods for parsing different precedence levels of expressions
-    std::unique_ptr<Stmt> parseBlock();
-    std::unique_ptr<Expr> parsePrimary();
-    std::unique_ptr<Expr> parseUnary();
-    std::unique_ptr<Expr> parseFactor();  // Multiplication and Division
-    std::unique_ptr<Expr> parseTerm();    // Addition and Subtraction
-    std::unique_ptr<Stmt> parsePrintStatement();
-    std::unique_ptr<Expr> parseComparison();
+    Stmt* parseBlock();
+    Expr* parsePrimary();
+    Expr* parseUnary();
+    // Binary operators binding with at least `minimumPower` and their operands (see bindingPowers in parser.cpp)
+    Expr* parseBinary(uint8_t minimumPower);
+    Stmt* parsePrintStatement();
     void synchronize();
-    std::unique_ptr<Stmt> parseIfStatement();
-    std::unique_ptr<Stmt> parseFunctionDefinition();
-    std::unique_ptr<Stmt> parseReturnStatement();
-    std::unique_ptr<Expr> parseFunctionCall(const std::string& functionName);
+    Stmt* parseIfStatement();
+    Stmt* parseWhileStatement();
+    Stmt* parseForStatement();
+    Stmt* parseFunctionDefinition();
+    Stmt* parseFunctionBody();
+    DeferredBody skipFunctionBody();
+    Stmt* parseReturnStatement();
+    Expr* parseFunctionCall(Symbol functionName);
 
 };
 
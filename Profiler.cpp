@@ -0,0 +1,302 @@
+/**
+ * @file profiler.cpp
+ * @brief Implementation of the call-tree timer, the counting wrappers and the reports of `--profile`.
+ *
+ * Instrumentation follows the Optimizer: each visit leaves the replacement for the visited node in a slot that
+ * `wrap`/`rewrite` hand back to the parent, which stores it in place of the original child. Only BinaryExpr and
+ * IfStmt nodes are replaced; every other node is kept and only has its children replaced.
+ */
+
+#include "Profiler.hpp"
+#include <algorithm>
+#include <iomanip>
+#include <map>
+#include <string>
+
+namespace {
+
+uint64_t nanoseconds(std::chrono::steady_clock::duration duration) {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count());
+}
+
+std::string frameName(const FunctionStmt* function) {
+    if (!function) return "<module>";
+    return function->getName() + ":" + std::to_string(function->getLine());
+}
+
+// Counts the evaluations of a BinaryExpr. Visitors see the wrapped expression.
+class CountedBinaryExpr : public Expr {
+    BinaryExpr& expr;
+    Profiler::Site& site;
+
+public:
+    CountedBinaryExpr(BinaryExpr& expr, Profiler::Site& site) : expr(expr), site(site) { setLine(expr.getLine()); }
+
+    Value evaluate(Interpreter& interpreter, Environment& env) override {
+        site.executions++;
+        return expr.evaluate(interpreter, env);
+    }
+    ExecStatus execute(Interpreter& interpreter, Environment& env) override { return expr.execute(interpreter, env); }
+    void accept(ASTVisitor& visitor) override { expr.accept(visitor); }
+};
+
+// Runs an IfStmt, counting its executions and how often the condition was true. Visitors see the wrapped
+// statement.
+class CountedIfStmt : public Stmt {
+    IfStmt& stmt;
+    Profiler::Site& site;
+
+public:
+    CountedIfStmt(IfStmt& stmt, Profiler::Site& site) : stmt(stmt), site(site) { setLine(stmt.getLine()); }
+
+    ExecStatus execute(Interpreter& interpreter, Environment& env) override {
+        site.executions++;
+        if (stmt.condition->evaluate(interpreter, env).isTruthy()) {
+            site.taken++;
+            return stmt.ifBranch->execute(interpreter, env);
+        }
+        return stmt.elseBranch ? stmt.elseBranch->execute(interpreter, env) : ExecStatus::Normal;
+    }
+    void accept(ASTVisitor& visitor) override { stmt.accept(visitor); }
+};
+
+class Instrumenter : public ASTVisitor {
+public:
+    Instrumenter(Profiler& profiler, Arena& arena) : profiler(profiler), arena(arena) {}
+
+    Expr* wrap(Expr* expr) {
+        wrappedExpr = expr;
+        expr->accept(*this);
+        return wrappedExpr;
+    }
+
+    Stmt* rewrite(Stmt* stmt) {
+        rewrittenStmt = stmt;
+        stmt->accept(*this);
+        return rewrittenStmt;
+    }
+
+    void visit(BinaryExpr& expr) override {
+        expr.setLeft(wrap(expr.getLeft()));
+        expr.setRight(wrap(expr.getRight()));
+        Profiler::Site& site = profiler.addSite(Profiler::Site::Kind::Binary, expr.getLine());
+        wrappedExpr = arena.make<CountedBinaryExpr>(expr, site);
+    }
+    void visit(LiteralExpr&) override {}
+    void visit(VarExpr&) override {}
+    void visit(AssignExpr& expr) override {
+        expr.setValue(wrap(expr.getValue()));
+        wrappedExpr = &expr;
+    }
+    void visit(StringLiteralExpr&) override {}
+    void visit(CallExpr& expr) override {
+        for (auto& arg : expr.getArguments()) {
+            arg = wrap(arg);
+        }
+        wrappedExpr = &expr;
+    }
+    void visit(AssignStmt& stmt) override {
+        stmt.setValue(wrap(stmt.getValue()));
+    }
+    void visit(IfStmt& stmt) override {
+        stmt.condition = wrap(stmt.condition);
+        stmt.ifBranch = rewrite(stmt.ifBranch);
+        if (stmt.elseBranch) stmt.elseBranch = rewrite(stmt.elseBranch);
+        Profiler::Site& site = profiler.addSite(Profiler::Site::Kind::If, stmt.getLine());
+        rewrittenStmt = arena.make<CountedIfStmt>(stmt, site);
+    }
+    void visit(PrintStmt& stmt) override {
+        for (auto& expr : stmt.getExpressions()) {
+            expr = wrap(expr);
+        }
+    }
+    void visit(ExpressionStmt& stmt) override {
+        stmt.setExpression(wrap(stmt.getExpression()));
+    }
+    void visit(ReturnStmt& stmt) override {
+        // A returned call is kept as it is, so it still runs as a tail call
+        if (stmt.getReturnValue()) stmt.setReturnValue(wrap(stmt.getReturnValue()));
+    }
+    void visit(FunctionStmt& stmt) override {
+        rewrite(stmt.getBody()); // The body is a BlockStmt, which is always rewritten in place
+        rewrittenStmt = &stmt;
+    }
+    void visit(BlockStmt& stmt) override {
+        for (auto& statement : stmt.getStatements()) {
+            statement = rewrite(statement);
+        }
+        rewrittenStmt = &stmt;
+    }
+    void visit(WhileStmt& stmt) override {
+        stmt.condition = wrap(stmt.condition);
+        stmt.body = rewrite(stmt.body);
+        rewrittenStmt = &stmt;
+    }
+    void visit(ForRangeStmt& stmt) override {
+        stmt.start = wrap(stmt.start);
+        stmt.stop = wrap(stmt.stop);
+        if (stmt.step) stmt.step = wrap(stmt.step);
+        stmt.body = rewrite(stmt.body);
+        rewrittenStmt = &stmt;
+    }
+
+private:
+    Profiler& profiler;
+    Arena& arena;
+    Expr* wrappedExpr = nullptr;   // Replacement for the expression being visited
+    Stmt* rewrittenStmt = nullptr; // Replacement for the statement being visited
+};
+
+} // namespace
+
+Profiler::Profiler() : start(Clock::now()) {
+    paths.push_back(PathNode(nullptr, 0));
+}
+
+void Profiler::instrument(Stmt& root, Arena& arena) {
+    Instrumenter instrumenter(*this, arena);
+    instrumenter.rewrite(&root); // The root is a BlockStmt, which stays in place
+}
+
+Profiler::Site& Profiler::addSite(Site::Kind kind, int line) {
+    sites.push_back(Site(kind, line));
+    return sites.back();
+}
+
+size_t Profiler::childPath(size_t parent, const FunctionStmt* function) {
+    for (const auto& child : paths[parent].children) {
+        if (child.first == function) return child.second;
+    }
+    size_t index = paths.size();
+    paths.push_back(PathNode(function, parent)); // May move paths[parent], so look it up again below
+    paths[parent].children.push_back(std::make_pair(function, index));
+    return index;
+}
+
+void Profiler::enter(const FunctionStmt& function) {
+    auto inserted = functions.insert(std::make_pair(&function, FunctionProfile()));
+    if (inserted.second) functionOrder.push_back(&function);
+    FunctionProfile& profile = inserted.first->second;
+    profile.calls++;
+    profile.active++;
+
+    size_t parent = stack.empty() ? 0 : stack.back().path;
+    ActiveCall call;
+    call.function = &function;
+    call.path = childPath(parent, &function);
+    call.childTime = 0;
+    call.start = Clock::now();
+    stack.push_back(call);
+}
+
+void Profiler::exit() {
+    ActiveCall call = stack.back();
+    stack.pop_back();
+    uint64_t elapsed = nanoseconds(Clock::now() - call.start);
+    uint64_t self = elapsed > call.childTime ? elapsed - call.childTime : 0;
+    paths[call.path].exclusive += self;
+
+    FunctionProfile& profile = functions[call.function];
+    profile.exclusive += self;
+    if (--profile.active == 0) {
+        profile.inclusive += elapsed; // Nested activations are already part of this one
+    }
+    if (stack.empty()) {
+        topLevelChildTime += elapsed;
+    } else {
+        stack.back().childTime += elapsed;
+    }
+}
+
+void Profiler::finish() {
+    if (finished) return;
+    while (!stack.empty()) exit();
+    total = nanoseconds(Clock::now() - start);
+    paths[0].exclusive = total > topLevelChildTime ? total - topLevelChildTime : 0;
+    finished = true;
+}
+
+void Profiler::writeCollapsed(std::ostream& out) const {
+    std::vector<const FunctionStmt*> frames;
+    for (const PathNode& node : paths) {
+        uint64_t micros = node.exclusive / 1000;
+        if (micros == 0) continue;
+        frames.clear();
+        for (const PathNode* frame = &node; frame->function; frame = &paths[frame->parent]) {
+            frames.push_back(frame->function);
+        }
+        out << frameName(nullptr);
+        for (size_t i = frames.size(); i-- > 0;) out << ';' << frameName(frames[i]);
+        out << ' ' << micros << '\n';
+    }
+}
+
+void Profiler::writeSummary(std::ostream& out, size_t maxLines) const {
+    uint64_t calls = 0;
+    for (const auto& entry : functions) calls += entry.second.calls;
+    std::ios_base::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+    out << std::fixed << std::setprecision(3);
+    out << "profile: " << calls << " calls of " << functions.size() << " functions, " << total / 1e6
+        << " ms in total" << '\n';
+
+    std::vector<const FunctionStmt*> order(functionOrder);
+    std::stable_sort(order.begin(), order.end(), [this](const FunctionStmt* a, const FunctionStmt* b) {
+        return functions.at(a).exclusive > functions.at(b).exclusive;
+    });
+    if (!order.empty()) {
+        out << "  " << std::left << std::setw(24) << "function" << std::right << std::setw(12) << "calls"
+            << std::setw(16) << "inclusive ms" << std::setw(16) << "exclusive ms" << '\n';
+    }
+    for (const FunctionStmt* function : order) {
+        const FunctionProfile& profile = functions.at(function);
+        out << "  " << std::left << std::setw(24) << frameName(function) << std::right << std::setw(12)
+            << profile.calls << std::setw(16) << profile.inclusive / 1e6 << std::setw(16)
+            << profile.exclusive / 1e6 << '\n';
+    }
+
+    // Several sites can share a line, e.g. the operators of one expression
+    struct LineCounts {
+        uint64_t binary = 0;
+        uint64_t ifs = 0;
+        uint64_t taken = 0;
+    };
+    std::map<int, LineCounts> lines;
+    for (const Site& site : sites) {
+        LineCounts& counts = lines[site.line];
+        if (site.kind == Site::Kind::Binary) {
+            counts.binary += site.executions;
+        } else {
+            counts.ifs += site.executions;
+            counts.taken += site.taken;
+        }
+    }
+    std::vector<std::pair<int, LineCounts>> hot;
+    for (const auto& entry : lines) {
+        if (entry.second.binary + entry.second.ifs > 0) hot.push_back(entry);
+    }
+    std::stable_sort(hot.begin(), hot.end(), [](const std::pair<int, LineCounts>& a,
+                                                const std::pair<int, LineCounts>& b) {
+        return a.second.binary + a.second.ifs > b.second.binary + b.second.ifs;
+    });
+    if (hot.size() > maxLines) hot.resize(maxLines);
+    if (!hot.empty()) {
+        out << "  " << std::left << std::setw(8) << "line" << std::right << std::setw(16) << "binary ops"
+            << std::setw(12) << "if runs" << std::setw(12) << "if taken" << '\n';
+    }
+    out << std::setprecision(1);
+    for (const auto& entry : hot) {
+        const LineCounts& counts = entry.second;
+        out << "  " << std::left << std::setw(8) << entry.first << std::right << std::setw(16) << counts.binary
+            << std::setw(12) << counts.ifs;
+        if (counts.ifs) {
+            out << std::setw(11) << 100.0 * counts.taken / counts.ifs << '%';
+        } else {
+            out << std::setw(12) << '-';
+        }
+        out << '\n';
+    }
+    out.flags(flags);
+    out.precision(precision);
+    out << std::flush;
+}
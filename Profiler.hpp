@@ -0,0 +1,118 @@
+/**
+ * @file profiler.hpp
+ * @brief Function and line profiler for the tree-walking Interpreter (`mypython --profile`).
+ *
+ * The Profiler records, for every FunctionStmt that runs, how often it was called and how much time was spent
+ * in it with (inclusive) and without (exclusive) the functions it called. Time is attributed to the full call
+ * path as well, and written at the end of the run in the collapsed-stack format read by flamegraph.pl and
+ * speedscope: one line per call path, frames separated by ';', followed by its exclusive time in microseconds.
+ * Frames are named `<name>:<line of the def>`, and the top level is `<module>`.
+ *
+ *   <module>;main:12;fib:1 48210
+ *
+ * Hot sites are counted by source line: every BinaryExpr evaluation and every IfStmt execution (with how often
+ * its branch was taken). They are listed in the summary, not the collapsed stacks, since they carry counts
+ * rather than time.
+ *
+ * Cost:
+ * - Without --profile the tree is not touched and Interpreter::callFunction tests one null pointer per call.
+ * - With it, `instrument` wraps each BinaryExpr and IfStmt in a counting node after the other passes have run
+ *   (so the AST cache, the Optimizer and the PurityAnalysis never see the wrappers), and every call reads the
+ *   clock twice. Recursive calls only add to the inclusive time of their outermost activation.
+ *
+ * A call in tail position (`return f(...)`) replaces its caller, as it does in the interpreter: the callee's
+ * frame sits directly below the caller's caller. Calls still open when the run ends (after an error) are closed
+ * by `finish`.
+ *
+ * Usage:
+ *   Profiler profiler;
+ *   profiler.instrument(*ast, arena);      // after the Resolver, the Optimizer and the PurityAnalysis
+ *   interpreter.setProfiler(&profiler);
+ *   interpreter.interpret(ast, globalSlotCount);
+ *   profiler.finish();
+ *   profiler.writeCollapsed(file);
+ *   profiler.writeSummary(std::cerr);
+ */
+
+#pragma once
+#include "Parser.hpp"
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+
+class Profiler {
+public:
+    // Execution counts of one instrumented node
+    struct Site {
+        enum class Kind { Binary, If };
+        Kind kind;
+        int line;
+        uint64_t executions = 0;
+        uint64_t taken = 0; // If statements only: how often the condition was true
+        Site(Kind kind, int line) : kind(kind), line(line) {}
+    };
+
+    Profiler();
+
+    /**
+     * Wraps every BinaryExpr and IfStmt below `root` in a node counting its executions. The wrappers are
+     * allocated in `arena` and refer to this Profiler, which must outlive every run of the tree.
+     */
+    void instrument(Stmt& root, Arena& arena);
+
+    // Called by Interpreter::callFunction around each run of a function body.
+    void enter(const FunctionStmt& function);
+    void exit();
+
+    // Closes the calls still open and stops the clock of the top level. Idempotent.
+    void finish();
+
+    // Writes the collapsed stacks; paths whose exclusive time rounds to 0 microseconds are left out.
+    void writeCollapsed(std::ostream& out) const;
+    // Writes a table of the functions by exclusive time and of the hottest lines.
+    void writeSummary(std::ostream& out, size_t maxLines = 10) const;
+
+    // Creates the counter of an instrumented node; the reference stays valid as long as the Profiler.
+    Site& addSite(Site::Kind kind, int line);
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct FunctionProfile {
+        uint64_t calls = 0;
+        uint64_t inclusive = 0; // Nanoseconds
+        uint64_t exclusive = 0;
+        size_t active = 0;      // Activations currently on the stack
+    };
+
+    // A node of the call tree: one distinct call path
+    struct PathNode {
+        const FunctionStmt* function; // Null for the root
+        size_t parent;
+        uint64_t exclusive = 0;
+        std::vector<std::pair<const FunctionStmt*, size_t>> children;
+        PathNode(const FunctionStmt* function, size_t parent) : function(function), parent(parent) {}
+    };
+
+    struct ActiveCall {
+        const FunctionStmt* function;
+        size_t path;
+        Clock::time_point start;
+        uint64_t childTime; // Inclusive time of the calls made from this one
+    };
+
+    Clock::time_point start;
+    uint64_t total = 0;
+    bool finished = false;
+    std::unordered_map<const FunctionStmt*, FunctionProfile> functions;
+    std::vector<const FunctionStmt*> functionOrder; // First-call order, for a stable report
+    std::vector<PathNode> paths;                    // paths[0] is the top level
+    std::vector<ActiveCall> stack;
+    uint64_t topLevelChildTime = 0;
+    std::deque<Site> sites;                         // Deque so addSite's references stay valid
+
+    size_t childPath(size_t parent, const FunctionStmt* function);
+};
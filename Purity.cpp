@@ -0,0 +1,146 @@
+/**
+ * @file purity.cpp
+ * @brief Implementation of the PurityAnalysis pass.
+ *
+ * A FunctionFinder collects every `def` in the program (nested ones and those in branches included), a
+ * BodyScanner records the local facts of each body without descending into nested defs, and `analyze`
+ * iterates over the call graph until the set of pure names is stable.
+ */
+
+#include "Purity.hpp"
+
+namespace {
+
+// Walks the body of one function and records what makes it impure and which names it calls.
+class BodyScanner : public ASTVisitor {
+public:
+    explicit BodyScanner(PurityAnalysis::FunctionFacts& facts) : facts(facts) {}
+
+    void visit(BinaryExpr& expr) override {
+        expr.getLeft()->accept(*this);
+        expr.getRight()->accept(*this);
+    }
+    void visit(LiteralExpr&) override {}
+    void visit(VarExpr& expr) override {
+        if (expr.getDepth() != 0) facts.locallyPure = false; // Reads a global
+    }
+    void visit(AssignExpr& expr) override {
+        if (expr.getDepth() != 0) facts.locallyPure = false;
+        expr.getValue()->accept(*this);
+    }
+    void visit(StringLiteralExpr&) override {}
+    void visit(CallExpr& expr) override {
+        facts.callees.insert(expr.getFunctionSymbol().id());
+        for (const auto& arg : expr.getArguments()) arg->accept(*this);
+    }
+    void visit(AssignStmt& stmt) override {
+        if (stmt.getDepth() != 0) facts.locallyPure = false;
+        stmt.getValue()->accept(*this);
+    }
+    void visit(IfStmt& stmt) override {
+        stmt.condition->accept(*this);
+        stmt.ifBranch->accept(*this);
+        if (stmt.elseBranch) stmt.elseBranch->accept(*this);
+    }
+    void visit(PrintStmt&) override { facts.locallyPure = false; }
+    void visit(ExpressionStmt& stmt) override { stmt.getExpression()->accept(*this); }
+    void visit(ReturnStmt& stmt) override {
+        if (stmt.getReturnValue()) stmt.getReturnValue()->accept(*this);
+    }
+    void visit(FunctionStmt&) override { facts.locallyPure = false; } // Rebinds a function name
+    void visit(BlockStmt& stmt) override {
+        for (const auto& statement : stmt.getStatements()) statement->accept(*this);
+    }
+    void visit(WhileStmt& stmt) override {
+        stmt.condition->accept(*this);
+        stmt.body->accept(*this);
+    }
+    void visit(ForRangeStmt& stmt) override {
+        if (stmt.getDepth() != 0) facts.locallyPure = false;
+        stmt.start->accept(*this);
+        stmt.stop->accept(*this);
+        if (stmt.step) stmt.step->accept(*this);
+        stmt.body->accept(*this);
+    }
+
+private:
+    PurityAnalysis::FunctionFacts& facts;
+};
+
+// Collects every FunctionStmt in the program.
+class FunctionFinder : public ASTVisitor {
+public:
+    std::vector<FunctionStmt*> found;
+
+    void visit(BinaryExpr&) override {}
+    void visit(LiteralExpr&) override {}
+    void visit(VarExpr&) override {}
+    void visit(AssignExpr&) override {}
+    void visit(StringLiteralExpr&) override {}
+    void visit(CallExpr&) override {}
+    void visit(AssignStmt&) override {}
+    void visit(IfStmt& stmt) override {
+        stmt.ifBranch->accept(*this);
+        if (stmt.elseBranch) stmt.elseBranch->accept(*this);
+    }
+    void visit(PrintStmt&) override {}
+    void visit(ExpressionStmt&) override {}
+    void visit(ReturnStmt&) override {}
+    void visit(FunctionStmt& stmt) override {
+        found.push_back(&stmt);
+        stmt.getBody()->accept(*this);
+    }
+    void visit(BlockStmt& stmt) override {
+        for (const auto& statement : stmt.getStatements()) statement->accept(*this);
+    }
+    void visit(WhileStmt& stmt) override { stmt.body->accept(*this); }
+    void visit(ForRangeStmt& stmt) override { stmt.body->accept(*this); }
+};
+
+} // namespace
+
+void PurityAnalysis::analyze(Stmt& root) {
+    FunctionFinder finder;
+    root.accept(finder);
+
+    functions.clear();
+    for (FunctionStmt* function : finder.found) {
+        FunctionFacts facts;
+        facts.function = function;
+        BodyScanner scanner(facts);
+        function->getBody()->accept(scanner);
+        functions.push_back(std::move(facts));
+    }
+
+    // Optimistically assume every defined name is pure, then demote until stable
+    std::unordered_map<uint32_t, bool> pureNames; // By symbol ID
+    for (const FunctionFacts& facts : functions) {
+        pureNames[facts.function->getSymbol().id()] = true;
+    }
+    std::vector<bool> pure(functions.size(), true);
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (size_t i = 0; i < functions.size(); i++) {
+            if (!pure[i]) continue;
+            const FunctionFacts& facts = functions[i];
+            bool stillPure = facts.locallyPure;
+            for (uint32_t callee : facts.callees) {
+                auto it = pureNames.find(callee);
+                if (it == pureNames.end() || !it->second) {
+                    stillPure = false;
+                    break;
+                }
+            }
+            if (!stillPure) {
+                pure[i] = false;
+                pureNames[facts.function->getSymbol().id()] = false; // Every def of a name must be pure
+                changed = true;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < functions.size(); i++) {
+        functions[i].function->setPure(pure[i] && pureNames[functions[i].function->getSymbol().id()]);
+    }
+}
@@ -0,0 +1,43 @@
+/**
+ * @file purity.hpp
+ * @brief Declaration of the PurityAnalysis pass that finds functions whose calls can be memoized.
+ *
+ * A function is pure when its result depends only on its arguments and calling it changes nothing else:
+ * - it contains no `print` and no nested `def` (which would rebind a function name),
+ * - it reads no global variables (assignments inside a function are always local, see the Resolver),
+ * - every function it calls is itself pure. Since `def` can rebind a name at runtime, a name counts as pure
+ *   only if every `def` of that name in the program is pure; calls to names that are never defined are impure.
+ *
+ * Recursion is handled by a fixed point: all candidate functions start out pure and are demoted until nothing
+ * changes. The result is stored on each FunctionStmt (`isPure()`), where Interpreter::callFunction reads it.
+ *
+ * Usage:
+ *   PurityAnalysis purity;
+ *   purity.analyze(*ast); // after the Resolver
+ */
+
+#pragma once
+#include "Parser.hpp"
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+class PurityAnalysis {
+public:
+    /**
+     * Marks every FunctionStmt below the root as pure or impure.
+     * @param root The BlockStmt returned by the parser, already processed by the Resolver.
+     */
+    void analyze(Stmt& root);
+
+    // Per-function facts gathered from its body, before the fixed point
+    struct FunctionFacts {
+        FunctionStmt* function;
+        bool locallyPure = true;             // No print, nested def or global read in the body itself
+        std::unordered_set<uint32_t> callees; // Symbol IDs of the called names
+    };
+
+private:
+    std::vector<FunctionFacts> functions;
+};
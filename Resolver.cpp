@@ -0,0 +1,249 @@
+/**
+ * @file resolver.cpp
+ * @brief Implementation of the Resolver pass.
+ *
+ * Resolving a function happens in two steps: a LocalCollector first walks the body and declares every
+ * assignment target as a local slot (after the parameters); the Resolver then walks the body again and
+ * binds each reference to a local slot (depth 0), a slot of an enclosing function or a global slot. Nested
+ * function bodies are resolved on their own when the Resolver reaches their `def`, with the scope of the
+ * function around them as their enclosing scope.
+ */
+
+#include "Resolver.hpp"
+#include <deque>
+#include <stdexcept>
+
+size_t Resolver::Scope::declare(Symbol name) {
+    auto inserted = slots.insert(std::make_pair(name.id(), names.size()));
+    if (inserted.second) names.push_back(name);
+    return inserted.first->second;
+}
+
+bool Resolver::Scope::lookup(Symbol name, size_t& slot) const {
+    auto it = slots.find(name.id());
+    if (it == slots.end()) return false;
+    slot = it->second;
+    return true;
+}
+
+namespace {
+
+// Declares every name assigned within a function body, without descending into nested functions.
+class LocalCollector : public ASTVisitor {
+public:
+    explicit LocalCollector(Resolver::Scope& scope) : scope(scope) {}
+
+    void visit(BinaryExpr& expr) override {
+        expr.getLeft()->accept(*this);
+        expr.getRight()->accept(*this);
+    }
+    void visit(LiteralExpr&) override {}
+    void visit(VarExpr&) override {}
+    void visit(AssignExpr& expr) override {
+        scope.declare(expr.getSymbol());
+        expr.getValue()->accept(*this);
+    }
+    void visit(StringLiteralExpr&) override {}
+    void visit(CallExpr& expr) override {
+        for (const auto& arg : expr.getArguments()) arg->accept(*this);
+    }
+    void visit(AssignStmt& stmt) override {
+        scope.declare(stmt.getSymbol());
+        stmt.getValue()->accept(*this);
+    }
+    void visit(IfStmt& stmt) override {
+        stmt.condition->accept(*this);
+        stmt.ifBranch->accept(*this);
+        if (stmt.elseBranch) stmt.elseBranch->accept(*this);
+    }
+    void visit(PrintStmt& stmt) override {
+        for (const auto& expr : stmt.getExpressions()) expr->accept(*this);
+    }
+    void visit(ExpressionStmt& stmt) override {
+        stmt.getExpression()->accept(*this);
+    }
+    void visit(ReturnStmt& stmt) override {
+        if (stmt.getReturnValue()) stmt.getReturnValue()->accept(*this);
+    }
+    void visit(FunctionStmt&) override {} // A nested def gets its own scope
+    void visit(BlockStmt& stmt) override {
+        for (const auto& statement : stmt.getStatements()) statement->accept(*this);
+    }
+    void visit(WhileStmt& stmt) override {
+        stmt.condition->accept(*this);
+        stmt.body->accept(*this);
+    }
+    void visit(ForRangeStmt& stmt) override {
+        scope.declare(stmt.getSymbol());
+        stmt.start->accept(*this);
+        stmt.stop->accept(*this);
+        if (stmt.step) stmt.step->accept(*this);
+        stmt.body->accept(*this);
+    }
+
+private:
+    Resolver::Scope& scope;
+};
+
+} // namespace
+
+void Resolver::resolve(Stmt& root) {
+    function = nullptr;
+    root.accept(*this);
+    if (sawDeferred) {
+        // Not a valid identifier and not in `globals`, so no program name can collide with it
+        undefinedSlot = globalNames.size();
+        globalNames.push_back("<undefined>");
+    }
+}
+
+void Resolver::resolveDeferred(FunctionStmt& stmt) {
+    globalsFixed = true;
+    // The enclosing functions were resolved when their bodies were: rebuild their scopes from their locals
+    std::deque<Scope> chain;
+    Scope* inner = nullptr;
+    for (FunctionStmt* enclosing = stmt.getEnclosing(); enclosing; enclosing = enclosing->getEnclosing()) {
+        chain.emplace_back();
+        Scope& scope = chain.back();
+        scope.function = enclosing;
+        for (Symbol local : enclosing->getLocals()) scope.declare(local);
+        if (inner) inner->enclosing = &scope;
+        inner = &scope;
+    }
+    function = chain.empty() ? nullptr : &chain.front();
+    stmt.accept(*this);
+    function = nullptr;
+}
+
+size_t Resolver::declareGlobal(Symbol name) {
+    if (name.id() >= globals.size()) globals.resize(name.id() + 1, 0);
+    size_t& entry = globals[name.id()];
+    if (entry == 0) {
+        globalNames.push_back(name.name());
+        entry = globalNames.size();
+    }
+    return entry - 1;
+}
+
+void Resolver::resolveName(Symbol name, size_t& depth, size_t& slot) {
+    if (function == nullptr) {
+        depth = 0;
+        slot = declareGlobal(name);
+        return;
+    }
+    depth = 0;
+    for (const Scope* scope = function; scope; scope = scope->enclosing, ++depth) {
+        if (scope->lookup(name, slot)) return;
+    }
+    // Not local to any enclosing function either: a global, one step up from the outermost function
+    if (!globalsFixed) {
+        slot = declareGlobal(name);
+    } else {
+        slot = name.id() < globals.size() && globals[name.id()] ? globals[name.id()] - 1 : undefinedSlot;
+    }
+}
+
+void Resolver::visit(BinaryExpr& expr) {
+    expr.getLeft()->accept(*this);
+    expr.getRight()->accept(*this);
+}
+
+void Resolver::visit(LiteralExpr& expr) {}
+
+void Resolver::visit(VarExpr& expr) {
+    size_t depth, slot;
+    resolveName(expr.getSymbol(), depth, slot);
+    expr.resolve(depth, slot);
+}
+
+void Resolver::visit(AssignExpr& expr) {
+    expr.getValue()->accept(*this);
+    size_t depth, slot;
+    resolveName(expr.getSymbol(), depth, slot);
+    expr.resolve(depth, slot);
+}
+
+void Resolver::visit(StringLiteralExpr& expr) {}
+
+void Resolver::visit(CallExpr& expr) {
+    for (const auto& arg : expr.getArguments()) {
+        arg->accept(*this);
+    }
+}
+
+void Resolver::visit(AssignStmt& stmt) {
+    stmt.getValue()->accept(*this);
+    size_t depth, slot;
+    resolveName(stmt.getSymbol(), depth, slot);
+    stmt.resolve(depth, slot);
+}
+
+void Resolver::visit(IfStmt& stmt) {
+    stmt.condition->accept(*this);
+    stmt.ifBranch->accept(*this);
+    if (stmt.elseBranch) stmt.elseBranch->accept(*this);
+}
+
+void Resolver::visit(PrintStmt& stmt) {
+    for (const auto& expr : stmt.getExpressions()) {
+        expr->accept(*this);
+    }
+}
+
+void Resolver::visit(ExpressionStmt& stmt) {
+    stmt.getExpression()->accept(*this);
+}
+
+void Resolver::visit(ReturnStmt& stmt) {
+    if (function == nullptr) {
+        throw std::runtime_error("'return' outside function.");
+    }
+    if (stmt.getReturnValue()) stmt.getReturnValue()->accept(*this);
+}
+
+void Resolver::visit(FunctionStmt& stmt) {
+    stmt.setEnclosing(function ? function->function : nullptr);
+    Scope scope;
+    scope.function = &stmt;
+    scope.enclosing = function;
+    for (const auto& parameter : stmt.getParameters()) {
+        if (scope.slots.count(parameter.id())) {
+            throw std::runtime_error("Duplicate argument '" + parameter.name() + "' in function definition.");
+        }
+        scope.declare(parameter);
+    }
+    if (stmt.isDeferred()) {
+        sawDeferred = true; // Resolved by resolveDeferred once the body is parsed
+        return;
+    }
+    LocalCollector collector(scope);
+    stmt.getBody()->accept(collector);
+
+    Scope* enclosing = function;
+    function = &scope;
+    stmt.getBody()->accept(*this);
+    function = enclosing;
+
+    stmt.setLocals(std::move(scope.names));
+}
+
+void Resolver::visit(BlockStmt& stmt) {
+    for (const auto& statement : stmt.getStatements()) {
+        statement->accept(*this);
+    }
+}
+
+void Resolver::visit(WhileStmt& stmt) {
+    stmt.condition->accept(*this);
+    stmt.body->accept(*this);
+}
+
+void Resolver::visit(ForRangeStmt& stmt) {
+    stmt.start->accept(*this);
+    stmt.stop->accept(*this);
+    if (stmt.step) stmt.step->accept(*this);
+    size_t depth, slot;
+    resolveName(stmt.getSymbol(), depth, slot);
+    stmt.resolve(depth, slot);
+    stmt.body->accept(*this);
+}
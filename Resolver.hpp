@@ -0,0 +1,93 @@
+/**
+ * @file resolver.hpp
+ * @brief Declaration of the Resolver pass that binds variable names to environment slots.
+ *
+ * The Resolver runs once after `Parser::parse()` and before execution. It assigns every variable a
+ * (depth, slot) pair so that the Interpreter and the VM read and write variables by index instead of
+ * hashing names at runtime.
+ *
+ * Scoping rules (Python's function-level scoping):
+ * - Top-level code uses the global frame; every name assigned or read there gets a global slot.
+ * - Inside a `def`, parameters and every name assigned anywhere in the body (including inside nested
+ *   if/else blocks and loops, and `for` loop variables) are locals of that function. Their slots follow the parameters, in order of appearance.
+ * - Any other name read inside a function refers to the innermost enclosing function that has it as a local,
+ *   at the depth of the number of scopes between them, or else to the global frame (depth 1 from the frame of
+ *   a top-level function, one more per level of nesting). Stores always find a local, as the name is one.
+ * - Blocks do not introduce scopes, so a name assigned inside an if branch stays visible after it.
+ *
+ * Deferred function bodies (see Parser::setLazyFunctions) are skipped by `resolve` and resolved by
+ * `resolveDeferred` once they are parsed, after the global frame has been sized. Only top-level code assigns
+ * globals and all of it has been resolved by then, so a body's global references all find an existing slot,
+ * except names nothing can assign: those share one extra global slot that stays unbound, and reading them fails
+ * with the usual "not defined" error.
+ *
+ * Usage:
+ *   Resolver resolver;
+ *   resolver.resolve(*ast);
+ *   interpreter.interpret(ast, resolver.getGlobals().size());
+ */
+
+#pragma once
+#include "Parser.hpp"
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class Resolver : public ASTVisitor {
+public:
+    /**
+     * Resolves every variable reference below the root.
+     * @param root The BlockStmt returned by the parser.
+     */
+    void resolve(Stmt& root);
+
+    /**
+     * Resolves a deferred function body that has just been parsed, without adding global slots.
+     * @param function A function that was deferred when `resolve` ran (or nested in such a function).
+     */
+    void resolveDeferred(FunctionStmt& function);
+
+    // Names of the global slots, indexed by slot.
+    const std::vector<std::string>& getGlobals() const { return globalNames; }
+
+    void visit(BinaryExpr& expr) override;
+    void visit(LiteralExpr& expr) override;
+    void visit(VarExpr& expr) override;
+    void visit(AssignExpr& expr) override;
+    void visit(StringLiteralExpr& expr) override;
+    void visit(CallExpr& expr) override;
+    void visit(AssignStmt& stmt) override;
+    void visit(IfStmt& stmt) override;
+    void visit(PrintStmt& stmt) override;
+    void visit(ExpressionStmt& stmt) override;
+    void visit(ReturnStmt& stmt) override;
+    void visit(FunctionStmt& stmt) override;
+    void visit(BlockStmt& stmt) override;
+    void visit(WhileStmt& stmt) override;
+    void visit(ForRangeStmt& stmt) override;
+
+    /**
+     * The slots of one function frame: a symbol ID to slot map plus the names in slot order, and the scope of
+     * the function the def is nested in.
+     */
+    struct Scope {
+        std::unordered_map<uint32_t, size_t> slots;
+        std::vector<Symbol> names;
+        FunctionStmt* function = nullptr;
+        Scope* enclosing = nullptr; // Null for a top-level function
+
+        size_t declare(Symbol name);
+        bool lookup(Symbol name, size_t& slot) const;
+    };
+
+private:
+    std::vector<size_t> globals;                  // Global slot + 1 by symbol ID, 0 if the name has none
+    std::vector<std::string> globalNames;         // Text of every global slot, in slot order
+    Scope* function = nullptr; // Scope of the function being resolved, null at top level
+    bool sawDeferred = false;  // Some function body was deferred, so the undefined slot is needed
+    bool globalsFixed = false; // The global frame is sized; unknown names go to the undefined slot
+    size_t undefinedSlot = 0;
+
+    size_t declareGlobal(Symbol name);
+    void resolveName(Symbol name, size_t& depth, size_t& slot);
+};
@@ -0,0 +1,279 @@
+/**
+ * @file runtime.cpp
+ * @brief Implementation of runProgram, the pipeline shared by main and the server.
+ */
+
+#include "Runtime.hpp"
+#include "Lexer.hpp"
+#include "Parser.hpp"
+#include "Interpreter.hpp"
+#include "Resolver.hpp"
+#include "Optimizer.hpp"
+#include "Purity.hpp"
+#include "Profiler.hpp"
+#include "Compiler.hpp"
+#include "VM.hpp"
+#include "Closure.hpp"
+#include "Lazy.hpp"
+#include "AstCache.hpp"
+#include "SourceFile.hpp"
+#include "MemStats.hpp"
+#include "Utilities.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+// Native stack given to one level of interpreted recursion. A typical call uses well under this, so the recursion
+// limit is usually reached first; a call whose body nests deeper finds the stack low and raises RecursionError
+// instead (see nativeStackLow).
+static const size_t nativeStackPerCall = 4096;
+
+// Runs a back end that recurses on the native stack, on a stack sized for the recursion limit.
+template<typename Body>
+static void runRecursive(const RunOptions& options, Body body) {
+    const size_t base = 1 << 20;
+    size_t stackBytes = options.recursionLimit < (SIZE_MAX - base) / nativeStackPerCall
+        ? options.recursionLimit * nativeStackPerCall + base : SIZE_MAX;
+    if (stackBytes <= options.callerStackBytes) {
+        body();
+    } else {
+        runWithStackSize(stackBytes, body);
+    }
+}
+
+// Writes the collapsed stacks to `path` and the summary to `err`.
+static void writeProfile(Profiler& profiler, const std::string& path, std::ostream& err) {
+    profiler.finish();
+    std::ofstream file(path, std::ios::trunc);
+    if (file) {
+        profiler.writeCollapsed(file);
+    } else {
+        err << "Could not write profile to " << path << std::endl;
+    }
+    profiler.writeSummary(err);
+}
+
+// Adds the time spent between enter() and the next enter() (or the end of the run) to a field of RunTimings.
+class PhaseClock {
+public:
+    explicit PhaseClock(RunTimings* timings) : timings(timings) {}
+    ~PhaseClock() { stop(); }
+
+    void enter(uint64_t RunTimings::*phase) {
+        stop();
+        if (!timings) return;
+        current = &(timings->*phase);
+        started = Clock::now();
+    }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+    RunTimings* timings;
+    uint64_t* current = nullptr;
+    Clock::time_point started;
+
+    void stop() {
+        if (!current) return;
+        *current += static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - started).count());
+        current = nullptr;
+    }
+};
+
+// With --mem-stats, counts the allocations of each phase of the run (see MemStats.hpp) and reports them, with the
+// Arena's footprint, when the run ends, whether it succeeds or not.
+class MemoryReport {
+public:
+    MemoryReport(bool enabled, const Arena& arena, std::ostream& err) : enabled(enabled), arena(arena), err(err) {
+        if (enabled) MemStats::start(MemStats::Phase::Parse);
+    }
+    ~MemoryReport() {
+        if (!enabled) return;
+        MemStats::stop();
+        MemStats::report(err);
+        err << "mem: arena_kb=" << arena.bytesReserved() / 1024 << std::endl;
+    }
+
+    void enter(MemStats::Phase phase) {
+        if (enabled) MemStats::enter(phase);
+    }
+
+private:
+    bool enabled;
+    const Arena& arena;
+    std::ostream& err;
+};
+
+int runProgram(const char* source, size_t size, const std::string& filename, const RunOptions& options,
+               std::ostream& out, std::ostream& err, RunTimings* timings) {
+    PhaseClock clock(timings);
+    // Every AST node is allocated in the arena; the whole tree is released at once when it goes out of scope,
+    // after the interpreter that refers to it
+    Arena arena;
+    MemoryReport memory(options.memoryStats, arena, err);
+    try {
+        clock.enter(&RunTimings::parse);
+        Interpreter interpreter;
+        interpreter.setOutput(out);
+
+        // With --cache, a valid __pycache__ entry replaces lexing, parsing, resolving and optimizing
+        Stmt* ast = nullptr;
+        std::vector<std::string> globals;
+        std::unique_ptr<AstCache> cache;
+        if (options.useCache) {
+            cache = std::make_unique<AstCache>(filename, source, size, options.optimizationLevel);
+            ast = cache->load(arena, globals);
+        }
+
+        // Function bodies are parsed on their first call only on the tree-walker, whose other options do
+        // not need every body up front
+        bool lazy = options.lazyFunctions && !options.useCache && !options.useVM && !options.dumpBytecode &&
+                    !options.useClosures && !options.memoize && options.profilePath.empty();
+        Resolver resolver; // Kept for the bodies resolved during the run
+        std::unique_ptr<BodyLoader> loader;
+
+        if (!ast) {
+            // Tokens are produced on demand while parsing
+            Lexer lexer(source, size);
+
+            // Parse the tokens into an AST
+            Parser parser(lexer, arena);
+            parser.setDiagnostics(err);
+            parser.setLazyFunctions(lazy);
+            ast = parser.parse();
+
+            // Ensure parsing resulted in an AST node
+            if (!ast) {
+                err << "Parsing error encountered." << std::endl;
+                return 1;
+            }
+
+            // Bind every variable reference to its environment slot
+            memory.enter(MemStats::Phase::Resolve);
+            resolver.resolve(*ast);
+            globals = resolver.getGlobals();
+            if (lazy) {
+                loader = std::make_unique<BodyLoader>(source, arena, parser.getStrings(), parser.getSymbols(),
+                                                      resolver, options.optimizationLevel);
+                loader->setDiagnostics(err);
+                interpreter.setBodyLoader(loader.get());
+            }
+
+            // Fold constant expressions and drop if branches that can never run
+            if (options.optimizationLevel >= 1) {
+                Optimizer optimizer(arena);
+                optimizer.optimize(*ast);
+            }
+
+            // A tree from a parse that skipped statements would hide their errors on later runs
+            if (cache && !parser.hadErrors()) {
+                cache->store(*ast, globals);
+            }
+        }
+
+        clock.enter(&RunTimings::compile);
+        memory.enter(MemStats::Phase::Compile);
+        if (options.useVM || options.dumpBytecode) {
+            // Lower the AST to bytecode and run it on the VM
+            Compiler compiler;
+            compiler.setSuperinstructions(options.optimizationLevel >= 1);
+            Chunk chunk = compiler.compile(*ast, globals);
+            if (options.dumpBytecode) {
+                disassemble(chunk, out);
+                return 0;
+            }
+            VM vm;
+            vm.setRecursionLimit(options.recursionLimit);
+            vm.setOutput(out);
+            vm.setDispatch(options.switchDispatch ? VM::Dispatch::Switch : VM::Dispatch::Threaded);
+            clock.enter(&RunTimings::execute);
+            memory.enter(MemStats::Phase::Execute);
+            vm.run(chunk);
+            return 0;
+        }
+
+        if (options.useClosures) {
+            ClosureProgram program(*ast, globals, arena);
+            program.setRecursionLimit(options.recursionLimit);
+            program.setOutput(out);
+            clock.enter(&RunTimings::execute);
+            memory.enter(MemStats::Phase::Execute);
+            runRecursive(options, [&]() { program.run(); });
+            return 0;
+        }
+
+        interpreter.setRecursionLimit(options.recursionLimit);
+        if (options.memoize) {
+            PurityAnalysis purity;
+            purity.analyze(*ast);
+            interpreter.enableMemoization();
+        }
+        // Instrumented last, so the cache entry written above and the analyses never see the counting nodes
+        std::unique_ptr<Profiler> profiler;
+        if (!options.profilePath.empty()) {
+            profiler = std::make_unique<Profiler>();
+            profiler->instrument(*ast, arena);
+            interpreter.setProfiler(profiler.get());
+        }
+        size_t globalSlotCount = globals.size();
+        clock.enter(&RunTimings::execute);
+        memory.enter(MemStats::Phase::Execute);
+        try {
+            runRecursive(options, [&]() { interpreter.interpret(ast, globalSlotCount); });
+        } catch (const std::exception&) {
+            // The profile of a failed run shows where it was spent up to the error
+            if (profiler) writeProfile(*profiler, options.profilePath, err);
+            throw;
+        }
+        if (profiler) writeProfile(*profiler, options.profilePath, err);
+
+        if (const MemoTable* memo = interpreter.getMemoTable()) {
+            size_t lookups = memo->getHits() + memo->getMisses();
+            err << "memo: " << memo->getHits() << " hits, " << memo->getMisses() << " misses, "
+                << memo->getEvictions() << " evictions, hit rate "
+                << (lookups ? 100.0 * memo->getHits() / lookups : 0.0) << "%" << std::endl;
+        }
+    } catch (const std::exception& e) {
+        err << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+std::vector<ScriptResult> runScripts(const std::vector<std::string>& paths, const RunOptions& options,
+                                     size_t threads) {
+    std::vector<ScriptResult> results(paths.size());
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = std::min(threads, paths.size());
+
+    RunOptions run = options;
+    run.callerStackBytes = 0; // Worker threads have the platform's default stack, so size the tree-walker's
+
+    // Each thread claims the next unstarted script; results are written to distinct elements only
+    std::atomic<size_t> next(0);
+    auto worker = [&]() {
+        for (size_t i = next++; i < paths.size(); i = next++) {
+            ScriptResult& result = results[i];
+            result.path = paths[i];
+            std::ostringstream out, err;
+            SourceFile source;
+            if (source.open(paths[i])) {
+                result.status = runProgram(source.data(), source.size(), paths[i], run, out, err, &result.timings);
+            } else {
+                err << "Could not open file: " << paths[i] << std::endl;
+            }
+            result.output = out.str();
+            result.errors = err.str();
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (size_t i = 1; i < threads; i++) pool.push_back(std::thread(worker));
+    worker(); // The calling thread takes a share too
+    for (std::thread& thread : pool) thread.join();
+    return results;
+}
@@ -0,0 +1,90 @@
+/**
+ * @file runtime.hpp
+ * @brief Runs one script from source text to exit code with its own output streams.
+ *
+ * `runProgram` is the whole pipeline main used to spell out inline: parse (or load from the AstCache), resolve,
+ * optimize, then execute on the tree-walker, the VM or the closure-compiled back end. Everything a run needs
+ * lives inside the call (Arena, Interpreter, VM), and the program's output and error messages go to the streams
+ * passed in instead of std::cout/std::cerr, so a process can run many scripts one after another, or several at
+ * once on different threads, without them affecting each other (see Server.hpp). No part of the pipeline keeps mutable state
+ * outside the objects of one run: the parser does not capture the Interpreter in the tree, print and the
+ * tree-walker write to the Interpreter's own stream, and the only rewiring of std::cout/std::cerr (TraceLog)
+ * happens in main.
+ *
+ * `runScripts` runs a batch of script files on a set of threads, each script with its own output buffers, for
+ * suites like ex1/ and ex2/ where the scripts are independent.
+ *
+ * Usage:
+ *   RunOptions options;
+ *   options.useVM = true;
+ *   RunTimings timings;
+ *   int status = runProgram(source.data(), source.size(), filename, options, std::cout, std::cerr, &timings);
+ *   std::vector<ScriptResult> results = runScripts(paths, options, 0);
+ */
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+struct RunOptions {
+    bool useVM = false;
+    bool useClosures = false;      // Run the closure-compiled back end (see Closure.hpp); --vm takes precedence
+    bool dumpBytecode = false;     // Print the bytecode listing instead of running
+    bool switchDispatch = false;   // Run the VM's switch loop instead of the threaded one
+    int optimizationLevel = 1;
+    size_t recursionLimit = 10000;
+    bool memoize = false;          // Tree-walker only; the hit rate is reported on the error stream
+    bool useCache = false;         // Load and store the parsed program in __pycache__ next to `filename`
+    // Tree-walker only: parse each function body on the first call of the function (see Lazy.hpp). Ignored
+    // with the VM, closures, the cache, memoization or profiling, which all need every body up front.
+    bool lazyFunctions = false;
+    // Tree-walker only: write the collapsed call stacks to this file at the end of the run and the profile
+    // summary to the error stream (see Profiler.hpp). Empty to run without profiling.
+    std::string profilePath;
+    // Count the allocations of each phase and report them, the peak RSS and the Arena's size on the error stream
+    // (see MemStats.hpp). The counters are process-wide: only one run at a time may enable this.
+    bool memoryStats = false;
+    // Native stack the calling thread is known to have. The tree-walker moves to a thread of its own when the
+    // recursion limit needs more; 0 always gives it one, for callers running on threads of unknown stack size.
+    size_t callerStackBytes = 8 << 20;
+};
+
+// Wall-clock time spent in each phase of one run, in microseconds (recorded in the trace, see Trace.hpp)
+struct RunTimings {
+    uint64_t parse = 0;    // Lexing, parsing, resolving and optimizing, or loading the AstCache entry instead
+    uint64_t compile = 0;  // Compiling to bytecode or closures; the purity analysis and profiler on the tree-walker
+    uint64_t execute = 0;
+};
+
+/**
+ * Runs a script.
+ * @param source The script's text; it only has to stay alive for the duration of the call.
+ * @param filename Name used for the cache entry (and nothing else); need not exist when useCache is off.
+ * @param out Receives the program's output.
+ * @param err Receives parse diagnostics, the memo, profile and memory reports and the "Error: ..." line of a
+ *            failed run.
+ * @param timings If not null, receives the time spent in each phase, up to the error for a failed run.
+ * @return The process exit code of the run: 0 on success, 1 on an error.
+ */
+int runProgram(const char* source, size_t size, const std::string& filename, const RunOptions& options,
+               std::ostream& out, std::ostream& err, RunTimings* timings = nullptr);
+
+struct ScriptResult {
+    std::string path;
+    int status = 1;        // As returned by runProgram; 1 if the file could not be opened
+    std::string output;
+    std::string errors;
+    RunTimings timings;
+};
+
+/**
+ * Runs every script in `paths` and collects their output.
+ * @param threads Threads to run the scripts on, 0 for one per hardware thread. Scripts are handed out in order,
+ *                one at a time, to whichever thread is free.
+ * @return One result per path, in the order of `paths`.
+ */
+std::vector<ScriptResult> runScripts(const std::vector<std::string>& paths, const RunOptions& options,
+                                     size_t threads);
@@ -0,0 +1,308 @@
+/**
+ * @file server.cpp
+ * @brief Implementation of the request loop, the connection framing and the worker pool of `--serve`.
+ *
+ * One reader per connection (the main thread for stdin, a detached thread per socket client) parses requests
+ * and queues them on the shared WorkerPool. A worker runs the script into string streams and writes the framed
+ * response with a single locked write sequence, so responses from different workers never interleave. The
+ * Connection is shared by its reader and its queued jobs and closes its socket when the last of them is done.
+ */
+
+#include "Server.hpp"
+#include "SourceFile.hpp"
+#include "Trace.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cerrno>
+#include <condition_variable>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+// Fixed set of threads running queued jobs in FIFO order.
+class WorkerPool {
+public:
+    explicit WorkerPool(size_t count) {
+        for (size_t i = 0; i < count; i++) {
+            threads.push_back(std::thread(&WorkerPool::run, this));
+        }
+    }
+
+    // Finishes every queued job, then stops the threads.
+    ~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread& thread : threads) thread.join();
+    }
+
+    void submit(std::function<void()> job) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back(std::move(job));
+        }
+        wake.notify_one();
+    }
+
+private:
+    std::vector<std::thread> threads;
+    std::deque<std::function<void()>> jobs;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    void run() {
+        for (;;) {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this]() { return stopping || !jobs.empty(); });
+                if (jobs.empty()) return; // Stopping and drained
+                job = std::move(jobs.front());
+                jobs.pop_front();
+            }
+            job();
+        }
+    }
+};
+
+// A client: requests are read from `input`, framed responses are written to `output`.
+class Connection {
+public:
+    Connection(int input, int output, bool owned) : input(input), output(output), owned(owned), buffer(64 * 1024) {}
+    ~Connection() {
+        if (owned) {
+            ::close(input);
+            if (output != input) ::close(output);
+        }
+    }
+
+    Connection(const Connection&) = delete;
+    Connection& operator=(const Connection&) = delete;
+
+    // Reads one line without its line terminator; false at the end of the input.
+    bool readLine(std::string& line) {
+        line.clear();
+        for (;;) {
+            char* first = buffer.data() + begin;
+            char* newline = static_cast<char*>(std::memchr(first, '\n', end - begin));
+            if (newline) {
+                line.append(first, newline);
+                begin = newline - buffer.data() + 1;
+                if (!line.empty() && line.back() == '\r') line.pop_back();
+                return true;
+            }
+            line.append(first, end - begin);
+            begin = end = 0;
+            if (!fill()) return !line.empty(); // A last line without a newline still counts
+        }
+    }
+
+    // Reads exactly `count` bytes; false if the input ends first.
+    bool readBytes(size_t count, std::string& bytes) {
+        bytes.clear();
+        bytes.reserve(count);
+        while (bytes.size() < count) {
+            if (begin == end) {
+                begin = end = 0;
+                if (!fill()) return false;
+            }
+            size_t take = std::min(count - bytes.size(), end - begin);
+            bytes.append(buffer.data() + begin, take);
+            begin += take;
+        }
+        return true;
+    }
+
+    void respond(unsigned long id, int status, const std::string& out, const std::string& err) {
+        std::string header = "done " + std::to_string(id) + " " + std::to_string(status) + " " +
+                             std::to_string(out.size()) + " " + std::to_string(err.size()) + "\n";
+        std::lock_guard<std::mutex> lock(writeMutex);
+        // A client that went away just loses its responses
+        writeAll(header) && writeAll(out) && writeAll(err);
+    }
+
+private:
+    int input;
+    int output;
+    bool owned; // Close the descriptors when done (socket clients, not stdin/stdout)
+    std::vector<char> buffer;
+    size_t begin = 0; // Unread part of the buffer is [begin, end)
+    size_t end = 0;
+    std::mutex writeMutex;
+
+    bool fill() {
+        for (;;) {
+            ssize_t count = ::read(input, buffer.data() + end, buffer.size() - end);
+            if (count > 0) {
+                end += static_cast<size_t>(count);
+                return true;
+            }
+            if (count < 0 && errno == EINTR) continue;
+            return false;
+        }
+    }
+
+    bool writeAll(const std::string& data) {
+        size_t written = 0;
+        while (written < data.size()) {
+            ssize_t count = ::write(output, data.data() + written, data.size() - written);
+            if (count < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            written += static_cast<size_t>(count);
+        }
+        return true;
+    }
+};
+
+struct ServerState {
+    RunOptions run;
+    WorkerPool pool;
+    TraceLog* trace; // Null without a trace; records runs from any worker
+    ServerState(const RunOptions& run, size_t workers, TraceLog* trace) : run(run), pool(workers), trace(trace) {}
+};
+
+bool startsWith(const std::string& text, const char* prefix) {
+    return text.compare(0, std::strlen(prefix), prefix) == 0;
+}
+
+// Parses "<length>[ <name>]" after "source "; false if the length is not a plain decimal number.
+bool parseSourceHeader(const std::string& rest, size_t& length, std::string& name) {
+    size_t digits = 0;
+    while (digits < rest.size() && rest[digits] >= '0' && rest[digits] <= '9') digits++;
+    if (digits == 0 || digits > 12 || (digits < rest.size() && rest[digits] != ' ')) return false;
+    length = static_cast<size_t>(std::strtoull(rest.c_str(), nullptr, 10));
+    name = digits < rest.size() ? rest.substr(digits + 1) : "<source>";
+    return true;
+}
+
+void serveConnection(std::shared_ptr<Connection> connection, ServerState& state) {
+    unsigned long id = 0;
+    std::string line;
+    while (connection->readLine(line)) {
+        if (line.empty()) continue;
+        id++;
+        if (startsWith(line, "run ")) {
+            std::string path = line.substr(4);
+            ServerState* server = &state;
+            state.pool.submit([connection, server, id, path]() {
+                std::ostringstream out, err;
+                int status = 1;
+                RunTimings timings;
+                SourceFile source;
+                if (source.open(path)) {
+                    status = runProgram(source.data(), source.size(), path, server->run, out, err, &timings);
+                } else {
+                    err << "Could not open file: " << path << std::endl;
+                }
+                if (server->trace) server->trace->recordRun(path, out.str(), err.str(), status, timings);
+                connection->respond(id, status, out.str(), err.str());
+            });
+        } else if (startsWith(line, "source ")) {
+            size_t length;
+            std::string name;
+            if (!parseSourceHeader(line.substr(7), length, name)) {
+                connection->respond(id, 2, "", "Invalid source length: " + line + "\n");
+                return; // The rest of the stream cannot be framed
+            }
+            auto text = std::make_shared<std::string>();
+            if (!connection->readBytes(length, *text)) return;
+            ServerState* server = &state;
+            state.pool.submit([connection, server, id, name, text]() {
+                std::ostringstream out, err;
+                RunOptions options = server->run;
+                options.useCache = false; // There is no file to keep the entry next to
+                RunTimings timings;
+                int status = runProgram(text->data(), text->size(), name, options, out, err, &timings);
+                if (server->trace) server->trace->recordRun(name, out.str(), err.str(), status, timings);
+                connection->respond(id, status, out.str(), err.str());
+            });
+        } else {
+            connection->respond(id, 2, "", "Unknown request: " + line + "\n");
+        }
+    }
+}
+
+} // namespace
+
+int serve(const ServeOptions& options, TraceLog* trace) {
+    std::signal(SIGPIPE, SIG_IGN); // Writing to a client that disconnected must not kill the server
+
+    size_t workers = options.workers;
+    if (workers == 0) workers = std::max(1u, std::thread::hardware_concurrency());
+    RunOptions run = options.run;
+    run.callerStackBytes = 0; // Pool threads have the platform's default stack, so size the tree-walker's
+
+    if (options.socketPath.empty()) {
+        // Destroying the state drains the pool, so every request read from stdin is answered before returning
+        ServerState state(run, workers, trace);
+        serveConnection(std::make_shared<Connection>(STDIN_FILENO, STDOUT_FILENO, false), state);
+        return 0;
+    }
+
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (options.socketPath.size() >= sizeof(address.sun_path)) {
+        std::cerr << "Socket path too long: " << options.socketPath << std::endl;
+        return 1;
+    }
+    std::strcpy(address.sun_path, options.socketPath.c_str());
+
+    // Replace a socket left behind by an earlier server, but never a file of another kind
+    struct stat existing;
+    if (::lstat(options.socketPath.c_str(), &existing) == 0) {
+        if (!S_ISSOCK(existing.st_mode)) {
+            std::cerr << "Not a socket, refusing to replace it: " << options.socketPath << std::endl;
+            return 1;
+        }
+        ::unlink(options.socketPath.c_str());
+    }
+
+    int listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) {
+        std::cerr << "Could not create socket: " << std::strerror(errno) << std::endl;
+        return 1;
+    }
+    if (::bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+        ::listen(listener, SOMAXCONN) != 0) {
+        std::cerr << "Could not listen on " << options.socketPath << ": " << std::strerror(errno) << std::endl;
+        ::close(listener);
+        return 1;
+    }
+
+    // Readers are detached and may still be running when this function returns, so the state lives until
+    // the process exits
+    ServerState* state = new ServerState(run, workers, trace);
+    for (;;) {
+        int client = ::accept(listener, nullptr, nullptr);
+        if (client < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (errno == EMFILE || errno == ENFILE) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10)); // Wait for a client to hang up
+                continue;
+            }
+            std::cerr << "Could not accept connection: " << std::strerror(errno) << std::endl;
+            ::close(listener);
+            return 1;
+        }
+        std::thread(serveConnection, std::make_shared<Connection>(client, client, true), std::ref(*state)).detach();
+    }
+}
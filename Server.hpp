@@ -0,0 +1,47 @@
+/**
+ * @file server.hpp
+ * @brief Persistent server mode (`mypython --serve`): one warm process runs many scripts.
+ *
+ * Starting a process, mapping the binary and opening the trace file cost more than running a short script.
+ * In server mode mypython reads requests from stdin (answering on stdout) or from clients of a Unix socket,
+ * and a pool of worker threads runs them through `runProgram`. Each request gets its own Arena, Interpreter
+ * (or VM) and output buffers, so requests are isolated from each other and independent ones run concurrently.
+ *
+ * Protocol (one request per line, responses are framed so output of any content can be carried):
+ *   run <path>                  Run the script at <path> (relative to the server's working directory).
+ *   source <length> [<name>]    Run the <length> bytes of source that follow the line. <name> is only a label.
+ *
+ *   done <id> <status> <outLength> <errLength>\n<program output><error output>
+ *
+ * Requests on a connection are numbered from 1 in the order they were received; the response to each one
+ * carries its number, and responses are sent as requests finish, which is not necessarily in request order.
+ * <status> is the exit code a normal run of the script would have had (2 for a malformed request). A `source`
+ * request with an invalid length ends the connection, since the rest of the stream cannot be framed.
+ *
+ * All requests run with the options given on the command line (--vm, -O0, --recursion-limit, --memo, --cache).
+ * The trace, if any, is opened once and records every request as a run, with its output (see Trace.hpp).
+ *
+ * Usage:
+ *   ServeOptions options;
+ *   options.socketPath = "/tmp/mypython.sock"; // Empty to serve stdin
+ *   return serve(options, trace.get());
+ */
+
+#pragma once
+#include "Runtime.hpp"
+#include <string>
+
+class TraceLog;
+
+struct ServeOptions {
+    RunOptions run;
+    size_t workers = 0;       // Worker threads, 0 for one per hardware thread
+    std::string socketPath;   // Unix socket to listen on (replacing only a socket); empty to read requests from stdin
+};
+
+/**
+ * Serves requests until stdin reaches its end (the socket server runs until the process is stopped).
+ * @param trace Records every request, or null.
+ * @return The process exit code: 0, or 1 if the socket could not be set up.
+ */
+int serve(const ServeOptions& options, TraceLog* trace);
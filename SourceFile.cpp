@@ -0,0 +1,64 @@
+/**
+ * @file sourcefile.cpp
+ * @brief Implementation of SourceFile using POSIX mmap with a read() fallback.
+ *
+ * Regular, non-empty files are mapped with PROT_READ/MAP_PRIVATE and advised for sequential access, matching
+ * the Lexer's single forward pass. Anything else is read into a std::string with the same interface.
+ */
+
+#include "SourceFile.hpp"
+#include <fstream>
+#include <sstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+SourceFile::~SourceFile() {
+    close();
+}
+
+void SourceFile::close() {
+    if (mapping) {
+        munmap(mapping, length);
+        mapping = nullptr;
+    }
+    buffer.clear();
+    contents = "";
+    length = 0;
+}
+
+bool SourceFile::open(const std::string& path) {
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+        void* address = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (address != MAP_FAILED) {
+            madvise(address, static_cast<size_t>(info.st_size), MADV_SEQUENTIAL);
+            ::close(fd); // The mapping stays valid after the descriptor is closed
+            mapping = address;
+            contents = static_cast<const char*>(address);
+            length = static_cast<size_t>(info.st_size);
+            return true;
+        }
+    }
+    ::close(fd);
+
+    // Fall back to reading the file's content into a string
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+    std::ostringstream stream;
+    stream << file.rdbuf();
+    buffer = stream.str();
+    contents = buffer.data();
+    length = buffer.size();
+    return true;
+}
@@ -0,0 +1,50 @@
+/**
+ * @file sourcefile.hpp
+ * @brief Read-only view of a source file, memory-mapped where possible.
+ *
+ * main used to read the script through a std::stringstream and copy it into a std::string, and the Lexer copied
+ * it once more, so a large script was resident up to three times. A SourceFile maps the file into memory
+ * instead: the pages are shared with the page cache and loaded lazily as the Lexer walks forward, so the
+ * interpreter never holds its own copy of the text.
+ *
+ * Details:
+ * - The mapping is read-only and is not NUL-terminated; consumers must use `size()` (the Lexer does).
+ * - Empty files and files that cannot be mapped (pipes, some special files) are read into an owned buffer
+ *   instead, so callers always see the same `data()`/`size()` interface.
+ * - The mapping is released in the destructor. Tokens and anything else pointing into `data()` must not outlive it.
+ *
+ * Usage:
+ *   SourceFile file;
+ *   if (!file.open("script.py")) { ... }
+ *   Lexer lexer(file.data(), file.size());
+ */
+
+#pragma once
+#include <cstddef>
+#include <string>
+
+class SourceFile {
+public:
+    SourceFile() = default;
+    ~SourceFile();
+
+    SourceFile(const SourceFile&) = delete;
+    SourceFile& operator=(const SourceFile&) = delete;
+
+    /**
+     * Maps (or, as a fallback, reads) the file.
+     * @return false if the file cannot be opened.
+     */
+    bool open(const std::string& path);
+
+    const char* data() const { return contents; }
+    size_t size() const { return length; }
+
+private:
+    const char* contents = "";
+    size_t length = 0;
+    void* mapping = nullptr; // Start of the mmap'ed region, null when the contents live in `buffer`
+    std::string buffer;
+
+    void close();
+};
@@ -0,0 +1,101 @@
+/**
+ * @file symbol.hpp
+ * @brief Interned identifiers: every distinct variable and function name of a program as one small integer.
+ *
+ * The Parser interns each identifier as it consumes the token, straight from the token's slice of the source, so
+ * a name is copied out of the source once per program rather than once per occurrence, and the AST stores a
+ * one-word Symbol instead of a std::string. Equal names are the same Symbol; comparing two is comparing
+ * pointers, and the passes that keep tables by name (function bindings, resolver scopes, the purity analysis,
+ * the compilers) key them by the dense `id()` instead of hashing the text again.
+ *
+ * A SymbolTable is created per program, in the program's Arena, by the Parser (or by the AST cache when it
+ * rebuilds a tree), and shared with the parser of every deferred function body (see Lazy.hpp), so one name has
+ * one ID across the whole program. IDs count from 0 in order of first appearance. Symbols stay valid, and
+ * their text stays at the same address, as long as the table.
+ *
+ * Usage:
+ *   SymbolTable symbols;
+ *   Symbol name = symbols.intern(source + token.offset, token.length);
+ *   bindings[name.id()] ... ; std::cout << name.name();
+ */
+
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <vector>
+
+struct SymbolEntry {
+    std::string name;
+    uint32_t id;
+};
+
+class Symbol {
+    const SymbolEntry* entry;
+
+public:
+    explicit Symbol(const SymbolEntry& entry) : entry(&entry) {}
+
+    uint32_t id() const { return entry->id; }
+    const std::string& name() const { return entry->name; }
+
+    bool operator==(Symbol other) const { return entry == other.entry; }
+    bool operator!=(Symbol other) const { return entry != other.entry; }
+};
+
+/**
+ * Open-addressing hash table from name to entry. Lookups hash and compare the caller's bytes in place, so
+ * interning a name that is already known allocates nothing.
+ */
+class SymbolTable {
+    std::deque<SymbolEntry> entries; // Indexed by ID; a deque never moves its elements as it grows
+    // ID + 1 of the entry in each bucket, 0 if empty, with the entry's hash so that a probe past another name
+    // does not have to load its entry; a power of two in size
+    struct Bucket {
+        uint32_t id;
+        uint32_t hash;
+    };
+    std::vector<Bucket> buckets;
+
+    static uint32_t hashOf(const char* text, size_t length) {
+        uint32_t hash = 2166136261u; // 32-bit FNV-1a
+        for (size_t i = 0; i < length; i++) {
+            hash = (hash ^ static_cast<unsigned char>(text[i])) * 16777619u;
+        }
+        return hash;
+    }
+
+    void grow() {
+        std::vector<Bucket> larger(buckets.empty() ? 64 : buckets.size() * 2, Bucket{0, 0});
+        size_t mask = larger.size() - 1;
+        for (const Bucket& bucket : buckets) {
+            if (!bucket.id) continue;
+            size_t index = bucket.hash & mask;
+            while (larger[index].id) index = (index + 1) & mask;
+            larger[index] = bucket;
+        }
+        buckets.swap(larger);
+    }
+
+public:
+    Symbol intern(const char* text, size_t length) {
+        if ((entries.size() + 1) * 2 > buckets.size()) grow(); // At most half full
+        uint32_t hash = hashOf(text, length);
+        size_t mask = buckets.size() - 1;
+        size_t index = hash & mask;
+        for (; buckets[index].id; index = (index + 1) & mask) {
+            if (buckets[index].hash != hash) continue;
+            const SymbolEntry& entry = entries[buckets[index].id - 1];
+            if (entry.name.size() == length && std::memcmp(entry.name.data(), text, length) == 0) return Symbol(entry);
+        }
+        uint32_t id = static_cast<uint32_t>(entries.size());
+        entries.push_back(SymbolEntry{std::string(text, length), id});
+        buckets[index] = Bucket{id + 1, hash};
+        return Symbol(entries.back());
+    }
+    Symbol intern(const std::string& name) { return intern(name.data(), name.size()); }
+
+    // Number of distinct names, and one more than the largest ID
+    size_t size() const { return entries.size(); }
+};
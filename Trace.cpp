@@ -0,0 +1,483 @@
+/**
+ * @file trace.cpp
+ * @brief Implementation of the TraceLog, which writes the trace files, and of queryTrace, which reads them.
+ *
+ * The console streams are teed (see TeeBuffer) to a TraceRecorder each, which turns every block they hand on into
+ * an output record while a run is open. All writes to the files (records from the console, whole runs from the
+ * server's workers, rotation) happen under the TraceLog's mutex, so records of different runs never interleave.
+ */
+
+#include "Trace.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iomanip>
+#include <sys/stat.h>
+#include <vector>
+
+namespace {
+
+const char logMagic[8] = {'M', 'P', 'Y', 'T', 'R', 'A', 'C', 'E'};
+const char indexMagic[8] = {'M', 'P', 'Y', 'T', 'R', 'I', 'D', 'X'};
+const uint32_t formatVersion = 1;
+const size_t fileHeaderSize = 12;  // Magic and version
+const size_t recordHeaderSize = 5; // Type and payload length
+const size_t indexEntrySize = 72;
+// Output larger than this is split over several records, so the payload length always fits in 32 bits
+const size_t maxOutputRecord = 1 << 30;
+
+void putU32(std::string& out, uint32_t value) {
+    for (int i = 0; i < 4; i++) out += static_cast<char>(value >> (8 * i));
+}
+
+void putU64(std::string& out, uint64_t value) {
+    for (int i = 0; i < 8; i++) out += static_cast<char>(value >> (8 * i));
+}
+
+uint32_t getU32(const char* data) {
+    uint32_t value = 0;
+    for (int i = 3; i >= 0; i--) value = (value << 8) | static_cast<unsigned char>(data[i]);
+    return value;
+}
+
+uint64_t getU64(const char* data) {
+    uint64_t value = 0;
+    for (int i = 7; i >= 0; i--) value = (value << 8) | static_cast<unsigned char>(data[i]);
+    return value;
+}
+
+std::string fileHeader(const char* magic) {
+    std::string header(magic, 8);
+    putU32(header, formatVersion);
+    return header;
+}
+
+bool hasFileHeader(const std::string& data, const char* magic) {
+    return data.size() >= fileHeaderSize && std::memcmp(data.data(), magic, 8) == 0 &&
+           getU32(data.data() + 8) == formatVersion;
+}
+
+// FNV-1a, to skip the start records of runs of other files without reading them
+uint32_t hashName(const std::string& name) {
+    uint32_t hash = 2166136261u;
+    for (char c : name) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+uint64_t sizeOf(const std::string& path) {
+    struct stat status;
+    return ::stat(path.c_str(), &status) == 0 ? static_cast<uint64_t>(status.st_size) : 0;
+}
+
+bool exists(const std::string& path) {
+    struct stat status;
+    return ::stat(path.c_str(), &status) == 0;
+}
+
+int64_t microsecondsSinceEpoch() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// Names of the files of a generation: 0 is the current one, 1 the most recently rotated
+std::string generationPath(const std::string& basePath, int generation, const char* extension) {
+    if (generation == 0) return basePath + extension;
+    return basePath + "." + std::to_string(generation) + extension;
+}
+
+} // namespace
+
+
+// Streambuf that hands everything written to it to the TraceLog as output of one console stream
+class TraceRecorder : public std::streambuf {
+public:
+    TraceRecorder(TraceLog& trace, int stream) : trace(trace), stream(stream) {}
+protected:
+    std::streamsize xsputn(const char* s, std::streamsize n) override {
+        trace.recordOutput(stream, s, static_cast<size_t>(n));
+        return n;
+    }
+    int overflow(int c) override {
+        if (c == EOF) return !EOF;
+        char ch = static_cast<char>(c);
+        trace.recordOutput(stream, &ch, 1);
+        return c;
+    }
+private:
+    TraceLog& trace;
+    int stream;
+};
+
+
+TraceLog::TraceLog(const std::string& basePath, bool async, uint64_t rotateBytes)
+    : basePath(basePath), async(async), rotateBytes(rotateBytes) {
+    open();
+    if (!isOpen()) return;
+
+    // Redirect std::cout and std::cerr to both the console and the trace
+    outRecorder.reset(new TraceRecorder(*this, 1));
+    errRecorder.reset(new TraceRecorder(*this, 2));
+    outBuffer.reset(new TeeBuffer(std::cout.rdbuf(), outRecorder.get()));
+    errBuffer.reset(new TeeBuffer(std::cerr.rdbuf(), errRecorder.get()));
+    originalOut = tee(std::cout, *outBuffer);
+    originalErr = tee(std::cerr, *errBuffer);
+}
+
+TraceLog::~TraceLog() {
+    if (!isOpen()) return;
+    endRun(1, RunTimings()); // Only does something if the run was not ended
+    flush();
+    std::cout.rdbuf(originalOut);
+    std::cerr.rdbuf(originalErr);
+    outBuffer.reset();
+    errBuffer.reset();
+    std::lock_guard<std::mutex> lock(mutex);
+    close();
+}
+
+void TraceLog::open() {
+    std::string logPath = generationPath(basePath, 0, ".bin");
+    std::string indexPath = generationPath(basePath, 0, ".idx");
+    logSize = sizeOf(logPath);
+    uint64_t indexSize = sizeOf(indexPath);
+    log.open(logPath, std::ios::binary | std::ios::app);
+    index.open(indexPath, std::ios::binary | std::ios::app);
+    if (!isOpen()) return;
+
+    sink = log.rdbuf();
+    if (async) {
+        asyncWriter.reset(new AsyncWriter(sink));
+        sink = asyncWriter.get();
+    }
+    if (logSize == 0) {
+        std::string header = fileHeader(logMagic);
+        sink->sputn(header.data(), static_cast<std::streamsize>(header.size()));
+        logSize = header.size();
+    }
+    if (indexSize == 0) {
+        std::string header = fileHeader(indexMagic);
+        index.write(header.data(), static_cast<std::streamsize>(header.size()));
+    }
+}
+
+void TraceLog::close() {
+    if (asyncWriter) asyncWriter->close();
+    asyncWriter.reset();
+    sink = nullptr;
+    log.close();
+    index.close();
+}
+
+void TraceLog::rotate() {
+    close();
+    for (int generation = keptGenerations - 1; generation >= 0; generation--) {
+        for (const char* extension : {".bin", ".idx"}) {
+            std::string from = generationPath(basePath, generation, extension);
+            if (exists(from)) std::rename(from.c_str(), generationPath(basePath, generation + 1, extension).c_str());
+        }
+    }
+    open();
+}
+
+void TraceLog::beginRun(const std::string& file) {
+    // Output written before the run belongs to no run
+    std::cout.flush();
+    std::cerr.flush();
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!isOpen()) return;
+    start(file, microsecondsSinceEpoch());
+}
+
+void TraceLog::endRun(int status, const RunTimings& timings) {
+    std::cout.flush();
+    std::cerr.flush();
+    std::lock_guard<std::mutex> lock(mutex);
+    if (inRun) finish(status, timings);
+}
+
+void TraceLog::recordRun(const std::string& file, const std::string& output, const std::string& errors,
+                         int status, const RunTimings& timings) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!isOpen() || inRun) return;
+    // The run is recorded when it is over, so its start is reconstructed from its duration
+    int64_t elapsed = static_cast<int64_t>(timings.parse + timings.compile + timings.execute);
+    start(file, microsecondsSinceEpoch() - elapsed);
+    writeOutput(1, output.data(), output.size());
+    writeOutput(2, errors.data(), errors.size());
+    finish(status, timings);
+}
+
+void TraceLog::flush() {
+    std::cout.flush();
+    std::cerr.flush();
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!isOpen()) return;
+    sink->pubsync();
+    index.flush();
+}
+
+void TraceLog::recordOutput(int stream, const char* data, size_t size) {
+    std::lock_guard<std::mutex> lock(mutex);
+    writeOutput(stream, data, size);
+}
+
+void TraceLog::start(const std::string& file, int64_t timestamp) {
+    if (logSize >= rotateBytes) rotate();
+    if (!isOpen()) return;
+    inRun = true;
+    runTimestamp = timestamp;
+    runStart = logSize;
+    runFileHash = hashName(file);
+    runBytes[0] = runBytes[1] = 0;
+    std::string payload;
+    putU64(payload, static_cast<uint64_t>(timestamp));
+    writeRecord('S', payload, file.data(), file.size());
+}
+
+void TraceLog::writeOutput(int stream, const char* data, size_t size) {
+    if (!inRun) return;
+    runBytes[stream - 1] += size;
+    const std::string payload(1, static_cast<char>(stream));
+    while (size > 0) {
+        size_t part = std::min(size, maxOutputRecord);
+        writeRecord('O', payload, data, part);
+        data += part;
+        size -= part;
+    }
+}
+
+void TraceLog::finish(int status, const RunTimings& timings) {
+    std::string payload;
+    putU32(payload, static_cast<uint32_t>(status));
+    putU64(payload, timings.parse);
+    putU64(payload, timings.compile);
+    putU64(payload, timings.execute);
+    writeRecord('E', payload);
+
+    std::string entry;
+    putU64(entry, static_cast<uint64_t>(runTimestamp));
+    putU64(entry, runStart);
+    putU64(entry, logSize);
+    putU64(entry, runBytes[0]);
+    putU64(entry, runBytes[1]);
+    putU64(entry, timings.parse);
+    putU64(entry, timings.compile);
+    putU64(entry, timings.execute);
+    putU32(entry, static_cast<uint32_t>(status));
+    putU32(entry, runFileHash);
+    // The records go out first, so an index entry never points past the end of the log
+    sink->pubsync();
+    index.write(entry.data(), static_cast<std::streamsize>(entry.size()));
+    index.flush();
+    inRun = false;
+}
+
+void TraceLog::writeRecord(char type, const std::string& payload, const char* data, size_t size) {
+    std::string header(1, type);
+    putU32(header, static_cast<uint32_t>(payload.size() + size));
+    sink->sputn(header.data(), static_cast<std::streamsize>(header.size()));
+    sink->sputn(payload.data(), static_cast<std::streamsize>(payload.size()));
+    if (size > 0) sink->sputn(data, static_cast<std::streamsize>(size));
+    logSize += header.size() + payload.size() + size;
+}
+
+
+namespace {
+
+struct IndexEntry {
+    int64_t timestamp;
+    uint64_t start;
+    uint64_t end;
+    uint64_t outputBytes;
+    uint64_t errorBytes;
+    uint64_t parse;
+    uint64_t compile;
+    uint64_t execute;
+    int32_t status;
+    uint32_t fileHash;
+};
+
+IndexEntry decodeEntry(const char* data) {
+    IndexEntry entry;
+    entry.timestamp = static_cast<int64_t>(getU64(data));
+    entry.start = getU64(data + 8);
+    entry.end = getU64(data + 16);
+    entry.outputBytes = getU64(data + 24);
+    entry.errorBytes = getU64(data + 32);
+    entry.parse = getU64(data + 40);
+    entry.compile = getU64(data + 48);
+    entry.execute = getU64(data + 56);
+    entry.status = static_cast<int32_t>(getU32(data + 64));
+    entry.fileHash = getU32(data + 68);
+    return entry;
+}
+
+// One generation of the trace, opened for reading
+class TraceGeneration {
+public:
+    std::string logPath;
+    std::vector<IndexEntry> entries;
+
+    // Reads the index; false (with the reason in `error`) if it is damaged or its log cannot be opened
+    bool open(const std::string& basePath, int generation, std::string& error) {
+        logPath = generationPath(basePath, generation, ".bin");
+        std::string indexPath = generationPath(basePath, generation, ".idx");
+        std::ifstream index(indexPath, std::ios::binary);
+        std::string data((std::istreambuf_iterator<char>(index)), std::istreambuf_iterator<char>());
+        if (!hasFileHeader(data, indexMagic)) {
+            error = indexPath + " is not a trace index of this version.";
+            return false;
+        }
+        // A partial entry at the end is one being written; it is not a completed run yet
+        for (size_t offset = fileHeaderSize; offset + indexEntrySize <= data.size(); offset += indexEntrySize) {
+            entries.push_back(decodeEntry(data.data() + offset));
+        }
+        log.open(logPath, std::ios::binary);
+        logSize = sizeOf(logPath);
+        char header[fileHeaderSize];
+        if (!log.read(header, fileHeaderSize) || !hasFileHeader(std::string(header, fileHeaderSize), logMagic)) {
+            error = logPath + " is not a trace log of this version.";
+            return false;
+        }
+        return true;
+    }
+
+    // Reads the record at `offset`; false if it does not lie within the log
+    bool readRecord(uint64_t offset, char& type, std::string& payload) {
+        char header[recordHeaderSize];
+        if (offset + recordHeaderSize > logSize) return false;
+        log.clear();
+        log.seekg(static_cast<std::streamoff>(offset));
+        if (!log.read(header, recordHeaderSize)) return false;
+        uint64_t length = getU32(header + 1);
+        if (offset + recordHeaderSize + length > logSize) return false;
+        type = header[0];
+        payload.resize(static_cast<size_t>(length));
+        return length == 0 || static_cast<bool>(log.read(&payload[0], static_cast<std::streamsize>(length)));
+    }
+
+private:
+    std::ifstream log;
+    uint64_t logSize = 0;
+};
+
+struct Match {
+    TraceGeneration* generation;
+    const IndexEntry* entry;
+    std::string file;
+};
+
+std::string formatTimestamp(int64_t microseconds) {
+    // Floored, so a time before the epoch still has a fraction in [0, 1000000) and ".%06d" fits the buffer
+    int64_t remainder = microseconds % 1000000;
+    if (remainder < 0) remainder += 1000000;
+    std::time_t seconds = static_cast<std::time_t>((microseconds - remainder) / 1000000);
+    std::tm local;
+    localtime_r(&seconds, &local);
+    char text[32];
+    std::strftime(text, sizeof(text), "%Y-%m-%d %H:%M:%S", &local);
+    char fraction[16];
+    std::snprintf(fraction, sizeof(fraction), ".%06u", static_cast<unsigned>(remainder));
+    return std::string(text) + fraction;
+}
+
+} // namespace
+
+bool parseTraceTime(const std::string& text, int64_t& microseconds) {
+    char* end = nullptr;
+    long long seconds = std::strtoll(text.c_str(), &end, 10);
+    if (!text.empty() && *end == '\0') {
+        microseconds = static_cast<int64_t>(seconds) * 1000000;
+        return true;
+    }
+    std::tm local;
+    std::memset(&local, 0, sizeof(local));
+    char separator = ' ';
+    int fields = std::sscanf(text.c_str(), "%d-%d-%d%c%d:%d:%d", &local.tm_year, &local.tm_mon, &local.tm_mday,
+                             &separator, &local.tm_hour, &local.tm_min, &local.tm_sec);
+    if (fields != 3 && fields < 6) return false;
+    if (fields > 3 && separator != ' ' && separator != 'T') return false;
+    local.tm_year -= 1900;
+    local.tm_mon -= 1;
+    local.tm_isdst = -1;
+    std::time_t time = std::mktime(&local);
+    if (time == static_cast<std::time_t>(-1)) return false;
+    microseconds = static_cast<int64_t>(time) * 1000000;
+    return true;
+}
+
+int queryTrace(const std::string& basePath, const TraceQuery& query, std::ostream& out, std::ostream& err) {
+    // Oldest generation first, so matches come out in the order the runs were recorded
+    std::vector<std::unique_ptr<TraceGeneration>> generations;
+    for (int generation = TraceLog::keptGenerations; generation >= 0; generation--) {
+        if (!exists(generationPath(basePath, generation, ".idx"))) continue;
+        std::unique_ptr<TraceGeneration> opened(new TraceGeneration());
+        std::string error;
+        if (!opened->open(basePath, generation, error)) {
+            err << "Error: " << error << std::endl;
+            return 1;
+        }
+        generations.push_back(std::move(opened));
+    }
+    if (generations.empty()) {
+        err << "Error: No trace found at " << generationPath(basePath, 0, ".idx") << std::endl;
+        return 1;
+    }
+
+    // Everything but the file name is decided by the index; entries are in recording order, so the runs since a
+    // time are found by binary search
+    uint32_t fileHash = hashName(query.file);
+    std::vector<Match> candidates;
+    for (const std::unique_ptr<TraceGeneration>& generation : generations) {
+        const std::vector<IndexEntry>& entries = generation->entries;
+        auto first = std::lower_bound(entries.begin(), entries.end(), query.since,
+                                      [](const IndexEntry& entry, int64_t since) { return entry.timestamp < since; });
+        for (auto entry = first; entry != entries.end(); ++entry) {
+            if (query.filterStatus && entry->status != query.status) continue;
+            if (!query.file.empty() && entry->fileHash != fileHash) continue;
+            candidates.push_back(Match{generation.get(), &*entry, std::string()});
+        }
+    }
+
+    // Only the start records of the runs shown are read, newest first until `last` are found
+    std::vector<Match> matches;
+    for (size_t i = candidates.size(); i-- > 0 && (query.last == 0 || matches.size() < query.last);) {
+        Match& match = candidates[i];
+        char type;
+        std::string payload;
+        if (!match.generation->readRecord(match.entry->start, type, payload) || type != 'S' || payload.size() < 8) {
+            err << "Error: " << match.generation->logPath << " has no run at offset " << match.entry->start
+                << "." << std::endl;
+            return 1;
+        }
+        match.file = payload.substr(8);
+        if (!query.file.empty() && match.file != query.file) continue;
+        matches.push_back(match);
+    }
+    std::reverse(matches.begin(), matches.end());
+
+    out << std::fixed << std::setprecision(3);
+    for (const Match& match : matches) {
+        const IndexEntry& entry = *match.entry;
+        out << formatTimestamp(entry.timestamp) << " status=" << entry.status << " parse_ms=" << entry.parse / 1000.0
+            << " compile_ms=" << entry.compile / 1000.0 << " exec_ms=" << entry.execute / 1000.0
+            << " out=" << entry.outputBytes << " err=" << entry.errorBytes << " file=" << match.file << '\n';
+        if (!query.showOutput) continue;
+        // The run's records lie between its start record and the end of its end record
+        uint64_t offset = entry.start;
+        char type;
+        std::string payload;
+        while (offset < entry.end && match.generation->readRecord(offset, type, payload)) {
+            if (type == 'O' && !payload.empty()) out.write(payload.data() + 1, payload.size() - 1);
+            offset += recordHeaderSize + payload.size();
+        }
+    }
+    out.flush();
+    return 0;
+}
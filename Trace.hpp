@@ -0,0 +1,143 @@
+/**
+ * @file trace.hpp
+ * @brief The binary run trace (`trace.bin` and `trace.idx`) and its reader, `mypython --trace-query`.
+ *
+ * Every run used to append a ctime header and a copy of all its console output, as text, to trace.log, which grew
+ * without bound and could only be searched by reading all of it. Runs are now recorded in two files:
+ *
+ * trace.bin, the log: an 8-byte magic ("MPYTRACE"), a 32-bit format version, then length-prefixed records, each
+ * a 1-byte type and a 32-bit payload length followed by the payload:
+ *   'S' start    int64 timestamp (microseconds since the epoch), then the script's file name
+ *   'O' output   1 byte stream (1 stdout, 2 stderr), then the bytes written to it
+ *   'E' end      int32 exit status, uint64 parse, compile and execute microseconds (see RunTimings)
+ * A run is a start record, the output records of what it printed, in the order the console received it, and an
+ * end record. Output streams straight into the log as it is written, so a run's output is never held in memory.
+ *
+ * trace.idx, the index: an 8-byte magic ("MPYTRIDX") and version, then one fixed-size entry per completed run,
+ * appended when it ends: timestamp, offsets of the run's first and past its last record in the log, output and
+ * error byte counts, the three phase times, exit status and a hash of the file name. A query reads the index,
+ * filters the entries, and then seeks to the records of the runs it shows: the log itself is never scanned. A run
+ * cut short by a crash has no index entry.
+ *
+ * Integers are little-endian. The log is not meant to be written by two processes at once (nor was trace.log).
+ *
+ * Rotation: when the log has reached the rotation size (`--trace-rotate BYTES`, 16 MB by default) as a run
+ * starts, both files are renamed to trace.1.bin and trace.1.idx (the older ones moving to trace.2 and trace.3,
+ * the oldest being dropped) and new ones are started. Queries read every generation, oldest first.
+ *
+ * Usage:
+ *   TraceLog trace("trace", false, TraceLog::defaultRotateBytes); // std::cout and std::cerr are teed into it
+ *   trace.beginRun("script.py");
+ *   ...                                                           // Console output is recorded
+ *   trace.endRun(status, timings);
+ *
+ *   TraceQuery query;
+ *   query.last = 10;
+ *   queryTrace("trace", query, std::cout, std::cerr);
+ */
+
+#pragma once
+#include "Runtime.hpp"
+#include "Utilities.hpp"
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+
+class TraceRecorder;
+
+// TraceLog: Records the runs of this process in the trace files for as long as it is alive. The constructor
+// tees std::cout and std::cerr, and what they receive between beginRun and endRun becomes the run's output (what
+// they receive outside a run only goes to the console). The destructor ends a run left open with status 1,
+// flushes everything and restores the original stream buffers, so it must be destroyed on every exit path.
+class TraceLog {
+public:
+    static const uint64_t defaultRotateBytes = 16 << 20;
+    static const int keptGenerations = 3; // Rotated generations kept besides the current files
+
+    // `basePath` names the files, e.g. "trace" for trace.bin and trace.idx. With `async`, the log is written by a
+    // background thread (see AsyncWriter).
+    TraceLog(const std::string& basePath, bool async, uint64_t rotateBytes);
+    ~TraceLog();
+
+    bool isOpen() const { return log.is_open() && index.is_open(); }
+
+    // Starts the record of a run of `file`, rotating the files first when the log has reached the rotation size
+    void beginRun(const std::string& file);
+    // Flushes std::cout and std::cerr into the run and completes its record
+    void endRun(int status, const RunTimings& timings);
+
+    // Records a whole run whose output was captured elsewhere (--jobs, --serve). Safe to call from any thread.
+    void recordRun(const std::string& file, const std::string& output, const std::string& errors, int status,
+                   const RunTimings& timings);
+
+    // Pushes buffered console and trace output all the way to the files.
+    void flush();
+
+private:
+    friend class TraceRecorder;
+
+    std::string basePath;
+    bool async;
+    uint64_t rotateBytes;
+    std::ofstream log;
+    std::ofstream index;
+    std::unique_ptr<AsyncWriter> asyncWriter;
+    std::streambuf* sink = nullptr; // The log's streambuf, or the AsyncWriter in front of it
+    uint64_t logSize = 0;           // Bytes in the log, including those still buffered
+
+    // The run in progress, if any. All state below `mutex` is guarded by it.
+    std::mutex mutex;
+    bool inRun = false;
+    int64_t runTimestamp = 0;
+    uint64_t runStart = 0;
+    uint32_t runFileHash = 0;
+    uint64_t runBytes[2] = {0, 0}; // Output and error bytes
+
+    std::unique_ptr<TraceRecorder> outRecorder;
+    std::unique_ptr<TraceRecorder> errRecorder;
+    std::unique_ptr<TeeBuffer> outBuffer;
+    std::unique_ptr<TeeBuffer> errBuffer;
+    std::streambuf* originalOut = nullptr;
+    std::streambuf* originalErr = nullptr;
+
+    // Called by the recorders with what the console streams receive
+    void recordOutput(int stream, const char* data, size_t size);
+
+    // The functions below expect `mutex` to be held
+    void open();
+    void close();
+    void rotate();
+    void start(const std::string& file, int64_t timestamp);
+    void writeOutput(int stream, const char* data, size_t size);
+    void finish(int status, const RunTimings& timings);
+    // A record of `type` whose payload is `payload` followed by the `size` bytes at `data`
+    void writeRecord(char type, const std::string& payload, const char* data = nullptr, size_t size = 0);
+};
+
+// The runs `mypython --trace-query` lists; every condition given must hold.
+struct TraceQuery {
+    std::string file;                                       // Runs of this exact path, empty for any file
+    bool filterStatus = false;                              // Only runs that exited with `status`
+    int status = 0;
+    int64_t since = std::numeric_limits<int64_t>::min();    // Only runs started at or after this (microseconds)
+    size_t last = 0;                                        // Only the last `last` matching runs, 0 for all
+    bool showOutput = false;                                // Print each run's output and errors after it
+};
+
+/**
+ * Parses a time for TraceQuery::since: "YYYY-MM-DD", "YYYY-MM-DD HH:MM[:SS]" (or with a 'T') in local time, or
+ * a number of seconds since the epoch.
+ * @return False if `text` is none of these.
+ */
+bool parseTraceTime(const std::string& text, int64_t& microseconds);
+
+/**
+ * Lists the recorded runs matching `query`, oldest first, one line each:
+ *   2026-10-14 13:45:50.123456 status=1 parse_ms=0.120 compile_ms=0.004 exec_ms=0.350 out=8 err=36 file=e.py
+ * @return The process exit code: 0, or 1 if there is no trace or it is damaged (reported on `err`).
+ */
+int queryTrace(const std::string& basePath, const TraceQuery& query, std::ostream& out, std::ostream& err);
@@ -18,40 +18,221 @@
  *
  * Implementation Details:
  * - TeeBuffer::overflow(int c): Overrides the overflow function of std::streambuf. This function is called automatically 
- *   whenever the stream buffer is full or when a character is explicitly written to the stream. It writes the character to both 
- *   of its managed streambuf objects and handles the EOF condition.
+ *   whenever the put area is full. It hands the buffered block to both of its managed streambuf objects, then stores the
+ *   character in the emptied buffer.
+ *
+ * - TeeBuffer::xsputn(): Copies whole strings into the put area; strings larger than the buffer are written to both targets
+ *   directly after flushing what is already buffered.
  * 
  * - TeeBuffer::sync(): Synchronizes the state of the TeeBuffer with its underlying streambuf objects, ensuring that any buffered 
  *   output is flushed to the respective outputs.
  *
- * - tee(std::ostream& strm, std::ostream& strm1, std::ostream& strm2): Sets up the given std::ostream object (strm) to use a TeeBuffer
- *   that duplicates its output to strm1 and strm2. This allows for the same output to be directed to two different targets.
+ * - AsyncWriter: The writing thread copies bytes into a ring buffer (waiting only when it is full) and a worker thread writes
+ *   contiguous chunks of the ring to the target. sync() asks the worker to drain the ring and flush the target, and waits for it.
+ *
+ * - tee(std::ostream& strm, TeeBuffer& teeBuffer): Sets up the given std::ostream object (strm) to use a TeeBuffer
+ *   that duplicates its output to two targets. This allows for the same output to be directed to two different targets.
+ *
+ * - runWithStackSize(): Starts a pthread with the requested stack size (std::thread cannot set one), captures any
+ *   exception in a std::exception_ptr and rethrows it after joining.
+ *
+ * - nativeStackFloor(): Reads the calling thread's stack bounds with pthread_getattr_np (glibc). The stack grows down,
+ *   so the floor is its lowest address plus the reserve.
  */
 #include "Utilities.hpp"
+#include <cstring>
+#include <exception>
+#include <stdexcept>
+#include <pthread.h>
+
+TeeBuffer::TeeBuffer(std::streambuf* sb1, std::streambuf* sb2, size_t bufferSize)
+    : sb1(sb1), sb2(sb2), buffer(bufferSize) {
+    setp(buffer.data(), buffer.data() + buffer.size());
+}
 
-TeeBuffer::TeeBuffer(std::streambuf* sb1, std::streambuf* sb2) : sb1(sb1), sb2(sb2) {}
+TeeBuffer::~TeeBuffer() {
+    sync();
+}
+
+// Writes the buffered block to both streambufs and empties the put area
+bool TeeBuffer::flushBuffer() {
+    std::streamsize n = pptr() - pbase();
+    if (n == 0) return true;
+    std::streamsize const r1 = sb1->sputn(pbase(), n);
+    std::streamsize const r2 = sb2->sputn(pbase(), n);
+    setp(buffer.data(), buffer.data() + buffer.size());
+    return r1 == n && r2 == n;
+}
 
-// This function is called when output is written to the stream
+// This function is called when output is written to a full buffer
 int TeeBuffer::overflow(int c) {
+    if (!flushBuffer()) return EOF;
     if (c == EOF) {
         return !EOF;
-    } else {
-        int const r1 = sb1->sputc(c);
-        int const r2 = sb2->sputc(c);
-        return r1 == EOF || r2 == EOF ? EOF : c;
     }
+    *pptr() = static_cast<char>(c);
+    pbump(1);
+    return c;
+}
+
+std::streamsize TeeBuffer::xsputn(const char* s, std::streamsize n) {
+    if (n <= epptr() - pptr()) {
+        std::memcpy(pptr(), s, static_cast<size_t>(n));
+        pbump(static_cast<int>(n));
+        return n;
+    }
+    if (!flushBuffer()) return 0;
+    if (n < static_cast<std::streamsize>(buffer.size())) {
+        std::memcpy(pptr(), s, static_cast<size_t>(n));
+        pbump(static_cast<int>(n));
+        return n;
+    }
+    // Larger than the whole buffer: skip the copy
+    std::streamsize const r1 = sb1->sputn(s, n);
+    std::streamsize const r2 = sb2->sputn(s, n);
+    return r1 < r2 ? r1 : r2;
 }
 
     // Sync both buffers
 int TeeBuffer::sync() {
+    bool const flushed = flushBuffer();
     int const r1 = sb1->pubsync();
     int const r2 = sb2->pubsync();
-    return r1 == 0 && r2 == 0 ? 0 : -1;
+    return flushed && r1 == 0 && r2 == 0 ? 0 : -1;
+}
+
+
+AsyncWriter::AsyncWriter(std::streambuf* target, size_t capacity) : target(target), ring(capacity) {
+    worker = std::thread(&AsyncWriter::run, this);
+}
+
+AsyncWriter::~AsyncWriter() {
+    close();
 }
 
+void AsyncWriter::close() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (stopping) return;
+        stopping = true;
+    }
+    wakeWorker.notify_one();
+    worker.join();
+    target->pubsync();
+}
+
+void AsyncWriter::run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+        wakeWorker.wait(lock, [this] { return size > 0 || flushRequested || stopping; });
+        while (size > 0) {
+            // Write the contiguous part of the ring without holding the lock; the writer only touches free space.
+            size_t chunk = std::min(size, ring.size() - head);
+            const char* data = ring.data() + head;
+            lock.unlock();
+            target->sputn(data, static_cast<std::streamsize>(chunk));
+            lock.lock();
+            head = (head + chunk) % ring.size();
+            size -= chunk;
+            wakeWriter.notify_all();
+        }
+        if (flushRequested) {
+            target->pubsync();
+            flushRequested = false;
+            wakeWriter.notify_all();
+        }
+        if (stopping) return;
+    }
+}
+
+std::streamsize AsyncWriter::xsputn(const char* s, std::streamsize n) {
+    std::unique_lock<std::mutex> lock(mutex);
+    std::streamsize written = 0;
+    while (written < n) {
+        wakeWriter.wait(lock, [this] { return size < ring.size(); });
+        size_t tail = (head + size) % ring.size();
+        size_t room = std::min(ring.size() - size, ring.size() - tail);
+        size_t chunk = std::min(room, static_cast<size_t>(n - written));
+        std::memcpy(ring.data() + tail, s + written, chunk);
+        size += chunk;
+        written += static_cast<std::streamsize>(chunk);
+        wakeWorker.notify_one();
+    }
+    return written;
+}
+
+int AsyncWriter::overflow(int c) {
+    if (c == EOF) return !EOF;
+    char ch = static_cast<char>(c);
+    return xsputn(&ch, 1) == 1 ? c : EOF;
+}
+
+int AsyncWriter::sync() {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (stopping) return 0;
+    flushRequested = true;
+    wakeWorker.notify_one();
+    wakeWriter.wait(lock, [this] { return !flushRequested; });
+    return 0;
+}
+
+
+std::streambuf* tee(std::ostream& strm, TeeBuffer& teeBuffer) {
+    return strm.rdbuf(&teeBuffer);
+}
+
+
+namespace {
+
+struct StackTask {
+    const std::function<void()>* body;
+    std::exception_ptr error;
+};
+
+void* runStackTask(void* argument) {
+    StackTask* task = static_cast<StackTask*>(argument);
+    try {
+        (*task->body)();
+    } catch (...) {
+        task->error = std::current_exception();
+    }
+    return nullptr;
+}
+
+} // namespace
+
+void runWithStackSize(size_t stackBytes, const std::function<void()>& body) {
+    StackTask task{&body, nullptr};
+    pthread_attr_t attributes;
+    if (pthread_attr_init(&attributes) != 0) {
+        throw std::runtime_error("Could not create a thread attribute for the native stack.");
+    }
+    pthread_t thread;
+    bool started = pthread_attr_setstacksize(&attributes, stackBytes) == 0
+        && pthread_create(&thread, &attributes, &runStackTask, &task) == 0;
+    pthread_attr_destroy(&attributes);
+    if (!started) {
+        throw std::runtime_error("Could not create a thread with a native stack of " +
+                                 std::to_string(stackBytes >> 20) + " MB for the recursion limit.");
+    }
+    pthread_join(thread, nullptr);
+    if (task.error) {
+        std::rethrow_exception(task.error);
+    }
+}
 
-std::ostream& tee(std::ostream& strm, std::ostream& strm1, std::ostream& strm2) {
-    static TeeBuffer teeBuffer(strm1.rdbuf(), strm2.rdbuf());
-    strm.rdbuf(&teeBuffer);
-    return strm;
+const char* nativeStackFloor(size_t reserve) {
+#if defined(__GLIBC__)
+    pthread_attr_t attributes;
+    if (pthread_getattr_np(pthread_self(), &attributes) != 0) return nullptr;
+    void* lowest = nullptr;
+    size_t size = 0;
+    int status = pthread_attr_getstack(&attributes, &lowest, &size);
+    pthread_attr_destroy(&attributes);
+    if (status != 0 || size <= reserve) return nullptr;
+    return static_cast<const char*>(lowest) + reserve;
+#else
+    (void)reserve;
+    return nullptr;
+#endif
 }
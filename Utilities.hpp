@@ -11,19 +11,29 @@
  * 
  * - TeeBuffer and tee function: Implements output stream duplication, allowing output to be written simultaneously 
  *   to two streambuf objects. This is particularly useful for logging purposes, where output needs to be echoed to both 
- *   the console and a log file.
+ *   the console and a log file. Output is block buffered, so each target sees one write per block instead of one per character.
+ *
+ * - AsyncWriter: Optional background writer thread that drains a ring buffer into a streambuf (the trace file), taking
+ *   disk writes off the interpreter's thread.
+ *
+ * - These are the building blocks of the TraceLog (see Trace.hpp), which tees std::cout and std::cerr into the trace.
+ *
+ * - runWithStackSize: Runs a function on a thread with a native stack of a given size, for the recursive tree-walker.
+ *
+ * - nativeStackFloor: Lowest stack address the calling thread may reach while leaving a reserve, for the same back end.
  * 
  * Usage:
  * - For creating unique_ptr instances:
  *   auto myObject = std::make_unique<MyClass>(constructor_arguments...);
  * 
- * - For duplicating output streams:
- *   std::ofstream logFile("log.txt");
- *   tee(std::cout, std::cout, logFile); // Echoes output to console and logFile
+ * - For duplicating output streams to the console and a log file:
+ *   std::ofstream file("log.txt");
+ *   TeeBuffer buffer(std::cout.rdbuf(), file.rdbuf());
+ *   std::streambuf* original = tee(std::cout, buffer); // Until std::cout.rdbuf(original)
  * 
  * Note:
  * - The std::make_unique polyfill is only provided if the compiler does not already support C++14 or newer (__cplusplus < 201402L).
- * - The TeeBuffer and tee function can be utilized regardless of the C++ standard version.
+ * - The TeeBuffer and AsyncWriter classes can be utilized regardless of the C++ standard version.
  */
  
 #ifndef UTILITIES_HPP
@@ -34,18 +44,17 @@
 #include <streambuf>
 #include <iostream>
 #include <fstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
 
 // Polyfill for std::make_unique in C++11
 
 #if __cplusplus < 201402L
 
-#include <exception>
-
-struct ReturnValue {
-    int value;
-    explicit ReturnValue(int value) : value(value) {}
-};
-
 namespace std {
     template<typename T, typename... Args>
     unique_ptr<T> make_unique(Args&&... args) {
@@ -54,24 +63,68 @@ namespace std {
 }
 
 
-// TeeBuffer: Duplicates output stream to two streambufs
+#endif // __cplusplus < 201402L
+
+
+// TeeBuffer: Duplicates output stream to two streambufs. Output is collected in a block buffer and handed to
+// both targets with one sputn each when the buffer fills up or the stream is flushed.
 class TeeBuffer : public std::streambuf {
 public:
-    TeeBuffer(std::streambuf* sb1, std::streambuf* sb2);
+    TeeBuffer(std::streambuf* sb1, std::streambuf* sb2, size_t bufferSize = 8192);
+    virtual ~TeeBuffer();
 protected:
     virtual int overflow(int c) override;
+    virtual std::streamsize xsputn(const char* s, std::streamsize n) override;
     virtual int sync() override;
 private:
     std::streambuf* sb1; // First streambuf
     std::streambuf* sb2; // Second streambuf
+    std::vector<char> buffer;
 
+    bool flushBuffer();
 };
 
 
-// tee: Utility function to connect an ostream to a TeeBuffer// tee: Utility function to connect an ostream to a TeeBuffer
-std::ostream& tee(std::ostream& strm, std::ostream& strm1, std::ostream& strm2);
+// AsyncWriter: streambuf that copies output into a ring buffer and lets a background thread drain it into
+// the target streambuf, so the writing thread never waits for the disk unless the ring is full.
+// sync() blocks until everything written so far has reached the target and the target has been flushed.
+class AsyncWriter : public std::streambuf {
+public:
+    AsyncWriter(std::streambuf* target, size_t capacity = 1 << 20);
+    virtual ~AsyncWriter();
+    // Drains the ring buffer and stops the background thread. Called by the destructor.
+    void close();
+protected:
+    virtual int overflow(int c) override;
+    virtual std::streamsize xsputn(const char* s, std::streamsize n) override;
+    virtual int sync() override;
+private:
+    std::streambuf* target;
+    std::vector<char> ring;
+    size_t head = 0;  // Index of the oldest byte not yet written to the target
+    size_t size = 0;  // Number of bytes in the ring, including the chunk being written
+    bool flushRequested = false;
+    bool stopping = false;
+    std::mutex mutex;
+    std::condition_variable wakeWorker;
+    std::condition_variable wakeWriter;
+    std::thread worker;
 
+    void run();
+};
 
-#endif // __cplusplus < 201402L
+
+// tee: Utility function to connect an ostream to a TeeBuffer. Returns the streambuf it replaced.
+std::streambuf* tee(std::ostream& strm, TeeBuffer& teeBuffer);
+
+
+// runWithStackSize: Runs `body` on a new thread whose native stack holds at least `stackBytes` and waits for it.
+// Exceptions thrown by `body` are rethrown in the calling thread. Throws a runtime_error if no such thread can be
+// created.
+void runWithStackSize(size_t stackBytes, const std::function<void()>& body);
+
+// nativeStackFloor: Address `reserve` bytes above the lowest end of the calling thread's native stack, or null where
+// the platform does not report its bounds. A recursion that takes the address of a local below it is out of stack.
+const char* nativeStackFloor(size_t reserve);
 
 #endif // UTILITIES_HPP
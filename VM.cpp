@@ -0,0 +1,387 @@
+/**
+ * @file vm.cpp
+ * @brief Implementation of the bytecode VM dispatch loop.
+ *
+ * `VM::execute` fetches one Instruction at a time and runs its handler. Arithmetic opcodes operate on
+ * the top two stack entries; the generic BINARY_OP, the division opcode and every operand that is not an
+ * integer go through BinaryExpr::apply, so both execution modes share one definition of the operators.
+ *
+ * Every handler is written once, between TARGET(op) and DISPATCH(). TARGET is both a case label of the
+ * switch and a label whose address goes into the dispatch table. DISPATCH either loops back to the switch
+ * (execute<false>) or fetches the next instruction and jumps through the table (execute<true>).
+ */
+
+#include "VM.hpp"
+#include "Parser.hpp"
+#include "Interpreter.hpp"
+#include <stdexcept>
+
+#if defined(__GNUC__) && !defined(MYPYTHON_SWITCH_DISPATCH)
+#define MYPYTHON_THREADED_DISPATCH 1
+#else
+#define MYPYTHON_THREADED_DISPATCH 0
+#endif
+
+static Value load(const Environment::Slot& slot, const std::string& name) {
+    if (!slot.isBound()) {
+        throw std::runtime_error("Variable '" + name + "' is not defined.");
+    }
+    return slot.value;
+}
+
+static void store(Environment::Slot& slot, Value value) {
+    slot.value = value;
+}
+
+const FunctionProto& VM::callee(const Chunk& chunk, const Instruction& instruction) const {
+    const std::string& name = chunk.names[instruction.a];
+    int index = functionBindings[instruction.a];
+    if (index < 0) {
+        throw std::runtime_error("Function '" + name + "' is not defined.");
+    }
+    const FunctionProto& proto = chunk.functions[index];
+    if (instruction.b != proto.arity) {
+        throw std::runtime_error("Incorrect number of arguments provided to function '" + name + "'.");
+    }
+    return proto;
+}
+
+size_t VM::enclosingCall(const Chunk& chunk, const Instruction& instruction, const FunctionProto& proto,
+                         const FunctionProto* function, size_t parent) const {
+    const FunctionProto* enclosing = &chunk.functions[proto.enclosing];
+    // frames[i] holds the state of the i-th call while it is not the current one; 0 is the top-level code
+    size_t call = frames.size();
+    while (call > 0) {
+        if (function == enclosing) return call;
+        call = parent;
+        function = frames[call].function;
+        parent = frames[call].parent;
+    }
+    throw std::runtime_error("Function '" + chunk.names[instruction.a] +
+                             "' is called outside the function that defines it.");
+}
+
+bool VM::hasThreadedDispatch() {
+    return MYPYTHON_THREADED_DISPATCH;
+}
+
+void VM::run(const Chunk& chunk) {
+    stack.clear();
+    frames.clear();
+    locals.clear();
+    globals.assign(chunk.globals.size(), Environment::Slot());
+    functionBindings.assign(chunk.names.size(), -1);
+    FlushOnExit flushOutput(output);
+
+    if (dispatch == Dispatch::Threaded && hasThreadedDispatch()) {
+        execute<true>(chunk);
+    } else {
+        execute<false>(chunk);
+    }
+}
+
+void VM::markRoots(BigIntHeap& heap) {
+    for (Value value : stack) heap.mark(value);
+    for (const Environment::Slot& slot : globals) heap.mark(slot.value);
+    for (const Environment::Slot& slot : locals) heap.mark(slot.value);
+}
+
+#if MYPYTHON_THREADED_DISPATCH
+#define TARGET(name) case OpCode::name: target_##name
+#define DISPATCH()                                                                    \
+    {                                                                                 \
+        if (Threaded) {                                                               \
+            instruction = &code[pc++];                                                \
+            goto *dispatchTable[static_cast<uint8_t>(instruction->op)];               \
+        }                                                                             \
+        continue;                                                                     \
+    }
+#else
+#define TARGET(name) case OpCode::name
+#define DISPATCH() continue
+#endif
+
+// Pops the right operand and replaces the left one with `left op right`, computed by the overflow-checked
+// Value::check on two inline integers; `token` is the operator for the slow path.
+#define ARITHMETIC(check, token)                                                      \
+    {                                                                                 \
+        Value right = pop();                                                          \
+        Value& left = stack.back();                                                   \
+        if (!Value::bothInts(left, right) || !Value::check(left, right, left)) {     \
+            left = BinaryExpr::applyToObjects(TokenType::token, left, right, bigInts); \
+        }                                                                             \
+        DISPATCH();                                                                   \
+    }
+
+// Pops the right operand and replaces the left one with the comparison `left op right`.
+#define COMPARE(op, token)                                                            \
+    {                                                                                 \
+        Value right = pop();                                                          \
+        Value& left = stack.back();                                                   \
+        if (Value::bothInts(left, right)) {                                           \
+            left = left.asInt() op right.asInt();                                     \
+        } else {                                                                      \
+            left = BinaryExpr::applyToObjects(TokenType::token, left, right, bigInts); \
+        }                                                                             \
+        DISPATCH();                                                                   \
+    }
+
+// Pops both operands of a comparison and jumps unless it holds.
+#define JUMP_UNLESS(op, token)                                                        \
+    {                                                                                 \
+        Value right = pop();                                                          \
+        Value left = pop();                                                           \
+        bool holds = Value::bothInts(left, right)                                     \
+            ? left.asInt() op right.asInt()                                           \
+            : BinaryExpr::applyToObjects(TokenType::token, left, right, bigInts).isTruthy(); \
+        if (!holds) pc = instruction->a;                                              \
+        DISPATCH();                                                                   \
+    }
+
+// Pushes a variable plus a constant; like `name + constant` for a string variable, raises the operator error.
+#define ADD_CONST(slot, name)                                                         \
+    {                                                                                 \
+        Value value = load(slot, name);                                               \
+        Value constant = instruction->a;                                              \
+        if (!value.isInt() || !Value::add(value, constant, value)) {                  \
+            value = BinaryExpr::applyToObjects(TokenType::PLUS, value, constant, bigInts); \
+        }                                                                             \
+        stack.push_back(value);                                                       \
+        DISPATCH();                                                                   \
+    }
+
+// Pushes a frame for `proto` and moves its `arity` arguments from the stack into its first slots. CALL_1..CALL_3
+// pass a constant arity, so the copy is unrolled.
+#define ENTER_FRAME(proto, arity)                                                     \
+    {                                                                                 \
+        if (frames.size() >= recursionLimit) {                                        \
+            throw RecursionError();                                                   \
+        }                                                                             \
+        size_t calleeParent = (proto).enclosing < 0                                   \
+            ? 0 : enclosingCall(chunk, *instruction, proto, function, parent);        \
+        frames.push_back(CallFrame{pc, base, stackBase, function, parent});           \
+        base = locals.size();                                                         \
+        function = &(proto);                                                          \
+        parent = calleeParent;                                                        \
+        locals.resize(base + (proto).locals.size());                                  \
+        /* Arguments were pushed left to right, so the first parameter is deepest */  \
+        size_t arguments = stack.size() - (arity);                                    \
+        for (size_t i = 0; i < (arity); i++) {                                        \
+            store(locals[base + i], stack[arguments + i]);                            \
+        }                                                                             \
+        stack.resize(arguments);                                                      \
+        stackBase = arguments;                                                        \
+        pc = (proto).entry;                                                           \
+        DISPATCH();                                                                   \
+    }
+
+template<bool Threaded>
+void VM::execute(const Chunk& chunk) {
+#if MYPYTHON_THREADED_DISPATCH
+    // In OpCode order; constant, so concurrent VMs share it safely
+    static const void* const dispatchTable[] = {
+        &&target_CONSTANT, &&target_CONSTANT_WIDE, &&target_CONSTANT_STRING,
+        &&target_LOAD_LOCAL, &&target_STORE_LOCAL, &&target_LOAD_GLOBAL, &&target_STORE_GLOBAL,
+        &&target_LOAD_ENCLOSING, &&target_POP,
+        &&target_ADD, &&target_SUBTRACT, &&target_MULTIPLY, &&target_FLOOR_DIVIDE,
+        &&target_EQUAL, &&target_LESS, &&target_LESS_EQUAL, &&target_GREATER, &&target_GREATER_EQUAL,
+        &&target_BINARY_OP,
+        &&target_JUMP, &&target_JUMP_IF_FALSE, &&target_FOR_RANGE_START, &&target_FOR_RANGE,
+        &&target_PRINT_STRING, &&target_PRINT_VALUE, &&target_PRINT_END,
+        &&target_DEFINE_FUNCTION, &&target_CALL, &&target_TAIL_CALL, &&target_RETURN,
+        &&target_ADD_LOCAL_CONST, &&target_ADD_GLOBAL_CONST,
+        &&target_JUMP_UNLESS_EQUAL, &&target_JUMP_UNLESS_LESS, &&target_JUMP_UNLESS_LESS_EQUAL,
+        &&target_JUMP_UNLESS_GREATER, &&target_JUMP_UNLESS_GREATER_EQUAL,
+        &&target_CALL_1, &&target_CALL_2, &&target_CALL_3,
+        &&target_HALT
+    };
+    static_assert(sizeof(dispatchTable) / sizeof(dispatchTable[0]) == static_cast<size_t>(OpCode::HALT) + 1,
+                  "dispatchTable must have one entry per OpCode");
+#endif
+
+    size_t base = 0; // Base of the current frame in `locals`
+    size_t stackBase = 0; // Height of `stack` when the current frame was entered
+    const FunctionProto* function = nullptr;
+    size_t parent = 0; // Index in `frames` of the current frame's parent (see CallFrame::parent)
+    const Instruction* code = chunk.code.data();
+    size_t pc = 0;
+
+    for (;;) {
+        const Instruction* instruction = &code[pc++];
+        switch (instruction->op) {
+            TARGET(CONSTANT):
+                stack.push_back(instruction->a);
+                DISPATCH();
+            TARGET(CONSTANT_WIDE):
+                stack.push_back(chunk.integers[instruction->a]);
+                DISPATCH();
+            TARGET(CONSTANT_STRING):
+                stack.push_back(Value::string(chunk.strings[instruction->a]));
+                DISPATCH();
+            TARGET(LOAD_LOCAL):
+                stack.push_back(load(locals[base + instruction->a], function->locals[instruction->a]));
+                DISPATCH();
+            TARGET(STORE_LOCAL):
+                store(locals[base + instruction->a], pop());
+                DISPATCH();
+            TARGET(LOAD_GLOBAL):
+                stack.push_back(load(globals[instruction->a], chunk.globals[instruction->a]));
+                DISPATCH();
+            TARGET(STORE_GLOBAL):
+                store(globals[instruction->a], pop());
+                DISPATCH();
+            TARGET(LOAD_ENCLOSING): {
+                size_t call = parent;
+                for (uint16_t level = 1; level < instruction->b; level++) call = frames[call].parent;
+                const CallFrame& frame = frames[call];
+                stack.push_back(load(locals[frame.base + instruction->a], frame.function->locals[instruction->a]));
+                DISPATCH();
+            }
+            TARGET(POP):
+                stack.pop_back();
+                DISPATCH();
+            TARGET(ADD): ARITHMETIC(add, PLUS)
+            TARGET(SUBTRACT): ARITHMETIC(subtract, MINUS)
+            TARGET(MULTIPLY): ARITHMETIC(multiply, MUL)
+            TARGET(FLOOR_DIVIDE): {
+                Value right = pop();
+                stack.back() = BinaryExpr::apply(TokenType::DIV, stack.back(), right, bigInts);
+                DISPATCH();
+            }
+            TARGET(EQUAL): {
+                // Equal integers and the same interned string have the same bits, so no type test is needed
+                Value right = pop();
+                stack.back() = stack.back() == right;
+                DISPATCH();
+            }
+            TARGET(LESS): COMPARE(<, LESS)
+            TARGET(LESS_EQUAL): COMPARE(<=, LESS_EQUAL)
+            TARGET(GREATER): COMPARE(>, GREATER)
+            TARGET(GREATER_EQUAL): COMPARE(>=, GREATER_EQUAL)
+            TARGET(BINARY_OP): {
+                Value right = pop();
+                TokenType op = static_cast<TokenType>(instruction->b);
+                stack.back() = BinaryExpr::apply(op, stack.back(), right, bigInts);
+                DISPATCH();
+            }
+            TARGET(JUMP):
+                pc = instruction->a;
+                DISPATCH();
+            TARGET(JUMP_IF_FALSE):
+                if (!pop().isTruthy()) pc = instruction->a;
+                DISPATCH();
+            TARGET(FOR_RANGE_START): {
+                // FOR_RANGE reads the triple unchecked, so make sure it holds integers
+                size_t top = stack.size();
+                for (size_t i = top - 3; i < top; i++) stack[i].toInt("range() argument");
+                if (stack.back().asInt() == 0) {
+                    throw std::runtime_error("range() arg 3 must not be zero.");
+                }
+                DISPATCH();
+            }
+            TARGET(FOR_RANGE): {
+                size_t top = stack.size();
+                int64_t counter = stack[top - 3].asInt();
+                int64_t stop = stack[top - 2].asInt();
+                int64_t step = stack[top - 1].asInt();
+                if (step > 0 ? counter < stop : counter > stop) {
+                    // Stepping past the inline range ends the loop (the 64-bit sum of two inline integers cannot
+                    // overflow)
+                    int64_t next = counter + step;
+                    stack[top - 3] = Value::fitsInline(next) ? Value::small(next) : stack[top - 2];
+                    stack.push_back(Value::small(counter));
+                } else {
+                    stack.resize(top - 3);
+                    pc = instruction->a;
+                }
+                DISPATCH();
+            }
+            TARGET(PRINT_STRING):
+                output.write(chunk.strings[instruction->a]);
+                output.write(' ');
+                DISPATCH();
+            TARGET(PRINT_VALUE):
+                output.write(pop());
+                output.write(' ');
+                DISPATCH();
+            TARGET(PRINT_END):
+                output.endLine();
+                DISPATCH();
+            TARGET(DEFINE_FUNCTION):
+                functionBindings[chunk.functions[instruction->a].nameIndex] = instruction->a;
+                DISPATCH();
+            TARGET(CALL): {
+                const FunctionProto& proto = callee(chunk, *instruction);
+                ENTER_FRAME(proto, proto.arity)
+            }
+            TARGET(TAIL_CALL): {
+                // Same as CALL, but the callee takes over the current frame's window of `locals`
+                const FunctionProto& proto = callee(chunk, *instruction);
+                size_t calleeParent = 0;
+                if (proto.enclosing >= 0) {
+                    calleeParent = enclosingCall(chunk, *instruction, proto, function, parent);
+                    // The callee reads this frame, so call it; the RETURN that follows returns its result
+                    if (calleeParent == frames.size()) ENTER_FRAME(proto, proto.arity)
+                }
+                function = &proto;
+                parent = calleeParent;
+                locals.resize(base);
+                locals.resize(base + proto.locals.size());
+                size_t arguments = stack.size() - proto.arity;
+                for (size_t i = 0; i < proto.arity; i++) {
+                    store(locals[base + i], stack[arguments + i]);
+                }
+                stack.resize(stackBase); // Also drops the state of loops the caller was in
+                pc = proto.entry;
+                DISPATCH();
+            }
+            TARGET(RETURN): {
+                // The return value replaces whatever the frame left on the stack (loop state) for the caller.
+                const CallFrame& frame = frames.back();
+                Value result = stack.back();
+                stack.resize(stackBase);
+                stack.push_back(result);
+                locals.resize(base);
+                pc = frame.returnAddress;
+                base = frame.base;
+                stackBase = frame.stackBase;
+                function = frame.function;
+                parent = frame.parent;
+                frames.pop_back();
+                DISPATCH();
+            }
+            TARGET(ADD_LOCAL_CONST): ADD_CONST(locals[base + instruction->b], function->locals[instruction->b])
+            TARGET(ADD_GLOBAL_CONST): ADD_CONST(globals[instruction->b], chunk.globals[instruction->b])
+            TARGET(JUMP_UNLESS_EQUAL): {
+                Value right = pop();
+                if (pop() != right) pc = instruction->a;
+                DISPATCH();
+            }
+            TARGET(JUMP_UNLESS_LESS): JUMP_UNLESS(<, LESS)
+            TARGET(JUMP_UNLESS_LESS_EQUAL): JUMP_UNLESS(<=, LESS_EQUAL)
+            TARGET(JUMP_UNLESS_GREATER): JUMP_UNLESS(>, GREATER)
+            TARGET(JUMP_UNLESS_GREATER_EQUAL): JUMP_UNLESS(>=, GREATER_EQUAL)
+            TARGET(CALL_1): {
+                const FunctionProto& proto = callee(chunk, *instruction);
+                ENTER_FRAME(proto, 1)
+            }
+            TARGET(CALL_2): {
+                const FunctionProto& proto = callee(chunk, *instruction);
+                ENTER_FRAME(proto, 2)
+            }
+            TARGET(CALL_3): {
+                const FunctionProto& proto = callee(chunk, *instruction);
+                ENTER_FRAME(proto, 3)
+            }
+            TARGET(HALT):
+                return;
+        }
+    }
+}
+
+#undef ENTER_FRAME
+#undef ADD_CONST
+#undef JUMP_UNLESS
+#undef BINARY
+#undef DISPATCH
+#undef TARGET
@@ -0,0 +1,105 @@
+/**
+ * @file vm.hpp
+ * @brief Declaration of the stack-based virtual machine that executes compiled bytecode.
+ *
+ * The VM runs a Chunk produced by the Compiler in one dispatch loop. Operands and intermediate results live
+ * on a value stack, and each call pushes a CallFrame instead of recursing on the native stack.
+ *
+ * Execution model:
+ * - Variables live in flat slot arrays using the slots assigned by the Resolver: one array for the globals
+ *   and one contiguous locals stack in which every active call owns a window starting at its base.
+ * - Calls never recurse on the native stack, so the depth of recursion is bounded only by the recursion limit
+ *   (RecursionError), and TAIL_CALL reuses the current frame so tail-recursive functions run in constant space.
+ * - Every call records its parent: the active call of the function its `def` is in (as found up the parents
+ *   of the calling frame), or the top-level code for a top-level function. LOAD_ENCLOSING follows the parents
+ *   to read a variable of an enclosing function. A tail call of a function nested in the current one needs the
+ *   current frame as its parent, so it is made as a normal call instead.
+ * - DEFINE_FUNCTION binds a function name when the `def` statement runs; CALL looks the binding up by name
+ *   index, so calling a function before its `def` has executed is an error in both modes.
+ * - `for` loops keep their state on the value stack, so RETURN and TAIL_CALL cut the stack back to the
+ *   height it had when the frame was entered before handing over the result or the arguments.
+ * - Runtime errors are reported by throwing std::runtime_error with the same messages as the tree-walker.
+ * - Stack entries and slots are Values. Arithmetic and comparison handlers test that both operands are inline
+ *   integers with one AND of the tag bits, and add, subtract and multiply with overflow-checked instructions
+ *   (see Value::add). They only leave the fast path for strings, big integers and results that overflow, through
+ *   BinaryExpr::applyToObjects, which allocates BigInts in the VM's heap.
+ *
+ * Dispatch:
+ * With GCC and Clang the loop is threaded: every handler jumps straight to the handler of the next instruction
+ * through a table of label addresses (labels as values), so each instruction has its own indirect branch that
+ * the CPU can predict, instead of sharing the single jump of a `switch`. Other compilers, or building with
+ * -DMYPYTHON_SWITCH_DISPATCH, use the `switch` loop, which can also be selected at runtime for comparison
+ * (`--vm-dispatch switch`, see bench/dispatch.sh). Both loops are the same code; only the jump between
+ * handlers differs.
+ *
+ * Usage:
+ *   VM vm;
+ *   vm.run(chunk);
+ */
+
+#pragma once
+#include "BigInt.hpp"
+#include "Bytecode.hpp"
+#include "Env.hpp"
+#include "Output.hpp"
+#include <vector>
+#include <iostream>
+
+class VM : private BigIntHeap::Roots {
+public:
+    enum class Dispatch { Threaded, Switch };
+
+    VM() : bigInts(this) {}
+
+    // True if this build has the threaded loop; otherwise Dispatch::Threaded runs the switch loop.
+    static bool hasThreadedDispatch();
+
+    void run(const Chunk& chunk);
+
+    // Maximum number of nested (non-tail) calls before a RecursionError is raised.
+    void setRecursionLimit(size_t limit) { recursionLimit = limit; }
+    // Stream print statements write to, std::cout by default. Must outlive the run.
+    void setOutput(std::ostream& stream) { output.setTarget(stream); }
+    // How the loop jumps from one instruction to the next, Dispatch::Threaded by default.
+    void setDispatch(Dispatch value) { dispatch = value; }
+
+private:
+    struct CallFrame {
+        size_t returnAddress;
+        size_t base;                 // Index of the frame's first slot in `locals`
+        size_t stackBase;            // Height of the value stack below the frame's own entries
+        const FunctionProto* function;
+        size_t parent;               // Index in `frames` of the frame of the parent call, 0 for the top level
+    };
+
+    std::vector<Value> stack;
+    std::vector<Environment::Slot> globals;
+    std::vector<Environment::Slot> locals;
+    std::vector<CallFrame> frames;
+    std::vector<int> functionBindings; // Chunk::names index -> Chunk::functions index, -1 when unbound
+    BigIntHeap bigInts;                // Integers computed beyond 63 bits
+    size_t recursionLimit = 10000;
+    OutputWriter output;
+    Dispatch dispatch = Dispatch::Threaded;
+
+    template<bool Threaded>
+    void execute(const Chunk& chunk);
+
+    // Looks up and checks the callee of a CALL or TAIL_CALL.
+    const FunctionProto& callee(const Chunk& chunk, const Instruction& instruction) const;
+    // Parent of a call of the nested function `proto` made by the current call (`function`, whose parent is
+    // `parent`): the index in `frames` of the call of the function that defines it, frames.size() for the
+    // current call itself.
+    size_t enclosingCall(const Chunk& chunk, const Instruction& instruction, const FunctionProto& proto,
+                         const FunctionProto* function, size_t parent) const;
+
+    // The numbers on the value stack, in the globals and in every frame, for a collection of `bigInts`. An
+    // instruction only allocates a number once it has popped or read its operands, so nothing else is live.
+    void markRoots(BigIntHeap& heap) override;
+
+    Value pop() {
+        Value value = stack.back();
+        stack.pop_back();
+        return value;
+    }
+};
@@ -0,0 +1,209 @@
+/**
+ * @file value.hpp
+ * @brief The runtime value of an expression: an integer or an interned string, in one 64-bit word.
+ *
+ * Every variable slot, argument, return value and VM stack entry is a Value. Integers are by far the most
+ * common, so they are stored inline and arithmetic on two of them needs one test and no memory access:
+ *
+ *   integer   [ 63-bit signed value | 1 ]
+ *   big       [ pointer to a BigInt (aligned, so bits 1..0 are 00) | 10 ], for integers beyond 63 bits
+ *   string    [ pointer to the interned std::string (aligned, so bits 1..0 are 00) ]
+ *   unbound   [ 0 ], the null pointer, which only variable slots hold (see Environment::Slot)
+ *
+ * Integers have arbitrary precision. `add`, `subtract` and `multiply` work on the tagged words of two inline
+ * integers with the compiler's overflow-checked builtins, so the common case stays one instruction and a
+ * branch; when the result does not fit in 63 bits they fail and the caller computes it with BigInt (see
+ * BigInt.hpp), which returns an inline integer again whenever the result fits. An integer therefore has
+ * exactly one representation, and `isInt()` means "inline", not "integer".
+ *
+ * Strings are never created at runtime; every string value is a literal of the program, interned once when the
+ * program is parsed (or loaded from the AST cache) in a StringTable kept in the program's Arena, and for the VM
+ * in the deduplicated Chunk::strings. Big integers live in the BigIntHeap of the run. A Value therefore never
+ * owns memory and copying one is copying a word. Two strings are equal exactly when their pointers are, and
+ * two integers when their words are unless both are big, so `==` compares the raw words and only looks at the
+ * digits of two BigInts. Values stay valid as long as the table or heap they point into, which outlives the run.
+ *
+ * Strings support assignment, passing, returning, printing, `==` and truth tests (non-empty is true). Any other
+ * operator, and using a string where an integer is required (range bounds), raises a std::runtime_error.
+ *
+ * Usage:
+ *   StringTable strings;
+ *   Value text = Value::string(strings.intern("hello"));
+ *   Value number = 42;                    // ints convert implicitly
+ *   Value sum;
+ *   if (!Value::bothInts(left, right) || !Value::add(left, right, sum)) sum = BigInt::add(left, right, heap);
+ */
+
+#pragma once
+#include <cstdint>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <unordered_set>
+
+class BigInt;
+
+class Value {
+    uint64_t bits;
+
+    static const uint64_t intTag = 1;
+    static const uint64_t bigTag = 2;
+    static const uint64_t tagMask = 3;
+
+    explicit Value(uint64_t bits, bool) : bits(bits) {}
+
+    static bool equalBigs(Value left, Value right); // In BigInt.cpp
+
+public:
+    // Range of the inline integers
+    static const int64_t inlineMin = -(static_cast<int64_t>(1) << 62);
+    static const int64_t inlineMax = (static_cast<int64_t>(1) << 62) - 1;
+
+    // The integer 0, which is also what a function without a return statement returns
+    Value() : bits(intTag) {}
+    Value(int value) : bits(static_cast<uint64_t>(static_cast<int64_t>(value)) << 1 | intTag) {}
+
+    static bool fitsInline(int64_t value) { return value >= inlineMin && value <= inlineMax; }
+    // An inline integer; `value` must satisfy fitsInline (see BigInt for the others)
+    static Value small(int64_t value) { return Value(static_cast<uint64_t>(value) << 1 | intTag, true); }
+
+    // Marks a variable slot that was never assigned. Not a valid pointer or integer, so no expression yields it.
+    static Value unbound() { return Value(0, true); }
+
+    // @param text An interned string (see StringTable), which must outlive the value.
+    static Value string(const std::string& text) {
+        static_assert(alignof(std::string) > tagMask, "String pointers need two free low bits for the tags");
+        return Value(static_cast<uint64_t>(reinterpret_cast<uintptr_t>(&text)), true);
+    }
+    // @param number A BigInt beyond the inline range, which must outlive the value.
+    static Value big(const BigInt& number) {
+        return Value(static_cast<uint64_t>(reinterpret_cast<uintptr_t>(&number)) | bigTag, true);
+    }
+
+    bool isInt() const { return bits & intTag; }
+    bool isBig() const { return (bits & tagMask) == bigTag; }
+    bool isInteger() const { return bits & tagMask; }
+    bool isString() const { return !(bits & tagMask); }
+    static bool bothInts(Value left, Value right) { return left.bits & right.bits & intTag; }
+    static bool bothIntegers(Value left, Value right) { return left.isInteger() && right.isInteger(); }
+
+    // Unchecked accessors; the caller has tested the type
+    int64_t asInt() const { return static_cast<int64_t>(bits) >> 1; }
+    const BigInt& asBig() const { return *reinterpret_cast<const BigInt*>(static_cast<uintptr_t>(bits & ~tagMask)); }
+    const std::string& asString() const { return *reinterpret_cast<const std::string*>(static_cast<uintptr_t>(bits)); }
+
+    /**
+     * Arithmetic on two inline integers (see bothInts), on the tagged words: with x and y stored as 2x+1 and
+     * 2y+1, the sum is (2x+1) + 2y and the product x * 2y + 1, so one checked instruction computes each result
+     * and detects that it leaves the inline range.
+     * @return false, leaving `result` unchanged, if the result needs a BigInt.
+     */
+    static bool add(Value left, Value right, Value& result) {
+        int64_t sum;
+        if (overflows(addWords(static_cast<int64_t>(left.bits), static_cast<int64_t>(right.bits - intTag), sum))) {
+            return false;
+        }
+        result = Value(static_cast<uint64_t>(sum), true);
+        return true;
+    }
+    static bool subtract(Value left, Value right, Value& result) {
+        int64_t difference;
+        if (overflows(subtractWords(static_cast<int64_t>(left.bits), static_cast<int64_t>(right.bits - intTag),
+                                    difference))) {
+            return false;
+        }
+        result = Value(static_cast<uint64_t>(difference), true);
+        return true;
+    }
+    static bool multiply(Value left, Value right, Value& result) {
+        int64_t product;
+        if (overflows(multiplyWords(left.asInt(), static_cast<int64_t>(right.bits - intTag), product))) {
+            return false;
+        }
+        result = Value(static_cast<uint64_t>(product) | intTag, true);
+        return true;
+    }
+
+    /**
+     * The value of an inline integer, for operands that must be machine integers.
+     * @param context What needs the integer, for the error message (e.g. "range() argument").
+     * @throws std::runtime_error If the value is a string or a big integer.
+     */
+    int64_t toInt(const char* context) const {
+        if (!isInt()) {
+            const char* problem = isBig() ? " is too large." : " must be an integer, not a string.";
+            throw std::runtime_error(std::string(context) + problem);
+        }
+        return asInt();
+    }
+
+    // Truth value in conditions: non-zero integers and non-empty strings are true (a BigInt is never zero)
+    bool isTruthy() const { return isInt() ? asInt() != 0 : isBig() || !asString().empty(); }
+
+    // The word itself, for hashing
+    uint64_t raw() const { return bits; }
+
+    // Equal integers, or the same interned string
+    bool operator==(Value other) const {
+        return bits == other.bits || (isBig() && other.isBig() && equalBigs(*this, other));
+    }
+    bool operator!=(Value other) const { return !(*this == other); }
+
+private:
+    static bool overflows(bool overflow) {
+#if defined(__GNUC__)
+        return __builtin_expect(overflow, 0);
+#else
+        return overflow;
+#endif
+    }
+
+    // Each returns true if the exact result does not fit in 64 bits
+#if defined(__GNUC__)
+    static bool addWords(int64_t a, int64_t b, int64_t& r) { return __builtin_add_overflow(a, b, &r); }
+    static bool subtractWords(int64_t a, int64_t b, int64_t& r) { return __builtin_sub_overflow(a, b, &r); }
+    static bool multiplyWords(int64_t a, int64_t b, int64_t& r) { return __builtin_mul_overflow(a, b, &r); }
+#else
+    static bool addWords(int64_t a, int64_t b, int64_t& r) {
+        if (b > 0 ? a > INT64_MAX - b : a < INT64_MIN - b) return true;
+        r = a + b;
+        return false;
+    }
+    static bool subtractWords(int64_t a, int64_t b, int64_t& r) {
+        if (b < 0 ? a > INT64_MAX + b : a < INT64_MIN + b) return true;
+        r = a - b;
+        return false;
+    }
+    static bool multiplyWords(int64_t a, int64_t b, int64_t& r) {
+        if (a != 0 && b != 0) {
+            uint64_t magnitudeA = a < 0 ? 0 - static_cast<uint64_t>(a) : static_cast<uint64_t>(a);
+            uint64_t magnitudeB = b < 0 ? 0 - static_cast<uint64_t>(b) : static_cast<uint64_t>(b);
+            uint64_t limit = static_cast<uint64_t>(INT64_MAX) + ((a < 0) != (b < 0) ? 1 : 0);
+            if (magnitudeA > limit / magnitudeB) return true;
+        }
+        r = static_cast<int64_t>(static_cast<uint64_t>(a) * static_cast<uint64_t>(b));
+        return false;
+    }
+#endif
+};
+
+// Integers are printed in decimal, strings as their text without quotes
+std::ostream& printBig(std::ostream& out, const BigInt& number); // In BigInt.cpp
+
+inline std::ostream& operator<<(std::ostream& out, Value value) {
+    if (value.isInt()) return out << value.asInt();
+    if (value.isBig()) return printBig(out, value.asBig());
+    return out << value.asString();
+}
+
+/**
+ * Interns the string literals of one program: equal texts get the same std::string, whose address never
+ * changes (the set's nodes are not moved on rehash), so Values can point at it.
+ */
+class StringTable {
+    std::unordered_set<std::string> strings;
+
+public:
+    const std::string& intern(const std::string& text) { return *strings.insert(text).first; }
+    size_t size() const { return strings.size(); }
+};
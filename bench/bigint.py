@@ -0,0 +1,25 @@
+#Benchmark: big integer arithmetic
+#Squaring 3 fourteen times gives a number of about 7800 digits, far above the Karatsuba threshold (64 limbs,
+#about 600 digits), and building 2000! multiplies a growing product by small factors. Printing the results
+#converts them to decimal.
+
+def power(base, exponent):
+    result = 1
+    while exponent > 0:
+        if exponent - exponent / 2 * 2 == 1:
+            result = result * base
+        base = base * base
+        exponent = exponent / 2
+    return result
+
+def factorial(n):
+    product = 1
+    for i in range(2, n + 1):
+        product = product * i
+    return product
+
+big = power(3, 16384)
+print(big * big / power(3, 32767))
+print(big / power(3, 16000) == power(3, 384))
+print(factorial(2000) / factorial(1998))
+print(factorial(300))
@@ -0,0 +1,15 @@
+#Benchmark: VM dispatch cost (see bench/dispatch.sh)
+#The loop body is a dozen cheap instructions (loads, small constants, adds, compare-and-branch), so the time
+#goes to jumping from one instruction to the next rather than to the work they do.
+
+def count(n):
+    i = 0
+    total = 0
+    while i < n:
+        if total > 1000000:
+            total = total - 1000000
+        total = total + i
+        i = i + 1
+    return total
+
+print(count(1000000))
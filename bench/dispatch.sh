@@ -0,0 +1,23 @@
+#!/bin/sh
+# Compares the VM's switch loop with the threaded loop, and both with and without superinstructions (-O0
+# emits none), by the fastest exec time of `mypython --vm --bench`.
+#
+# Usage: bench/dispatch.sh [runs] [script...]   (defaults: 20 runs, bench/dispatch.py)
+
+RUNS=${1:-20}
+[ $# -gt 0 ] && shift
+cd "$(dirname "$0")/.." || exit 1
+[ $# -gt 0 ] || set -- bench/dispatch.py
+
+for file in "$@"; do
+    echo "$file ($RUNS runs, fastest exec ms)"
+    baseline=
+    for config in "switch -O0" "threaded -O0" "switch -O1" "threaded -O1"; do
+        set -- $config
+        fastest=$(./mypython --no-trace --vm --vm-dispatch "$1" "$2" --bench "$RUNS" --bench-json "$file" |
+                 sed 's/.*"exec": {"min_ms": \([0-9.e+-]*\).*/\1/') || exit 1
+        [ -n "$baseline" ] || baseline=$fastest
+        awk -v name="$1 $2" -v ms="$fastest" -v base="$baseline" \
+            'BEGIN { printf "  %-14s %10.3f  %5.2fx\n", name, ms, base / ms }'
+    done
+done
@@ -0,0 +1,34 @@
+#!/bin/sh
+# Compares eager and lazy (--lazy) parsing of function bodies on a generated module that defines many helpers
+# and calls a few of them, by the fastest parse and exec times of `mypython --bench`.
+#
+# Usage: bench/lazy.sh [runs] [functions]   (defaults: 20 runs, 500 functions)
+
+RUNS=${1:-20}
+FUNCTIONS=${2:-500}
+cd "$(dirname "$0")/.." || exit 1
+MODULE=$(mktemp "${TMPDIR:-/tmp}/lazy.XXXXXX") || exit 1
+trap 'rm -f "$MODULE"' EXIT
+
+awk -v n="$FUNCTIONS" 'BEGIN {
+    for (i = 0; i < n; i++) {
+        printf "def helper%d(a, b):\n", i
+        printf "    total = 0\n"
+        printf "    for i in range(a):\n"
+        printf "        if i / 2 * 2 == i:\n"
+        printf "            total = total + i * b - %d\n", i
+        printf "        else:\n"
+        printf "            total = total - b\n"
+        printf "    while total > 1000:\n"
+        printf "        total = total - 1000\n"
+        printf "    return total\n"
+    }
+    print "print(helper0(10, 3), helper1(20, 4), helper2(30, 5))"
+}' > "$MODULE"
+
+echo "$FUNCTIONS functions, 3 called ($RUNS runs, fastest ms)"
+for flag in "" "--lazy"; do
+    ./mypython --no-trace $flag --bench "$RUNS" --bench-json "$MODULE" |
+        sed 's/.*"mode": "\([a-z-]*\)".*"parse": {"min_ms": \([0-9.e+-]*\).*"exec": {"min_ms": \([0-9.e+-]*\).*/\1 \2 \3/' |
+        awk '{ printf "  %-10s parse %8.3f  exec %8.3f  total %8.3f\n", $1, $2, $3, $2 + $3 }'
+done
@@ -0,0 +1,39 @@
+#!/bin/sh
+# Measures the Lexer's throughput in MB/s on a generated module of the given size, with the SSE2 scanning
+# loops and with the scalar ones (`mypython --bench N --bench-lex [--scalar-lex]`).
+#
+# Usage: bench/lexer.sh [runs] [megabytes]   (defaults: 10 runs, 64 MB)
+
+RUNS=${1:-10}
+MEGABYTES=${2:-64}
+cd "$(dirname "$0")/.." || exit 1
+MODULE=$(mktemp "${TMPDIR:-/tmp}/lexer.XXXXXX") || exit 1
+trap 'rm -f "$MODULE"' EXIT
+
+# Nested blocks, long and short names, literals, comments and blank lines, about 600 bytes per function
+awk -v bytes="$((MEGABYTES * 1000000))" 'BEGIN {
+    for (i = 0; written < bytes; i++) {
+        text = sprintf("def accumulateSamples%d(firstOperand, secondOperand):\n", i)
+        text = text "    # Sums the operands over a window, folding the total back below the limit\n"
+        text = text "    runningTotal = 0\n"
+        text = text sprintf("    for index in range(firstOperand, secondOperand + %d):\n", i % 1000)
+        text = text "        if index / 2 * 2 == index:\n"
+        text = text "            runningTotal = runningTotal + index * secondOperand - 12345\n"
+        text = text "        else:\n"
+        text = text "            runningTotal = runningTotal - firstOperand\n"
+        text = text "\n"
+        text = text "    while runningTotal > 1000000:\n"
+        text = text "        runningTotal = runningTotal - 1000000\n"
+        text = text sprintf("    print(\"window\", %d, runningTotal)\n", i)
+        text = text "    return runningTotal\n"
+        printf "%s", text
+        written += length(text)
+    }
+}' > "$MODULE"
+
+echo "$(wc -c < "$MODULE") bytes ($RUNS runs, fastest)"
+for flag in "" "--scalar-lex"; do
+    ./mypython --no-trace --bench "$RUNS" --bench-lex --bench-json $flag "$MODULE" |
+        sed 's/.*"lex_scan": "\([a-z0-9]*\)", "lex_mb_per_s": \([0-9.e+-]*\).*"min_ms": \([0-9.e+-]*\).*/\1 \2 \3/' |
+        awk '{ printf "  %-7s %8.1f MB/s  %9.3f ms\n", $1, $2, $3 }'
+done
@@ -0,0 +1,34 @@
+#!/bin/sh
+# Measures the parser's throughput in MB/s (lexing included) on a generated module of long arithmetic and
+# comparison expressions (`mypython --bench N --bench-parse`).
+#
+# Usage: bench/parser.sh [runs] [megabytes]   (defaults: 10 runs, 16 MB)
+
+RUNS=${1:-10}
+MEGABYTES=${2:-16}
+cd "$(dirname "$0")/.." || exit 1
+MODULE=$(mktemp "${TMPDIR:-/tmp}/parser.XXXXXX") || exit 1
+trap 'rm -f "$MODULE"' EXIT
+
+# Assignments of 40-operand expressions mixing every precedence level, with parentheses and calls, and
+# comparisons in if conditions, about 400 bytes per statement
+awk -v bytes="$((MEGABYTES * 1000000))" 'BEGIN {
+    split("+ - * / + -", operators, " ")
+    for (i = 0; written < bytes; i++) {
+        text = sprintf("total%d = %d", i % 97, i % 1000)
+        for (j = 1; j < 40; j++) {
+            operand = j % 7 == 0 ? sprintf("(first + %d * second)", j) : j % 11 == 0 ? "scale(first, 3)" : \
+                      j % 3 == 0 ? "second" : sprintf("%d", (i * j) % 10007)
+            text = text " " operators[(i + j) % 6 + 1] " " operand
+        }
+        text = text "\n"
+        if (i % 4 == 0) text = text sprintf("if first * 2 + %d <= second - 7 * first:\n    first = first + 1\n", i % 50)
+        printf "%s", text
+        written += length(text)
+    }
+}' > "$MODULE"
+
+echo "$(wc -c < "$MODULE") bytes ($RUNS runs, fastest)"
+./mypython --no-trace --bench "$RUNS" --bench-parse --bench-json "$MODULE" |
+    sed 's/.*"lex_mb_per_s": \([0-9.e+-]*\), "parse_mb_per_s": \([0-9.e+-]*\).*"parse": {"min_ms": \([0-9.e+-]*\).*/\1 \2 \3/' |
+    awk '{ printf "  lex     %8.1f MB/s\n  parse   %8.1f MB/s  %9.3f ms\n", $1, $2, $3 }'
@@ -0,0 +1,8 @@
+#Benchmark: printing integers
+#Prints 300000 lines of three numbers each, small, negative and ten digits long, so the time goes into formatting
+#and writing output rather than computing it.
+
+i = 0
+while i < 300000:
+    print(i, 0 - i, i * 7919 + 1000000000)
+    i = i + 1
@@ -0,0 +1,30 @@
+#!/bin/sh
+# Runs `mypython --bench` over the example suites (in*.py, ex1/, ex2/) on the tree-walker, the VM and the
+# closure-compiled back end and collects the JSON reports into one file.
+#
+# Usage: bench/run.sh [runs] [report]   (defaults: 20 runs, bench/report.json)
+# Compare two reports by diffing the median_ms fields, e.g. before and after a change.
+
+RUNS=${1:-20}
+REPORT=${2:-bench/report.json}
+cd "$(dirname "$0")/.." || exit 1
+
+{
+    echo "{\"version\": \"$(git rev-parse --short HEAD 2>/dev/null || echo unknown)\", \"runs\": $RUNS, \"results\": ["
+    first=1
+    for file in in*.py ex1/*.py ex2/*.py; do
+        for mode in "" "--vm" "--closures"; do
+            result=$(./mypython --no-trace $mode --bench "$RUNS" --bench-json "$file" 2>/dev/null) || {
+                echo "bench: $file $mode failed, skipped" >&2
+                continue
+            }
+            [ $first = 1 ] || echo ","
+            first=0
+            printf '  %s' "$result"
+        done
+    done
+    echo
+    echo "]}"
+} > "$REPORT"
+
+echo "Wrote $REPORT"
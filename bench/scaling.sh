@@ -0,0 +1,155 @@
+#!/bin/sh
+# Measures how the time and memory of each phase grow with the size of the scripts of bench/workload.sh, fits
+# the growth curve, and fails when any phase grows faster than linearly.
+#
+# Every axis is run at SIZES sizes, doubling from its base size. At each size the script is timed by the
+# median of REPEATS processes, each reporting the median of RUNS runs of `mypython --bench` (lex, parse (with
+# resolve and optimize), compile on the VM, exec), so that neither a slow run nor a slow process (another
+# program holding the CPU for a while) moves a point. One run with --mem-stats gives the bytes allocated in each
+# phase plus the Arena's, and the peak RSS.
+# Each measure is fitted as c * x^k by least squares on log(x) and log(y), where x is the size, except for the
+# lex and parse times, which are fitted against the script's length in bytes (the nested ifs are indented by
+# their depth, so that axis's source grows as the square of its size). A measure fails when k exceeds LIMIT,
+# which is low enough to catch work growing as x^1.3. Points below a noise floor (0.1 ms, 64 KB), where timer
+# resolution and fixed costs dominate, are left out of the fit; a measure with fewer than 3 points above it is
+# not fitted. The base sizes put every time measure of every axis above the floor.
+# Linear work fits well above 1 when the sizes cross the last level cache (on the machines this was tuned on, at
+# a working set of about 20 to 30 MB), as every access then becomes a miss: the largest size of each axis keeps
+# its working set below that.
+#
+# Usage: bench/scaling.sh [runs] [mode]   (defaults: 5 runs, the tree-walker; the mode is a flag like --vm)
+# Environment: LIMIT (default 1.25), SIZES (default 5), REPEATS (default 3), SEED (default 1)
+# Exits with 1 if any measure failed.
+
+RUNS=${1:-5}
+MODE=${2:-}
+LIMIT=${LIMIT:-1.25}
+SIZES=${SIZES:-5}
+REPEATS=${REPEATS:-3}
+SEED=${SEED:-1}
+cd "$(dirname "$0")/.." || exit 1
+SCRIPTS=$(mktemp -d "${TMPDIR:-/tmp}/scaling.XXXXXX") || exit 1
+TIMES=$(mktemp "${TMPDIR:-/tmp}/scaling.XXXXXX") || exit 1
+RESULTS=$(mktemp "${TMPDIR:-/tmp}/scaling.XXXXXX") || exit 1
+trap 'rm -rf "$SCRIPTS" "$TIMES" "$RESULTS"' EXIT
+
+# glibc gives a large buffer back to the kernel when it is freed and maps fresh pages for the next one, so every
+# run of a large script would pay a page fault per 4 KB of each of its large vectors, where the runs of a small
+# script reuse the pages of the run before. That difference would read as growth with the size; keeping freed
+# memory in the heap makes every run after the first one reuse warm pages at every size. Other C libraries
+# ignore the variable.
+TUNABLES=glibc.malloc.mmap_threshold=1073741824:glibc.malloc.trim_threshold=4294967295
+
+# The lexer, the parser and the passes over the tree recurse on the native stack for every level of the expr and
+# if axes, and so does --bench on the tree-walker for every call of the recursion axis. Their largest sizes need
+# more than the usual 8 MB of stack.
+ulimit -s 1048576 2>/dev/null || ulimit -s unlimited 2>/dev/null
+
+# Axis and base size
+for axis in "assign 4000" "expr 4000" "if 400" "def 2000" "recursion 2000" "print 50000"; do
+    set -- $axis
+    sizes=
+    size=$2
+    for step in $(seq "$SIZES"); do
+        ./bench/workload.sh "$1" "$size" "$SEED" > "$SCRIPTS/$size.py" || exit 1
+        memory=$(./mypython --no-trace $MODE --recursion-limit $((size + 100)) --mem-stats "$SCRIPTS/$size.py" \
+                 2>&1 >/dev/null)
+        echo "$memory" | awk -v axis="$1" -v size="$size" '
+            /^mem: [a-z]+ allocs=/ { sub(/bytes=/, "", $4); print axis, size, 0, $2 "_kb", $4 / 1024 }
+            /^mem: arena_kb=/ { sub(/.*=/, "", $2); print axis, size, 0, "arena_kb", $2 }
+            /^mem: peak_rss_kb=/ { sub(/.*=/, "", $2); print axis, size, 0, "peak_rss_kb", $2 }' >> "$RESULTS"
+        sizes="$sizes $size"
+        size=$((size * 2))
+    done
+    # The repeats go round all the sizes in turn, so that a slow spell of the machine falls on different sizes
+    # in different repeats, and the median of each size leaves it out
+    : > "$TIMES"
+    for repeat in $(seq "$REPEATS"); do
+        for size in $sizes; do
+            line=$(GLIBC_TUNABLES=$TUNABLES ./mypython --no-trace $MODE --recursion-limit $((size + 100)) \
+                   --bench "$RUNS" --bench-json "$SCRIPTS/$size.py") || {
+                echo "scaling: $1 $size failed" >&2
+                exit 1
+            }
+            echo "$size $line" >> "$TIMES"
+        done
+    done
+    # One line per measure: axis, size, bytes, measure, value (the median of the repeats)
+    awk -v axis="$1" '
+        BEGIN { count = split("lex parse compile exec", phases, " ") }
+        {
+            size = $1
+            if (!(size in bytes)) order[++sizes] = size
+            match($0, /"bytes": [0-9]+/)
+            bytes[size] = substr($0, RSTART + 9, RLENGTH - 9)
+            for (i = 1; i <= count; i++) {
+                if (!match($0, "\"" phases[i] "\": {[^}]*\"median_ms\": [0-9.e+-]+")) continue
+                value = substr($0, RSTART, RLENGTH)
+                sub(/.*: /, "", value)
+                # Insertion sort of the repeats of each size and phase
+                j = ++samples[size, i]
+                while (j > 1 && sorted[size, i, j - 1] > value + 0) {
+                    sorted[size, i, j] = sorted[size, i, j - 1]
+                    j--
+                }
+                sorted[size, i, j] = value + 0
+            }
+        }
+        END {
+            for (s = 1; s <= sizes; s++) {
+                size = order[s]
+                for (i = 1; i <= count; i++) {
+                    if (!samples[size, i]) continue
+                    print axis, size, bytes[size], phases[i] "_ms", sorted[size, i, int((samples[size, i] + 1) / 2)]
+                }
+                print axis, size, bytes[size], "bytes", bytes[size]
+            }
+        }' "$TIMES" >> "$RESULTS"
+done
+
+echo "Growth exponent k of each measure (y ~ x^k), $RUNS runs${MODE:+, $MODE}, fails above $LIMIT"
+awk -v limit="$LIMIT" '
+    # The script length of each axis and size, for the measures fitted against it
+    $4 == "bytes" { length_of[$1, $2] = $5 }
+    {
+        key = $1 SUBSEP $4
+        if (!(key in points)) order[++keys] = key
+        points[key] = points[key] " " $2 ":" $5
+    }
+    END {
+        failed = 0
+        printf "  %-12s %12s %12s  %5s\n", "measure", "smallest", "largest", "k"
+        for (i = 1; i <= keys; i++) {
+            split(order[i], parts, SUBSEP)
+            axis = parts[1]
+            measure = parts[2]
+            if (measure == "bytes") continue
+            against_bytes = measure == "lex_ms" || measure == "parse_ms"
+            floor = measure ~ /_ms$/ ? 0.1 : 64
+            count = split(substr(points[order[i]], 2), samples, " ")
+            n = 0; sx = 0; sy = 0; sxx = 0; sxy = 0
+            for (j = 1; j <= count; j++) {
+                split(samples[j], sample, ":")
+                x = against_bytes ? length_of[axis, sample[1]] : sample[1]
+                y = sample[2]
+                if (j == 1) first = y
+                last = y
+                if (x <= 0 || y < floor) continue
+                n++; sx += log(x); sy += log(y); sxx += log(x) * log(x); sxy += log(x) * log(y)
+            }
+            if (axis != previous) {
+                printf "%s\n", axis
+                previous = axis
+            }
+            if (n < 3 || n * sxx == sx * sx) {
+                printf "  %-12s %12.3f %12.3f      -\n", measure, first, last
+                continue
+            }
+            k = (n * sxy - sx * sy) / (n * sxx - sx * sx)
+            verdict = k > limit ? "  SUPER-LINEAR" : ""
+            if (k > limit) failed = 1
+            printf "  %-12s %12.3f %12.3f  %5.2f%s%s\n", measure, first, last, k, against_bytes ? " (bytes)" : "",
+                   verdict
+        }
+        exit failed
+    }' "$RESULTS"
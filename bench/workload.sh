@@ -0,0 +1,94 @@
+#!/bin/sh
+# Writes a generated script to stdout that stresses one axis of the interpreter with a given size, for
+# bench/scaling.sh. The constants and operators are drawn from a Park-Miller generator seeded with SEED, so the
+# same arguments always give the same script, whichever awk runs it.
+#
+#   assign N     N top-level assignments to N distinct globals, each reading an earlier one
+#   expr N       one assignment of an expression nested N parentheses deep
+#   if N         ifs nested N deep (one space of indentation per level), all of their conditions true, run 100 times
+#   def N        N function definitions, then a call of each in turn
+#   recursion N  a function recursing N calls deep (run it with --recursion-limit above N)
+#   print N      a loop printing N lines of two integers
+#
+# Usage: bench/workload.sh axis size [seed]   (default seed: 1)
+
+if [ $# -lt 2 ]; then
+    echo "Usage: $0 assign|expr|if|def|recursion|print size [seed]" >&2
+    exit 2
+fi
+
+awk -v axis="$1" -v n="$2" -v seed="${3:-1}" '
+function next_random(bound) {
+    # 16807 * (2^31 - 1) stays below 2^53, so awk doubles compute it exactly
+    state = (state * 16807) % 2147483647
+    return state % bound
+}
+function operator() { return next_random(2) ? "+" : "-" }
+BEGIN {
+    state = seed % 2147483647
+    if (state <= 0) state += 2147483646
+    if (axis == "assign") {
+        print "v0 = " next_random(1000)
+        for (i = 1; i < n; i++) printf "v%d = v%d %s %d\n", i, next_random(i), operator(), next_random(1000)
+        printf "print(v%d, v%d)\n", n - 1, next_random(n)
+    } else if (axis == "expr") {
+        # Each level wraps the expression so far on the left or the right of a new operand. The innermost
+        # operand is a variable, so the Optimizer cannot fold any level away.
+        # The text before and after the expression so far is kept per level, as appending to the whole
+        # expression at every level would copy it n times.
+        print "x = " next_random(1000)
+        for (i = 0; i < n; i++) {
+            if (next_random(2)) {
+                before[i] = "("
+                after[i] = " " operator() " " next_random(1000) ")"
+            } else {
+                before[i] = "(" next_random(1000) " " operator() " "
+                after[i] = ")"
+            }
+        }
+        printf "x = "
+        for (i = n - 1; i >= 0; i--) printf "%s", before[i]
+        printf "x"
+        for (i = 0; i < n; i++) printf "%s", after[i]
+        print ""
+        print "print(x)"
+    } else if (axis == "if") {
+        # The nest runs 100 times, so that its execution takes longer than starting the program does
+        print "round = 0"
+        print "while round < 100:"
+        print "    depth = 0"
+        indent = "    "
+        for (i = 0; i < n; i++) {
+            printf "%sif depth < %d:\n", indent, i + 1 + next_random(1000)
+            indent = indent " "
+            printf "%sdepth = depth + 1\n", indent
+        }
+        print "    round = round + 1"
+        print "print(depth)"
+    } else if (axis == "def") {
+        for (i = 0; i < n; i++) {
+            printf "def f%d(a, b):\n", i
+            printf "    return a %s b * %d\n", operator(), 1 + next_random(9)
+        }
+        print "total = 0"
+        # In the order of definition: calling them at random would mostly measure cache misses on the bodies,
+        # which are then no longer in the cache once there are a few thousand
+        for (i = 0; i < n; i++) printf "total = f%d(total, %d) - total\n", i, next_random(100)
+        print "print(total)"
+    } else if (axis == "recursion") {
+        # Not a tail call, so every level keeps its frame
+        print "def down(n):"
+        print "    if n == 0:"
+        print "        return 0"
+        printf "    return down(n - 1) %s %d\n", operator(), next_random(10)
+        printf "print(down(%d))\n", n
+    } else if (axis == "print") {
+        print "i = 0"
+        printf "while i < %d:\n", n
+        printf "    print(i, i * %d)\n", 1 + next_random(100)
+        print "    i = i + 1"
+    } else {
+        print "Unknown axis: " axis > "/dev/stderr"
+        exit 2
+    }
+}'
@@ -0,0 +1,61 @@
+#Benchmark: 8 levels of nested if/else inside a function
+#Time this script together with the other nesting benchmarks (in13.py = 4, in14.py = 8, in15.py = 16 levels)
+#to see how the cost of entering blocks grows with the nesting depth.
+
+def nest(x):
+    v0 = x + 1
+    if v0 > 0:
+        v1 = v0 + 1
+        if v1 > 0:
+            v2 = v1 + 1
+            if v2 > 0:
+                v3 = v2 + 1
+                if v3 > 0:
+                    v4 = v3 + 1
+                    if v4 > 0:
+                        v5 = v4 + 1
+                        if v5 > 0:
+                            v6 = v5 + 1
+                            if v6 > 0:
+                                v7 = v6 + 1
+                                if v7 > 0:
+                                    v8 = v7 + 1
+    else:
+        v8 = 0
+    return v8
+
+def batch(n):
+    total = 0
+    t0 = nest(n)
+    t1 = nest(n)
+    t2 = nest(n)
+    t3 = nest(n)
+    t4 = nest(n)
+    t5 = nest(n)
+    t6 = nest(n)
+    t7 = nest(n)
+    t8 = nest(n)
+    t9 = nest(n)
+    total = total + t0 + t1 + t2 + t3 + t4 + t5 + t6 + t7 + t8 + t9
+    return total
+
+def run(n):
+    total = 0
+    if n > 0:
+        total = run(n - 1)
+    t0 = batch(n)
+    t1 = batch(n)
+    t2 = batch(n)
+    t3 = batch(n)
+    t4 = batch(n)
+    t5 = batch(n)
+    t6 = batch(n)
+    t7 = batch(n)
+    t8 = batch(n)
+    t9 = batch(n)
+    total = total + t0 + t1 + t2 + t3 + t4 + t5 + t6 + t7 + t8 + t9
+    return total
+
+result = run(1000)
+print("depth =", 8)
+print("result =", result)
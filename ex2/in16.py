@@ -0,0 +1,38 @@
+#Benchmark: the same summation done with recursion, a while loop and a for loop
+#Loops run in the caller's frame and write their counter straight into its slot, so the loop versions
+#should be much faster than the recursive one and need no recursion limit.
+
+def sumRecursive(n, acc):
+    if n == 0:
+        return acc
+    return sumRecursive(n - 1, acc + n)
+
+def sumWhile(n):
+    acc = 0
+    while n > 0:
+        acc = acc + n
+        n = n - 1
+    return acc
+
+def sumFor(n):
+    acc = 0
+    for i in range(1, n + 1):
+        acc = acc + i
+    return acc
+
+a = sumRecursive(20000, 0)
+b = sumWhile(20000)
+c = sumFor(20000)
+print("recursive", a)
+print("while", b)
+print("for", c)
+
+total = 0
+for round in range(50):
+    total = total + sumFor(1000) - sumWhile(1000)
+print("difference", total)
+
+count = 0
+for down in range(10, 0, -2):
+    count = count + down
+print("countdown", count)
@@ -0,0 +1,59 @@
+#Scope for functions defined inside other functions
+
+# Global variables
+a = 100
+scale = 3
+
+def outer(a):
+    # Reads the parameter of the enclosing function
+    def inner(b):
+        return a + b
+    return inner(10)
+
+print("outer(5) =", outer(5))
+
+def counter(start, steps):
+    total = start * scale
+    def step(i):
+        # Reads a local of the enclosing function and a global
+        return total + i * scale
+    i = 0
+    result = 0
+    while i < steps:
+        result = result + step(i)
+        i = i + 1
+    return result
+
+print("counter(2, 4) =", counter(2, 4))
+
+def level1(x):
+    y = x * 2
+    def level2(z):
+        def level3(w):
+            # Two levels up, one level up, and its own parameter
+            return x + y + z + w
+        return level3(z + 1) + level3(0)
+    return level2(x + 1)
+
+print("level1(1) =", level1(1))
+
+def power(base, n):
+    def times(k):
+        # Recursion within the enclosing function's call
+        if k == 0:
+            return 1
+        return base * times(k - 1)
+    return times(n)
+
+print("power(2, 10) =", power(2, 10))
+print("power(3, 3) =", power(3, 3))
+
+def shadow(a):
+    a = a + 1
+    def inner(b):
+        a = b * 2
+        return a
+    return inner(a) + a
+
+print("shadow(1) =", shadow(1))
+print("a =", a)
@@ -0,0 +1,26 @@
+#Integer literals beyond 63 bits
+
+# The largest and smallest integers held inline, and the first ones past them
+small = 4611686018427387903
+smallest = -4611686018427387904
+print("small + 1 =", small + 1)
+print("smallest - 1 =", smallest - 1)
+
+# A 64-bit literal and arithmetic on it
+big = 9223372036854775807
+print("big =", big)
+print("big + 1 =", big + 1)
+print("big * big =", big * big)
+print("big / 4294967296 =", big / 4294967296)
+print("-9223372036854775808 + big =", -9223372036854775808 + big)
+
+# A 100-digit literal
+huge = 1234567890123456789012345678901234567890123456789012345678901234567890123456789012345678901234567890
+print("huge =", huge)
+print("huge / big =", huge / big)
+print("huge - huge =", huge - huge)
+
+# Results that fit inline again
+print("18446744073709551616 / 4294967296 =", 18446744073709551616 / 4294967296)
+if 99999999999999999999 - 99999999999999999998:
+    print("a big condition is true")
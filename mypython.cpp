@@ -5,24 +5,79 @@
  * of the Python language, focusing on integer arithmetic, variable assignments, and
  * conditional statements. It reads a Python source file, tokenizes the input, parses
  * it into an abstract syntax tree (AST), and finally interprets the AST to execute the
- * program. There is an addiitonal features for debugging and traceability: It appends 
- * execution details, including timestamps and file names, to a trace file ('trace.log'). 
- * This facilitates tracking the execution of various scripts over time and capturing any 
- *runtime errors for analysis.
+ * program. There is an addiitonal features for debugging and traceability: It records
+ * every run, with its timestamp, file name, exit status, phase timings and output, in a
+ * binary trace ('trace.bin', indexed by 'trace.idx'; see Trace.hpp) that `--trace-query`
+ * searches. This facilitates tracking the execution of various scripts over time and
+ * capturing any runtime errors for analysis.
  * 
  * Usage:
- *   ./mypython <file.py>
+ *   ./mypython [--vm [--vm-dispatch switch|threaded]] [--closures] [--dump-bytecode] [--no-trace] [--async-trace] [--trace-rotate BYTES] [-O0|-O1] [--recursion-limit N] [--memo] [--profile] [--mem-stats] [--cache] [--lazy] [--bench N [--bench-json] [--bench-lex|--bench-parse] [--scalar-lex]] <file.py>
+ *   ./mypython --serve|--socket PATH [--workers N] [--vm|--closures] [-O0|-O1] [--recursion-limit N] [--memo] [--cache] [--lazy]
+ *   ./mypython --jobs N [--vm|--closures] [-O0|-O1] [--recursion-limit N] [--memo] [--cache] [--lazy] <file.py>...
+ *   ./mypython --trace-query [--file PATH] [--status N] [--since TIME] [--last N] [--output]
  * 
- * The program expects exactly one command-line argument, which is the path to the
- * Python source file to be interpreted. It demonstrates a simplified workflow of a
+ * The program expects the path to the Python source file to be interpreted, optionally
+ * preceded by flags:
+ * - --vm: Compile the AST to bytecode and run it on the stack-based VM instead of walking the tree.
+ *   The tree-walker stays the default and the reference for the output of the VM.
+ * - --vm-dispatch switch|threaded: Jump between VM instructions through the `switch` loop or the threaded
+ *   (labels-as-values) loop, the default where the compiler supports it. See VM.hpp and bench/dispatch.sh.
+ * - --closures: Compile every AST node once into a closure specialized for it and run those instead of walking
+ *   the tree (see Closure.hpp). --vm takes precedence.
+ * - --dump-bytecode: Print the compiled bytecode listing instead of running the program.
+ * - --no-trace: Do not record the run in the trace.
+ * - --async-trace: Write the trace log from a background thread instead of the interpreter's thread.
+ * - --trace-rotate BYTES: Start new trace files once the log has reached BYTES (16 MB by default), keeping the
+ *   last three generations as trace.1 to trace.3.
+ *   Console and trace output are block buffered either way and flushed (in order) when the program exits,
+ *   and line by line when stdout is a terminal.
+ * - -O0 / -O1: Disable / enable (default) constant folding and dead-branch elimination on the AST.
+ * - --recursion-limit N: Maximum depth of nested function calls (default 10000) before a RecursionError.
+ *   Calls in tail position (`return f(...)`) reuse the caller's frame and do not count towards the limit.
+ * - --memo: Memoize calls to pure functions (see Purity.hpp) in the tree-walker and report the hit rate on stderr.
+ *   Has no effect with --vm or --closures.
+ * - --profile: Time every function call and count the BinaryExpr and IfStmt executions of every line in the
+ *   tree-walker (see Profiler.hpp). The call stacks are written to 'profile.folded' in collapsed-stack format for
+ *   flame graph tools, and a summary goes to stderr. Has no effect with --vm or --closures; cannot be combined with
+ *   --serve or --jobs.
+ * - --mem-stats: Count the allocations, bytes and frees of the parse, resolve, compile and execute phases, and
+ *   report them on stderr with the resident set size at the end of each phase, the peak RSS and the Arena's size
+ *   (see MemStats.hpp). Not with --bench; cannot be combined with --serve or --jobs.
+ * - --cache: Load the parsed program from `__pycache__` next to the script when the entry matches the source and
+ *   this build, skipping the Lexer and Parser; otherwise parse as usual and write the entry (see AstCache.hpp).
+ * - --lazy: Parse the body of each function on the first call of the function instead of up front, so startup
+ *   scales with the code that runs (see Lazy.hpp). Syntax errors in a body are then reported by its first call.
+ *   Tree-walker only; ignored with --vm, --closures, --cache, --memo and --profile.
+ * - --serve: Keep running and execute the scripts requested on stdin, answering with framed output on stdout
+ *   (see Server.hpp). --socket PATH listens on a Unix socket instead; --workers N sets the size of the pool.
+ * - --jobs N: Run every file given, N at a time on threads of this process, and print their output one file
+ *   after another in argument order (see runScripts in Runtime.hpp). The exit code is the highest of the runs.
+ * - --bench N: Run the program N times and report min/median/p99 of the lex, parse and exec phases instead of
+ *   its output (see Bench.hpp). --bench-json prints the report as one JSON object. --bench-lex times the lexer
+ *   alone and --scalar-lex makes it scan one byte at a time, to compare with its SSE2 loops. --bench-parse times
+ *   the lexer and the parser alone and reports the parser's throughput.
+ * - --trace-query: List the recorded runs, oldest first, reading only the trace index and the records of the
+ *   runs shown; --file, --status, --since (a date, a local time or epoch seconds) and --last N select runs, and
+ *   --output prints each one's output after it. Nothing is run or recorded.
+ * It demonstrates a simplified workflow of a
  * programming language interpreter by leveraging three major components:
  * 
- * - Lexer: Tokenizes the input source code into a sequence of tokens.
+ * - SourceFile: Memory-maps the script so it is never copied.
+ * - Lexer: Tokenizes the input source code into a sequence of tokens, one at a time as the parser asks for them.
  * - Parser: Analyzes the tokens to build an abstract syntax tree representing the
  *   structure of the source code.
+ * - Optimizer: Folds constant expressions and removes dead if branches before execution.
+ * - AstCache: Optionally stores the resulting tree on disk so later runs can skip the steps above.
  * - Interpreter: Walks the AST and executes the code according to the semantics
  *   of the language.
- * - Utilities: Includes utility functions like 'tee' for output redirection and logging to a trace file.
+ * - Compiler/VM: Alternative back end that lowers the AST to a flat instruction array and
+ *   executes it in a single dispatch loop.
+ * - Utilities: Includes utility functions like 'tee' for output redirection.
+ * - Trace: Records every run in the trace files and answers --trace-query.
+ * - MemStats: Counts the allocations of each phase of a run for --mem-stats.
+ * - Runtime/Server: runProgram runs one script through the components above with its own output streams, and
+ *   the server runs many of them in one warm process.
  * This file integrates these components and orchestrates the process from reading
  * the source file to executing the interpreted code.
  */
@@ -30,81 +85,234 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
-#include "Lexer.hpp"
-#include "Parser.hpp"
-#include "Interpreter.hpp"
 #include "Utilities.hpp"
-#include <chrono>
-#include <ctime>
+#include "SourceFile.hpp"
+#include "Bench.hpp"
+#include "Runtime.hpp"
+#include "Server.hpp"
+#include "Trace.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
 
 
 
 int main(int argc, char* argv[]) {
 
-    //    std::ofstream traceFile("trace.log");
-    std::ofstream traceFile("trace.log", std::ios::app); // Open for appending
-    //time trace log is opened
-    auto now = std::chrono::system_clock::now();
-    std::time_t now_time = std::chrono::system_clock::to_time_t(now);
-    
+    // Reading the trace runs nothing, so it is not traced itself
+    if (argc > 1 && std::string(argv[1]) == "--trace-query") {
+        TraceQuery query;
+        for (int argi = 2; argi < argc; argi++) {
+            std::string flag = argv[argi];
+            if (flag == "--file" && argi + 1 < argc) {
+                query.file = argv[++argi];
+            } else if (flag == "--status" && argi + 1 < argc) {
+                query.filterStatus = true;
+                query.status = std::atoi(argv[++argi]);
+            } else if (flag == "--since" && argi + 1 < argc && parseTraceTime(argv[argi + 1], query.since)) {
+                argi++;
+            } else if (flag == "--last" && argi + 1 < argc && std::atol(argv[argi + 1]) > 0) {
+                query.last = static_cast<size_t>(std::atol(argv[++argi]));
+            } else if (flag == "--output") {
+                query.showOutput = true;
+            } else {
+                std::cerr << "Usage: mypython --trace-query [--file PATH] [--status N] [--since TIME] [--last N] [--output]" << std::endl;
+                return 1;
+            }
+        }
+        return queryTrace("trace", query, std::cout, std::cerr);
+    }
+
+    // Parse the optional flags preceding the source file
+    bool useVM = false;
+    bool useClosures = false;
+    bool dumpBytecode = false;
+    bool switchDispatch = false;
+    bool writeTrace = true;
+    bool asyncTrace = false;
+    uint64_t traceRotateBytes = TraceLog::defaultRotateBytes;
+    int optimizationLevel = 1;
+    int benchRuns = 0;
+    long recursionLimit = 10000;
+    bool memoize = false;
+    bool profile = false;
+    bool memoryStats = false;
+    bool benchJson = false;
+    bool benchLex = false;
+    bool benchParse = false;
+    bool scalarLex = false;
+    bool useCache = false;
+    bool lazyFunctions = false;
+    bool serveMode = false;
+    std::string socketPath;
+    long workers = 0;
+    long jobs = 0;
+    int argi = 1;
+    for (; argi < argc && argv[argi][0] == '-'; argi++) {
+        std::string flag = argv[argi];
+        if (flag == "--vm") {
+            useVM = true;
+        } else if (flag == "--vm-dispatch" && argi + 1 < argc &&
+                   (std::string(argv[argi + 1]) == "switch" || std::string(argv[argi + 1]) == "threaded")) {
+            switchDispatch = std::string(argv[++argi]) == "switch";
+        } else if (flag == "--closures") {
+            useClosures = true;
+        } else if (flag == "--dump-bytecode") {
+            dumpBytecode = true;
+        } else if (flag == "--no-trace") {
+            writeTrace = false;
+        } else if (flag == "--async-trace") {
+            asyncTrace = true;
+        } else if (flag == "--trace-rotate" && argi + 1 < argc && std::atoll(argv[argi + 1]) > 0) {
+            traceRotateBytes = static_cast<uint64_t>(std::atoll(argv[++argi]));
+        } else if (flag == "-O0" || flag == "-O1") {
+            optimizationLevel = flag[2] - '0';
+        } else if (flag == "--bench" && argi + 1 < argc && std::atoi(argv[argi + 1]) > 0) {
+            benchRuns = std::atoi(argv[++argi]);
+        } else if (flag == "--recursion-limit" && argi + 1 < argc && std::atol(argv[argi + 1]) > 0) {
+            recursionLimit = std::atol(argv[++argi]);
+        } else if (flag == "--memo") {
+            memoize = true;
+        } else if (flag == "--profile") {
+            profile = true;
+        } else if (flag == "--mem-stats") {
+            memoryStats = true;
+        } else if (flag == "--cache") {
+            useCache = true;
+        } else if (flag == "--lazy") {
+            lazyFunctions = true;
+        } else if (flag == "--serve") {
+            serveMode = true;
+        } else if (flag == "--socket" && argi + 1 < argc) {
+            serveMode = true;
+            socketPath = argv[++argi];
+        } else if (flag == "--workers" && argi + 1 < argc && std::atol(argv[argi + 1]) > 0) {
+            workers = std::atol(argv[++argi]);
+        } else if (flag == "--jobs" && argi + 1 < argc && std::atol(argv[argi + 1]) > 0) {
+            jobs = std::atol(argv[++argi]);
+        } else if (flag == "--bench-json") {
+            benchJson = true;
+        } else if (flag == "--bench-lex") {
+            benchLex = true;
+        } else if (flag == "--bench-parse") {
+            benchParse = true;
+        } else if (flag == "--scalar-lex") {
+            scalarLex = true;
+        } else {
+            std::cerr << "Unknown option: " << flag << std::endl;
+            return 1;
+        }
+    }
 
+    // Redirect std::cout and std::cerr to both console and trace until `trace` goes out of scope, which
+    // completes the run's record and flushes everything on every return path below
+    std::unique_ptr<TraceLog> trace;
+    if (writeTrace) {
+        trace = std::make_unique<TraceLog>("trace", asyncTrace, traceRotateBytes); // Open for appending
+        if (!trace->isOpen()) {
+            std::cerr << "Failed to open trace file for writing." << std::endl;
+            return 1;
+        }
+    }
 
-    if (!traceFile.is_open()) {
-        std::cerr << "Failed to open trace file for writing." << std::endl;
+    RunOptions options;
+    options.useVM = useVM;
+    options.useClosures = useClosures;
+    options.dumpBytecode = dumpBytecode;
+    options.switchDispatch = switchDispatch;
+    options.optimizationLevel = optimizationLevel;
+    options.recursionLimit = static_cast<size_t>(recursionLimit);
+    options.memoize = memoize;
+    if (profile) options.profilePath = "profile.folded";
+    options.memoryStats = memoryStats;
+    options.useCache = useCache;
+    options.lazyFunctions = lazyFunctions;
+
+    if (profile && (serveMode || jobs > 0)) {
+        std::cerr << "--profile cannot be combined with --serve or --jobs." << std::endl;
+        return 1;
+    }
+    if (memoryStats && (serveMode || jobs > 0)) {
+        std::cerr << "--mem-stats cannot be combined with --serve or --jobs." << std::endl;
         return 1;
     }
 
-    // Redirect std::cout and std::cerr to both console and trace file
-    tee(std::cout, std::cout, traceFile);
-    tee(std::cerr, std::cerr, traceFile);
+    if (serveMode) {
+        if (argc - argi != 0) {
+            std::cerr << "Usage: mypython --serve|--socket PATH [--workers N] [options]" << std::endl;
+            return 1;
+        }
+        ServeOptions serveOptions;
+        serveOptions.run = options;
+        serveOptions.workers = static_cast<size_t>(workers);
+        serveOptions.socketPath = socketPath;
+        return serve(serveOptions, trace.get());
+    }
+
+    if (jobs > 0) {
+        if (argc - argi == 0) {
+            std::cerr << "Usage: mypython --jobs N [options] <source_file>..." << std::endl;
+            return 1;
+        }
+        std::vector<std::string> paths(argv + argi, argv + argc);
+        std::vector<ScriptResult> results = runScripts(paths, options, static_cast<size_t>(jobs));
+        int status = 0;
+        for (const ScriptResult& result : results) {
+            if (trace) {
+                trace->recordRun(result.path, result.output, result.errors, result.status, result.timings);
+            }
+            std::cout << result.output;
+            std::cerr << result.errors;
+            status = std::max(status, result.status);
+        }
+        return status;
+    }
 
     try{
         // Check for correct usage
-        if (argc != 2) {
-            std::cerr << "Usage: mypython <source_file>" << std::endl;
+        if (argc - argi != 1) {
+            std::cerr << "Usage: mypython [--vm [--vm-dispatch switch|threaded]] [--closures] [--dump-bytecode] [--no-trace] [--async-trace] [--trace-rotate BYTES] [-O0|-O1] [--recursion-limit N] [--memo] [--profile] [--mem-stats] [--cache] [--lazy] [--bench N [--bench-json] [--bench-lex|--bench-parse] [--scalar-lex]] <source_file>" << std::endl;
             return 1;
         }
 
-        // Writing the timestamp and the filename to the trace file
-        traceFile << '\n' << "Run at: " << std::ctime(&now_time) << "File: " << argv[1] << std::endl;
+        // Everything printed from here on is the output of the run
+        std::string filename = argv[argi];
+        if (trace) {
+            trace->beginRun(filename);
+        }
 
-        // Open the source file
-        std::string filename = argv[1];
-        std::ifstream file(filename);
-        if (!file.is_open()) {
+        // Map the source file into memory; the lexer reads it in place
+        SourceFile source;
+        if (!source.open(filename)) {
             std::cerr << "Could not open file: " << filename << std::endl;
             return 1;
         }
 
-        // Read the file's content into a string
-        std::stringstream buffer;
-        buffer << file.rdbuf(); // Read the file's content into a string stream
-        std::string source = buffer.str(); // Convert the string stream into a string
-        file.close();
-
-        // Tokenize the source code
-        Lexer lexer(source);
-        auto tokens = lexer.tokenize();
-        // Interpret the AST
-        Interpreter interpreter;
-
-        // Parse the tokens into an AST
-        Parser parser(tokens,interpreter);
-        auto ast = parser.parse(); 
-
-        // Ensure parsing resulted in an AST node
-        if (!ast) {
-            std::cerr << "Parsing error encountered." << std::endl;
-            return 1;
+        if (benchRuns > 0) {
+            BenchOptions benchOptions;
+            benchOptions.runs = benchRuns;
+            benchOptions.useVM = useVM;
+            benchOptions.useClosures = useClosures;
+            benchOptions.switchDispatch = switchDispatch;
+            benchOptions.optimizationLevel = optimizationLevel;
+            benchOptions.recursionLimit = recursionLimit;
+            benchOptions.memoize = memoize;
+            benchOptions.lazyFunctions = lazyFunctions;
+            benchOptions.json = benchJson;
+            benchOptions.lexOnly = benchLex;
+            benchOptions.parseOnly = benchParse;
+            benchOptions.scalarLex = scalarLex;
+            int status = runBenchmark(source, filename, benchOptions, std::cout);
+            if (trace) trace->endRun(status, RunTimings());
+            return status;
         }
 
-        // // Interpret the AST
-        // Interpreter interpreter;
-        interpreter.interpret(std::move(ast)); 
+        RunTimings timings;
+        int status = runProgram(source.data(), source.size(), filename, options, std::cout, std::cerr, &timings);
+        if (trace) trace->endRun(status, timings);
+        return status;
         } catch (const std::exception& e) {
             std::cerr << "Error: " << e.what() << std::endl;
             return 1;
         }
-
-        return 0;
  }
@@ -10,19 +10,21 @@
  * 
  * Major components implemented in this file include:
  * - `Parser::parse()`: Parses the tokens into a BlockStmt, which is the root of the AST for the given source.
- * - `Parser::parseStatement()`: Parses individual statements, including variable assignments, print statements, and
- *   if statements, creating the corresponding AST nodes.
+ * - `Parser::parseStatement()`: Parses individual statements, including variable assignments, print statements,
+ *   if statements and while/for loops, creating the corresponding AST nodes.
  * - `Parser::parseExpression()`: Parses expressions, including binary operations and comparisons, and constructs the
  *   corresponding expression AST nodes.
  * 
  * The parser supports basic control structures like if-else statements and variable assignments. Expressions can
  * include arithmetic operations, variable references, and literals. The parser is designed to follow the principles
  * of recursive descent parsing, breaking down the parsing process into smaller functions that handle specific
- * parts of the grammar.
+ * parts of the grammar. Binary operators are the exception: `parseBinary` parses them by precedence climbing over
+ * a table of binding powers indexed by TokenType, in one loop per operand instead of one function per precedence
+ * level, and adding an operator means adding its power to the table.
  * 
  * Usage:
- * After tokenizing the input source code with Lexer, create a Parser instance with the tokens and call `parse()`
- * to build the AST. This AST can then be interpreted to execute the program.
+ * Create a Parser instance with a Lexer over the source code and call `parse()` to build the AST; the parser pulls
+ * tokens from the lexer as it needs them. This AST can then be interpreted to execute the program.
  * 
  */
 
@@ -34,110 +36,235 @@
 #include <iostream>
 
 
-struct ReturnValue;  // Forward declaration
+// Expressions used as statements outside of ExpressionStmt print their value, which helps when debugging the parser
+ExecStatus BinaryExpr::execute(Interpreter& interpreter, Environment& env) {
+    interpreter.getOutput().stream() << "BinaryExpr value: " << evaluate(interpreter, env) << std::endl;
+    return ExecStatus::Normal;
+}
 
+Value BinaryExpr::evaluate(Interpreter& interpreter, Environment& env) {
+    Value leftVal = left->evaluate(interpreter, env); // Pass the environment to left expression
+    Value rightVal = leftVal.isBig() ? evaluateRightPinned(leftVal, interpreter, env)
+                                     : right->evaluate(interpreter, env); // Pass the environment to right expression
+    return apply(op, leftVal, rightVal, interpreter.getBigInts());
+}
 
-AssignStmt::AssignStmt(const std::string& name, std::unique_ptr<Expr> value) : name(name), value(std::move(value)) {}
+Value BinaryExpr::evaluateRightPinned(Value leftVal, Interpreter& interpreter, Environment& env) {
+    // The right operand may allocate numbers, and a collection would not see leftVal otherwise
+    BigIntHeap& heap = interpreter.getBigInts();
+    heap.pin(leftVal);
+    Value rightVal = right->evaluate(interpreter, env);
+    heap.unpin();
+    return rightVal;
+}
 
-void AssignStmt::execute(Interpreter& interpreter, Environment& env)  {
-        int val = value->evaluate(env); // Evaluate the expression with the given environment
-        env.define(name, val); // Define or update the variable in the environment
-        
+Value BinaryExpr::applyToObjects(TokenType op, Value leftVal, Value rightVal, BigIntHeap& heap) {
+    if (op == TokenType::EQUAL) {
+        return leftVal == rightVal;
+    }
+    if (!Value::bothIntegers(leftVal, rightVal)) {
+        throw std::runtime_error("Unsupported operand type 'str' for binary operator.");
+    }
+    switch (op) {
+        case TokenType::PLUS: return BigInt::add(leftVal, rightVal, heap);
+        case TokenType::MINUS: return BigInt::subtract(leftVal, rightVal, heap);
+        case TokenType::MUL: return BigInt::multiply(leftVal, rightVal, heap);
+        case TokenType::DIV: return BigInt::floorDivide(leftVal, rightVal, heap);
+        case TokenType::LESS_EQUAL: return BigInt::compare(leftVal, rightVal) <= 0;
+        case TokenType::LESS: return BigInt::compare(leftVal, rightVal) < 0;
+        case TokenType::GREATER: return BigInt::compare(leftVal, rightVal) > 0;
+        case TokenType::GREATER_EQUAL: return BigInt::compare(leftVal, rightVal) >= 0;
+        default:
+            throw std::runtime_error("Unsupported binary operator.");
     }
+}
+
+ExecStatus LiteralExpr::execute(Interpreter& interpreter, Environment& env) {
+    interpreter.getOutput().stream() << "LiteralExpr value: " << value << std::endl;
+    return ExecStatus::Normal;
+}
+
+ExecStatus VarExpr::execute(Interpreter& interpreter, Environment& env) {
+    interpreter.getOutput().stream() << "VarExpr value: " << evaluate(interpreter, env) << std::endl;
+    return ExecStatus::Normal;
+}
 
+ExecStatus AssignExpr::execute(Interpreter& interpreter, Environment& env) {
+    interpreter.getOutput().stream() << "AssignExpr value: " << evaluate(interpreter, env) << std::endl;
+    return ExecStatus::Normal;
+}
 
-BlockStmt::BlockStmt(std::vector<std::unique_ptr<Stmt>> statements) : statements(std::move(statements)) {}
+ExecStatus StringLiteralExpr::execute(Interpreter& interpreter, Environment& env) {
+    interpreter.getOutput().stream() << value << std::endl; // Print the literal's text
+    return ExecStatus::Normal;
+}
 
-void BlockStmt::execute(Interpreter& interpreter, Environment& env)  {
-        // Create a new environment for this block, with the current environment as its parent.
-        Environment blockEnvironment(&env);
+AssignStmt::AssignStmt(Symbol name, Expr* value) : name(name), value(value) {}
+
+ExecStatus AssignStmt::execute(Interpreter& interpreter, Environment& env)  {
+        Value val = value->evaluate(interpreter, env); // Evaluate the expression with the given environment
+        env.assign(depth, slot, val); // Define or update the variable in its resolved slot
+        return ExecStatus::Normal;
+    }
 
+
+BlockStmt::BlockStmt(NodeList<Stmt*> statements) : statements(statements) {}
+
+ExecStatus BlockStmt::execute(Interpreter& interpreter, Environment& env)  {
+        // Blocks do not introduce a scope: the Resolver binds every name to the frame of the enclosing
+        // function (or the global frame), so the statements run directly in that environment.
         for (auto& stmt : statements) {
-            // Execute each statement within the block using the new scoped environment.
-            stmt->execute(interpreter, blockEnvironment);
+            ExecStatus status = stmt->execute(interpreter, env);
+            if (status != ExecStatus::Normal) {
+                return status; // A return skips the rest of the block
+            }
         }
-
-        // The blockEnvironment goes out of scope here, along with any variables defined within the block.
-        // Merge changes back to the parent environment
-        env.mergeChanges(blockEnvironment);
-      
+        return ExecStatus::Normal;
     }
     
-    void IfStmt::execute(Interpreter& interpreter, Environment& env) {
+    ExecStatus IfStmt::execute(Interpreter& interpreter, Environment& env) {
     // Evaluate the condition
-    bool conditionValue = condition->evaluate(env);  
+    bool conditionValue = condition->evaluate(interpreter, env).isTruthy();
     
 
     if (conditionValue) {
         // If the condition is true, execute the actions associated with the condition.
 
-        ifBranch->execute(interpreter, env); 
+        return ifBranch->execute(interpreter, env); 
     } else if (elseBranch != nullptr) {
         // If the condition is false and there is an else branch, execute the else branch.
-        elseBranch->execute(interpreter, env);
+        return elseBranch->execute(interpreter, env);
     }
     // If there's no else branch, nothing happens when the condition is false.
+    return ExecStatus::Normal;
 }
 
-void ReturnStmt::execute(Interpreter& interpreter, Environment& env) {
-    int value = returnValue ? interpreter.evaluateExpr(returnValue, env) : 0; // returning 0 if no expression
-    throw ReturnValue(value); // pass return values
+ExecStatus PrintStmt::execute(Interpreter& interpreter, Environment& env) {
+    OutputWriter& out = interpreter.getOutput();
+    for (const auto& expr : expressions) {
+        // Integers print in decimal and strings as their text, whatever expression produced them
+        out.write(expr->evaluate(interpreter, env));
+        out.write(' '); // Separate arguments with spaces.
+    }
+    out.endLine(); // End the print statement with a newline. The writer decides when to flush (see Output.hpp).
+    return ExecStatus::Normal;
+}
+
+ExecStatus WhileStmt::execute(Interpreter& interpreter, Environment& env) {
+    // The body is executed in place on every iteration; like an if branch it has no environment of its own
+    while (condition->evaluate(interpreter, env).isTruthy()) {
+        ExecStatus status = body->execute(interpreter, env);
+        if (status != ExecStatus::Normal) {
+            return status; // A return inside the loop leaves it
+        }
+    }
+    return ExecStatus::Normal;
+}
+
+ExecStatus ForRangeStmt::execute(Interpreter& interpreter, Environment& env) {
+    // The bounds are inline integers (63 bits), so the 64-bit counter cannot overflow before it passes `last`
+    int64_t first = start->evaluate(interpreter, env).toInt("range() argument");
+    int64_t last = stop->evaluate(interpreter, env).toInt("range() argument");
+    int64_t increment = step ? step->evaluate(interpreter, env).toInt("range() argument") : 1;
+    if (increment == 0) {
+        throw std::runtime_error("range() arg 3 must not be zero.");
+    }
+    Environment::Slot& target = env.slotAt(depth, slot);
+    for (int64_t i = first; increment > 0 ? i < last : i > last; i += increment) {
+        target.value = Value::small(i);
+        ExecStatus status = body->execute(interpreter, env);
+        if (status != ExecStatus::Normal) {
+            return status;
+        }
+    }
+    return ExecStatus::Normal;
+}
+
+ExecStatus ReturnStmt::execute(Interpreter& interpreter, Environment& env) {
+    if (tailCall) {
+        return tailCall->evaluateTailCall(interpreter, env); // The callee replaces the current call
+    }
+    Value value = returnValue ? interpreter.evaluateExpr(returnValue, env) : Value(); // returning 0 if no expression
+    interpreter.setReturnValue(value); // picked up by Interpreter::callFunction
+    return ExecStatus::Return;
 }
 
 // Execute function in interpreter context
-void FunctionStmt::execute(Interpreter& interpreter, Environment& env) {
-    //captures the current function statement as a shared_ptr to store in the environment
-    auto self = std::shared_ptr<FunctionStmt>(this, [](FunctionStmt*) {});
-    interpreter.defineFunction(name, self);
+ExecStatus FunctionStmt::execute(Interpreter& interpreter, Environment& env) {
+    // The node lives in the parser's Arena, which outlives the interpreter, so the table keeps a plain pointer
+    interpreter.defineFunction(name, this);
+    return ExecStatus::Normal;
 
 }
-int CallExpr::evaluate(Environment& env) {
-        std::vector<int> argValues = convertArgumentsToValues(arguments, env);
-        return interpreter.callFunction(functionName, argValues,env);
+size_t CallExpr::pushArguments(Interpreter& interpreter, Environment& env) {
+        if (owner != &interpreter) {
+            binding = &interpreter.bindingFor(functionName);
+            owner = &interpreter;
+        }
+        // Arguments go on the interpreter's argument stack instead of a fresh vector; nested calls made while
+        // evaluating them push above this call's base and pop back before it is used.
+        std::vector<Value>& stack = interpreter.getArgumentStack();
+        size_t base = stack.size();
+        for (Expr* arg : arguments) {
+            Value value = arg->evaluate(interpreter, env);
+            stack.push_back(value);
+        }
+        return base;
     }
 
-void CallExpr::execute(Interpreter& interpreter, Environment& env) {
+Value CallExpr::evaluate(Interpreter& interpreter, Environment& env) {
+        size_t base = pushArguments(interpreter, env);
+        return interpreter.callFunction(functionName.name(), *binding, base, env);
+    }
 
-        evaluate(env);
+ExecStatus CallExpr::evaluateTailCall(Interpreter& interpreter, Environment& env) {
+        size_t base = pushArguments(interpreter, env);
+        return interpreter.requestTailCall(functionName.name(), *binding, base);
     }
 
+ExecStatus CallExpr::execute(Interpreter& interpreter, Environment& env) {
 
+        evaluate(interpreter, env);
+        return ExecStatus::Normal;
+    }
 
 
-std::unique_ptr<Stmt> Parser::parse() {
-    std::vector<std::unique_ptr<Stmt>> statements;
+
+
+Stmt* Parser::parse() {
+    std::vector<Stmt*> statements;
     while (!isAtEnd() && peek().type != TokenType::END_OF_FILE) {
         auto stmt = parseStatement();
         if (stmt != nullptr) {
-            statements.push_back(std::move(stmt));
+            statements.push_back(stmt);
         }
     }
     // Return a single BlockStmt containing all statements
-    return std::make_unique<BlockStmt>(std::move(statements));
+    return arena.make<BlockStmt>(arena.copyList(statements));
 }
 
-std::unique_ptr<Expr> Parser::parsePrimary() {
+Expr* Parser::parsePrimary() {
     if (peek().type == TokenType::INTEGER) {
-        int value = std::stoi(advance().lexeme);
-        return std::make_unique<LiteralExpr>(value);
+        return integerLiteral(advance(), false); // Decoded by the lexer
     } else if (peek().type == TokenType::STRING) {
-        std::string value = advance().lexeme;
-        return std::make_unique<StringLiteralExpr>(value);    
+        std::string value = advance().text(source);
+        return arena.make<StringLiteralExpr>(strings.intern(value));
     } else if (peek().type == TokenType::IDENTIFIER) {
-        std::string varName = advance().lexeme;
+        int line = peek().line;
+        Symbol varName = symbol(advance());
         if (match({TokenType::LPAREN})) {
             // Handle function call
-            std::vector<std::unique_ptr<Expr>> arguments;
+            std::vector<Expr*> arguments;
             if (!check(TokenType::RPAREN)) {
                 do {
                     arguments.push_back(parseExpression());
                 } while (match({TokenType::COMMA}));
             }
             consume(TokenType::RPAREN, "Expect ')' after arguments.");
-            return std::make_unique<CallExpr>(varName, std::move(arguments),interpreter);
+            return at(line, arena.make<CallExpr>(varName, arena.copyList(arguments)));
         } else {
             // It's a simple variable reference
-            return std::make_unique<VarExpr>(varName);
+            return arena.make<VarExpr>(varName);
         }
     }  else if (match({TokenType::LPAREN})) {
         auto expr = parseExpression();
@@ -148,104 +275,165 @@ std::unique_ptr<Expr> Parser::parsePrimary() {
     throw std::runtime_error("UnExpected expression.");
 }
 
-std::unique_ptr<Expr> Parser::parseUnary() { 
+Expr* Parser::parseUnary() { 
     if (match({TokenType::MINUS})) {
         if (peek().type == TokenType::INTEGER)  {
-            int value = -std::stoi(advance().lexeme); // Negate the integer value
-            return std::make_unique<LiteralExpr>(value);
+            return integerLiteral(advance(), true); // Negate the integer value
         }
     }
     return parsePrimary();
 }
 
 
-std::unique_ptr<Expr> Parser::parseFactor() {
-    auto expr = parseUnary();
-    while (match({TokenType::MUL, TokenType::DIV})) {
-        Token op = previous();
-        auto right = parseUnary();
-        TokenType type = op.type;
-        expr = std::make_unique<BinaryExpr>(std::move(expr), type, std::move(right));
-    }
-    return expr;
+namespace {
+
+// Binding powers of the binary operators: a higher power binds tighter. Every operator is left-associative.
+const uint8_t notAnOperator = 0;
+const uint8_t comparisonPower = 1; // == != < > <= >=
+const uint8_t sumPower = 2;        // + -
+const uint8_t productPower = 3;    // * /
+
+// Binding power of every token as a binary operator, indexed by TokenType, in the order of its enumerators
+constexpr uint8_t bindingPowers[] = {
+    notAnOperator, sumPower, sumPower, productPower, productPower,       // INTEGER PLUS MINUS MUL DIV
+    notAnOperator, notAnOperator, notAnOperator, notAnOperator,          // LPAREN RPAREN IDENTIFIER ASSIGN
+    notAnOperator, notAnOperator, notAnOperator,                         // END_OF_FILE UNKNOWN PRINT
+    notAnOperator, notAnOperator, notAnOperator, notAnOperator,          // SEMICOLON IF ELSE STRING
+    notAnOperator, comparisonPower, comparisonPower, comparisonPower,    // COMMA EQUAL GREATER LESS
+    comparisonPower, comparisonPower, comparisonPower,                   // NOT_EQUAL GREATER_EQUAL LESS_EQUAL
+    notAnOperator, notAnOperator, notAnOperator, notAnOperator,          // COLON INDENT DEDENT NEWLINE
+    notAnOperator, notAnOperator, notAnOperator, notAnOperator,          // DEF RETURN WHILE FOR
+    notAnOperator,                                                       // IN
+};
+
+constexpr uint8_t bindingPower(TokenType type) {
+    return bindingPowers[static_cast<size_t>(type)];
 }
 
-std::unique_ptr<Expr> Parser::parseTerm() {
-    auto expr = parseFactor();
-    while (match({TokenType::PLUS, TokenType::MINUS})) {
-        Token op = previous();
-        auto right = parseFactor();
-        TokenType type = op.type;
-        expr = std::make_unique<BinaryExpr>(std::move(expr), type, std::move(right));
+static_assert(sizeof(bindingPowers) == static_cast<size_t>(TokenType::IN) + 1,
+              "bindingPowers must have one entry per TokenType");
+static_assert(bindingPower(TokenType::PLUS) == sumPower && bindingPower(TokenType::DIV) == productPower &&
+              bindingPower(TokenType::EQUAL) == comparisonPower &&
+              bindingPower(TokenType::LESS_EQUAL) == comparisonPower &&
+              bindingPower(TokenType::COMMA) == notAnOperator && bindingPower(TokenType::IN) == notAnOperator,
+              "bindingPowers is out of step with TokenType");
+
+} // namespace
+
+Expr* Parser::parseBinary(uint8_t minimumPower) {
+    Expr* expr = parseUnary();
+    // Operators at least as strong as `minimumPower` are folded into `expr` from left to right; the right operand
+    // of each takes only the operators that bind tighter than it, so `a - b * c - d` is `(a - (b * c)) - d`
+    for (;;) {
+        TokenType type = peek().type;
+        uint8_t power = bindingPower(type);
+        if (power == notAnOperator || power < minimumPower) return expr;
+        int line = advance().line;
+        Expr* right = parseBinary(power + 1);
+        expr = at(line, arena.make<BinaryExpr>(expr, type, right));
     }
-    return expr;
 }
 
-std::unique_ptr<Expr> Parser::parseComparison() {
-    auto expr = parseTerm();
-    while (match({TokenType::EQUAL, TokenType::NOT_EQUAL, TokenType::GREATER, TokenType::LESS, TokenType::GREATER_EQUAL, TokenType::LESS_EQUAL})) {
-        Token op = previous();
-        auto right = parseTerm();
-        expr = std::make_unique<BinaryExpr>(std::move(expr), op.type, std::move(right));
-    }
-
-    return expr;
+Expr* Parser::parseExpression() {
+    return parseBinary(comparisonPower); // Starting point for expression parsing
 }
 
-
-std::unique_ptr<Expr> Parser::parseExpression() {
-    return parseComparison(); // Starting point for expression parsing
-    throw std::runtime_error("Unexpected token in expression");
-}
-
-std::unique_ptr<Stmt> Parser::parseStatement() {
+Stmt* Parser::parseStatement() {
+    int line = peek().line;
     if (match({TokenType::PRINT})) {
-        return parsePrintStatement();
+        return at(line, parsePrintStatement());
     } else if (match({TokenType::IDENTIFIER})) {
         // Save the identifier token for later use
-        Token variableName = previous();
+        Token variableName = previous(); // Copied: previous() changes as the value is parsed
         consume(TokenType::ASSIGN, "Expect '=' after variable name.");
         auto value = parseExpression(); // Parse the right-hand side expression 
-        return std::make_unique<AssignStmt>(variableName.lexeme, std::move(value));
+        return at(line, arena.make<AssignStmt>(symbol(variableName), value));
     }
     else if (match({TokenType::IF})){
-        return parseIfStatement();
+        return at(line, parseIfStatement());
+    }
+    else if (match({TokenType::WHILE})) {
+        return at(line, parseWhileStatement());
+    }
+    else if (match({TokenType::FOR})) {
+        return at(line, parseForStatement());
     }
     else if (match({TokenType::DEF})) {
-        return parseFunctionDefinition();
+        return at(line, parseFunctionDefinition());
+    }
+    else if (match({TokenType::RETURN})) {
+        return at(line, parseReturnStatement());
     }
     throw std::runtime_error("Unexpected token in statement");
     
 }
-std::unique_ptr<Stmt> Parser::parseIfStatement() {
+Stmt* Parser::parseIfStatement() {
     auto condition = parseExpression();
     consume(TokenType::COLON, "Expect ':' after if condition.");
     auto ifBranch = parseBlock();
-    std::unique_ptr<Stmt> elseBranch = nullptr;
+    Stmt* elseBranch = nullptr;
 
     if (match({TokenType::ELSE})) {
         consume(TokenType::COLON, "Expect ':' after else.");
         elseBranch = parseBlock();
     }
-    return std::make_unique<IfStmt>(std::move(condition), std::move(ifBranch), std::move(elseBranch));
+    return arena.make<IfStmt>(condition, ifBranch, elseBranch);
+}
+
+Stmt* Parser::parseWhileStatement() {
+    auto condition = parseExpression();
+    consume(TokenType::COLON, "Expect ':' after while condition.");
+    auto body = parseBlock();
+    return arena.make<WhileStmt>(condition, body);
 }
 
+// for name in range(stop) | range(start, stop) | range(start, stop, step)
+Stmt* Parser::parseForStatement() {
+    consume(TokenType::IDENTIFIER, "Expect loop variable after 'for'.");
+    Symbol name = symbol(previous());
+    consume(TokenType::IN, "Expect 'in' after loop variable.");
+    if (!check(TokenType::IDENTIFIER) || !peek().is(source, "range")) {
+        throw std::runtime_error("Only 'for ... in range(...)' loops are supported.");
+    }
+    advance();
+    consume(TokenType::LPAREN, "Expect '(' after 'range'.");
+    std::vector<Expr*> bounds;
+    if (!check(TokenType::RPAREN)) {
+        do {
+            bounds.push_back(parseExpression());
+        } while (match({TokenType::COMMA}));
+    }
+    consume(TokenType::RPAREN, "Expect ')' after range arguments.");
+    if (bounds.empty() || bounds.size() > 3) {
+        throw std::runtime_error("range expected 1 to 3 arguments.");
+    }
+    consume(TokenType::COLON, "Expect ':' after for clause.");
+    auto body = parseBlock();
+
+    Expr* start = bounds.size() == 1 ? arena.make<LiteralExpr>(0) : bounds[0];
+    Expr* stop = bounds.size() == 1 ? bounds[0] : bounds[1];
+    Expr* step = bounds.size() == 3 ? bounds[2] : nullptr;
+    return arena.make<ForRangeStmt>(name, start, stop, step, body);
+}
 
-std::unique_ptr<Stmt> Parser::parseBlock() {
-    std::vector<std::unique_ptr<Stmt>> blockStatements;
+Stmt* Parser::parseBlock() {
+    std::vector<Stmt*> blockStatements;
     consume(TokenType::INDENT, "Expected indent at the start of a new block.");
     while (!check(TokenType::DEDENT) && !isAtEnd()) {
         try {
             blockStatements.push_back(parseStatement());
+        } catch (const LexError&) {
+            throw; // The source itself is malformed; give up on the whole parse
         } catch (const std::runtime_error& e) {
-            std::cerr << "Error parsing statement in block: " << e.what() << std::endl;
+            *diagnostics << "Error parsing statement in block: " << e.what() << std::endl;
+            errorCount++;
             // Skip to the end of the statement or synchronize
             synchronize();
         }
     }
     consume(TokenType::DEDENT, "Expected dedent at the end of the block.");
 
-    return std::make_unique<BlockStmt>(std::move(blockStatements));
+    return arena.make<BlockStmt>(arena.copyList(blockStatements));
 }
 
 void Parser::synchronize() {
@@ -260,6 +448,8 @@ void Parser::synchronize() {
                 return;
             case TokenType::IF:
             case TokenType::ELSE:
+            case TokenType::WHILE:
+            case TokenType::FOR:
                 return;
             default:
                 advance();  // Continue to skip tokens until reaching a significant one
@@ -271,9 +461,9 @@ void Parser::synchronize() {
 
 
 
-std::unique_ptr<Stmt> Parser::parsePrintStatement() {
+Stmt* Parser::parsePrintStatement() {
     consume(TokenType::LPAREN, "Expect '(' after 'print'.");
-    std::vector<std::unique_ptr<Expr>> expressions;
+    std::vector<Expr*> expressions;
 
     if (!check(TokenType::RPAREN)) {
         do {
@@ -283,55 +473,87 @@ std::unique_ptr<Stmt> Parser::parsePrintStatement() {
     }
     
     consume(TokenType::RPAREN, "Expect ')' after arguments.");
-    return std::make_unique<PrintStmt>(std::move(expressions));
+    return arena.make<PrintStmt>(arena.copyList(expressions));
 }
 
-std::unique_ptr<Stmt> Parser::parseFunctionDefinition() {
-    auto functionName = advance().lexeme;
+Stmt* Parser::parseFunctionDefinition() {
+    Symbol functionName = symbol(advance());
     // Parse parameters
     consume(TokenType::LPAREN, "Expect '(' after function name.");
-    std::vector<std::string> parameters;
+    std::vector<Symbol> parameters;
     if (!check(TokenType::RPAREN)) { // Check if there are any parameters
         do {
-            parameters.push_back(advance().lexeme);
+            parameters.push_back(symbol(advance()));
         } while (match({TokenType::COMMA}));
     }
     consume(TokenType::RPAREN, "Expect ')' after parameters.");
     consume(TokenType::COLON, "Expect ':' after parameter list.");
 
+    if (lazyFunctions) {
+        return arena.make<FunctionStmt>(functionName, std::move(parameters), skipFunctionBody());
+    }
+    return arena.make<FunctionStmt>(functionName, std::move(parameters), parseFunctionBody());
+}
+
+Stmt* Parser::parseFunctionBody() {
     // Handle indentation
     consume(TokenType::INDENT, "Expect an indentation after function header.");
 
-    std::vector<std::unique_ptr<Stmt>> body;
+    std::vector<Stmt*> body;
     while (!check(TokenType::DEDENT) && !isAtEnd()) {
-        if (match({TokenType::RETURN})) {
-            body.push_back(parseReturnStatement());
-            break;  // stop parsing after return 
-        } else {
-            body.push_back(parseStatement());
-        }
+        body.push_back(parseStatement()); // return statements may appear anywhere in the body
     }
 
     // Handle dedentation
     consume(TokenType::DEDENT, "Expect dedentation at the end of function block.");
 
-    return std::make_unique<FunctionStmt>(functionName, std::move(parameters), std::make_unique<BlockStmt>(std::move(body)));
+    return arena.make<BlockStmt>(arena.copyList(body));
+}
+
+DeferredBody Parser::skipFunctionBody() {
+    if (!check(TokenType::INDENT)) {
+        consume(TokenType::INDENT, "Expect an indentation after function header."); // Reports the error
+    }
+    // The INDENT is reported at the first token of the body; its line starts right after a line break
+    const Token& indent = peek();
+    DeferredBody body;
+    body.begin = indent.offset - (indent.column - 1) - 1;
+    body.line = indent.line - 1;
+    int depth = 0;
+    do {
+        TokenType type = advance().type;
+        if (type == TokenType::INDENT) {
+            depth++;
+        } else if (type == TokenType::DEDENT) {
+            depth--;
+        }
+    } while (depth > 0 && !isAtEnd());
+    body.end = previous().offset; // The DEDENT that closed the body sits at the next token
+    return body;
+}
+
+Stmt* Parser::parseDeferredBody() {
+    Stmt* body = parseFunctionBody();
+    if (!check(TokenType::END_OF_FILE)) {
+        throw std::runtime_error("Unexpected token after function body.");
+    }
+    return body;
 }
 
 
-std::unique_ptr<Stmt> Parser::parseReturnStatement() {
+Stmt* Parser::parseReturnStatement() {
 
     auto value = parseExpression();  // Assume return is followed by an expression
-    return std::make_unique<ReturnStmt>(std::move(value));
+    return arena.make<ReturnStmt>(value);
 }
 
-std::unique_ptr<Expr> Parser::parseFunctionCall(const std::string& functionName) {
-    std::vector<std::unique_ptr<Expr>> arguments;
+Expr* Parser::parseFunctionCall(Symbol functionName) {
+    std::vector<Expr*> arguments;
     if (!check(TokenType::RPAREN)) {  // If there are arguments
         do {
             arguments.push_back(parseExpression());
         } while (match({TokenType::COMMA}));
     }
     consume(TokenType::RPAREN, "Expect ')' after arguments.");
-    return std::make_unique<CallExpr>(functionName, std::move(arguments),interpreter);
+    return arena.make<CallExpr>(functionName, arena.copyList(arguments));
 }